@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "catalogue.h"
+#include "playback.h"
+#include "file_misc.h" /* CalcCRC32(), DecodeBigendian(), EncodeBigendian() */
+
+#define CATALOGUE_SIG 0xCA7A10
+#define CATALOGUE_VER 1
+#define HEADER_LEN 3
+#define ENTRY_LEN 13 /* Words of an entry before the name */
+#define SCAN_CHUNK 4096 /* Bytes read at once by CatalogueScanDemo() */
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/**
+    FILE:
+    0-3 bytes   -> magic signature
+    4-7 bytes   -> version
+    8-11 bytes  -> count of entries
+    12-n bytes  -> entries
+    n+1-n+4 bytes -> CRC32 of the file
+
+    ENTRY:
+    0-3 bytes   -> length of the name
+    4-51 bytes  -> mtime, size, hash high, hash low, ending, randomiser,
+                   duration, score, rows, level, pieces, instructions
+    52-n bytes  -> name, padded with zeros to a multiple of 4 bytes
+
+    Entries are ordered by name
+*/
+
+static unsigned NameWords(unsigned len); // Words taken by a name of len bytes
+
+demo_catalogue* CatalogueCreate(void) {
+    return (demo_catalogue*)calloc(1, sizeof(demo_catalogue));
+}
+
+void CatalogueFree(demo_catalogue* cat) {
+    if (!cat) return;
+
+    for (unsigned i=0; i < cat->count; i++) free(cat->entries[i].name);
+    free(cat->entries);
+    free(cat);
+}
+
+demo_catalogue* CatalogueRead(const char* path) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return NULL;
+
+    //  Get size of file
+    fseek(fp, 0, SEEK_END);
+    long fLen = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (fLen < (long)sizeof(unsigned)*(HEADER_LEN+1) || fLen % sizeof(unsigned) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    unsigned* buffer = (unsigned*)malloc(fLen);
+    if (!buffer || fread(buffer, 1, fLen, fp) != (size_t)fLen) {
+        free(buffer);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+
+    unsigned words = fLen/sizeof(unsigned) - 1; // without checksum
+    demo_catalogue* cat = NULL;
+    if (CalcCRC32((char*)buffer, fLen-4) != DecodeBigendian(buffer[words]) ||
+        DecodeBigendian(buffer[0]) != CATALOGUE_SIG ||
+        DecodeBigendian(buffer[1]) != CATALOGUE_VER ||
+        !(cat = CatalogueCreate())
+    ) {
+        free(buffer);
+        return NULL;
+    }
+
+    unsigned count = DecodeBigendian(buffer[2]);
+    unsigned* p = buffer + HEADER_LEN;
+    unsigned* end = buffer + words;
+    for (unsigned i=0; i < count; i++) {
+        if (end - p < ENTRY_LEN) break;
+
+        catalogue_entry e;
+        unsigned nameLen = DecodeBigendian(p[0]);
+        e.mtime      = DecodeBigendian(p[1]);
+        e.size       = DecodeBigendian(p[2]);
+        e.hash[0]    = DecodeBigendian(p[3]);
+        e.hash[1]    = DecodeBigendian(p[4]);
+        e.ending     = DecodeBigendian(p[5]);
+        e.randomiser = DecodeBigendian(p[6]);
+        e.duration   = DecodeBigendian(p[7]);
+        e.score      = DecodeBigendian(p[8]);
+        e.rows       = DecodeBigendian(p[9]);
+        e.level      = DecodeBigendian(p[10]);
+        e.pieces     = DecodeBigendian(p[11]);
+        e.instrs     = DecodeBigendian(p[12]);
+        p += ENTRY_LEN;
+
+        //  Copy name
+        if (nameLen > (unsigned)(end - p)*sizeof(unsigned)) break;
+        e.name = (char*)malloc(nameLen+1);
+        if (!e.name) break;
+        memcpy(e.name, p, nameLen);
+        e.name[nameLen] = '\0';
+        p += NameWords(nameLen);
+
+        if (CatalogueAdd(cat, &e) != 0) {
+            free(e.name);
+            break;
+        }
+    }
+    free(buffer);
+
+    //  Entries and the count must agree
+    if (cat->count != count || p != end) {
+        CatalogueFree(cat);
+        return NULL;
+    }
+    return cat;
+}
+
+unsigned CatalogueSave(demo_catalogue* cat, const char* path) {
+    if (!cat) return 0;
+
+    //  Calculate length for buffer, header+entries+crc32
+    size_t words = HEADER_LEN + 1;
+    for (unsigned i=0; i < cat->count; i++) {
+        words += ENTRY_LEN + NameWords(strlen(cat->entries[i].name));
+    }
+    unsigned* buffer = (unsigned*)calloc(words, sizeof(unsigned));
+    if (!buffer) return 0;
+
+    unsigned* p = buffer;
+    p[0] = EncodeBigendian(CATALOGUE_SIG);
+    p[1] = EncodeBigendian(CATALOGUE_VER);
+    p[2] = EncodeBigendian(cat->count);
+    p += HEADER_LEN;
+
+    for (unsigned i=0; i < cat->count; i++) {
+        catalogue_entry* e = &cat->entries[i];
+        unsigned nameLen = strlen(e->name);
+        p[0]  = EncodeBigendian(nameLen);
+        p[1]  = EncodeBigendian(e->mtime);
+        p[2]  = EncodeBigendian(e->size);
+        p[3]  = EncodeBigendian(e->hash[0]);
+        p[4]  = EncodeBigendian(e->hash[1]);
+        p[5]  = EncodeBigendian(e->ending);
+        p[6]  = EncodeBigendian(e->randomiser);
+        p[7]  = EncodeBigendian(e->duration);
+        p[8]  = EncodeBigendian(e->score);
+        p[9]  = EncodeBigendian(e->rows);
+        p[10] = EncodeBigendian(e->level);
+        p[11] = EncodeBigendian(e->pieces);
+        p[12] = EncodeBigendian(e->instrs);
+        p += ENTRY_LEN;
+
+        memcpy(p, e->name, nameLen); // padding stays zero
+        p += NameWords(nameLen);
+    }
+
+    size_t bufLen = words*sizeof(unsigned);
+    *p = EncodeBigendian(CalcCRC32((char*)buffer, bufLen-4));
+
+    //  Write next to the old index and replace it, readers never see a partial file
+    size_t pathLen = strlen(path);
+    char* tmp = (char*)malloc(pathLen+5);
+    if (!tmp) {
+        free(buffer);
+        return 0;
+    }
+    memcpy(tmp, path, pathLen);
+    strcpy(tmp+pathLen, ".tmp");
+
+    unsigned ret = 0;
+    FILE* fp = fopen(tmp, "w");
+    if (fp) {
+        ret = fwrite(buffer, 1, bufLen, fp);
+        if (fclose(fp) != 0 || ret != bufLen || rename(tmp, path) != 0) {
+            remove(tmp);
+            ret = 0;
+        }
+    }
+
+    free(tmp);
+    free(buffer);
+    return ret;
+}
+
+int CatalogueAdd(demo_catalogue* cat, catalogue_entry* entry) {
+    if (!cat || !entry) return -1;
+
+    if (cat->count == cat->size) {
+        unsigned newSize = cat->size ? cat->size*2 : 64;
+        catalogue_entry* grown = (catalogue_entry*)realloc(cat->entries, sizeof(catalogue_entry)*newSize);
+        if (!grown) return -1;
+        cat->entries = grown;
+        cat->size = newSize;
+    }
+    cat->entries[cat->count++] = *entry;
+    return 0;
+}
+
+catalogue_entry* CatalogueFind(demo_catalogue* cat, const char* name) {
+    if (!cat) return NULL;
+
+    //  Binary search, entries are sorted by name
+    unsigned lo = 0, hi = cat->count;
+    while (lo < hi) {
+        unsigned mid = lo + (hi-lo)/2;
+        int cmp = strcmp(cat->entries[mid].name, name);
+        if (cmp == 0) return &cat->entries[mid];
+        if (cmp < 0) lo = mid+1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+bool CatalogueScanDemo(const char* path, unsigned width, unsigned height, catalogue_entry* entry) {
+    entry->ending = CATALOGUE_INVALID;
+    entry->randomiser = CATALOGUE_STORED;
+    entry->duration = entry->score = entry->rows = entry->level = 0;
+    entry->pieces = entry->instrs = 0;
+    entry->hash[0] = entry->hash[1] = 0;
+
+    FILE* fp = fopen(path, "r");
+    if (!fp) return false;
+
+    demo_stream* stream = DemoStreamCreate();
+    if (!stream) {
+        fclose(fp);
+        return false;
+    }
+
+    //  Hash and decode in one pass over the file
+    unsigned long long hash = FNV_OFFSET;
+    unsigned char chunk[SCAN_CHUNK];
+    size_t len;
+    while ((len = fread(chunk, 1, SCAN_CHUNK, fp)) > 0) {
+        for (size_t i=0; i < len; i++) {
+            hash = (hash ^ chunk[i]) * FNV_PRIME;
+        }
+        DemoStreamFeed(stream, chunk, len);
+    }
+    fclose(fp);
+    entry->hash[0] = (unsigned)(hash >> 32);
+    entry->hash[1] = (unsigned)hash;
+
+    demo* record = NULL;
+    if (stream->status == DEMO_STREAM_DONE) record = DemoStreamDetach(stream);
+    DemoStreamFree(stream);
+    if (!record) return false;
+
+    demo_playback* playback = PlaybackCreate(record, width, height);
+    if (!playback) {
+        DemoFree(record);
+        return false;
+    }
+    while (PlaybackStep(playback));
+
+    game_info* info = &playback->gme->info;
+    entry->ending = (info->status & GAME_STATUS_END) ? CATALOGUE_TOPOUT : CATALOGUE_ENDED;
+    if (record->flags & DEMO_FLAG_SEEDED) entry->randomiser = record->randomiser;
+    entry->duration = playback->time;
+    entry->score = info->score;
+    entry->rows = info->rows;
+    entry->level = info->level;
+    entry->pieces = PlaybackPieces(playback);
+    entry->instrs = record->instrsCount;
+
+    PlaybackFree(playback);
+    DemoFree(record);
+    return true;
+}
+
+/*
+    Static functions
+*/
+
+unsigned NameWords(unsigned len) {
+    return (len + sizeof(unsigned)-1)/sizeof(unsigned);
+}
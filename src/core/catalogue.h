@@ -0,0 +1,105 @@
+#ifndef _CATALOGUE_H_
+#define _CATALOGUE_H_
+
+#include <stdbool.h>
+
+#define CATALOGUE_FILE ".democat" /* Name of the index in a demo directory */
+#define CATALOGUE_STORED 0xFFFFFFFF /* Randomiser of demos with stored pieces */
+
+/**
+    \brief How the game of an indexed demo ends
+*/
+typedef enum {
+    CATALOGUE_INVALID,  /**< Demo couldn't be read or played */
+    CATALOGUE_ENDED,    /**< Demo ended before game over */
+    CATALOGUE_TOPOUT    /**< Game ended to a top out */
+} catalogue_ending;
+
+/**
+    \brief Metadata of one demo in the catalogue
+*/
+typedef struct {
+    char* name;         /**< File name relative to the directory */
+    unsigned mtime;     /**< Modification time of the file since the Epoch in seconds */
+    unsigned size;      /**< Size of the file in bytes */
+    unsigned hash[2];   /**< 64-bit FNV-1a of the whole file, high word first */
+
+    unsigned ending;    /**< catalogue_ending */
+    unsigned randomiser; /**< randomiser_type of a seed-based demo, or CATALOGUE_STORED */
+    unsigned duration;  /**< Time of the last instruction in milliseconds */
+    unsigned score;
+    unsigned rows;
+    unsigned level;
+    unsigned pieces;    /**< Count of pieces spawned */
+    unsigned instrs;    /**< Count of instructions */
+} catalogue_entry;
+
+/**
+    \brief Index of the demos of one directory, sorted by name
+*/
+typedef struct {
+    catalogue_entry* entries;
+    unsigned count; /**< Count of entries */
+    unsigned size;  /**< Allocated entries */
+} demo_catalogue;
+
+/**
+    \brief Creates an empty catalogue
+    \return Pointer to the catalogue, NULL on error
+
+    \note Use CatalogueFree() to delete instance
+*/
+extern demo_catalogue* CatalogueCreate(void);
+
+/**
+    \brief Frees catalogue and names of its entries
+    \param cat Pointer to the catalogue
+*/
+extern void CatalogueFree(demo_catalogue* cat);
+
+/**
+    \brief Reads catalogue from a file
+    \param path Path to the index
+    \return Pointer to the catalogue, NULL if missing or invalid
+
+    \note Use CatalogueFree() to delete instance
+*/
+extern demo_catalogue* CatalogueRead(const char* path);
+
+/**
+    \brief Writes catalogue to a file
+    \param cat Pointer to the catalogue
+    \param path Path to the index, replaced atomically
+    \return Count of bytes written, 0 on error
+*/
+extern unsigned CatalogueSave(demo_catalogue* cat, const char* path);
+
+/**
+    \brief Appends entry to the catalogue
+    \param cat Pointer to the catalogue
+    \param entry Entry to copy, catalogue takes ownership of the name
+    \return 0 on success
+
+    \note Entries must be added in the order of names
+*/
+extern int CatalogueAdd(demo_catalogue* cat, catalogue_entry* entry);
+
+/**
+    \brief Finds entry by file name
+    \param cat Pointer to the catalogue
+    \param name File name relative to the directory
+    \return Pointer to the entry, NULL if not found
+*/
+extern catalogue_entry* CatalogueFind(demo_catalogue* cat, const char* name);
+
+/**
+    \brief Reads and plays demo to fill metadata of an entry
+    \param path Path to the demo
+    \param width The width of the game area
+    \param height The height of the game area
+    \param entry Where hash and metadata are written, name, mtime and size are left untouched
+    \return True if demo was valid, otherwise ending is CATALOGUE_INVALID
+*/
+extern bool CatalogueScanDemo(const char* path, unsigned width, unsigned height, catalogue_entry* entry);
+
+#endif //_CATALOGUE_H_
@@ -0,0 +1,642 @@
+#include <stdlib.h>
+#include <string.h> /* memcpy() */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "codec.h"
+#include "crc32.h"
+#include "playback.h"
+
+#define CODEC_SIG 0xDE0C0D
+#define CODEC_VER 1
+#define CODEC_HEADER_WORDS 12
+#define CODEC_MAX_WIDTH 32 /* Column offsets are coded in 6 bits */
+
+#define PROB_BITS 11
+#define PROB_INIT (1 << (PROB_BITS-1))
+#define PROB_SHIFT 5 /* Adaptation speed of the probabilities */
+#define RANGE_TOP (1u << 24)
+
+#define TIME_CONTEXTS (INPUT_UPDATE+2) /* Type of the previous instruction, or none */
+#define TIME_LEN_BITS 33 /* Bit lengths of delta+1 */
+#define TIME_HIGH_BITS 4 /* Bits after the leading one coded with a model */
+#define TYPE_TREE 8 /* Instruction types fit in a 3-bit tree */
+
+/*
+    FILE:
+        0-3             Signature           (unsigned)
+        4-7             Version             (unsigned)
+        8-11            Flags               (unsigned)
+        12-15           Randomiser          (unsigned)
+        16-19           RNG version         (unsigned)
+        20-23           Seed                (unsigned)
+        24-27           Width               (unsigned)
+        28-31           Height              (unsigned)
+        32-35           Piece count         (unsigned)
+        36-39           Instruction count   (unsigned)
+        40-43           Start time          (unsigned)
+        44-47           Start state length  (unsigned)
+        48-s            Start state         (unsigned)*length
+        (s+1)-c         Range coded data
+        c+1             CRC32               (unsigned)
+
+        Header words are big-endian like in demo files. Start time and
+        state are the first checkpoint of a clip, 0 for other demos.
+
+        Coded data has the stored pieces followed by instructions. For
+        each instruction the time from the previous one is coded first,
+        and the decoder runs gravity until it. When a new piece is active,
+        its final rotation and column are coded. Then one bit tells if the
+        instruction was the predicted one, followed by the type if not.
+*/
+
+/**
+    \brief Adaptive probabilities of the coded values
+*/
+typedef struct {
+    uint16_t pieces[TYPE_TREE];
+    uint16_t timeLen[TIME_CONTEXTS][TIME_LEN_BITS];
+    uint16_t timeHigh[TIME_LEN_BITS][1 << TIME_HIGH_BITS];
+    uint16_t rotation[SHAPE_MAX][4];
+    uint16_t column[SHAPE_MAX][1 << 6];
+    uint16_t hit[INPUT_UPDATE+1][2];
+    uint16_t type[INPUT_UPDATE+1][TYPE_TREE];
+} codec_model;
+
+/**
+    \brief Binary range coder writing to a growing buffer
+*/
+typedef struct {
+    uint64_t low;
+    uint32_t range;
+    uint8_t cache;
+    uint64_t cacheSize;
+
+    unsigned char* buf;
+    size_t len, size;
+    bool failed;    /**< Buffer couldn't be grown */
+} codec_encoder;
+
+/**
+    \brief Binary range decoder reading a buffer
+*/
+typedef struct {
+    uint32_t range;
+    uint32_t code;
+
+    const unsigned char* buf;
+    size_t pos, len;
+} codec_decoder;
+
+/**
+    \brief Where the active piece is heading, same in encoder and decoder
+*/
+typedef struct {
+    unsigned piece;     /**< Number of the piece the pose belongs to */
+    unsigned rotation;  /**< Rotations done since spawn, modulo 4 */
+    int x;              /**< Column of the origin */
+    unsigned targetRotation;
+    int targetX;
+    bool targetKnown;   /**< Target of this piece has been coded */
+} codec_pose;
+
+static void ModelInit(codec_model* m);
+static void PutByte(codec_encoder* enc, unsigned char byte);
+static void PutWord(codec_encoder* enc, unsigned word);
+static void ShiftLow(codec_encoder* enc);
+static void EncodeBit(codec_encoder* enc, uint16_t* prob, unsigned bit);
+static void EncodeDirect(codec_encoder* enc, unsigned value, unsigned bits);
+static void EncodeTree(codec_encoder* enc, uint16_t* probs, unsigned value, unsigned bits);
+static void EncodeTime(codec_encoder* enc, codec_model* m, unsigned ctx, unsigned delta);
+static void EncodeFlush(codec_encoder* enc);
+static unsigned DecodeBit(codec_decoder* dec, uint16_t* prob);
+static unsigned DecodeDirect(codec_decoder* dec, unsigned bits);
+static unsigned DecodeTree(codec_decoder* dec, uint16_t* probs, unsigned bits);
+static unsigned DecodeTime(codec_decoder* dec, codec_model* m, unsigned ctx);
+static unsigned ReadWord(const unsigned char* data);
+
+static void PoseUpdate(codec_pose* pose, demo_playback* pb); // Follows the active piece after gravity
+static bool PoseRotated(demo_playback* pb, const int* before); // Rotation changed the blocks
+static void SaveOffsets(demo_playback* pb, int* out);
+static unsigned Predict(codec_pose* pose, demo_playback* pb);
+
+unsigned char* CodecEncode(demo* ptr, unsigned width, unsigned height, size_t* outLen) {
+    if (!ptr || !outLen || width > CODEC_MAX_WIDTH) return NULL;
+    if ((ptr->flags & DEMO_FLAG_SEEDED) && ptr->rngVersion != RANDOMISER_RNG_VERSION) return NULL;
+
+    demo_playback* pb = PlaybackCreate(ptr, width, height);
+    if (!pb) return NULL;
+
+    //  First pass replays the demo and keeps final poses, they are the targets
+    unsigned count = ptr->instrsCount;
+    codec_pose* poses = (codec_pose*)malloc(sizeof(codec_pose)*(count+1));
+    unsigned* pieces = (unsigned*)malloc(sizeof(unsigned)*(count+1));
+    if (!poses || !pieces) {
+        free(poses);
+        free(pieces);
+        PlaybackFree(pb);
+        return NULL;
+    }
+
+    bool valid = true;
+    unsigned startTime = pb->time, prevTime = pb->time;
+    codec_pose pose = {.piece = 0};
+    for (unsigned i=0; i < count && valid; i++) {
+        demo_instruction* ins = PlaybackPeek(pb);
+        if (!ins || ins->time < prevTime || ins->instruction > INPUT_UPDATE) {
+            valid = false;
+            break;
+        }
+        prevTime = ins->time;
+        PlaybackAdvance(pb, ins->time);
+        PoseUpdate(&pose, pb);
+        pieces[i] = pose.piece;
+
+        int before[8];
+        SaveOffsets(pb, before);
+        PlaybackStep(pb);
+        if (ins->instruction == INPUT_ROTATE && PoseRotated(pb, before)) pose.rotation = (pose.rotation+1) & 3;
+        if (pb->gme->active && PlaybackPieces(pb) == pose.piece) pose.x = (int)pb->gme->active->x;
+        poses[i] = pose;
+    }
+    PlaybackFree(pb);
+
+    //  Target of a piece is its pose after its last instruction
+    for (unsigned i=0; i < count && valid; i++) {
+        unsigned last = i;
+        while (last+1 < count && pieces[last+1] == pieces[i]) last++;
+        for (unsigned j=i; j <= last; j++) {
+            poses[j].targetRotation = poses[last].rotation;
+            poses[j].targetX = poses[last].x;
+            if (abs(poses[j].targetX - poses[j].x) >= CODEC_MAX_WIDTH) valid = false;
+        }
+        i = last;
+    }
+    free(pieces);
+
+    //  Clip starts from its first checkpoint
+    demo_checkpoint* start = NULL;
+    if ((ptr->flags & DEMO_FLAG_CLIP) && ptr->checkpointsFirst) start = (demo_checkpoint*)ptr->checkpointsFirst->value;
+
+    codec_encoder enc = {.range = 0xFFFFFFFF, .cacheSize = 1};
+    pb = valid ? PlaybackCreate(ptr, width, height) : NULL;
+    codec_model* m = (codec_model*)malloc(sizeof(codec_model));
+    if (!pb || !m) {
+        free(m);
+        free(poses);
+        PlaybackFree(pb);
+        return NULL;
+    }
+    ModelInit(m);
+
+    unsigned header[CODEC_HEADER_WORDS] = {CODEC_SIG, CODEC_VER, ptr->flags, ptr->randomiser, ptr->rngVersion, ptr->seed,
+        width, height, ptr->piecesCount, count, start ? start->time : 0, start ? start->len : 0};
+    for (unsigned i=0; i < CODEC_HEADER_WORDS; i++) PutWord(&enc, header[i]);
+    for (unsigned i=0; start && i < start->len; i++) PutWord(&enc, start->state[i]);
+    size_t headerLen = enc.len;
+
+    for (demo_list* list = ptr->piecesFirst; list != NULL; list = list->next) {
+        EncodeTree(&enc, m->pieces, *(unsigned*)list->value, 3);
+    }
+
+    //  Second pass codes instructions against the predictions
+    prevTime = startTime;
+    unsigned prevType = INPUT_UPDATE+1;
+    bool prevHit = true;
+    pose = (codec_pose){.piece = 0};
+    for (unsigned i=0; i < count; i++) {
+        demo_instruction* ins = PlaybackPeek(pb);
+        EncodeTime(&enc, m, prevType, ins->time - prevTime);
+        prevTime = ins->time;
+        PlaybackAdvance(pb, ins->time);
+        PoseUpdate(&pose, pb);
+
+        game* gme = pb->gme;
+        if (!pose.targetKnown && gme->active && !(gme->info.status & GAME_STATUS_END)) {
+            pose.targetRotation = poses[i].targetRotation;
+            pose.targetX = poses[i].targetX;
+            pose.targetKnown = true;
+            EncodeTree(&enc, m->rotation[gme->active->shape], pose.targetRotation, 2);
+            EncodeTree(&enc, m->column[gme->active->shape], (unsigned)(pose.targetX - pose.x + CODEC_MAX_WIDTH) & 63, 6);
+        }
+
+        unsigned predicted = Predict(&pose, pb);
+        bool hit = ins->instruction == predicted;
+        EncodeBit(&enc, &m->hit[predicted][prevHit], hit);
+        if (!hit) EncodeTree(&enc, m->type[predicted], ins->instruction, 3);
+        prevType = ins->instruction;
+        prevHit = hit;
+
+        int before[8];
+        SaveOffsets(pb, before);
+        PlaybackStep(pb);
+        if (ins->instruction == INPUT_ROTATE && PoseRotated(pb, before)) pose.rotation = (pose.rotation+1) & 3;
+        if (gme->active && PlaybackPieces(pb) == pose.piece) pose.x = (int)gme->active->x;
+    }
+    EncodeFlush(&enc);
+    PlaybackFree(pb);
+    free(poses);
+    free(m);
+
+    //  Crc32 of everything before it
+    unsigned crc = CRC32(enc.buf, enc.len);
+    PutWord(&enc, crc);
+    if (enc.failed || enc.len == headerLen) {
+        free(enc.buf);
+        return NULL;
+    }
+    *outLen = enc.len;
+    return enc.buf;
+}
+
+demo* CodecDecode(const unsigned char* data, size_t len) {
+    if (!data || len < sizeof(unsigned)*(CODEC_HEADER_WORDS+1)) return NULL;
+    if (CRC32(data, len-4) != ReadWord(data+len-4)) return NULL;
+
+    unsigned header[CODEC_HEADER_WORDS];
+    for (unsigned i=0; i < CODEC_HEADER_WORDS; i++) header[i] = ReadWord(data + 4*i);
+    unsigned flags = header[2], count = header[9], startLen = header[11];
+    if (header[0] != CODEC_SIG || header[1] != CODEC_VER || header[6] > CODEC_MAX_WIDTH) return NULL;
+    if (startLen > DEMO_CHECKPOINT_MAX_LEN || len < sizeof(unsigned)*(CODEC_HEADER_WORDS+1+startLen) + 5) return NULL;
+    if (!(flags & DEMO_FLAG_CLIP) != !startLen) return NULL;
+
+    demo* ret = DemoCreateInstance();
+    codec_model* m = (codec_model*)malloc(sizeof(codec_model));
+    unsigned* state = (unsigned*)malloc(sizeof(unsigned)*(startLen+1));
+    if (!ret || !m || !state) {
+        DemoFree(ret);
+        free(m);
+        free(state);
+        return NULL;
+    }
+    ModelInit(m);
+
+    ret->flags = flags & (DEMO_FLAG_TIMED_GRAVITY | DEMO_FLAG_CLIP);
+    bool valid = true;
+    if (flags & DEMO_FLAG_SEEDED) {
+        valid = header[4] == RANDOMISER_RNG_VERSION && DemoSetSeed(ret, (randomiser_type)header[3], header[5]) == 0;
+    }
+    ret->randomiser = header[3];
+    ret->rngVersion = header[4];
+    ret->seed = header[5];
+
+    //  Coder starts after the start state and ends before the crc
+    size_t pos = sizeof(unsigned)*(CODEC_HEADER_WORDS+startLen);
+    for (unsigned i=0; i < startLen; i++) state[i] = ReadWord(data + sizeof(unsigned)*CODEC_HEADER_WORDS + 4*i);
+    codec_decoder dec = {.range = 0xFFFFFFFF, .code = 0, .buf = data, .pos = pos, .len = len-4};
+    for (unsigned i=0; i < 5; i++) dec.code = (dec.code << 8) | dec.buf[dec.pos++];
+
+    for (unsigned i=0; i < header[8] && valid; i++) {
+        if (dec.pos > dec.len) valid = false;
+        else valid = DemoAddPiece(ret, DecodeTree(&dec, m->pieces, 3)) == 0;
+    }
+    if (valid && startLen) valid = DemoAddCheckpoint(ret, 0, header[10], state, startLen) == 0;
+    free(state);
+
+    demo_playback* pb = valid ? PlaybackCreate(ret, header[6], header[7]) : NULL;
+    if (!pb) {
+        DemoFree(ret);
+        free(m);
+        return NULL;
+    }
+
+    //  Instruction is added before its type is known, gravity needs its time
+    unsigned prevTime = pb->time;
+    unsigned prevType = INPUT_UPDATE+1;
+    bool prevHit = true;
+    codec_pose pose = {.piece = 0};
+    for (unsigned i=0; i < count && valid; i++) {
+        unsigned delta = DecodeTime(&dec, m, prevType);
+        if (dec.pos > dec.len || prevTime + delta < prevTime || DemoAddInstruction(ret, prevTime + delta, INPUT_UPDATE) != 0) {
+            valid = false;
+            break;
+        }
+        prevTime += delta;
+        demo_instruction* ins = (demo_instruction*)ret->instrsCurrent->value;
+        PlaybackAdvance(pb, ins->time);
+        PoseUpdate(&pose, pb);
+
+        game* gme = pb->gme;
+        if (!pose.targetKnown && gme->active && !(gme->info.status & GAME_STATUS_END)) {
+            pose.targetRotation = DecodeTree(&dec, m->rotation[gme->active->shape], 2);
+            pose.targetX = pose.x + (int)DecodeTree(&dec, m->column[gme->active->shape], 6) - CODEC_MAX_WIDTH;
+            pose.targetKnown = true;
+        }
+
+        unsigned predicted = Predict(&pose, pb);
+        bool hit = DecodeBit(&dec, &m->hit[predicted][prevHit]);
+        ins->instruction = hit ? predicted : DecodeTree(&dec, m->type[predicted], 3);
+        if (ins->instruction > INPUT_UPDATE) {
+            valid = false;
+            break;
+        }
+        prevType = ins->instruction;
+        prevHit = hit;
+
+        int before[8];
+        SaveOffsets(pb, before);
+        PlaybackStep(pb);
+        if (ins->instruction == INPUT_ROTATE && PoseRotated(pb, before)) pose.rotation = (pose.rotation+1) & 3;
+        if (gme->active && PlaybackPieces(pb) == pose.piece) pose.x = (int)gme->active->x;
+    }
+    PlaybackFree(pb);
+    free(m);
+
+    if (!valid || dec.pos > dec.len) {
+        DemoFree(ret);
+        return NULL;
+    }
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Sets every probability to one half
+    \param m Pointer to the model
+*/
+void ModelInit(codec_model* m) {
+    uint16_t* probs = (uint16_t*)m;
+    for (size_t i=0; i < sizeof(codec_model)/sizeof(uint16_t); i++) probs[i] = PROB_INIT;
+}
+
+/**
+    \brief Appends a byte to the output, grows buffer when full
+    \param enc Pointer to the encoder
+    \param byte Byte to append
+*/
+void PutByte(codec_encoder* enc, unsigned char byte) {
+    if (enc->len == enc->size) {
+        size_t newSize = enc->size ? enc->size*2 : 4096;
+        unsigned char* grown = (unsigned char*)realloc(enc->buf, newSize);
+        if (!grown) {
+            enc->failed = true;
+            return;
+        }
+        enc->buf = grown;
+        enc->size = newSize;
+    }
+    enc->buf[enc->len++] = byte;
+}
+
+/**
+    \brief Appends a big-endian word to the output, outside the range coder
+    \param enc Pointer to the encoder
+    \param word Word to append
+*/
+void PutWord(codec_encoder* enc, unsigned word) {
+    for (int shift = 24; shift >= 0; shift -= 8) PutByte(enc, (unsigned char)(word >> shift));
+}
+
+/**
+    \brief Writes the top byte of low, carries are delayed until known
+    \param enc Pointer to the encoder
+*/
+void ShiftLow(codec_encoder* enc) {
+    if ((uint32_t)enc->low < 0xFF000000 || (enc->low >> 32) != 0) {
+        uint8_t carry = (uint8_t)(enc->low >> 32);
+        uint8_t temp = enc->cache;
+        do {
+            PutByte(enc, (unsigned char)(temp + carry));
+            temp = 0xFF;
+        } while (--enc->cacheSize != 0);
+        enc->cache = (uint8_t)(enc->low >> 24);
+    }
+    enc->cacheSize++;
+    enc->low = (enc->low & 0x00FFFFFF) << 8;
+}
+
+/**
+    \brief Codes a bit and adapts its probability
+    \param enc Pointer to the encoder
+    \param prob Probability of 0 in PROB_BITS bits
+    \param bit The bit
+*/
+void EncodeBit(codec_encoder* enc, uint16_t* prob, unsigned bit) {
+    uint32_t bound = (enc->range >> PROB_BITS) * *prob;
+    if (!bit) {
+        enc->range = bound;
+        *prob += ((1 << PROB_BITS) - *prob) >> PROB_SHIFT;
+    } else {
+        enc->low += bound;
+        enc->range -= bound;
+        *prob -= *prob >> PROB_SHIFT;
+    }
+    while (enc->range < RANGE_TOP) {
+        enc->range <<= 8;
+        ShiftLow(enc);
+    }
+}
+
+/**
+    \brief Codes bits with even probabilities
+    \param enc Pointer to the encoder
+    \param value Value to code, most significant bit first
+    \param bits Count of bits
+*/
+void EncodeDirect(codec_encoder* enc, unsigned value, unsigned bits) {
+    while (bits-- > 0) {
+        enc->range >>= 1;
+        if ((value >> bits) & 1) enc->low += enc->range;
+        while (enc->range < RANGE_TOP) {
+            enc->range <<= 8;
+            ShiftLow(enc);
+        }
+    }
+}
+
+/**
+    \brief Codes a value with a binary tree of probabilities
+    \param enc Pointer to the encoder
+    \param probs Tree of 1 << bits probabilities
+    \param value Value to code
+    \param bits Count of bits in the value
+*/
+void EncodeTree(codec_encoder* enc, uint16_t* probs, unsigned value, unsigned bits) {
+    unsigned node = 1;
+    while (bits-- > 0) {
+        unsigned bit = (value >> bits) & 1;
+        EncodeBit(enc, &probs[node], bit);
+        node = (node << 1) | bit;
+    }
+}
+
+/**
+    \brief Codes time between instructions as length and mantissa of delta+1
+    \param enc Pointer to the encoder
+    \param m Pointer to the model
+    \param ctx Type of the previous instruction
+    \param delta Milliseconds from the previous instruction
+*/
+void EncodeTime(codec_encoder* enc, codec_model* m, unsigned ctx, unsigned delta) {
+    uint64_t value = (uint64_t)delta + 1;
+    unsigned bits = 0; // Bits after the leading one
+    while ((value >> (bits+1)) != 0) bits++;
+
+    for (unsigned i=0; i < bits; i++) EncodeBit(enc, &m->timeLen[ctx][i], 1);
+    if (bits < TIME_LEN_BITS-1) EncodeBit(enc, &m->timeLen[ctx][bits], 0);
+
+    unsigned high = bits < TIME_HIGH_BITS ? bits : TIME_HIGH_BITS;
+    unsigned low = bits - high;
+    EncodeTree(enc, m->timeHigh[bits], (unsigned)(value >> low) & ((1u << high) - 1), high);
+    EncodeDirect(enc, (unsigned)value & ((1u << low) - 1), low);
+}
+
+/**
+    \brief Writes the bytes still in the coder
+    \param enc Pointer to the encoder
+*/
+void EncodeFlush(codec_encoder* enc) {
+    for (unsigned i=0; i < 5; i++) ShiftLow(enc);
+}
+
+/**
+    \brief Decodes a bit coded with EncodeBit()
+    \param dec Pointer to the decoder
+    \param prob Probability of 0 in PROB_BITS bits
+    \return The bit
+*/
+unsigned DecodeBit(codec_decoder* dec, uint16_t* prob) {
+    uint32_t bound = (dec->range >> PROB_BITS) * *prob;
+    unsigned bit;
+    if (dec->code < bound) {
+        dec->range = bound;
+        *prob += ((1 << PROB_BITS) - *prob) >> PROB_SHIFT;
+        bit = 0;
+    } else {
+        dec->code -= bound;
+        dec->range -= bound;
+        *prob -= *prob >> PROB_SHIFT;
+        bit = 1;
+    }
+    while (dec->range < RANGE_TOP) {
+        //  Reading past the end is noticed by the caller from pos
+        dec->range <<= 8;
+        dec->code = (dec->code << 8) | (dec->pos < dec->len ? dec->buf[dec->pos] : 0);
+        dec->pos++;
+    }
+    return bit;
+}
+
+/**
+    \brief Decodes bits coded with EncodeDirect()
+    \param dec Pointer to the decoder
+    \param bits Count of bits
+    \return The value
+*/
+unsigned DecodeDirect(codec_decoder* dec, unsigned bits) {
+    unsigned ret = 0;
+    while (bits-- > 0) {
+        dec->range >>= 1;
+        unsigned bit = dec->code >= dec->range;
+        if (bit) dec->code -= dec->range;
+        ret = (ret << 1) | bit;
+        while (dec->range < RANGE_TOP) {
+            dec->range <<= 8;
+            dec->code = (dec->code << 8) | (dec->pos < dec->len ? dec->buf[dec->pos] : 0);
+            dec->pos++;
+        }
+    }
+    return ret;
+}
+
+/**
+    \brief Decodes a value coded with EncodeTree()
+    \param dec Pointer to the decoder
+    \param probs Tree of 1 << bits probabilities
+    \param bits Count of bits in the value
+    \return The value
+*/
+unsigned DecodeTree(codec_decoder* dec, uint16_t* probs, unsigned bits) {
+    unsigned node = 1;
+    for (unsigned i=0; i < bits; i++) node = (node << 1) | DecodeBit(dec, &probs[node]);
+    return node - (1u << bits);
+}
+
+/**
+    \brief Decodes time coded with EncodeTime()
+    \param dec Pointer to the decoder
+    \param m Pointer to the model
+    \param ctx Type of the previous instruction
+    \return Milliseconds from the previous instruction
+*/
+unsigned DecodeTime(codec_decoder* dec, codec_model* m, unsigned ctx) {
+    unsigned bits = 0;
+    while (bits < TIME_LEN_BITS-1 && DecodeBit(dec, &m->timeLen[ctx][bits])) bits++;
+
+    unsigned high = bits < TIME_HIGH_BITS ? bits : TIME_HIGH_BITS;
+    unsigned low = bits - high;
+    uint64_t value = (1u << high) | DecodeTree(dec, m->timeHigh[bits], high);
+    value = (value << low) | DecodeDirect(dec, low);
+    return (unsigned)(value - 1);
+}
+
+/**
+    \brief Reads a big-endian word
+    \param data Pointer to 4 bytes
+*/
+unsigned ReadWord(const unsigned char* data) {
+    return ((unsigned)data[0] << 24) | ((unsigned)data[1] << 16) | ((unsigned)data[2] << 8) | data[3];
+}
+
+/**
+    \brief Starts a new pose when gravity has spawned a new piece
+    \param pose Pose of the previous instruction
+    \param pb Pointer to the playback
+*/
+void PoseUpdate(codec_pose* pose, demo_playback* pb) {
+    unsigned piece = PlaybackPieces(pb);
+    if (piece == pose->piece) return;
+
+    pose->piece = piece;
+    pose->rotation = 0;
+    pose->x = pb->gme->active ? (int)pb->gme->active->x : 0;
+    pose->targetKnown = false;
+}
+
+/**
+    \brief Saves block offsets of the active piece
+    \param pb Pointer to the playback
+    \param out Array of 8 offsets, zeros without active piece
+*/
+void SaveOffsets(demo_playback* pb, int* out) {
+    tetromino* t = pb->gme->active;
+    for (unsigned i=0; i < 4; i++) {
+        out[2*i] = t ? t->blocks[i]->x : 0;
+        out[2*i+1] = t ? t->blocks[i]->y : 0;
+    }
+}
+
+/**
+    \brief Check if a rotation turned the same piece
+
+    Rotations which fail or don't change the blocks, like those of O,
+    aren't counted.
+    \param pb Pointer to the playback
+    \param before Offsets saved before the rotation
+*/
+bool PoseRotated(demo_playback* pb, const int* before) {
+    int after[8];
+    SaveOffsets(pb, after);
+    return memcmp(before, after, sizeof(after)) != 0;
+}
+
+/**
+    \brief Predicts the next instruction from the shortest path to the target
+
+    Only clockwise rotations exist, so the path rotates first and then
+    moves sideways before the hard drop.
+    \param pose Current pose and target of the active piece
+    \param pb Pointer to the playback
+    \return The predicted input
+*/
+unsigned Predict(codec_pose* pose, demo_playback* pb) {
+    game* gme = pb->gme;
+    if (!gme->active || (gme->info.status & GAME_STATUS_END) || !pose->targetKnown) return INPUT_UPDATE;
+    if (pose->rotation != pose->targetRotation) return INPUT_ROTATE;
+    if (pose->x < pose->targetX) return INPUT_RIGHT;
+    if (pose->x > pose->targetX) return INPUT_LEFT;
+    return INPUT_SET;
+}
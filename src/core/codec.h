@@ -0,0 +1,40 @@
+#ifndef _CODEC_H_
+#define _CODEC_H_
+
+#include <stddef.h> /* size_t */
+
+#include "demo.h"
+
+/**
+    \brief Compresses demo by predicting its inputs with the game itself
+
+    Encoder and decoder run the same playback. For every piece the final
+    rotation and column is stored once, and every input is predicted as
+    the next step of the shortest path there: rotations first, then moves,
+    then the hard drop. Inputs following the prediction cost a fraction of
+    a bit, others and the times between inputs are coded with adaptive
+    models in a binary range coder.
+
+    Checkpoints are not stored, except for the starting state of a clip.
+    \param ptr Pointer to the demo instance
+    \param width The width of the game area the demo was recorded with
+    \param height The height of the game area
+    \param outLen Length of the returned data in bytes
+    \return Compressed data, free with free(). NULL on error or if the demo can't be coded
+*/
+extern unsigned char* CodecEncode(demo* ptr, unsigned width, unsigned height, size_t* outLen);
+
+/**
+    \brief Decompresses demo coded with CodecEncode()
+
+    Game is replayed while decoding, so it costs about as much as playing
+    the demo to the end.
+    \param data Compressed data
+    \param len Length of the data in bytes
+    \return New demo instance, NULL if data is invalid
+
+    \note Use DemoFree() to delete instance
+*/
+extern demo* CodecDecode(const unsigned char* data, size_t len);
+
+#endif //_CODEC_H_
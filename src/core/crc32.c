@@ -0,0 +1,110 @@
+#include <stdatomic.h>
+
+#include "crc32.h"
+
+#define CRC32_POLY 0x04C11DB7
+#define CRC32_POLY_REFLECTED 0xEDB88320
+#define CRC32_SLICES 8
+
+/*
+    crcTable[k][i] is the checksum of byte i followed by k zero bytes.
+    crcTable[0] is the classic byte-at-a-time table.
+*/
+static unsigned crcTable[CRC32_SLICES][256];
+static unsigned crcTableReflected[CRC32_SLICES][256]; // Same for the reflected checksum, bytes from the low end
+static atomic_int tableState = 0; // 0 = not built, 1 = building, 2 = ready
+
+/**
+    \brief Builds look-up tables once, other threads wait until ready
+*/
+static void CRC32Init();
+
+unsigned CRC32Update(unsigned crc, const void* data, size_t len) {
+    if (atomic_load_explicit(&tableState, memory_order_acquire) != 2) CRC32Init();
+
+    const unsigned char* p = (const unsigned char*)data;
+
+    //  8 bytes per iteration, first 4 are folded into the checksum
+    for (; len >= 8; len -= 8, p += 8) {
+        crc ^= (unsigned)p[0] << 24 | (unsigned)p[1] << 16 | (unsigned)p[2] << 8 | p[3];
+        crc = crcTable[7][crc >> 24] ^ crcTable[6][(crc >> 16) & 0xff] ^
+              crcTable[5][(crc >> 8) & 0xff] ^ crcTable[4][crc & 0xff] ^
+              crcTable[3][p[4]] ^ crcTable[2][p[5]] ^
+              crcTable[1][p[6]] ^ crcTable[0][p[7]];
+    }
+
+    //  Tail byte by byte
+    for (; len > 0; len--, p++) {
+        crc = (crc << 8) ^ crcTable[0][(crc >> 24) ^ *p];
+    }
+
+    return crc;
+}
+
+unsigned CRC32Final(unsigned crc) {
+    return crc; // No final xor
+}
+
+unsigned CRC32(const void* data, size_t len) {
+    return CRC32Final(CRC32Update(CRC32_INIT, data, len));
+}
+
+unsigned CRC32Reflected(unsigned crc, const void* data, size_t len) {
+    if (atomic_load_explicit(&tableState, memory_order_acquire) != 2) CRC32Init();
+
+    const unsigned char* p = (const unsigned char*)data;
+    unsigned (*t)[256] = crcTableReflected;
+    crc = ~crc;
+
+    for (; len >= 8; len -= 8, p += 8) {
+        crc ^= (unsigned)p[0] | (unsigned)p[1] << 8 | (unsigned)p[2] << 16 | (unsigned)p[3] << 24;
+        crc = t[7][crc & 0xff] ^ t[6][(crc >> 8) & 0xff] ^
+              t[5][(crc >> 16) & 0xff] ^ t[4][crc >> 24] ^
+              t[3][p[4]] ^ t[2][p[5]] ^
+              t[1][p[6]] ^ t[0][p[7]];
+    }
+
+    for (; len > 0; len--, p++) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+    }
+
+    return ~crc;
+}
+
+/*
+    Static functions
+*/
+
+void CRC32Init() {
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&tableState, &expected, 1)) {
+        //  Another thread builds the tables
+        while (atomic_load_explicit(&tableState, memory_order_acquire) != 2);
+        return;
+    }
+
+    for (unsigned i=0; i<256; i++) {
+        unsigned crc = i << 24;
+        for (unsigned j=0; j<8; j++) {
+            if (crc & 0x80000000) crc = (crc << 1) ^ CRC32_POLY;
+            else crc <<= 1;
+        }
+        crcTable[0][i] = crc;
+
+        crc = i;
+        for (unsigned j=0; j<8; j++) crc = crc & 1 ? (crc >> 1) ^ CRC32_POLY_REFLECTED : crc >> 1;
+        crcTableReflected[0][i] = crc;
+    }
+
+    //  Each slice appends one more zero byte
+    for (unsigned k=1; k<CRC32_SLICES; k++) {
+        for (unsigned i=0; i<256; i++) {
+            unsigned prev = crcTable[k-1][i];
+            crcTable[k][i] = (prev << 8) ^ crcTable[0][prev >> 24];
+            prev = crcTableReflected[k-1][i];
+            crcTableReflected[k][i] = (prev >> 8) ^ crcTableReflected[0][prev & 0xff];
+        }
+    }
+
+    atomic_store_explicit(&tableState, 2, memory_order_release);
+}
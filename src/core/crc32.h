@@ -0,0 +1,53 @@
+#ifndef _CRC32_H_
+#define _CRC32_H_
+/*
+    CRC32 used by the file formats. MSB-first with polynomial 0x04C11DB7,
+    initial value 0 and no final xor. Data is processed 8 bytes at a time
+    with slicing-by-8 tables, which are built once on first use.
+    The reflected variant is the checksum of zlib and PNG.
+*/
+#include <stddef.h> /* size_t */
+
+#define CRC32_INIT 0
+
+/**
+    \brief Continues checksum with more data
+    \param crc Checksum so far, CRC32_INIT for new checksum
+    \param data Bytes to add
+    \param len Count of bytes
+    \return Updated checksum
+
+    \note Safe to call from multiple threads
+*/
+extern unsigned CRC32Update(unsigned crc, const void* data, size_t len);
+
+/**
+    \brief Finalises checksum
+    \param crc Checksum returned by CRC32Update()
+    \return The 32-bit checksum stored in files
+*/
+extern unsigned CRC32Final(unsigned crc);
+
+/**
+    \brief Calculates checksum of whole buffer
+    \param data Bytes to check
+    \param len Count of bytes
+    \return The 32-bit checksum
+*/
+extern unsigned CRC32(const void* data, size_t len);
+
+/**
+    \brief Continues the reflected checksum of zlib and PNG
+
+    Polynomial 0xEDB88320, initial value and final xor 0xFFFFFFFF. Like
+    crc32() of zlib, the result is final and can be continued.
+    \param crc Checksum so far, CRC32_INIT for new checksum
+    \param data Bytes to add
+    \param len Count of bytes
+    \return Updated checksum
+
+    \note Safe to call from multiple threads
+*/
+extern unsigned CRC32Reflected(unsigned crc, const void* data, size_t len);
+
+#endif // _CRC32_H_
@@ -3,13 +3,56 @@
 
 #include "demo.h"
 #include "file_misc.h"
+#include "crc32.h"
 
-#define DEMO_METADATA sizeof(unsigned)*5
 #define DEMO_SIG 0xDE0666
-#define DEMO_VER 1
+#define DEMO_VER 3
+#define WRITER_CHUNK 1024 /* Words encoded between writes */
+#define READER_CHUNK 4096 /* Bytes read at once by DemoRead() */
 
-static demo_list* CreateListElement(void* val);
+/**
+    \brief Fields of the file decoded by demo_stream
+*/
+enum {
+    STAGE_SIG,
+    STAGE_VERSION,
+    STAGE_FLAGS,
+    STAGE_RANDOMISER,
+    STAGE_RNG_VERSION,
+    STAGE_SEED,
+    STAGE_PIECES_COUNT,
+    STAGE_INSTRS_COUNT,
+    STAGE_PIECES,
+    STAGE_TIME,
+    STAGE_INSTRUCTION,
+    STAGE_CHECKPOINTS_COUNT,
+    STAGE_CP_INSTRS,
+    STAGE_CP_TIME,
+    STAGE_CP_LEN,
+    STAGE_CP_STATE,
+    STAGE_CRC
+};
+
+/**
+    \brief Buffered writer which checksums data while writing
+*/
+typedef struct {
+    FILE* fp;
+    unsigned crc;       /**< Checksum of flushed data */
+    unsigned written;   /**< Bytes written */
+    unsigned used;      /**< Words in chunk */
+    unsigned chunk[WRITER_CHUNK];
+} demo_writer;
+
+static demo_list* CreateListElement(size_t valueSize);
 static void FreeList(demo_list* list);
+static void WriterPut(demo_writer* wr, unsigned value); // Appends big-endian word
+static void WriterFlush(demo_writer* wr); // Checksums and writes chunk
+static void StreamWord(demo_stream* stream, unsigned word); // Processes decoded word
+static void StreamStartBody(demo_stream* stream); // Validates header and moves to pieces
+static void StreamFail(demo_stream* stream, const char* error);
+static void StreamEndInstructions(demo_stream* stream); // Moves to checkpoints or the checksum
+static void StreamNextCheckpoint(demo_stream* stream); // Moves to the next checkpoint or the checksum
 
 demo* DemoCreateInstance(void) {
     demo* ret = (demo*)malloc(sizeof(demo));
@@ -23,6 +66,15 @@ demo* DemoCreateInstance(void) {
     ret->piecesCount = 0;
     ret->instrsCount = 0;
 
+    ret->flags = 0;
+    ret->randomiser = 0;
+    ret->rngVersion = 0;
+    ret->seed = 0;
+
+    ret->checkpointsFirst = NULL;
+    ret->checkpointsCurrent = NULL;
+    ret->checkpointsCount = 0;
+
     return ret;
 }
 
@@ -30,24 +82,25 @@ void DemoFree(demo* ptr) {
     if (ptr) {
         FreeList(ptr->instrsFirst);
         FreeList(ptr->piecesFirst);
+        FreeList(ptr->checkpointsFirst);
         free(ptr);
     }
 }
 
+void DemoInstructionInfo(demo_instruction* ptr, unsigned* outTime, unsigned* outInstruction) {
+    if (outTime) *outTime = ptr ? ptr->time : 0;
+    if (outInstruction) *outInstruction = ptr ? ptr->instruction : 0;
+}
+
 int DemoAddInstruction(demo* ptr, unsigned time, unsigned instruction) {
     if (!ptr) return -1;
 
-    demo_instruction* ins = (demo_instruction*)malloc(sizeof(demo_instruction));
-    if (!ins) return -2;
+    demo_list* nw = CreateListElement(sizeof(demo_instruction));
+    if (!nw) return -2;
+    demo_instruction* ins = (demo_instruction*)nw->value;
     ins->time = time;
     ins->instruction = instruction;
 
-    demo_list* nw = CreateListElement((void*)ins);
-    if (!nw) {
-        free(ins);
-        return -3;
-    }
-
     if (!ptr->instrsCurrent) { // 1st instruction
         ptr->instrsFirst = nw;
         ptr->instrsCurrent = ptr->instrsFirst;
@@ -59,17 +112,73 @@ int DemoAddInstruction(demo* ptr, unsigned time, unsigned instruction) {
     return 0;
 }
 
-int DemoAddPiece(demo* ptr, unsigned shape) {
+int DemoInsertInstruction(demo* ptr, demo_list* after, unsigned time, unsigned instruction) {
+    if (!ptr) return -1;
+
+    //  Appending keeps the last instruction up to date
+    if (after ? after == ptr->instrsCurrent : !ptr->instrsFirst) return DemoAddInstruction(ptr, time, instruction);
+
+    demo_list* nw = CreateListElement(sizeof(demo_instruction));
+    if (!nw) return -2;
+    demo_instruction* ins = (demo_instruction*)nw->value;
+    ins->time = time;
+    ins->instruction = instruction;
+
+    if (!after) {
+        nw->next = ptr->instrsFirst;
+        ptr->instrsFirst = nw;
+    } else {
+        nw->next = after->next;
+        after->next = nw;
+    }
+    ptr->instrsCount++;
+    return 0;
+}
+
+int DemoRemoveInstruction(demo* ptr, demo_list* after) {
     if (!ptr) return -1;
 
-    unsigned* ptrShape = (unsigned*)malloc(sizeof(unsigned));
-    *ptrShape = shape;
-    demo_list* nw = CreateListElement((void*)ptrShape);
-    if (!nw) {
-        free(ptrShape);
-        return -2;
+    demo_list* rm = after ? after->next : ptr->instrsFirst;
+    if (!rm) return -3;
+
+    if (after) after->next = rm->next;
+    else ptr->instrsFirst = rm->next;
+    if (rm == ptr->instrsCurrent) ptr->instrsCurrent = after;
+    ptr->instrsCount--;
+    free(rm);
+    return 0;
+}
+
+void DemoDropCheckpoints(demo* ptr, unsigned instrsDone) {
+    if (!ptr) return;
+
+    //  Find the last checkpoint which stays
+    demo_list* keep = NULL;
+    unsigned kept = 0;
+    for (demo_list* list = ptr->checkpointsFirst; list != NULL; list = list->next) {
+        demo_checkpoint* cp = (demo_checkpoint*)list->value;
+        bool start = (ptr->flags & DEMO_FLAG_CLIP) && list == ptr->checkpointsFirst;
+        if (cp->instrsDone >= instrsDone && !start) break;
+        keep = list;
+        kept++;
     }
 
+    FreeList(keep ? keep->next : ptr->checkpointsFirst);
+    if (keep) keep->next = NULL;
+    else ptr->checkpointsFirst = NULL;
+    ptr->checkpointsCurrent = keep;
+    ptr->checkpointsCount = kept;
+}
+
+int DemoAddPiece(demo* ptr, unsigned shape) {
+    if (!ptr) return -1;
+
+    if (ptr->flags & DEMO_FLAG_SEEDED) return 0; // Regenerated from the seed
+
+    demo_list* nw = CreateListElement(sizeof(unsigned));
+    if (!nw) return -2;
+    *(unsigned*)nw->value = shape;
+
     if (!ptr->piecesCurrent) { // 1st piece
         ptr->piecesFirst = nw;
         ptr->piecesCurrent = ptr->piecesFirst;
@@ -81,138 +190,277 @@ int DemoAddPiece(demo* ptr, unsigned shape) {
     return 0;
 }
 
+int DemoAddCheckpoint(demo* ptr, unsigned instrsDone, unsigned time, const unsigned* state, unsigned len) {
+    if (!ptr || (len > 0 && !state)) return -1;
+
+    //  Find the last instruction processed before the checkpoint
+    demo_list* position = NULL;
+    unsigned index = 0;
+    demo_checkpoint* last = ptr->checkpointsCurrent ? (demo_checkpoint*)ptr->checkpointsCurrent->value : NULL;
+    if (instrsDone > ptr->instrsCount || (last && instrsDone < last->instrsDone)) return -3;
+    if (instrsDone == ptr->instrsCount) {
+        position = ptr->instrsCurrent; // Recorder adds checkpoints at the end
+    } else {
+        if (last) {
+            position = last->position;
+            index = last->instrsDone;
+        }
+        for (; index < instrsDone; index++) position = position ? position->next : ptr->instrsFirst;
+    }
+
+    demo_list* nw = CreateListElement(sizeof(demo_checkpoint) + sizeof(unsigned)*len);
+    if (!nw) return -2;
+    demo_checkpoint* cp = (demo_checkpoint*)nw->value;
+    cp->instrsDone = instrsDone;
+    cp->time = time;
+    cp->position = position;
+    cp->len = len;
+    cp->state = (unsigned*)(cp+1);
+    for (unsigned i=0; i < len; i++) cp->state[i] = state[i];
+
+    if (!ptr->checkpointsCurrent) { // 1st checkpoint
+        ptr->checkpointsFirst = nw;
+    } else {
+        ptr->checkpointsCurrent->next = nw;
+    }
+    ptr->checkpointsCurrent = nw;
+    ptr->checkpointsCount++;
+    return 0;
+}
+
+int DemoSetSeed(demo* ptr, randomiser_type randomiser, unsigned seed) {
+    if (!ptr) return -1;
+
+    const randomiser_desc* desc = RandomiserGet(randomiser);
+    if (!desc) return -2;
+
+    ptr->flags |= DEMO_FLAG_SEEDED;
+    ptr->randomiser = randomiser;
+    ptr->rngVersion = RANDOMISER_RNG_VERSION;
+    ptr->seed = seed;
+    return 0;
+}
+
 /*
     FILE:
         0-3             Signature           (unsigned)
         4-7             Version*            (unsigned)
-        8-11            Piece count         (unsigned)
-        12-15           Instruction count   (unsigned)
-        16-x            Pieces              (unsigned)
+        8-11            Flags               (unsigned)
+        12-15           Randomiser          (unsigned)
+        16-19           RNG version         (unsigned)
+        20-23           Seed                (unsigned)
+        24-27           Piece count         (unsigned)
+        28-31           Instruction count   (unsigned)
+        32-x            Pieces              (unsigned)
         (x+1)-z         Instructions        (unsigned)*2
-        z+1             CRC32               (unsigned)
+        z+1             Checkpoint count    (unsigned)
+        (z+5)-c         Checkpoints
+        c+1             CRC32               (unsigned)
 
-        x = sizeof(unsigned)*piecesCount
+        x = sizeof(unsigned)*piecesCount, 0 for seed-based demos
         z = sizeof(2*unsigned)*instrsCount
 
+        CHECKPOINT:
+        0-3             Instructions processed before   (unsigned)
+        4-7             Time                (unsigned)
+        8-11            State length        (unsigned)
+        12-s            State               (unsigned)*length
+
+        Version 1 has no bytes 8-23, its pieces are always stored.
+        Versions 1 and 2 have no checkpoint count or checkpoints.
+
+        Demos with DEMO_FLAG_TIMED_GRAVITY have player inputs and one
+        INPUT_UPDATE at the game over, gravity is derived from the time.
+        Other demos have every gravity step as an INPUT_UPDATE.
+
+        Clips with DEMO_FLAG_CLIP are cut from the middle of a game. They
+        are always seed-based, and their first checkpoint with 0
+        instructions processed is the state where playback starts.
+
+        Instruction count DEMO_COUNT_OPEN is used when the length isn't known
+        while writing, for example in live streams. Instructions end to a
+        pair of DEMO_END_MARKER words, which is followed by the CRC32.
+
         *Version means the version of the demosystem, not the complete game
 */
 
 unsigned DemoSave(demo* ptr, const char* path) {
-    unsigned ret = 0;
-    if (!ptr) return ret;
+    if (!ptr) return 0;
 
-    //  Allocate buffer
-    size_t bufLen = sizeof(demo_instruction)*(ptr->instrsCount) + sizeof(unsigned)*(ptr->piecesCount) + DEMO_METADATA;
-    unsigned* buf = (unsigned*)calloc(bufLen+1, 1);
-    if (!buf) return ret;
+    FILE* fp = fopen(path, "w");
+    if (!fp) return 0;
+
+    //  Data is encoded in chunks, checksummed and written while streaming
+    demo_writer wr = {.fp = fp, .crc = CRC32_INIT};
 
-    unsigned* pos = buf;
     // Write header
-    *pos = EncodeBigendian(DEMO_SIG);
-    *(pos+1) = EncodeBigendian(DEMO_VER);
-    *(pos+2) = EncodeBigendian(ptr->piecesCount); //  Write count of pieces
-    *(pos+3) = EncodeBigendian(ptr->instrsCount); //  Write count of instructions
-    pos += 4;
-
-    //  Write all pieces to the buffer
-    demo_list* list = ptr->piecesFirst;
-    while (list != NULL) {
-        *pos = EncodeBigendian(*(unsigned*)list->value);
-        pos++;
-        list = list->next;
+    WriterPut(&wr, DEMO_SIG);
+    WriterPut(&wr, DEMO_VER);
+    WriterPut(&wr, ptr->flags);
+    WriterPut(&wr, ptr->randomiser);
+    WriterPut(&wr, ptr->rngVersion);
+    WriterPut(&wr, ptr->seed);
+    WriterPut(&wr, ptr->piecesCount); //  Write count of pieces
+    WriterPut(&wr, ptr->instrsCount); //  Write count of instructions
+
+    //  Write all pieces
+    for (demo_list* list = ptr->piecesFirst; list != NULL; list = list->next) {
+        WriterPut(&wr, *(unsigned*)list->value);
     }
 
-    list = ptr->instrsFirst;
-    while(list != NULL) {
+    for (demo_list* list = ptr->instrsFirst; list != NULL; list = list->next) {
         demo_instruction* c = (demo_instruction*)list->value;
-        *pos     = EncodeBigendian(c->time);
-        *(pos+1) = EncodeBigendian(c->instruction);
-        pos += 2;
-        list = list->next;
+        WriterPut(&wr, c->time);
+        WriterPut(&wr, c->instruction);
     }
 
-    //  Crc32
-    unsigned crc32 = CalcCRC32((char*)buf, bufLen-4);
-    *pos = EncodeBigendian(crc32);
-
-    //  Write buffer into a file
-    FILE* fp = fopen(path, "w");
-    if (fp) {
-        ret = fwrite((void*)buf, 1, bufLen, fp);
-        fclose(fp);
+    WriterPut(&wr, ptr->checkpointsCount);
+    for (demo_list* list = ptr->checkpointsFirst; list != NULL; list = list->next) {
+        demo_checkpoint* cp = (demo_checkpoint*)list->value;
+        WriterPut(&wr, cp->instrsDone);
+        WriterPut(&wr, cp->time);
+        WriterPut(&wr, cp->len);
+        for (unsigned i=0; i < cp->len; i++) WriterPut(&wr, cp->state[i]);
     }
-    free(buf);  //  Free buffer
-    return ret;
+
+    //  Crc32 of everything before it
+    WriterFlush(&wr);
+    wr.chunk[wr.used++] = EncodeBigendian(CRC32Final(wr.crc));
+    wr.written += fwrite(wr.chunk, 1, sizeof(unsigned)*wr.used, fp);
+
+    fclose(fp);
+    return wr.written;
 }
 
 demo* DemoRead(const char* path) {
     FILE* fp = fopen(path, "r");
     if (!fp) return NULL;
 
-    //  Get filesize
-    fseek(fp, 0, SEEK_END);
-    long len = ftell(fp);
-    rewind(fp);
-
-    //  Allocate buffer
-    unsigned* buffer = (unsigned*)calloc(sizeof(char)*len, 1);
-    if (!buffer) {
+    demo_stream* stream = DemoStreamCreate();
+    if (!stream) {
         fclose(fp);
         return NULL;
     }
-    //  Read file to buffer
-    fread(buffer, sizeof(char), len, fp);
+
+    //  Decode file in chunks, the whole file is never buffered
+    unsigned char chunk[READER_CHUNK];
+    size_t len;
+    while ((len = fread(chunk, 1, READER_CHUNK, fp)) > 0) {
+        if (DemoStreamFeed(stream, chunk, len) == DEMO_STREAM_ERROR) break;
+    }
     fclose(fp);
 
-    //  Check CRC32 checksum
-    unsigned crc32 = DecodeBigendian(*(unsigned*)((char*)buffer+len-4));
-    if (crc32 != CalcCRC32((char*)buffer, len-4)) {
-        free(buffer);
+    //  Only complete demos with a valid checksum are returned
+    demo* ret = NULL;
+    if (stream->status == DEMO_STREAM_DONE) ret = DemoStreamDetach(stream);
+    DemoStreamFree(stream);
+    return ret;
+}
+
+demo_stream* DemoStreamCreate(void) {
+    demo_stream* ret = (demo_stream*)calloc(1, sizeof(demo_stream));
+    if (!ret) return NULL;
+
+    ret->record = DemoCreateInstance();
+    if (!ret->record) {
+        free(ret);
         return NULL;
     }
+    ret->status = DEMO_STREAM_HEADER;
+    ret->stage = STAGE_SIG;
+    ret->crc = CRC32_INIT;
+    return ret;
+}
+
+void DemoStreamFree(demo_stream* stream) {
+    if (!stream) return;
+
+    DemoFree(stream->record);
+    free(stream->cpState);
+    free(stream);
+}
+
+demo* DemoStreamDetach(demo_stream* stream) {
+    if (!stream) return NULL;
 
-    unsigned* pos = buffer;
-    // Check signature and version
-    if(DecodeBigendian(*pos) != DEMO_SIG || DecodeBigendian(*(pos+1)) != DEMO_VER) {
-       free(buffer);
-       return NULL;
+    demo* ret = stream->record;
+    stream->record = NULL;
+    return ret;
+}
+
+int DemoStreamFeed(demo_stream* stream, const void* data, size_t len) {
+    if (!stream) return DEMO_STREAM_ERROR;
+    if (stream->status == DEMO_STREAM_ERROR) return stream->status;
+    if (stream->status == DEMO_STREAM_DONE) {
+        if (len > 0) StreamFail(stream, "Data after the checksum");
+        return stream->status;
     }
 
-    unsigned pieces = DecodeBigendian(*(pos+2));
-    unsigned instrs = DecodeBigendian(*(pos+3));
-    pos += 4;
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t crcStart = (stream->stage == STAGE_CRC) ? len : 0; // Bytes before this are in the checksum
+    for (size_t i = 0; i < len; i++) {
+        if (stream->wordLen == 0 && i+4 <= len) {
+            //  Whole word available
+            stream->word = (unsigned)bytes[i] << 24 | (unsigned)bytes[i+1] << 16 | (unsigned)bytes[i+2] << 8 | bytes[i+3];
+            stream->wordLen = 4;
+            i += 3;
+        } else {
+            stream->word = (stream->word << 8) | bytes[i];
+            if (++stream->wordLen < 4) continue;
+        }
 
-    //  Create demo instance
-    demo* ret = DemoCreateInstance();
-    if (ret) {
-        //  Extract all pieces
-        for (unsigned* end=pos+pieces; pos != end; pos++) {
-            DemoAddPiece(ret, DecodeBigendian(*pos));
+        //  Checksum covers everything before the checksum itself
+        if (stream->stage == STAGE_CRC) {
+            if (stream->word != CRC32Final(stream->crc)) StreamFail(stream, "Checksum doesn't match");
+            else stream->status = DEMO_STREAM_DONE;
+
+            if (i+1 < len && stream->status == DEMO_STREAM_DONE) StreamFail(stream, "Data after the checksum");
+            return stream->status;
         }
 
-        //  Extract all instructions
-        for (unsigned* end=pos+instrs*2; pos != end; pos+=2) {
-            unsigned time = DecodeBigendian(*pos);
-            unsigned instruction = DecodeBigendian(*(pos+1));
-            DemoAddInstruction(ret, time, instruction);
+        unsigned word = stream->word;
+        stream->word = 0;
+        stream->wordLen = 0;
+        StreamWord(stream, word);
+        if (stream->status == DEMO_STREAM_ERROR) return stream->status;
+
+        //  Next word is the checksum
+        if (stream->stage == STAGE_CRC) {
+            stream->crc = CRC32Update(stream->crc, bytes+crcStart, i+1-crcStart);
+            crcStart = len;
         }
     }
+    if (crcStart < len) stream->crc = CRC32Update(stream->crc, bytes+crcStart, len-crcStart);
 
-    // Free buffer and return demo instance
-    free(buffer);
-    return ret;
+    return stream->status;
 }
 
 void* DemoRandomizerInit(void* data) {
-    demo_list* d = ((demo*)data)->piecesFirst;
-    demo_rand_data* da = (demo_rand_data*)malloc(sizeof(demo_rand_data));
-    da->current = d;
+    demo* record = (demo*)data;
+    const randomiser_desc* desc = NULL;
+    if (record->flags & DEMO_FLAG_SEEDED) desc = RandomiserGet(record->randomiser);
+
+    //  Randomiser data is allocated in the same block
+    demo_rand_data* da = (demo_rand_data*)malloc(sizeof(demo_rand_data) + (desc ? desc->dataSize : 0));
+    if (!da) return NULL;
+    da->first = record->piecesFirst;
+    da->current = record->piecesFirst;
+    da->desc = desc;
+    da->generator = NULL;
+
+    //  Regenerate the recorded sequence
+    if (desc) {
+        da->generator = (void*)(da+1);
+        RandomiserSeed(da->generator, record->seed);
+        desc->fnInit(da->generator);
+    }
     return da;
 }
 
 unsigned DemoRandomizerNext(void* data) {
     if (!data) return 0;
     demo_rand_data* d = data;
+    if (d->desc) return d->desc->fnNext(d->generator);
     if (!d->current) return 0;  // If end of list
 
     unsigned ret = *(unsigned*)d->current->value; // Get shape
@@ -220,13 +468,26 @@ unsigned DemoRandomizerNext(void* data) {
     return ret;
 }
 
+void DemoRandomizerSeek(void* data, unsigned drawn) {
+    if (!data) return;
+    demo_rand_data* d = data;
+
+    d->current = d->first;
+    for (unsigned i=0; i < drawn && d->current; i++) d->current = d->current->next;
+}
+
 /**
     STATIC FUNCTIONS
 **/
-demo_list* CreateListElement(void* val) {
-    demo_list* ret = (demo_list*)malloc(sizeof(demo_list));
+/**
+    \brief Allocates a list element and its value in one block
+    \param valueSize Size of the value in bytes
+    \return Pointer to the new element, value points right after it
+*/
+demo_list* CreateListElement(size_t valueSize) {
+    demo_list* ret = (demo_list*)malloc(sizeof(demo_list) + valueSize);
     if (ret) {
-        ret->value = val;
+        ret->value = (void*)(ret+1);
         ret->next = NULL;
     }
     return ret;
@@ -236,7 +497,151 @@ void FreeList(demo_list* list) {
     while (list != NULL) {
         demo_list* rm = list;
         list = list->next;
-        free(rm->value); // Free value
-        free(rm);        // Free list element
+        free(rm); // Free list element and its value
+    }
+}
+
+void WriterPut(demo_writer* wr, unsigned value) {
+    if (wr->used == WRITER_CHUNK) WriterFlush(wr);
+    wr->chunk[wr->used++] = EncodeBigendian(value);
+}
+
+void WriterFlush(demo_writer* wr) {
+    size_t len = sizeof(unsigned)*wr->used;
+    wr->crc = CRC32Update(wr->crc, wr->chunk, len);
+    wr->written += fwrite(wr->chunk, 1, len, wr->fp);
+    wr->used = 0;
+}
+
+void StreamWord(demo_stream* stream, unsigned word) {
+    switch (stream->stage) {
+        case STAGE_SIG: {
+            if (word != DEMO_SIG) StreamFail(stream, "Not a demo");
+            stream->stage = STAGE_VERSION;
+        } break;
+        case STAGE_VERSION: {
+            if (word < 1 || word > DEMO_VER) StreamFail(stream, "Unsupported demo version");
+            stream->version = word;
+            //  Version 1 has no randomiser fields
+            stream->stage = (word == 1) ? STAGE_PIECES_COUNT : STAGE_FLAGS;
+        } break;
+        case STAGE_FLAGS: stream->flags = word; stream->stage = STAGE_RANDOMISER; break;
+        case STAGE_RANDOMISER: stream->randomiser = word; stream->stage = STAGE_RNG_VERSION; break;
+        case STAGE_RNG_VERSION: stream->rngVersion = word; stream->stage = STAGE_SEED; break;
+        case STAGE_SEED: stream->seed = word; stream->stage = STAGE_PIECES_COUNT; break;
+        case STAGE_PIECES_COUNT: {
+            stream->pieces = word;
+            stream->stage = STAGE_INSTRS_COUNT;
+        } break;
+        case STAGE_INSTRS_COUNT: {
+            stream->instrs = word;
+            StreamStartBody(stream);
+        } break;
+        case STAGE_PIECES: {
+            if (DemoAddPiece(stream->record, word) != 0) StreamFail(stream, "Out of memory");
+            if (--stream->remaining == 0) {
+                stream->remaining = stream->instrs;
+                stream->status = DEMO_STREAM_INSTRUCTIONS;
+                if (stream->instrs > 0) stream->stage = STAGE_TIME;
+                else StreamEndInstructions(stream);
+            }
+        } break;
+        case STAGE_TIME: {
+            stream->time = word;
+            stream->stage = STAGE_INSTRUCTION;
+        } break;
+        case STAGE_INSTRUCTION: {
+            //  Open-ended streams end to a marker pair
+            if (stream->instrs == DEMO_COUNT_OPEN && stream->time == DEMO_END_MARKER && word == DEMO_END_MARKER) {
+                StreamEndInstructions(stream);
+                break;
+            }
+
+            if (DemoAddInstruction(stream->record, stream->time, word) != 0) StreamFail(stream, "Out of memory");
+            stream->stage = STAGE_TIME;
+            if (stream->instrs != DEMO_COUNT_OPEN && --stream->remaining == 0) StreamEndInstructions(stream);
+        } break;
+        case STAGE_CHECKPOINTS_COUNT: {
+            stream->checkpoints = word;
+            StreamNextCheckpoint(stream);
+        } break;
+        case STAGE_CP_INSTRS: stream->cpInstrs = word; stream->stage = STAGE_CP_TIME; break;
+        case STAGE_CP_TIME: stream->cpTime = word; stream->stage = STAGE_CP_LEN; break;
+        case STAGE_CP_LEN: {
+            if (word > DEMO_CHECKPOINT_MAX_LEN) {
+                StreamFail(stream, "Invalid checkpoint");
+                break;
+            }
+            unsigned* grown = (unsigned*)realloc(stream->cpState, sizeof(unsigned)*(word+1));
+            if (!grown) {
+                StreamFail(stream, "Out of memory");
+                break;
+            }
+            stream->cpState = grown;
+            stream->cpLen = word;
+            stream->cpUsed = 0;
+            stream->stage = STAGE_CP_STATE;
+            if (word == 0) StreamWord(stream, 0); // Nothing to wait for
+        } break;
+        case STAGE_CP_STATE: {
+            if (stream->cpUsed < stream->cpLen) stream->cpState[stream->cpUsed++] = word;
+            if (stream->cpUsed < stream->cpLen) break;
+
+            if (DemoAddCheckpoint(stream->record, stream->cpInstrs, stream->cpTime, stream->cpState, stream->cpLen) != 0) {
+                StreamFail(stream, "Invalid checkpoint");
+                break;
+            }
+            stream->checkpoints--;
+            StreamNextCheckpoint(stream);
+        } break;
+        default: break;
     }
 }
+
+void StreamStartBody(demo_stream* stream) {
+    //  Pieces can't be regenerated with other generator versions
+    if (stream->flags & DEMO_FLAG_SEEDED) {
+        if (stream->rngVersion != RANDOMISER_RNG_VERSION) {
+            StreamFail(stream, "Unsupported randomiser version");
+            return;
+        }
+        if (DemoSetSeed(stream->record, stream->randomiser, stream->seed) != 0 || stream->pieces > 0) {
+            StreamFail(stream, "Invalid randomiser");
+            return;
+        }
+    } else if (stream->instrs == DEMO_COUNT_OPEN && stream->version < 2) {
+        StreamFail(stream, "Unsupported demo version");
+        return;
+    }
+    if ((stream->flags & DEMO_FLAG_CLIP) && !(stream->flags & DEMO_FLAG_SEEDED)) {
+        StreamFail(stream, "Clip without a seed");
+        return;
+    }
+    stream->record->flags |= stream->flags & (DEMO_FLAG_TIMED_GRAVITY | DEMO_FLAG_CLIP);
+
+    if (stream->pieces > 0) {
+        stream->remaining = stream->pieces;
+        stream->stage = STAGE_PIECES;
+        return;
+    }
+
+    //  No pieces stored, instructions follow
+    stream->remaining = stream->instrs;
+    stream->status = DEMO_STREAM_INSTRUCTIONS;
+    if (stream->instrs > 0) stream->stage = STAGE_TIME;
+    else StreamEndInstructions(stream);
+}
+
+void StreamEndInstructions(demo_stream* stream) {
+    stream->stage = (stream->version >= 3) ? STAGE_CHECKPOINTS_COUNT : STAGE_CRC;
+}
+
+void StreamNextCheckpoint(demo_stream* stream) {
+    stream->stage = stream->checkpoints > 0 ? STAGE_CP_INSTRS : STAGE_CRC;
+}
+
+void StreamFail(demo_stream* stream, const char* error) {
+    if (stream->status == DEMO_STREAM_ERROR) return; // Keep the first error
+    stream->status = DEMO_STREAM_ERROR;
+    stream->error = error;
+}
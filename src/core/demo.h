@@ -1,3 +1,18 @@
+#ifndef _DEMO_H_
+#define _DEMO_H_
+
+#include "game_randomisers.h"
+
+#include <stddef.h> /* size_t */
+
+#define DEMO_FLAG_SEEDED 0x1 /* Pieces are generated from the seed, none stored */
+#define DEMO_FLAG_TIMED_GRAVITY 0x2 /* Gravity steps are derived from time, only the last one is stored */
+#define DEMO_FLAG_CLIP 0x4 /* Instant replay, playback starts from the first checkpoint */
+#define DEMO_COUNT_OPEN 0xFFFFFFFF /* Instruction count of streams, ends to DEMO_END_MARKER */
+#define DEMO_END_MARKER 0xFFFFFFFF
+#define DEMO_CHECKPOINT_PIECES 100 /* Pieces between checkpoints of recorded games */
+#define DEMO_CHECKPOINT_MAX_LEN 0x10000 /* Longest accepted checkpoint state in words */
+
 typedef struct {
     unsigned time; /**< Time from start in milliseconds when given */
     unsigned instruction; /**< The instruction */
@@ -8,6 +23,20 @@ typedef struct List {
     struct List* next;  /**< Pointer to the next list element */
 } demo_list;
 
+/**
+    \brief Game state saved while recording
+
+    Playback can start from a checkpoint instead of the first instruction,
+    so segments between checkpoints can be verified independently.
+*/
+typedef struct {
+    unsigned instrsDone;    /**< Count of instructions processed before the checkpoint */
+    unsigned time;          /**< Time of the last processed instruction */
+    demo_list* position;    /**< Last processed instruction, NULL before the first */
+    unsigned len;           /**< Count of state words */
+    unsigned* state;        /**< Words written by GameSaveState(), allocated after this struct */
+} demo_checkpoint;
+
 typedef struct {
     demo_list* instrsFirst; /**< First instruction int the list */
     demo_list* piecesFirst; /**< First piece in the list */
@@ -16,6 +45,15 @@ typedef struct {
 
     unsigned piecesCount; /**< Count of pieces*/
     unsigned instrsCount; /**< Count of instructions*/
+
+    unsigned flags;         /**< DEMO_FLAG_* */
+    unsigned randomiser;    /**< Randomiser type of a seed-based demo */
+    unsigned rngVersion;    /**< RANDOMISER_RNG_VERSION used in recording */
+    unsigned seed;          /**< Seed of the randomiser */
+
+    demo_list* checkpointsFirst;    /**< First checkpoint, ordered by instrsDone */
+    demo_list* checkpointsCurrent;  /**< Last checkpoint in the list */
+    unsigned checkpointsCount;      /**< Count of checkpoints */
 } demo;
 
 /**
@@ -38,13 +76,70 @@ extern void DemoFree(demo* ptr);
     \return 0 on success
 */
 extern int DemoAddInstruction(demo* ptr, unsigned time, unsigned instruction);
+/**
+    \brief Reads the fields of an instruction
+
+    For tools which load the core as a library and can't rely on its struct layouts.
+    \param ptr Pointer to the instruction
+    \param outTime Time of the instruction, can be NULL
+    \param outInstruction The instruction, can be NULL
+*/
+extern void DemoInstructionInfo(demo_instruction* ptr, unsigned* outTime, unsigned* outInstruction);
+/**
+    \brief Inserts an instruction in the middle of the list
+    \param ptr Pointer to the demo instance
+    \param after Instruction after which it is inserted, NULL for the first
+    \param time Time from start in milliseconds
+    \param instruction Instruction to add
+    \return 0 on success
+
+    \note Caller keeps the times in order and drops invalidated checkpoints
+*/
+extern int DemoInsertInstruction(demo* ptr, demo_list* after, unsigned time, unsigned instruction);
+/**
+    \brief Removes an instruction from the list
+    \param ptr Pointer to the demo instance
+    \param after Instruction before the removed one, NULL removes the first
+    \return 0 on success, -3 if there is no instruction to remove
+*/
+extern int DemoRemoveInstruction(demo* ptr, demo_list* after);
+/**
+    \brief Removes checkpoints which an edit of the instructions invalidates
+    \param ptr Pointer to the demo instance
+    \param instrsDone Checkpoints with at least this many instructions processed are removed
+
+    \note Starting checkpoint of a clip is kept
+*/
+extern void DemoDropCheckpoints(demo* ptr, unsigned instrsDone);
 /**
     \brief Adds a piece to the list
     \param ptr Pointer to the demo instance
     \param shape Shape of the piece
     \return 0 on success
+
+    \note Pieces of seed-based demos are not stored
 */
 extern int DemoAddPiece(demo* ptr, unsigned shape);
+/**
+    \brief Adds a checkpoint to the list
+    \param ptr Pointer to the demo instance
+    \param instrsDone Count of instructions processed before the state
+    \param time Time of the last processed instruction
+    \param state Game state from GameSaveState(), copied
+    \param len Count of state words
+    \return 0 on success, -3 if instrsDone is before the previous checkpoint or after the last instruction
+*/
+extern int DemoAddCheckpoint(demo* ptr, unsigned instrsDone, unsigned time, const unsigned* state, unsigned len);
+/**
+    \brief Makes demo seed-based, pieces are regenerated in playback
+    \param ptr Pointer to the demo instance
+    \param randomiser Randomiser type used by the game
+    \param seed Seed of the randomiser
+    \return 0 on success, -2 if the randomiser is invalid
+
+    \note Call before any pieces are added
+*/
+extern int DemoSetSeed(demo* ptr, randomiser_type randomiser, unsigned seed);
 
 /**
     \brief Writes demo instance to a file
@@ -56,26 +151,110 @@ extern unsigned DemoSave(demo* ptr, const char* path);
 /**
     \brief Reads file and creates demo instance
     \param path Path to file to read
-    \return If success new demo instance, NULL on error
+    \return If success new demo instance, NULL on error or incomplete file
 
     \note Use DemoFree() to delete instance
 */
 extern demo* DemoRead(const char* path);
 
-typedef struct {demo_list* current;} demo_rand_data;
+/**
+    \brief Status of a demo stream
+*/
+typedef enum {
+    DEMO_STREAM_ERROR = -1,     /**< Invalid data, see error */
+    DEMO_STREAM_HEADER,         /**< Header or pieces still incomplete */
+    DEMO_STREAM_INSTRUCTIONS,   /**< Playback can start, instructions are being added */
+    DEMO_STREAM_DONE            /**< Complete demo with a valid checksum */
+} demo_stream_status;
+
+/**
+    \brief Incremental decoder of demo files
+
+    Data is fed in pieces of any size. Pieces and instructions are added to
+    the record as soon as they are decoded, so playback can start before the
+    whole demo has arrived.
+*/
+typedef struct {
+    demo* record;           /**< Demo being decoded, owned by the stream */
+    int status;             /**< demo_stream_status */
+    const char* error;      /**< Reason of DEMO_STREAM_ERROR */
+
+    unsigned stage;         /**< Field being decoded */
+    unsigned remaining;     /**< Words left of pieces or instructions */
+    unsigned word;          /**< Partially read word */
+    unsigned wordLen;       /**< Bytes in the partial word */
+    unsigned crc;           /**< Checksum of the data so far */
+    unsigned time;          /**< Time of the instruction being decoded */
+
+    unsigned version, flags, randomiser, rngVersion, seed;
+    unsigned pieces;        /**< Count of stored pieces */
+    unsigned instrs;        /**< Count of instructions or DEMO_COUNT_OPEN */
+
+    unsigned checkpoints;   /**< Checkpoints left to decode */
+    unsigned cpInstrs, cpTime, cpLen, cpUsed; /**< Checkpoint being decoded */
+    unsigned* cpState;      /**< State words of the checkpoint */
+} demo_stream;
+
+/**
+    \brief Creates a new demo decoder
+    \return Pointer to the decoder, NULL on error
+
+    \note Use DemoStreamFree() to delete instance
+*/
+extern demo_stream* DemoStreamCreate(void);
+
+/**
+    \brief Frees decoder and the demo it owns
+    \param stream Pointer to the decoder
+*/
+extern void DemoStreamFree(demo_stream* stream);
+
+/**
+    \brief Decodes more data
+    \param stream Pointer to the decoder
+    \param data Bytes read from the demo
+    \param len Count of bytes
+    \return Status of the stream, demo_stream_status
+*/
+extern int DemoStreamFeed(demo_stream* stream, const void* data, size_t len);
+
+/**
+    \brief Takes ownership of the decoded demo
+    \param stream Pointer to the decoder
+    \return The demo, free with DemoFree()
+    \note Stream can't decode more data after this
+*/
+extern demo* DemoStreamDetach(demo_stream* stream);
+
+typedef struct {
+    demo_list* first;   /**< First stored piece */
+    demo_list* current; /**< Next stored piece */
+    const randomiser_desc* desc; /**< Randomiser of a seed-based demo, NULL for stored pieces */
+    void* generator; /**< Data of the randomiser, allocated after this struct */
+} demo_rand_data;
 
 /**
     \brief Initializes tetromino queue for the demo playback
     \param demo Pointer to the demo instance
-    \return The shape of the first tetromino
-    \note Doesn't copy the demo struct or free given data
+    \return Pointer to the queue, free with free()
+    \note Doesn't copy the demo struct or free given data. Seed-based demos
+    regenerate the pieces with the recorded randomiser.
 */
 extern void* DemoRandomizerInit(void* demo);
 
 /**
     \brief Get the next tetromino recorded in demo
-    \param Pointer to the list of tetrominos
+    \param Pointer to the queue
     \return The shape of the next tetromino
-    \note Modifies piecesCurrent pointer
 */
 extern unsigned DemoRandomizerNext(void* data);
+
+/**
+    \brief Moves the queue of stored pieces
+    \param data Pointer to the queue
+    \param drawn Count of pieces drawn from the start
+    \note Seed-based queues are restored by copying the generator instead
+*/
+extern void DemoRandomizerSeek(void* data, unsigned drawn);
+
+#endif //_DEMO_H_
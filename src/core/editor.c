@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <string.h> /* memset() */
+#include <limits.h> /* UINT_MAX */
+
+#include "editor.h"
+
+static void CacheSnapshot(demo_editor* ed); // Saves the cursor if it is at a snapshot interval
+static void Invalidate(demo_editor* ed); // Drops snapshots after the cursor before an edit
+static void TimeLimits(demo_editor* ed, demo_list* next, unsigned* lo, unsigned* hi); // Times allowed before next
+
+demo_editor* EditorCreate(demo* record, unsigned width, unsigned height) {
+    if (!record) return NULL;
+
+    demo_editor* ret = (demo_editor*)calloc(1, sizeof(demo_editor));
+    if (!ret) return NULL;
+
+    ret->record = record;
+    ret->cursor = PlaybackCreate(record, width, height);
+    ret->result = PlaybackCreate(record, width, height);
+    if (!ret->cursor || !ret->result) {
+        EditorFree(ret);
+        return NULL;
+    }
+    return ret;
+}
+
+void EditorFree(demo_editor* ed) {
+    if (!ed) return;
+
+    for (unsigned i=0; i < ed->cacheSize; i++) free(ed->cache[i]);
+    free(ed->cache);
+    PlaybackFree(ed->cursor);
+    PlaybackFree(ed->result);
+    free(ed);
+}
+
+int EditorSeek(demo_editor* ed, unsigned instrsDone) {
+    if (!ed) return -1;
+    demo_playback* pb = ed->cursor;
+    ed->resimulated = 0;
+
+    //  Nearest snapshot before the position, unless the cursor is closer
+    unsigned slot = instrsDone / EDITOR_SNAPSHOT_INTERVAL;
+    if (slot >= ed->cacheSize) slot = ed->cacheSize ? ed->cacheSize-1 : 0;
+    while (slot > 0 && !ed->cache[slot]) slot--;
+
+    unsigned from = slot * EDITOR_SNAPSHOT_INTERVAL;
+    if (pb->instrsDone > instrsDone || pb->instrsDone < from) {
+        int err = slot > 0 ? PlaybackLoadCheckpoint(pb, ed->cache[slot]) : PlaybackRestart(pb);
+        if (err != 0) return err;
+    }
+
+    while (pb->instrsDone < instrsDone) {
+        if (!PlaybackStep(pb)) return 1; // end of demo
+        ed->resimulated++;
+        CacheSnapshot(ed);
+    }
+    return 0;
+}
+
+demo_instruction* EditorNext(demo_editor* ed) {
+    if (!ed) return NULL;
+    return PlaybackPeek(ed->cursor);
+}
+
+int EditorInsert(demo_editor* ed, unsigned time, unsigned instruction) {
+    if (!ed) return -1;
+
+    demo_list* after = ed->cursor->position;
+    demo_list* next = after ? after->next : ed->record->instrsFirst;
+    unsigned lo, hi;
+    TimeLimits(ed, next, &lo, &hi);
+    if (time < lo) time = lo;
+    if (time > hi) time = hi;
+
+    Invalidate(ed);
+    return DemoInsertInstruction(ed->record, after, time, instruction);
+}
+
+int EditorDelete(demo_editor* ed) {
+    if (!ed) return -1;
+    if (!EditorNext(ed)) return -3;
+
+    Invalidate(ed);
+    return DemoRemoveInstruction(ed->record, ed->cursor->position);
+}
+
+int EditorRetime(demo_editor* ed, int delta) {
+    if (!ed) return -1;
+
+    demo_list* after = ed->cursor->position;
+    demo_list* next = after ? after->next : ed->record->instrsFirst;
+    if (!next) return -3;
+
+    //  Instructions keep their order
+    unsigned lo, hi;
+    TimeLimits(ed, next->next, &lo, &hi);
+    demo_instruction* ins = (demo_instruction*)next->value;
+    long long time = (long long)ins->time + delta;
+    if (time < lo) time = lo;
+    if (time > hi) time = hi;
+
+    Invalidate(ed);
+    ins->time = (unsigned)time;
+    return 0;
+}
+
+demo_playback* EditorResult(demo_editor* ed) {
+    if (!ed) return NULL;
+    demo_playback* pb = ed->cursor;
+
+    //  Continue from the cursor instead of the beginning
+    unsigned len = GameSaveState(pb->gme, NULL, 0);
+    unsigned* state = (unsigned*)malloc(sizeof(unsigned)*len);
+    if (!state) return NULL;
+    GameSaveState(pb->gme, state, len);
+
+    demo_checkpoint cp = {
+        .instrsDone = pb->instrsDone,
+        .time = pb->time,
+        .position = pb->position,
+        .len = len,
+        .state = state
+    };
+    int err = PlaybackLoadCheckpoint(ed->result, &cp);
+    free(state);
+    if (err != 0) return NULL;
+
+    ed->resimulated = PlaybackSeekEnd(ed->result);
+    return ed->result;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Caches the game at the cursor every EDITOR_SNAPSHOT_INTERVAL instructions
+    \param ed Pointer to the editor
+*/
+void CacheSnapshot(demo_editor* ed) {
+    demo_playback* pb = ed->cursor;
+    if (pb->instrsDone % EDITOR_SNAPSHOT_INTERVAL != 0) return;
+
+    unsigned slot = pb->instrsDone / EDITOR_SNAPSHOT_INTERVAL;
+    if (slot >= ed->cacheSize) {
+        unsigned newSize = ed->cacheSize ? ed->cacheSize*2 : 64;
+        while (newSize <= slot) newSize *= 2;
+        demo_checkpoint** grown = (demo_checkpoint**)realloc(ed->cache, sizeof(demo_checkpoint*)*newSize);
+        if (!grown) return;
+        memset(grown + ed->cacheSize, 0, sizeof(demo_checkpoint*)*(newSize - ed->cacheSize));
+        ed->cache = grown;
+        ed->cacheSize = newSize;
+    }
+    if (ed->cache[slot]) return;
+
+    //  State is allocated in the same block
+    unsigned len = GameSaveState(pb->gme, NULL, 0);
+    demo_checkpoint* cp = (demo_checkpoint*)malloc(sizeof(demo_checkpoint) + sizeof(unsigned)*len);
+    if (!cp) return;
+    cp->instrsDone = pb->instrsDone;
+    cp->time = pb->time;
+    cp->position = pb->position;
+    cp->len = len;
+    cp->state = (unsigned*)(cp+1);
+    GameSaveState(pb->gme, cp->state, len);
+    ed->cache[slot] = cp;
+}
+
+/**
+    \brief Drops everything which an edit after the cursor makes invalid
+
+    Games before the next instruction don't change, so snapshots up to the
+    cursor stay. Checkpoints of the demo at the cursor may be after the
+    new time of the next instruction, so they are dropped too.
+    \param ed Pointer to the editor
+*/
+void Invalidate(demo_editor* ed) {
+    unsigned done = ed->cursor->instrsDone;
+    for (unsigned i = done/EDITOR_SNAPSHOT_INTERVAL + 1; i < ed->cacheSize; i++) {
+        free(ed->cache[i]);
+        ed->cache[i] = NULL;
+    }
+    DemoDropCheckpoints(ed->record, done);
+}
+
+/**
+    \brief Get times allowed for the instruction after the cursor
+    \param ed Pointer to the editor
+    \param next Instruction which must stay after it, NULL at the end
+    \param lo Time of the cursor
+    \param hi Time of next
+*/
+void TimeLimits(demo_editor* ed, demo_list* next, unsigned* lo, unsigned* hi) {
+    *lo = ed->cursor->time;
+    *hi = next ? ((demo_instruction*)next->value)->time : UINT_MAX;
+    if (*hi < *lo) *hi = *lo;
+}
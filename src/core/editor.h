@@ -0,0 +1,90 @@
+#ifndef _EDITOR_H_
+#define _EDITOR_H_
+
+#include "playback.h"
+
+#define EDITOR_SNAPSHOT_INTERVAL 64 /* Instructions between cached snapshots */
+
+/**
+    \brief Edits instructions of a demo and re-simulates the result
+
+    The cursor is a playback which has processed a given count of
+    instructions. Edits change the next instruction after the cursor, so
+    the game at the cursor stays the same. Snapshots of the game are
+    cached while seeking, and seeking backwards or after an edit starts
+    from the nearest valid snapshot instead of the beginning.
+*/
+typedef struct {
+    demo* record;           /**< Demo being edited, not owned by the editor */
+    demo_playback* cursor;  /**< Game after the instructions before the cursor */
+    demo_playback* result;  /**< Game at the end of demo, updated by EditorResult() */
+
+    demo_checkpoint** cache; /**< Snapshot after i*EDITOR_SNAPSHOT_INTERVAL instructions, NULL if not cached */
+    unsigned cacheSize;     /**< Count of slots in the cache */
+    unsigned resimulated;   /**< Instructions processed by the last seek or result */
+} demo_editor;
+
+/**
+    \brief Creates an editor with the cursor at the beginning of the demo
+    \param record Pointer to the demo instance
+    \param width The width of the game area
+    \param height The height of the game area
+    \return Pointer to the editor, NULL on error
+
+    \note Use EditorFree() to delete instance. Demo isn't freed with it.
+*/
+extern demo_editor* EditorCreate(demo* record, unsigned width, unsigned height);
+
+/**
+    \brief Frees editor, its playbacks and snapshots
+    \param ed Pointer to the editor
+*/
+extern void EditorFree(demo_editor* ed);
+
+/**
+    \brief Moves the cursor
+    \param ed Pointer to the editor
+    \param instrsDone Count of instructions processed before the cursor
+    \return 0 on success, 1 if demo ended before the position
+*/
+extern int EditorSeek(demo_editor* ed, unsigned instrsDone);
+
+/**
+    \brief Get the instruction after the cursor
+    \param ed Pointer to the editor
+    \return Pointer to the instruction, NULL at the end of demo
+*/
+extern demo_instruction* EditorNext(demo_editor* ed);
+
+/**
+    \brief Inserts an instruction after the cursor
+    \param ed Pointer to the editor
+    \param time Time of the instruction, limited between its neighbours
+    \param instruction The instruction
+    \return 0 on success
+*/
+extern int EditorInsert(demo_editor* ed, unsigned time, unsigned instruction);
+
+/**
+    \brief Deletes the instruction after the cursor
+    \param ed Pointer to the editor
+    \return 0 on success, -3 at the end of demo
+*/
+extern int EditorDelete(demo_editor* ed);
+
+/**
+    \brief Changes the time of the instruction after the cursor
+    \param ed Pointer to the editor
+    \param delta Milliseconds added, the time is limited between its neighbours
+    \return 0 on success, -3 at the end of demo
+*/
+extern int EditorRetime(demo_editor* ed, int delta);
+
+/**
+    \brief Plays the demo from the cursor to the end
+    \param ed Pointer to the editor
+    \return Playback at the end of demo, owned by the editor
+*/
+extern demo_playback* EditorResult(demo_editor* ed);
+
+#endif //_EDITOR_H_
@@ -5,6 +5,7 @@
     \param input Array of bytes
     \param len Lenght of array
     \return A 32-bit checksum
+    \see CRC32Update() in crc32.h for checksums of streamed data
 */
 extern unsigned CalcCRC32(char* input, unsigned len);
 
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h> /* memcpy() */
 
 #include "game.h"
 
@@ -7,6 +8,31 @@
 #define MAX_DELAY 1200
 #define MIN_DELAY 150
 
+/**
+    \brief Words of a state written by GameSaveState()
+
+    Map cells follow the fixed fields, 8 cells per word with 4 bits each,
+    symbol+1 or 0 for empty. Generator words are last.
+*/
+enum {
+    STATE_WIDTH,
+    STATE_HEIGHT,
+    STATE_STATUS,
+    STATE_SCORE,
+    STATE_ROWS,
+    STATE_LEVEL,
+    STATE_COMBO,
+    STATE_ROWS_TO_NEXT,
+    STATE_STEP,
+    STATE_NEXT_UPDATE,  /**< Relative to the start of the game */
+    STATE_COUNT_TETROMINO,
+    STATE_COUNT_CLEARS = STATE_COUNT_TETROMINO + SHAPE_MAX,
+    STATE_ACTIVE = STATE_COUNT_CLEARS + 4, /**< Shape, x, y and x, y of each block */
+    STATE_NEXT = STATE_ACTIVE + 11,
+    STATE_GENERATOR_LEN,
+    STATE_MAP
+};
+
 static bool SetRandomiser(game* ptr, randomiser_type new_randomiser);
 
 static bool ActiveCollided(game* ptr); // Test if collided with borders or other blocks
@@ -22,7 +48,15 @@ static int TetrominoRotate(game* ptr);
 static int TetrominoRotateKick(game* ptr);
 static void TetrominoFree(tetromino* ptr);
 static int CalcGhost(game* ptr);
-static void HardDrop(game* ptr);
+static void HardDrop(game* ptr, unsigned time);
+static int GravityStep(game* ptr, unsigned time); // Moves active down once, time is when it happens
+static int GravityUntil(game* ptr, unsigned time); // Steps which are due before or at the time
+
+static unsigned HashWord(unsigned hash, unsigned word); // One step of FNV-1a
+static void* StateGenerator(game* ptr, unsigned* outWords); // Randomiser data saved in states
+static void RecordCheckpoint(game* ptr, unsigned time); // Adds state to the demo every DEMO_CHECKPOINT_PIECES pieces
+static void RecordInstruction(game* ptr, unsigned time, unsigned instruction); // Adds to the demo and the replay ring
+static void RecordSnapshot(game* ptr, unsigned time); // Writes state to the replay ring
 
 game* GameInitialize(unsigned width, unsigned height, randomiser_type randomiser, unsigned (*fnTime)()) {
     if (width == 0 || height == 0 || fnTime == NULL) return NULL;
@@ -41,6 +75,8 @@ game* GameInitialize(unsigned width, unsigned height, randomiser_type randomiser
     ptrGame->info.fnRandomiserNext = NULL;
     ptrGame->fnMillis = fnTime;
     ptrGame->demorecord = NULL;
+    ptrGame->recordedGravity = false;
+    ptrGame->replay = NULL;
 
     //  Allocate memory for blockmask and initialize it 0
     ptrGame->map.blockMask = (block**)calloc(width*height, sizeof(block*) * width*height);
@@ -68,9 +104,17 @@ game* GameInitDemo(unsigned width, unsigned height, unsigned (*fnTime)(), demo*
     game_info* info = &ret->info;
 
     //  Change randomiser set by initializer to demo's tetromino queue
+    free(info->randomiser_data);
     info->fnRandomiserInit = DemoRandomizerInit;
     info->fnRandomiserNext = DemoRandomizerNext;
     info->randomiser_data = DemoRandomizerInit(record);
+    if (!info->randomiser_data) {
+        GameFree(ret);
+        return NULL;
+    }
+    info->seed = record->seed;
+    if (record->flags & DEMO_FLAG_SEEDED) info->randomiser = record->randomiser;
+    ret->recordedGravity = !(record->flags & DEMO_FLAG_TIMED_GRAVITY);
 
     //  Reset statistics and free already generated tetrominos
     info->countTetromino[ret->active->shape] = 0;
@@ -84,6 +128,11 @@ game* GameInitDemo(unsigned width, unsigned height, unsigned (*fnTime)(), demo*
 
     shape = DemoRandomizerNext(info->randomiser_data); // next
     info->next = TetrominoNew(shape, ret->map.width/2);
+    CalcGhost(ret);
+
+    //  Playback doesn't need to record the demo again
+    DemoFree(ret->demorecord);
+    ret->demorecord = NULL;
 
     return ret;
 }
@@ -94,90 +143,41 @@ int GameUpdate(game* ptr) {
     else if (ptr->info.status & GAME_STATUS_PAUSE) return 0;
 
     unsigned milliseconds = ptr->fnMillis();
-    int ret = 0;
-
-    //  Check if the timer has expired.
-    if (ptr->nextUpdate - milliseconds <= ptr->step) return ret;
-
-    //  Record Update to demo recording
-    unsigned delta = ptr->info.timeStarted + ptr->info.timePaused;
-    //  Add input to the demo record
-    DemoAddInstruction(ptr->demorecord, ptr->fnMillis() - delta, (unsigned int)INPUT_UPDATE);
-
-    //  Check if active tetromino hit bottom or tetromino below.
-    if (TetrominoMove(ptr, INPUT_DOWN)) {
-        int origoy = ptr->active->y;
-        FreezeActive(ptr);
-
-        //  Check rows, there can be blocks above origo
-        if (origoy < 2) {
-            origoy = 0;
-        } else {
-            origoy -= 2;
-        }
-
-        ret = ClearFilledRows(ptr, origoy, 5);
-
-        game_info* s = &ptr->info;
-        if (ret > 0) {
-            s->score += ret*50*(s->level+1) + (s->combo*10*(s->level+1));
-            s->combo++;
-
-            //  Add rows to counter and to level progress
-            s->rows += ret;
-            s->rowsToNextLevel -= ret;
-            bool levels = false;
-            while (s->rowsToNextLevel <= 0) {
-                s->level += 1;
-                s->rowsToNextLevel += (s->level)*3;
-                levels = true;
-            }
-
-            //  If level has changed calculate new step duration
-            if (levels) {
-                unsigned lvl = s->level;
-                if (lvl > MIN_DELAY_LEVEL) lvl = MIN_DELAY_LEVEL;
-                ptr->step = (MAX_DELAY-MIN_DELAY)*(MIN_DELAY_LEVEL-lvl)/MIN_DELAY_LEVEL + MIN_DELAY;
-            }
-        } else {
-            s->combo = 0;
-        }
+    ptr->timeLast = milliseconds;
 
-        //  Assign next to active tetromino
-        ptr->active = s->next;
-        s->countTetromino[ptr->active->shape] += 1;
-        //  Create a new next tetromino
-        tetromino_shape shape = s->fnRandomiserNext(s->randomiser_data);
-        s->next = TetrominoNew(shape, ptr->map.width/2);
-        //  Add it to the demo record
-        DemoAddPiece(ptr->demorecord, s->next->shape);
-
-        //  Calculate ghost for the new active tetromino
-        CalcGhost(ptr);
-
-        if (ActiveCollided(ptr)) {
-            s->status |= GAME_STATUS_END;
-            return -2; //   New tetromino already collided with something -> game over
-        }
+    //  Old demos force every step with an instruction
+    if (ptr->recordedGravity) {
+        //  Check if the timer has expired.
+        if (ptr->nextUpdate - milliseconds <= ptr->step) return 0;
+        return GravityStep(ptr, milliseconds);
     }
-
-    //  Set time of next update
-    ptr->nextUpdate = milliseconds + ptr->step;
-
-    return ret;
+    return GravityUntil(ptr, milliseconds);
 }
 
 int GameProcessInput(game* ptr, player_input input) {
+    if (!ptr) return -1;
+    return GameProcessInputAt(ptr, input, ptr->fnMillis());
+}
+
+int GameProcessInputAt(game* ptr, player_input input, unsigned time) {
     if (!ptr) return -1;
     if (ptr->info.status & (GAME_STATUS_END | GAME_STATUS_PAUSE)) return -2;
 
     tetromino* act = ptr->active;
     if (!act) return 0;
 
-    // Make sure demo time starts from 0, and demo has no pauses
-    unsigned delta = ptr->info.timeStarted + ptr->info.timePaused;
+    //  Can't happen before what has been run already, or in the future
+    unsigned now = ptr->fnMillis();
+    if ((int)(time - ptr->timeLast) < 0) time = ptr->timeLast;
+    if ((int)(now - time) < 0) time = now;
+    ptr->timeLast = time;
+
+    //  Steps due before the input happen first, so playback sees the same order
+    unsigned milliseconds = time;
+    if (!ptr->recordedGravity && GravityUntil(ptr, milliseconds) == -2) return -2;
+
     //  Add input to the demo record
-    DemoAddInstruction(ptr->demorecord, ptr->fnMillis() - delta, (unsigned int)input);
+    RecordInstruction(ptr, milliseconds, (unsigned int)input);
 
     int ret = 0;
     switch (input) {
@@ -185,11 +185,14 @@ int GameProcessInput(game* ptr, player_input input) {
         case INPUT_RIGHT: {
             ret = TetrominoMove(ptr, input);
         } break;
-        case INPUT_DOWN: ptr->nextUpdate = 0; break;
+        case INPUT_DOWN: {
+            if (ptr->recordedGravity) ptr->nextUpdate = 0;
+            else GravityStep(ptr, milliseconds);
+        } break;
         case INPUT_ROTATE: {
             ret = TetrominoRotateKick(ptr);
         } break;
-        case INPUT_SET: HardDrop(ptr); break;
+        case INPUT_SET: HardDrop(ptr, milliseconds); break;
         default: break;
     }
     return ret;
@@ -219,6 +222,7 @@ void GameFree(game* ptr) {
     //  Free recorded demo
     DemoFree(ptr->demorecord);
     ptr->demorecord = NULL;
+    ReplayFree(ptr->replay);
 
     //  Free game struct
     free(ptr);
@@ -246,17 +250,25 @@ void GameReset(game* ptr) {
     s->timePaused = 0;
     s->rowsToNextLevel  = 2;
     s->timeStarted = ptr->fnMillis();
+    ptr->timeLast = s->timeStarted;
 
     for (unsigned i=0;i<SHAPE_MAX;i++) s->countTetromino[i] = 0;
+    for (unsigned i=0;i<4;i++) s->countClears[i] = 0;
 
     //  Update timer
     ptr->step = MAX_DELAY;
     ptr->nextUpdate = ptr->fnMillis() + ptr->step;
 
-    //  Demo record init
+    //  New seed for every game, rand() has at least 15 random bits
+    s->seed = ((unsigned)rand() << 16) ^ (unsigned)rand();
+    RandomiserSeed(s->randomiser_data, s->seed);
+
+    //  Demo record init, the seed replaces stored pieces when possible
     DemoFree(ptr->demorecord);
     ptr->demorecord = NULL;
     ptr->demorecord = DemoCreateInstance();
+    DemoSetSeed(ptr->demorecord, s->randomiser, s->seed);
+    if (ptr->demorecord) ptr->demorecord->flags |= DEMO_FLAG_TIMED_GRAVITY;
 
     // Free active tetromino
     if (ptr->active) TetrominoFree(ptr->active);
@@ -280,6 +292,59 @@ void GameReset(game* ptr) {
 
     //  Calculate ghost
     CalcGhost(ptr);
+
+    //  Instant replays of the new game start from here
+    if (ptr->replay) {
+        ReplayReset(ptr->replay, ptr->demorecord);
+        RecordSnapshot(ptr, ptr->fnMillis());
+    }
+}
+
+int GameEnableReplay(game* ptr, unsigned seconds) {
+    if (!ptr) return -1;
+
+    ReplayFree(ptr->replay);
+    ptr->replay = NULL;
+    if (seconds == 0) return 0;
+    if (!ptr->demorecord) return -2;
+
+    ptr->replay = ReplayCreate(seconds, GameSaveState(ptr, NULL, 0));
+    if (!ptr->replay) return -2;
+
+    //  Clips can start from the current state until the next tetromino
+    ReplayReset(ptr->replay, ptr->demorecord);
+    RecordSnapshot(ptr, ptr->fnMillis());
+    return 0;
+}
+
+demo* GameReplayClip(game* ptr) {
+    if (!ptr) return NULL;
+
+    game_info* s = &ptr->info;
+    unsigned delta = s->timeStarted + s->timePaused;
+    unsigned now = ptr->fnMillis() - delta;
+    demo* clip = ReplayClip(ptr->replay, now);
+    if (!clip) return NULL;
+
+    //  Gravity runs until now, nothing moves during pause or after the end
+    if (!(s->status & (GAME_STATUS_END | GAME_STATUS_PAUSE))) {
+        unsigned last = 0;
+        if (clip->instrsCurrent) last = ((demo_instruction*)clip->instrsCurrent->value)->time;
+        else if (clip->checkpointsFirst) last = ((demo_checkpoint*)clip->checkpointsFirst->value)->time;
+        if (now > last && DemoAddInstruction(clip, now, (unsigned int)INPUT_UPDATE) != 0) {
+            DemoFree(clip);
+            return NULL;
+        }
+    }
+    return clip;
+}
+
+demo* GameDetachDemo(game* ptr) {
+    if (!ptr) return NULL;
+
+    demo* ret = ptr->demorecord;
+    ptr->demorecord = NULL;
+    return ret;
 }
 
 unsigned GameGetTime(game* ptr) {
@@ -302,8 +367,9 @@ unsigned GameTogglePause(game* ptr) {
         unsigned pauseDelta = ptr->fnMillis() - pauseStart;
         s->timePaused += pauseDelta;
 
-        //  Correct the time of next update
+        //  Correct the time of next update, inputs from the pause happen now
         ptr->nextUpdate += pauseDelta;
+        ptr->timeLast = ptr->fnMillis();
     } else if (!(s->status & GAME_STATUS_END)) {
         //  Pause game
         s->status |= GAME_STATUS_PAUSE;
@@ -314,6 +380,208 @@ unsigned GameTogglePause(game* ptr) {
     return ret;
 }
 
+void GameSummary(game* ptr, unsigned* outScore, unsigned* outRows, unsigned* outLevel) {
+    if (outScore) *outScore = ptr ? ptr->info.score : 0;
+    if (outRows) *outRows = ptr ? ptr->info.rows : 0;
+    if (outLevel) *outLevel = ptr ? ptr->info.level : 0;
+}
+
+unsigned GameHashState(game* ptr) {
+    if (ptr == NULL) return 0;
+
+    //  FNV-1a over 32-bit words
+    unsigned hash = 2166136261u;
+
+    unsigned len = ptr->map.width * ptr->map.height;
+    for (unsigned i = 0; i < len; i++) {
+        block* b = ptr->map.blockMask[i];
+        hash = HashWord(hash, b ? b->symbol+1 : 0);
+    }
+
+    tetromino* t = ptr->active;
+    if (t) {
+        hash = HashWord(hash, t->shape);
+        hash = HashWord(hash, t->x);
+        hash = HashWord(hash, t->y);
+        for (unsigned i = 0; i < 4; i++) {
+            hash = HashWord(hash, t->blocks[i]->x);
+            hash = HashWord(hash, t->blocks[i]->y);
+        }
+    }
+    if (ptr->info.next) hash = HashWord(hash, ptr->info.next->shape);
+
+    game_info* s = &ptr->info;
+    hash = HashWord(hash, s->status & GAME_STATUS_END);
+    hash = HashWord(hash, s->score);
+    hash = HashWord(hash, s->rows);
+    hash = HashWord(hash, s->level);
+    hash = HashWord(hash, s->combo);
+    hash = HashWord(hash, s->rowsToNextLevel);
+    for (unsigned i = 0; i < SHAPE_MAX; i++) hash = HashWord(hash, s->countTetromino[i]);
+    return hash;
+}
+
+unsigned GameSaveState(game* ptr, unsigned* buf, unsigned len) {
+    if (ptr == NULL) return 0;
+
+    unsigned genWords;
+    void* gen = StateGenerator(ptr, &genWords);
+    unsigned cells = ptr->map.width * ptr->map.height;
+    unsigned needed = STATE_MAP + (cells+7)/8 + genWords;
+    if (buf == NULL || len < needed) return needed;
+
+    game_info* s = &ptr->info;
+    buf[STATE_WIDTH] = ptr->map.width;
+    buf[STATE_HEIGHT] = ptr->map.height;
+    buf[STATE_STATUS] = s->status & GAME_STATUS_END;
+    buf[STATE_SCORE] = s->score;
+    buf[STATE_ROWS] = s->rows;
+    buf[STATE_LEVEL] = s->level;
+    buf[STATE_COMBO] = s->combo;
+    buf[STATE_ROWS_TO_NEXT] = (unsigned)s->rowsToNextLevel;
+    buf[STATE_STEP] = ptr->step;
+    buf[STATE_NEXT_UPDATE] = ptr->nextUpdate - (s->timeStarted + s->timePaused);
+    for (unsigned i = 0; i < SHAPE_MAX; i++) buf[STATE_COUNT_TETROMINO+i] = s->countTetromino[i];
+    for (unsigned i = 0; i < 4; i++) buf[STATE_COUNT_CLEARS+i] = s->countClears[i];
+
+    tetromino* t = ptr->active;
+    buf[STATE_ACTIVE] = t ? (unsigned)t->shape : SHAPE_MAX;
+    buf[STATE_ACTIVE+1] = t ? t->x : 0;
+    buf[STATE_ACTIVE+2] = t ? t->y : 0;
+    for (unsigned i = 0; i < 4; i++) {
+        buf[STATE_ACTIVE+3+2*i] = t ? (unsigned)t->blocks[i]->x : 0;
+        buf[STATE_ACTIVE+4+2*i] = t ? (unsigned)t->blocks[i]->y : 0;
+    }
+    buf[STATE_NEXT] = s->next ? (unsigned)s->next->shape : SHAPE_MAX;
+    buf[STATE_GENERATOR_LEN] = genWords;
+
+    //  Pack map
+    unsigned* p = buf + STATE_MAP;
+    for (unsigned i = 0; i < (cells+7)/8; i++) p[i] = 0;
+    for (unsigned i = 0; i < cells; i++) {
+        block* b = ptr->map.blockMask[i];
+        if (b) p[i/8] |= ((b->symbol+1) & 0xF) << (4*(i%8));
+    }
+    p += (cells+7)/8;
+
+    if (genWords > 0) memcpy(p, gen, sizeof(unsigned)*genWords);
+    return needed;
+}
+
+int GameLoadState(game* ptr, const unsigned* buf, unsigned len) {
+    if (ptr == NULL || buf == NULL) return -1;
+
+    unsigned genWords;
+    void* gen = StateGenerator(ptr, &genWords);
+    unsigned cells = ptr->map.width * ptr->map.height;
+    if (len != STATE_MAP + (cells+7)/8 + genWords ||
+        buf[STATE_WIDTH] != ptr->map.width ||
+        buf[STATE_HEIGHT] != ptr->map.height ||
+        buf[STATE_GENERATOR_LEN] != genWords ||
+        buf[STATE_ACTIVE] >= SHAPE_MAX || buf[STATE_NEXT] >= SHAPE_MAX
+    ) {
+        return -3;
+    }
+
+    //  Rebuild map
+    const unsigned* p = buf + STATE_MAP;
+    for (unsigned i = 0; i < cells; i++) {
+        unsigned symbol = (p[i/8] >> (4*(i%8))) & 0xF;
+        block* b = ptr->map.blockMask[i];
+        if (symbol == 0) {
+            free(b);
+            ptr->map.blockMask[i] = NULL;
+            continue;
+        }
+        if (!b) {
+            b = (block*)malloc(sizeof(block));
+            if (!b) return -2;
+            ptr->map.blockMask[i] = b;
+        }
+        b->symbol = symbol-1;
+        b->x = 0;
+        b->y = 0;
+    }
+    p += (cells+7)/8;
+
+    //  Tetrominos
+    tetromino* active = TetrominoNew((tetromino_shape)buf[STATE_ACTIVE], ptr->map.width/2);
+    tetromino* next = TetrominoNew((tetromino_shape)buf[STATE_NEXT], ptr->map.width/2);
+    if (!active || !next) {
+        TetrominoFree(active);
+        TetrominoFree(next);
+        return -2;
+    }
+    active->x = buf[STATE_ACTIVE+1];
+    active->y = buf[STATE_ACTIVE+2];
+    for (unsigned i = 0; i < 4; i++) {
+        active->blocks[i]->x = (int)buf[STATE_ACTIVE+3+2*i];
+        active->blocks[i]->y = (int)buf[STATE_ACTIVE+4+2*i];
+    }
+    game_info* s = &ptr->info;
+    TetrominoFree(ptr->active);
+    TetrominoFree(s->next);
+    ptr->active = active;
+    s->next = next;
+
+    //  Statistics and timer
+    s->status = buf[STATE_STATUS] & GAME_STATUS_END;
+    s->score = buf[STATE_SCORE];
+    s->rows = buf[STATE_ROWS];
+    s->level = buf[STATE_LEVEL];
+    s->combo = buf[STATE_COMBO];
+    s->rowsToNextLevel = (int)buf[STATE_ROWS_TO_NEXT];
+    ptr->step = buf[STATE_STEP];
+    ptr->nextUpdate = buf[STATE_NEXT_UPDATE] + s->timeStarted + s->timePaused;
+    ptr->timeLast = ptr->nextUpdate - ptr->step; // Latest step, seeking may go back in time
+    unsigned drawn = 1; // The next tetromino
+    for (unsigned i = 0; i < SHAPE_MAX; i++) {
+        s->countTetromino[i] = buf[STATE_COUNT_TETROMINO+i];
+        drawn += s->countTetromino[i];
+    }
+    for (unsigned i = 0; i < 4; i++) s->countClears[i] = buf[STATE_COUNT_CLEARS+i];
+
+    //  Randomiser continues from the same position
+    if (genWords > 0) memcpy(gen, p, sizeof(unsigned)*genWords);
+    else if (s->fnRandomiserNext == DemoRandomizerNext) DemoRandomizerSeek(s->randomiser_data, drawn);
+
+    CalcGhost(ptr);
+    return 0;
+}
+
+unsigned GameDumpMap(game* ptr, char* buf, unsigned len) {
+    if (ptr == NULL || buf == NULL || len == 0) return 0;
+
+    static const char minos[] = "OITLJSZ";
+    unsigned w = ptr->map.width,
+             h = ptr->map.height;
+
+    unsigned pos = 0;
+    for (unsigned y = 0; y < h; y++) {
+        for (unsigned x = 0; x <= w && pos+1 < len; x++) {
+            char c = '\n';
+            if (x < w) {
+                block* b = ptr->map.blockMask[y*w + x];
+                c = b ? minos[b->symbol % SHAPE_MAX] : '.';
+            }
+            buf[pos++] = c;
+        }
+    }
+    buf[pos] = '\0';
+
+    //  Mark the active tetromino
+    tetromino* t = ptr->active;
+    if (t) {
+        for (unsigned i = 0; i < 4; i++) {
+            unsigned x = t->x + t->blocks[i]->x;
+            unsigned y = t->y + t->blocks[i]->y;
+            unsigned at = y*(w+1) + x;
+            if (x < w && y < h && at < pos) buf[at] = '@';
+        }
+    }
+    return pos;
+}
+
 /*
     Static functions
 */
@@ -327,30 +595,22 @@ unsigned GameTogglePause(game* ptr) {
 bool SetRandomiser(game* ptr, randomiser_type new_randomiser) {
     if (!ptr) return false;
 
+    const randomiser_desc* desc = RandomiserGet(new_randomiser);
+    if (!desc) {
+        new_randomiser = RANDOMISER_RANDOM;
+        desc = RandomiserGet(new_randomiser);
+    }
+
     //  Free old randomiser data
     game_info* nfo = &(ptr->info);
     if (nfo->randomiser_data) free(nfo->randomiser_data);
 
-    switch (new_randomiser) {
-        case RANDOMISER_BAG: {
-            nfo->randomiser_data = malloc(sizeof(randombag));
-            if (!nfo->randomiser_data) return false;
-            nfo->fnRandomiserInit = &RandomBagInit;
-            nfo->fnRandomiserNext = &RandomBagNext;
-        } break;
-        case RANDOMISER_TGM: {
-            nfo->randomiser_data = malloc(sizeof(randomiser_TGM_data));
-            if (!nfo->randomiser_data) return false;
-            nfo->fnRandomiserInit = &RandomTGMInit;
-            nfo->fnRandomiserNext = &RandomTGMNext;
-        } break;
-        case RANDOMISER_RANDOM:
-        default: {
-            nfo->randomiser_data = NULL;
-            nfo->fnRandomiserInit = &RandomRandomInit;
-            nfo->fnRandomiserNext = &RandomRandomNext;
-        } break;
-    }
+    //  Data starts with the generator, so it is never empty
+    nfo->randomiser_data = calloc(1, desc->dataSize);
+    if (!nfo->randomiser_data) return false;
+    nfo->randomiser = new_randomiser;
+    nfo->fnRandomiserInit = desc->fnInit;
+    nfo->fnRandomiserNext = desc->fnNext;
     return true;
 }
 
@@ -711,12 +971,207 @@ int CalcGhost(game* ptr) {
 /**
     \brief Drops active tetromino of given game instance to the place of ghost
     \param ptr Pointer to the game instance
+    \param time Time of the drop in milliseconds
 */
-void HardDrop(game* ptr) {
+void HardDrop(game* ptr, unsigned time) {
     //  Make sure position of the ghost is correct
     int y = CalcGhost(ptr);
     ptr->active->y = y;
 
-    // Call Update() to lock tetromino and generate new
-    ptr->nextUpdate = 0;
+    //  Lock tetromino and generate new, old demos do it with the next recorded step
+    if (ptr->recordedGravity) ptr->nextUpdate = 0;
+    else GravityStep(ptr, time);
+}
+
+/**
+    \brief Moves active tetromino down once, locks it if it can't move
+    \param ptr Pointer to the game instance
+    \param time Time of the step in milliseconds, the next one is due a step later
+    \return Number of rows destroyed, -2 on game over
+*/
+int GravityStep(game* ptr, unsigned time) {
+    int ret = 0;
+    bool spawned = false;
+
+    //  Check if active tetromino hit bottom or tetromino below.
+    if (TetrominoMove(ptr, INPUT_DOWN)) {
+        int origoy = ptr->active->y;
+        FreezeActive(ptr);
+
+        //  Check rows, there can be blocks above origo
+        if (origoy < 2) {
+            origoy = 0;
+        } else {
+            origoy -= 2;
+        }
+
+        ret = ClearFilledRows(ptr, origoy, 5);
+
+        game_info* s = &ptr->info;
+        if (ret > 0) {
+            s->score += ret*50*(s->level+1) + (s->combo*10*(s->level+1));
+            s->combo++;
+            if (ret <= 4) s->countClears[ret-1]++;
+
+            //  Add rows to counter and to level progress
+            s->rows += ret;
+            s->rowsToNextLevel -= ret;
+            bool levels = false;
+            while (s->rowsToNextLevel <= 0) {
+                s->level += 1;
+                s->rowsToNextLevel += (s->level)*3;
+                levels = true;
+            }
+
+            //  If level has changed calculate new step duration
+            if (levels) {
+                unsigned lvl = s->level;
+                if (lvl > MIN_DELAY_LEVEL) lvl = MIN_DELAY_LEVEL;
+                ptr->step = (MAX_DELAY-MIN_DELAY)*(MIN_DELAY_LEVEL-lvl)/MIN_DELAY_LEVEL + MIN_DELAY;
+            }
+        } else {
+            s->combo = 0;
+        }
+
+        //  Assign next to active tetromino
+        ptr->active = s->next;
+        s->countTetromino[ptr->active->shape] += 1;
+        //  Create a new next tetromino
+        tetromino_shape shape = s->fnRandomiserNext(s->randomiser_data);
+        s->next = TetrominoNew(shape, ptr->map.width/2);
+        //  Add it to the demo record
+        DemoAddPiece(ptr->demorecord, s->next->shape);
+        spawned = true;
+
+        //  Calculate ghost for the new active tetromino
+        CalcGhost(ptr);
+
+        if (ActiveCollided(ptr)) {
+            s->status |= GAME_STATUS_END;
+
+            //  Playback runs steps until the recorded end
+            RecordInstruction(ptr, time, (unsigned int)INPUT_UPDATE);
+            return -2; //   New tetromino already collided with something -> game over
+        }
+    }
+
+    //  Set time of next update
+    ptr->nextUpdate = time + ptr->step;
+
+    //  Recorded demos can be verified from checkpoints in parallel
+    if (spawned) {
+        RecordCheckpoint(ptr, time);
+        RecordSnapshot(ptr, time);
+    }
+
+    return ret;
+}
+
+/**
+    \brief Runs gravity steps which are due
+    \param ptr Pointer to the game instance
+    \param time Current time in milliseconds
+    \return Number of rows destroyed, -2 on game over
+*/
+int GravityUntil(game* ptr, unsigned time) {
+    int ret = 0;
+
+    //  Steps happen at their due time, not when they are noticed
+    while ((int)(time - ptr->nextUpdate) >= 0) {
+        int rows = GravityStep(ptr, ptr->nextUpdate);
+        if (rows < 0) return rows;
+        ret += rows;
+    }
+    return ret;
+}
+
+/**
+    \brief Get randomiser data which is saved in game states
+
+    Only generators of seed-based games are saved. Stored pieces of a demo
+    are found again with the count of spawned tetrominos.
+    \param ptr Pointer to the game instance
+    \param outWords Length of the data in words, 0 if nothing is saved
+    \return Pointer to the data, NULL if nothing is saved
+*/
+void* StateGenerator(game* ptr, unsigned* outWords) {
+    game_info* s = &ptr->info;
+    void* gen = NULL;
+    size_t size = 0;
+
+    if (s->fnRandomiserNext == DemoRandomizerNext) {
+        //  Demo playback
+        demo_rand_data* d = (demo_rand_data*)s->randomiser_data;
+        if (d && d->desc) {
+            gen = d->generator;
+            size = d->desc->dataSize;
+        }
+    } else if (ptr->demorecord && (ptr->demorecord->flags & DEMO_FLAG_SEEDED)) {
+        //  Recorded game
+        const randomiser_desc* desc = RandomiserGet(s->randomiser);
+        gen = s->randomiser_data;
+        size = desc ? desc->dataSize : 0;
+    }
+
+    *outWords = gen ? size/sizeof(unsigned) : 0;
+    return gen;
+}
+
+/**
+    \brief Adds the current state to the recorded demo
+    \param ptr Pointer to the game instance
+    \param time Time of the gravity step which spawned a tetromino
+*/
+void RecordCheckpoint(game* ptr, unsigned time) {
+    demo* record = ptr->demorecord;
+    if (!record) return;
+
+    unsigned pieces = 0;
+    for (unsigned i = 0; i < SHAPE_MAX; i++) pieces += ptr->info.countTetromino[i];
+    if (pieces % DEMO_CHECKPOINT_PIECES != 0) return;
+
+    unsigned len = GameSaveState(ptr, NULL, 0);
+    unsigned* state = (unsigned*)malloc(sizeof(unsigned)*len);
+    if (!state) return;
+    GameSaveState(ptr, state, len);
+
+    //  Playback reaches the state by running steps until the time after the last instruction
+    unsigned delta = ptr->info.timeStarted + ptr->info.timePaused;
+    DemoAddCheckpoint(record, record->instrsCount, time - delta, state, len);
+    free(state);
+}
+
+/**
+    \brief Adds an instruction to the recorded demo and the replay ring
+    \param ptr Pointer to the game instance
+    \param time Time of the instruction from the game clock
+    \param instruction The instruction
+*/
+void RecordInstruction(game* ptr, unsigned time, unsigned instruction) {
+    // Make sure demo time starts from 0, and demo has no pauses
+    unsigned delta = ptr->info.timeStarted + ptr->info.timePaused;
+    DemoAddInstruction(ptr->demorecord, time - delta, instruction);
+    ReplayAddInstruction(ptr->replay, time - delta, instruction);
+}
+
+/**
+    \brief Writes the current state to the replay ring
+    \param ptr Pointer to the game instance
+    \param time Time of the state from the game clock
+*/
+void RecordSnapshot(game* ptr, unsigned time) {
+    if (!ptr->replay) return;
+
+    unsigned delta = ptr->info.timeStarted + ptr->info.timePaused;
+    GameSaveState(ptr, ReplaySnapshot(ptr->replay, time - delta), ptr->replay->stateLen);
+}
+
+/**
+    \brief Mixes a word to FNV-1a hash
+    \param hash Hash so far
+    \param word Word to add
+    \return New hash
+*/
+unsigned HashWord(unsigned hash, unsigned word) {
+    return (hash ^ word) * 16777619u;
 }
@@ -1,5 +1,11 @@
+#ifndef _GAME_H_
+#define _GAME_H_
+
+#include <stdbool.h>
+
 #include "game_randomisers.h"
 #include "demo.h"
+#include "replay.h"
 
 
 typedef enum {
@@ -16,7 +22,7 @@ typedef enum {
     INPUT_DOWN,     /**< Same as calling Update() */
     INPUT_ROTATE,   /**< Rotate clockwise */
     INPUT_SET,      /**< Hard drop */
-    INPUT_UPDATE    /**< For demo recording purposes! */
+    INPUT_UPDATE    /**< For demo recording purposes! Runs gravity until the time, or one step in old demos */
 } player_input;
 
 /**
@@ -75,6 +81,7 @@ typedef struct {
     unsigned score; /**< Player score */
     unsigned rows;  /**< Number of rows destroyed */
     unsigned countTetromino[SHAPE_MAX]; /**< Count of each different tetromino spawned */
+    unsigned countClears[4]; /**< Count of single, double, triple and tetris clears */
 
     unsigned level; /**< Current level */
     unsigned combo; /**< Current combo */
@@ -83,6 +90,8 @@ typedef struct {
     int ghostY; /**< Ghost of the active tetromino */
 
     tetromino* next;     /**< The next tetromino */
+    randomiser_type randomiser; /**< Randomiser used */
+    unsigned seed;       /**< Seed of the randomiser, new one on every reset */
     void* randomiser_data; /**< The data used by randomiser functions */
     void* (*fnRandomiserInit)(void*); /**< Function pointer to randomiser init */
     unsigned (*fnRandomiserNext)(void*); /**< Function pointer to randomiser next */
@@ -99,9 +108,12 @@ typedef struct {
     unsigned nextUpdate; /**< Time of next update */
     unsigned step; /**< Time step between updates */
     unsigned (*fnMillis)(); /**< Function used to get current time in milliseconds */
+    unsigned timeLast;  /**< Latest time the game has been run to, earlier inputs are moved to it */
 
     unsigned recording;
     demo* demorecord;
+    bool recordedGravity; /**< Playback of a demo which has every gravity step as an instruction */
+    demo_replay* replay; /**< Latest moments for instant replays, NULL if disabled */
 } game;
 
 /**
@@ -130,7 +142,10 @@ extern game* GameInitialize(unsigned width, unsigned height, randomiser_type ran
 extern game* GameInitDemo(unsigned width, unsigned height, unsigned (*fnTime)(), demo* record);
 
 /**
-    \brief Process one step of game logic
+    \brief Process game logic until the current time
+
+    Gravity steps happen at fixed intervals from the start of the game and
+    are run when they are due, so demos only need the player inputs.
     \param ptr Pointer to game instance
     \return Number of rows destroyed. If negative something else has happened.
 */
@@ -144,6 +159,19 @@ extern int GameUpdate(game* ptr);
 */
 extern int GameProcessInput(game* ptr, player_input input);
 
+/**
+   \brief Processes user input at the time it happened
+   \param ptr Pointer to game instance
+   \param input Input from user
+   \param time Time of the input from the time function of the game
+
+   Gravity steps due before the time are run first, and the input is
+   recorded with its time. Time is kept between the latest processed input
+   or update and now, so demos stay in order.
+   \return 0 on success
+*/
+extern int GameProcessInputAt(game* ptr, player_input input, unsigned time);
+
 /**
     \brief Free memory allocated for the game.
     \param ptr Pointer to the game instance being freed
@@ -152,10 +180,41 @@ extern void GameFree(game* ptr);
 
 /**
     \brief Reset given game
+
+    Draws a new randomiser seed with rand() and starts a new demo record.
     \param ptr Pointer to game instance
 */
 extern void GameReset(game* ptr);
 
+/**
+    \brief Keeps the latest moments of the game for instant replays
+
+    Instructions and a snapshot at every spawned tetromino are written to
+    rings allocated here, recording doesn't allocate after this.
+    \param ptr Pointer to the game instance
+    \param seconds Length of clips in seconds, 0 disables
+    \return 0 on success, -2 if the game isn't recorded or on allocation error
+*/
+extern int GameEnableReplay(game* ptr, unsigned seconds);
+
+/**
+    \brief Makes an instant replay of the latest moments
+    \param ptr Pointer to the game instance
+    \return New demo which plays the last seconds until now, NULL on error
+
+    \note Use DemoFree() to delete the clip
+*/
+extern demo* GameReplayClip(game* ptr);
+
+/**
+    \brief Takes the recorded demo from the game, recording stops
+    \param ptr Pointer to the game instance
+    \return The demo, NULL if the game isn't recorded or it was taken already
+
+    \note Use DemoFree() to delete the demo
+*/
+extern demo* GameDetachDemo(game* ptr);
+
 /**
     \brief Get game duration
     \param ptr Pointer to the game instance
@@ -169,3 +228,61 @@ extern unsigned GameGetTime(game* ptr);
     \return 1 on pause
 */
 extern unsigned GameTogglePause(game* ptr);
+
+/**
+    \brief Calculates a hash of the game state
+
+    Hash covers the map, the active and next tetromino and statistics,
+    but not timers. Equal games give equal hashes between builds.
+    \param ptr Pointer to the game instance
+    \return 32-bit FNV-1a hash
+*/
+extern unsigned GameHashState(game* ptr);
+
+/**
+    \brief Reads the score statistics of the game
+
+    For tools which load the core as a library and can't rely on its struct layouts.
+    \param ptr Pointer to the game instance
+    \param outScore Score, can be NULL
+    \param outRows Cleared rows, can be NULL
+    \param outLevel Level, can be NULL
+*/
+extern void GameSummary(game* ptr, unsigned* outScore, unsigned* outRows, unsigned* outLevel);
+
+/**
+    \brief Saves the game state as words
+
+    State covers everything that affects the game from now on: the map,
+    tetrominos, statistics, the gravity timer relative to the game start
+    and the randomiser of seed-based games. Playback continues from a
+    loaded state exactly like it would have continued from the original.
+    \param ptr Pointer to the game instance
+    \param buf Where state is written, can be NULL
+    \param len Length of the buffer in words
+    \return Count of words needed, nothing is written if larger than len
+*/
+extern unsigned GameSaveState(game* ptr, unsigned* buf, unsigned len);
+
+/**
+    \brief Loads a state written by GameSaveState()
+    \param ptr Pointer to the game instance, a demo playback for stored pieces
+    \param buf State words
+    \param len Count of words
+    \return 0 on success, -3 if the state is for another map or randomiser
+*/
+extern int GameLoadState(game* ptr, const unsigned* buf, unsigned len);
+
+/**
+    \brief Writes the map as text, one line per row
+
+    Empty cells are '.', blocks are their shape letter and the
+    active tetromino is '@'. Hidden rows are included.
+    \param ptr Pointer to the game instance
+    \param buf Buffer where text is written
+    \param len Length of the buffer, (width+1)*height+1 is enough
+    \return Count of characters written, excluding '\0'
+*/
+extern unsigned GameDumpMap(game* ptr, char* buf, unsigned len);
+
+#endif //_GAME_H_
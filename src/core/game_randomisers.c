@@ -1,6 +1,31 @@
-#include <stdlib.h>
 #include "game_randomisers.h"
 
+static const randomiser_desc randomisers[RANDOMISER_MAX] = {
+    [RANDOMISER_RANDOM] = {"random", sizeof(randomiser_random_data), RandomRandomInit, RandomRandomNext},
+    [RANDOMISER_TGM]    = {"tgm", sizeof(randomiser_TGM_data), RandomTGMInit, RandomTGMNext},
+    [RANDOMISER_BAG]    = {"7bag", sizeof(randombag), RandomBagInit, RandomBagNext},
+};
+
+const randomiser_desc* RandomiserGet(randomiser_type type) {
+    if ((unsigned)type >= RANDOMISER_MAX) return NULL;
+    return &randomisers[type];
+}
+
+void RandomiserSeed(void* data, unsigned seed) {
+    if (data == NULL) return;
+    ((randomiser_rng*)data)->state = seed;
+}
+
+unsigned RandomNext(randomiser_rng* rng, unsigned range) {
+    //  Weyl sequence mixed with an integer hash, any seed is valid
+    rng->state += 0x9E3779B9;
+    unsigned z = rng->state;
+    z = (z ^ (z >> 16)) * 0x7FEB352D;
+    z = (z ^ (z >> 15)) * 0x846CA68B;
+    z ^= z >> 16;
+    return range ? z % range : z;
+}
+
 unsigned RandomBagNext(void* bag) {
     if (bag == NULL) return 0;
     randombag* b = (randombag*) bag;
@@ -28,7 +53,7 @@ void* RandomBagInit(void* bag) {
     //  Swap tetrominos randomly for the each index
     for (i=0; i <7; i++) {
         unsigned tmp = b->tetrominos[i];
-        unsigned other = rand()%7;
+        unsigned other = RandomNext(&b->rng, 7);
         b->tetrominos[i] = b->tetrominos[other];
         b->tetrominos[other] = tmp;
     }
@@ -56,7 +81,7 @@ unsigned RandomTGMNext(void* data) {
     unsigned quit = 0;
     //  Try get tetromino which isn't in history
     for (unsigned i=0; i < d->max_tries || !quit; i++) {
-        ret = rand()%7;
+        ret = RandomNext(&d->rng, 7);
         quit = 1;
         //  Check history
         for (unsigned j=0; j<4; j++) {
@@ -77,9 +102,10 @@ unsigned RandomTGMNext(void* data) {
 }
 
 void* RandomRandomInit(void* data) {
-    return NULL;
+    return data;
 }
 
 unsigned RandomRandomNext(void* data) {
-    return rand()%7;
+    if (data == NULL) return 0;
+    return RandomNext(&((randomiser_random_data*)data)->rng, 7);
 }
@@ -1,3 +1,16 @@
+#ifndef _GAME_RANDOMISERS_H_
+#define _GAME_RANDOMISERS_H_
+
+#include <stdbool.h>
+#include <stddef.h> /* size_t */
+
+/*
+    Version of the generator behind the randomisers. Seed-based demos store
+    it and only play back with the same version, bump it when the output of
+    RandomNext() or any randomiser changes for the same seed.
+*/
+#define RANDOMISER_RNG_VERSION 1
+
 /**
     \brief Enum for each different randomiser functions
 */
@@ -8,10 +21,56 @@ typedef enum {
     RANDOMISER_MAX
 } randomiser_type;
 
+/**
+    \brief Deterministic random number generator owned by one game
+
+    Every randomiser data struct starts with this, so the generator can be
+    seeded without knowing the randomiser.
+*/
+typedef struct {
+    unsigned state;
+} randomiser_rng;
+
+/**
+    \brief Describes a randomiser
+
+    Sequences depend only on the seed, so demos store the seed instead of
+    the pieces.
+*/
+typedef struct {
+    const char* name;   /**< Name used on the command line */
+    size_t dataSize;    /**< Size of the randomiser data, starts with randomiser_rng */
+    void* (*fnInit)(void*);     /**< Initializes data allocated by caller */
+    unsigned (*fnNext)(void*);  /**< Shape of next tetromino */
+} randomiser_desc;
+
+/**
+    \brief Get description of a randomiser
+    \param type The randomiser
+    \return Pointer to the description, NULL if type is invalid
+*/
+extern const randomiser_desc* RandomiserGet(randomiser_type type);
+
+/**
+    \brief Seeds the generator of randomiser data
+    \param data Pointer to the randomiser data
+    \param seed The seed, all values are valid
+*/
+extern void RandomiserSeed(void* data, unsigned seed);
+
+/**
+    \brief Get next random number
+    \param rng Pointer to the generator
+    \param range Count of possible values
+    \return Number from 0 to range-1
+*/
+extern unsigned RandomNext(randomiser_rng* rng, unsigned range);
+
 /**
     \brief Structure that holds the data used by the bag randomiser functions
 */
 typedef struct {
+    randomiser_rng rng;
     unsigned tetrominos[7]; /**< Permutation of different shapes*/
     unsigned next; /**< Position of next tetromino */
 } randombag;
@@ -34,6 +93,7 @@ extern unsigned RandomBagNext(void* bag);
     \brief Structure for a TGM randomiser
 */
 typedef struct {
+    randomiser_rng rng;
     unsigned history[4];
     unsigned max_tries;
 } randomiser_TGM_data;
@@ -52,15 +112,24 @@ extern void* RandomTGMInit(void* data);
 */
 extern unsigned RandomTGMNext(void* data);
 
+/**
+    \brief Structure for a total random randomiser
+*/
+typedef struct {
+    randomiser_rng rng;
+} randomiser_random_data;
+
 /**
     \brief Total random randomizer init
-    \param data should be NULL
-    \return NULL
+    \param data A pointer to the randomiser data
+    \return Return a pointer to the randomiser data
 */
 extern void* RandomRandomInit(void* data);
 /**
     \brief Get next random tetromino
-    \param data should be NULL
+    \param data A pointer to the randomiser data
     \return Shape of next tetromino
 */
 extern unsigned RandomRandomNext(void* data);
+
+#endif //_GAME_RANDOMISERS_H_
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h> /* strlen(), strcpy() */
 
 #include "hiscore.h"
 #include "file_misc.h" /* CalcCRC32(), DecodeBigendian(), EncodeBigendian() */
@@ -48,6 +49,7 @@ int ReadHiScores(const char* file, hiscore_list_entry* ptrTable, unsigned len) {
     //  Check CRC32 of the file
     unsigned crc32 = CalcCRC32((char*)buffer, fLen-4);
     if (crc32 != DecodeBigendian(*(unsigned*)((char*)buffer+fLen-4))) {
+        free(buffer);
         return -4;
     }
 
@@ -124,15 +126,29 @@ int SaveHiScores(const char* file, hiscore_list_entry* ptrTable, unsigned len) {
     *(unsigned*)((char*)buffer+bufLen-4) = EncodeBigendian(crc32);
     // printf("0x%08x\n", crc32);
 
-    //   Open file for writing
-    FILE* ptrFile = fopen(file, "w");
+    //  Write next to the old file and replace it, readers never see a partial table
+    size_t pathLen = strlen(file);
+    char* tmp = (char*)malloc(pathLen+5);
+    if (!tmp) {
+        free(buffer);
+        return -1;
+    }
+    memcpy(tmp, file, pathLen);
+    strcpy(tmp+pathLen, ".tmp");
+
+    FILE* ptrFile = fopen(tmp, "w");
     if (!ptrFile) {
+        free(tmp);
         free(buffer);
         return -2;
     }
     int ret = fwrite(buffer, sizeof(char), bufLen, ptrFile);
+    if (fclose(ptrFile) != 0 || (size_t)ret != bufLen || rename(tmp, file) != 0) {
+        remove(tmp);
+        ret = -5;
+    }
 
-    fclose(ptrFile);
+    free(tmp);
     free(buffer);
     return ret;
 }
@@ -1,3 +1,6 @@
+#ifndef _HISCORE_H_
+#define _HISCORE_H_
+
 /**
     \brief A container struct for a hi score table entry
 */
@@ -21,6 +24,9 @@ extern int ReadHiScores(const char* file, hiscore_list_entry* ptrTable, unsigned
 
 /**
     \brief Writes given hi score array to file
+
+    The table is written to file.tmp which then replaces the file, so
+    readers see either the old or the new table.
     \param file Path to hi score file
     \param ptrTable Pointer to array of scores to be saved
     \param len Lenght of given array
@@ -45,3 +51,5 @@ extern int AddScoreToList(hiscore_list_entry* ptrTable, unsigned len, hiscore_li
     \return Ranking starting from 0
 */
 extern unsigned GetRanking(hiscore_list_entry* ptrTable, unsigned len, hiscore_list_entry* ptrEntry);
+
+#endif //_HISCORE_H_
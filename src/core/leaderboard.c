@@ -0,0 +1,776 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h> /* UINT_MAX */
+
+#include "leaderboard.h"
+#include "crc32.h"
+#include "file_misc.h" /* DecodeBigendian(), EncodeBigendian() */
+
+#define MANIFEST_SIG 0x1EADB0
+#define RUN_SIG 0x1EADB1
+#define LOG_SIG 0x1EADB2
+#define LEADERBOARD_VER 1
+#define RECORD_WORDS 10 /* score, rows, lvl, time, date, seq, name[16] */
+#define RUN_HEADER_LEN 3
+#define LOG_HEADER_LEN 2
+#define MANIFEST_LEN (6 + 2*LEADERBOARD_LEVELS + 1)
+#define SOURCES (LEADERBOARD_LEVELS+1) /* Log and every level */
+
+/**
+    FILES:
+    <path>          Manifest
+        0-3             Signature           (unsigned)
+        4-7             Version             (unsigned)
+        8-11            Next sequence number (unsigned)
+        12-15           Next generation     (unsigned)
+        16-19           Generation of the log (unsigned)
+        20-23           Count of levels     (unsigned)
+        24-x            Generation and count of every level (unsigned)*2
+        x+1             CRC32               (unsigned)
+
+    <path>.<gen>.run    Sorted run, best score first
+        0-3             Signature           (unsigned)
+        4-7             Version             (unsigned)
+        8-11            Count of records    (unsigned)
+        12-x            Records             (unsigned)*10
+        x+1             CRC32               (unsigned)
+
+    <path>.<gen>.log    Unsorted scores posted after the last merge
+        0-3             Signature           (unsigned)
+        4-7             Version             (unsigned)
+        8-x             Records followed by their CRC32 (unsigned)*11
+
+    Words are big-endian. A record is score, rows, level, time, date and
+    sequence number followed by the 16 bytes of the name. A record which
+    was written partially is the end of the log.
+*/
+
+static leaderboard_key KeyOf(const hiscore_list_entry* e, unsigned seq);
+static int CompareKeys(const leaderboard_key* a, const leaderboard_key* b);
+static void EncodeRecord(unsigned* out, const hiscore_list_entry* e, unsigned seq);
+static void DecodeRecord(const unsigned* in, hiscore_list_entry* e, leaderboard_key* key);
+static char* FileName(leaderboard* lb, unsigned gen, const char* suffix);
+
+static int RunOpen(leaderboard_run* run, const char* path, unsigned gen, unsigned count);
+static void RunClose(leaderboard_run* run);
+static int RunRead(leaderboard_run* run, unsigned index, hiscore_list_entry** e, leaderboard_key** key);
+static unsigned RunCountBetter(leaderboard_run* run, const leaderboard_key* key);
+
+static int LogAppend(leaderboard* lb, const hiscore_list_entry* e, const leaderboard_key* key);
+static int LogRead(leaderboard* lb);
+static FILE* LogCreate(leaderboard* lb, unsigned gen);
+static unsigned LogCountBetter(leaderboard* lb, const leaderboard_key* key);
+
+static int SourceGet(leaderboard* lb, unsigned source, unsigned index, hiscore_list_entry** e, leaderboard_key** key);
+static unsigned SourceCount(leaderboard* lb, unsigned source);
+static unsigned CountBetter(leaderboard* lb, const leaderboard_key* key);
+static int ReadManifest(leaderboard* lb);
+static int WriteManifest(leaderboard* lb);
+static int Merge(leaderboard* lb);
+
+leaderboard* LeaderboardOpen(const char* path) {
+    if (!path) return NULL;
+
+    leaderboard* lb = (leaderboard*)calloc(1, sizeof(leaderboard));
+    if (!lb) return NULL;
+    lb->path = (char*)malloc(strlen(path)+1);
+    if (!lb->path) {
+        free(lb);
+        return NULL;
+    }
+    strcpy(lb->path, path);
+    for (unsigned i=0; i < LEADERBOARD_LEVELS; i++) lb->runs[i].blockIndex = UINT_MAX;
+
+    int err = ReadManifest(lb);
+    if (err == -2) {
+        //  New board
+        lb->nextGen = 1;
+        lb->logGen = lb->nextGen++;
+        lb->logFp = LogCreate(lb, lb->logGen);
+        err = lb->logFp && WriteManifest(lb) == 0 ? 0 : -2;
+    } else if (err == 0) {
+        err = LogRead(lb);
+    }
+    if (err != 0) {
+        LeaderboardClose(lb);
+        return NULL;
+    }
+
+    lb->total = lb->logCount;
+    for (unsigned i=0; i < LEADERBOARD_LEVELS; i++) lb->total += lb->runs[i].count;
+    return lb;
+}
+
+void LeaderboardClose(leaderboard* lb) {
+    if (!lb) return;
+
+    for (unsigned i=0; i < LEADERBOARD_LEVELS; i++) RunClose(&lb->runs[i]);
+    if (lb->logFp) fclose(lb->logFp);
+    free(lb->log);
+    free(lb->logKeys);
+    free(lb->path);
+    free(lb);
+}
+
+int LeaderboardAdd(leaderboard* lb, const hiscore_list_entry* entry, unsigned* outRank) {
+    if (!lb || !entry) return -1;
+
+    leaderboard_key key = KeyOf(entry, lb->nextSeq);
+    if (LogAppend(lb, entry, &key) != 0) return -2;
+    lb->nextSeq++;
+    lb->total++;
+
+    //  Rank is counted before merging, it doesn't change the order
+    if (outRank) *outRank = CountBetter(lb, &key);
+    if (lb->logCount >= LEADERBOARD_LOG_MAX) Merge(lb); // Retried with the next score if it fails
+    return 0;
+}
+
+unsigned LeaderboardRank(leaderboard* lb, const hiscore_list_entry* entry) {
+    if (!lb || !entry) return 0;
+
+    leaderboard_key key = KeyOf(entry, lb->nextSeq);
+    return CountBetter(lb, &key);
+}
+
+unsigned LeaderboardPage(leaderboard* lb, unsigned offset, hiscore_list_entry* out, unsigned len) {
+    if (!lb || !out || offset >= lb->total) return 0;
+
+    //  Scores before the offset in every source, found by their overall rank
+    unsigned pos[SOURCES];
+    for (unsigned s=0; s < SOURCES; s++) {
+        unsigned lo = 0, hi = SourceCount(lb, s);
+        while (lo < hi && offset > 0) {
+            unsigned mid = lo + (hi-lo)/2;
+            leaderboard_key* key;
+            if (SourceGet(lb, s, mid, NULL, &key) != 0) return 0;
+            leaderboard_key copy = *key;
+            if (CountBetter(lb, &copy) < offset) lo = mid+1;
+            else hi = mid;
+        }
+        pos[s] = lo;
+    }
+
+    //  Merge the sources from there
+    unsigned ret = 0;
+    for (; ret < len; ret++) {
+        int best = -1;
+        leaderboard_key bestKey;
+        for (unsigned s=0; s < SOURCES; s++) {
+            leaderboard_key* key;
+            if (pos[s] >= SourceCount(lb, s) || SourceGet(lb, s, pos[s], NULL, &key) != 0) continue;
+            if (best < 0 || CompareKeys(key, &bestKey) < 0) {
+                best = s;
+                bestKey = *key;
+            }
+        }
+        hiscore_list_entry* e;
+        if (best < 0 || SourceGet(lb, best, pos[best], &e, NULL) != 0) break;
+        out[ret] = *e;
+        pos[best]++;
+    }
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Get sort key of a score
+    \param e Pointer to the score
+    \param seq Sequence number of the score
+*/
+leaderboard_key KeyOf(const hiscore_list_entry* e, unsigned seq) {
+    leaderboard_key ret = {.score = e->score, .time = e->time, .date = e->date, .seq = seq};
+    return ret;
+}
+
+/**
+    \brief Compares keys like the hi score table, older scores win ties
+    \param a Pointer to key
+    \param b Pointer to key
+    \return <0 if a ranks higher, >0 if b ranks higher, 0 if same
+*/
+int CompareKeys(const leaderboard_key* a, const leaderboard_key* b) {
+    if (a->score != b->score) return a->score > b->score ? -1 : 1;
+    if (a->time != b->time) return a->time < b->time ? -1 : 1;
+    if (a->date != b->date) return a->date < b->date ? -1 : 1;
+    if (a->seq != b->seq) return a->seq < b->seq ? -1 : 1;
+    return 0;
+}
+
+/**
+    \brief Encodes score to RECORD_WORDS words
+    \param out Where the words are written
+    \param e Pointer to the score
+    \param seq Sequence number of the score
+*/
+void EncodeRecord(unsigned* out, const hiscore_list_entry* e, unsigned seq) {
+    out[0] = EncodeBigendian(e->score);
+    out[1] = EncodeBigendian(e->rows);
+    out[2] = EncodeBigendian(e->lvl);
+    out[3] = EncodeBigendian(e->time);
+    out[4] = EncodeBigendian(e->date);
+    out[5] = EncodeBigendian(seq);
+
+    //  Padding after the name is zero
+    char* name = (char*)(out+6);
+    size_t len = strnlen(e->name, sizeof(e->name)-1);
+    memset(name, 0, sizeof(e->name));
+    memcpy(name, e->name, len);
+}
+
+/**
+    \brief Decodes score written by EncodeRecord()
+    \param in Words of the record
+    \param e Where the score is written, can be NULL
+    \param key Where the key is written, can be NULL
+*/
+void DecodeRecord(const unsigned* in, hiscore_list_entry* e, leaderboard_key* key) {
+    if (e) {
+        e->score = DecodeBigendian(in[0]);
+        e->rows = DecodeBigendian(in[1]);
+        e->lvl = DecodeBigendian(in[2]);
+        e->time = DecodeBigendian(in[3]);
+        e->date = DecodeBigendian(in[4]);
+        memcpy(e->name, in+6, sizeof(e->name));
+        e->name[sizeof(e->name)-1] = '\0';
+    }
+    if (key) {
+        key->score = DecodeBigendian(in[0]);
+        key->time = DecodeBigendian(in[3]);
+        key->date = DecodeBigendian(in[4]);
+        key->seq = DecodeBigendian(in[5]);
+    }
+}
+
+/**
+    \brief Get name of a file of the board
+    \param lb Pointer to the board
+    \param gen Generation of the file
+    \param suffix "run" or "log"
+    \return Path, free with free()
+*/
+char* FileName(leaderboard* lb, unsigned gen, const char* suffix) {
+    size_t len = strlen(lb->path) + strlen(suffix) + 13;
+    char* ret = (char*)malloc(len);
+    if (ret) snprintf(ret, len, "%s.%u.%s", lb->path, gen, suffix);
+    return ret;
+}
+
+/**
+    \brief Opens a run and checks it, first keys of the blocks are read to memory
+    \param run Pointer to the run, closed
+    \param path Path to the run
+    \param gen Generation of the run
+    \param count Count of records listed in the manifest
+    \return 0 on success, -2 if the file can't be read, -3 if invalid
+*/
+int RunOpen(leaderboard_run* run, const char* path, unsigned gen, unsigned count) {
+    unsigned blocks = (count + LEADERBOARD_BLOCK-1) / LEADERBOARD_BLOCK;
+    run->fp = fopen(path, "rb");
+    run->fences = (leaderboard_key*)malloc(sizeof(leaderboard_key)*(blocks+1));
+    run->block = (hiscore_list_entry*)malloc(sizeof(hiscore_list_entry)*LEADERBOARD_BLOCK);
+    run->blockKeys = (leaderboard_key*)malloc(sizeof(leaderboard_key)*LEADERBOARD_BLOCK);
+    run->blockIndex = UINT_MAX;
+    run->gen = gen;
+    run->count = count;
+    if (!run->fp || !run->fences || !run->block || !run->blockKeys) {
+        RunClose(run);
+        return -2;
+    }
+
+    //  Whole run is checked once, blocks are read without checks later
+    unsigned words[RECORD_WORDS*LEADERBOARD_BLOCK];
+    unsigned crc = CRC32_INIT;
+    if (fread(words, sizeof(unsigned), RUN_HEADER_LEN, run->fp) != RUN_HEADER_LEN ||
+        DecodeBigendian(words[0]) != RUN_SIG || DecodeBigendian(words[1]) != LEADERBOARD_VER ||
+        DecodeBigendian(words[2]) != count) {
+        RunClose(run);
+        return -3;
+    }
+    crc = CRC32Update(crc, words, sizeof(unsigned)*RUN_HEADER_LEN);
+
+    leaderboard_key prev;
+    for (unsigned b=0; b < blocks; b++) {
+        unsigned n = count - b*LEADERBOARD_BLOCK;
+        if (n > LEADERBOARD_BLOCK) n = LEADERBOARD_BLOCK;
+        if (fread(words, sizeof(unsigned)*RECORD_WORDS, n, run->fp) != n) {
+            RunClose(run);
+            return -3;
+        }
+        crc = CRC32Update(crc, words, sizeof(unsigned)*RECORD_WORDS*n);
+
+        //  Order is checked too, searches depend on it
+        for (unsigned i=0; i < n; i++) {
+            leaderboard_key key;
+            DecodeRecord(words + i*RECORD_WORDS, NULL, &key);
+            if ((b > 0 || i > 0) && CompareKeys(&prev, &key) >= 0) {
+                RunClose(run);
+                return -3;
+            }
+            if (i == 0) run->fences[b] = key;
+            prev = key;
+        }
+    }
+    if (fread(words, sizeof(unsigned), 1, run->fp) != 1 || DecodeBigendian(words[0]) != CRC32Final(crc)) {
+        RunClose(run);
+        return -3;
+    }
+    return 0;
+}
+
+/**
+    \brief Closes file of the run and marks the level empty
+    \param run Pointer to the run
+*/
+void RunClose(leaderboard_run* run) {
+    if (run->fp) fclose(run->fp);
+    free(run->fences);
+    free(run->block);
+    free(run->blockKeys);
+    memset(run, 0, sizeof(leaderboard_run));
+    run->blockIndex = UINT_MAX;
+}
+
+/**
+    \brief Get record of a run, the block of it is read if not cached
+    \param run Pointer to the run
+    \param index Index of the record
+    \param e Pointer to the score in the cache, valid until the next read, can be NULL
+    \param key Pointer to the key in the cache, can be NULL
+    \return 0 on success, -2 if reading failed
+*/
+int RunRead(leaderboard_run* run, unsigned index, hiscore_list_entry** e, leaderboard_key** key) {
+    if (index >= run->count) return -1;
+
+    unsigned b = index / LEADERBOARD_BLOCK;
+    if (run->blockIndex != b) {
+        unsigned n = run->count - b*LEADERBOARD_BLOCK;
+        if (n > LEADERBOARD_BLOCK) n = LEADERBOARD_BLOCK;
+
+        unsigned words[RECORD_WORDS*LEADERBOARD_BLOCK];
+        long pos = sizeof(unsigned)*(RUN_HEADER_LEN + (long)b*LEADERBOARD_BLOCK*RECORD_WORDS);
+        run->blockIndex = UINT_MAX;
+        if (fseek(run->fp, pos, SEEK_SET) != 0 || fread(words, sizeof(unsigned)*RECORD_WORDS, n, run->fp) != n) return -2;
+        for (unsigned i=0; i < n; i++) DecodeRecord(words + i*RECORD_WORDS, &run->block[i], &run->blockKeys[i]);
+        run->blockIndex = b;
+    }
+
+    unsigned i = index % LEADERBOARD_BLOCK;
+    if (e) *e = &run->block[i];
+    if (key) *key = &run->blockKeys[i];
+    return 0;
+}
+
+/**
+    \brief Counts records of a run which rank higher than the key
+
+    Block is found from the keys in memory, so only one block is read.
+    \param run Pointer to the run
+    \param key Pointer to the key
+*/
+unsigned RunCountBetter(leaderboard_run* run, const leaderboard_key* key) {
+    if (run->count == 0) return 0;
+
+    //  Last block starting with a better key
+    unsigned blocks = (run->count + LEADERBOARD_BLOCK-1) / LEADERBOARD_BLOCK;
+    unsigned lo = 0, hi = blocks;
+    while (lo < hi) {
+        unsigned mid = lo + (hi-lo)/2;
+        if (CompareKeys(&run->fences[mid], key) < 0) lo = mid+1;
+        else hi = mid;
+    }
+    if (lo == 0) return 0;
+
+    unsigned b = lo-1;
+    unsigned first = b*LEADERBOARD_BLOCK;
+    unsigned n = run->count - first;
+    if (n > LEADERBOARD_BLOCK) n = LEADERBOARD_BLOCK;
+    leaderboard_key* keys;
+    if (RunRead(run, first, NULL, &keys) != 0) return first;
+
+    lo = 0;
+    hi = n;
+    while (lo < hi) {
+        unsigned mid = lo + (hi-lo)/2;
+        if (CompareKeys(&keys[mid], key) < 0) lo = mid+1;
+        else hi = mid;
+    }
+    return first + lo;
+}
+
+/**
+    \brief Writes score to the log and inserts it to the sorted scores in memory
+    \param lb Pointer to the board
+    \param e Pointer to the score
+    \param key Key of the score
+    \return 0 on success, -2 on errors
+*/
+int LogAppend(leaderboard* lb, const hiscore_list_entry* e, const leaderboard_key* key) {
+    //  Grow arrays in steps of LEADERBOARD_LOG_MAX, log can outgrow it if a merge fails
+    if (lb->logCount % LEADERBOARD_LOG_MAX == 0) {
+        unsigned size = lb->logCount + LEADERBOARD_LOG_MAX;
+        hiscore_list_entry* log = (hiscore_list_entry*)realloc(lb->log, sizeof(hiscore_list_entry)*size);
+        if (log) lb->log = log;
+        leaderboard_key* keys = (leaderboard_key*)realloc(lb->logKeys, sizeof(leaderboard_key)*size);
+        if (keys) lb->logKeys = keys;
+        if (!log || !keys) return -2;
+    }
+
+    if (lb->logFp) {
+        unsigned words[RECORD_WORDS+1];
+        EncodeRecord(words, e, key->seq);
+        words[RECORD_WORDS] = EncodeBigendian(CRC32(words, sizeof(unsigned)*RECORD_WORDS));
+        if (fwrite(words, sizeof(words), 1, lb->logFp) != 1 || fflush(lb->logFp) != 0) return -2;
+    }
+
+    unsigned pos = LogCountBetter(lb, key);
+    memmove(lb->log+pos+1, lb->log+pos, sizeof(hiscore_list_entry)*(lb->logCount-pos));
+    memmove(lb->logKeys+pos+1, lb->logKeys+pos, sizeof(leaderboard_key)*(lb->logCount-pos));
+    lb->log[pos] = *e;
+    lb->log[pos].name[sizeof(e->name)-1] = '\0';
+    lb->logKeys[pos] = *key;
+    lb->logCount++;
+    return 0;
+}
+
+/**
+    \brief Reads scores of the log listed in the manifest and opens it for appending
+
+    A partially written record ends the log, it is rewritten without it.
+    \param lb Pointer to the board
+    \return 0 on success, -2 on errors, -3 if the log is invalid
+*/
+int LogRead(leaderboard* lb) {
+    char* path = FileName(lb, lb->logGen, "log");
+    FILE* fp = path ? fopen(path, "rb") : NULL;
+    if (!fp) {
+        free(path);
+        return -2;
+    }
+
+    unsigned words[RECORD_WORDS+1];
+    if (fread(words, sizeof(unsigned), LOG_HEADER_LEN, fp) != LOG_HEADER_LEN ||
+        DecodeBigendian(words[0]) != LOG_SIG || DecodeBigendian(words[1]) != LEADERBOARD_VER) {
+        fclose(fp);
+        free(path);
+        return -3;
+    }
+
+    //  Scores are added without writing, the file is opened after
+    bool torn = false;
+    while (fread(words, sizeof(unsigned), RECORD_WORDS+1, fp) == RECORD_WORDS+1) {
+        if (DecodeBigendian(words[RECORD_WORDS]) != CRC32(words, sizeof(unsigned)*RECORD_WORDS)) {
+            torn = true;
+            break;
+        }
+        hiscore_list_entry e;
+        leaderboard_key key;
+        DecodeRecord(words, &e, &key);
+        if (LogAppend(lb, &e, &key) != 0) {
+            fclose(fp);
+            free(path);
+            return -2;
+        }
+        if (key.seq >= lb->nextSeq) lb->nextSeq = key.seq+1;
+    }
+    torn = torn || !feof(fp) || ftell(fp) != (long)(sizeof(unsigned)*(LOG_HEADER_LEN + (long)lb->logCount*(RECORD_WORDS+1)));
+    fclose(fp);
+
+    if (!torn) {
+        lb->logFp = fopen(path, "ab");
+        free(path);
+        return lb->logFp ? 0 : -2;
+    }
+    free(path);
+
+    //  Valid scores are moved to a new log
+    unsigned gen = lb->nextGen++;
+    FILE* nw = LogCreate(lb, gen);
+    if (!nw) return -2;
+    for (unsigned i=0; i < lb->logCount; i++) {
+        EncodeRecord(words, &lb->log[i], lb->logKeys[i].seq);
+        words[RECORD_WORDS] = EncodeBigendian(CRC32(words, sizeof(unsigned)*RECORD_WORDS));
+        if (fwrite(words, sizeof(words), 1, nw) != 1) {
+            fclose(nw);
+            return -2;
+        }
+    }
+    unsigned oldGen = lb->logGen;
+    lb->logGen = gen;
+    lb->logFp = nw;
+    if (fflush(nw) != 0 || WriteManifest(lb) != 0) return -2;
+
+    char* old = FileName(lb, oldGen, "log");
+    if (old) remove(old);
+    free(old);
+    return 0;
+}
+
+/**
+    \brief Creates an empty log
+    \param lb Pointer to the board
+    \param gen Generation of the log
+    \return File opened for appending, NULL on error
+*/
+FILE* LogCreate(leaderboard* lb, unsigned gen) {
+    char* path = FileName(lb, gen, "log");
+    FILE* fp = path ? fopen(path, "wb") : NULL;
+    free(path);
+    if (!fp) return NULL;
+
+    unsigned header[LOG_HEADER_LEN] = {EncodeBigendian(LOG_SIG), EncodeBigendian(LEADERBOARD_VER)};
+    if (fwrite(header, sizeof(header), 1, fp) != 1 || fflush(fp) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+/**
+    \brief Counts scores of the log which rank higher than the key
+    \param lb Pointer to the board
+    \param key Pointer to the key
+*/
+unsigned LogCountBetter(leaderboard* lb, const leaderboard_key* key) {
+    unsigned lo = 0, hi = lb->logCount;
+    while (lo < hi) {
+        unsigned mid = lo + (hi-lo)/2;
+        if (CompareKeys(&lb->logKeys[mid], key) < 0) lo = mid+1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/**
+    \brief Get score of the log or a run
+    \param lb Pointer to the board
+    \param source 0 for the log, level+1 for runs
+    \param index Index of the score in the source
+    \param e Pointer to the score, can be NULL
+    \param key Pointer to the key, can be NULL
+    \return 0 on success
+*/
+int SourceGet(leaderboard* lb, unsigned source, unsigned index, hiscore_list_entry** e, leaderboard_key** key) {
+    if (source > 0) return RunRead(&lb->runs[source-1], index, e, key);
+    if (index >= lb->logCount) return -1;
+
+    if (e) *e = &lb->log[index];
+    if (key) *key = &lb->logKeys[index];
+    return 0;
+}
+
+/**
+    \brief Get count of scores in the log or a run
+    \param lb Pointer to the board
+    \param source 0 for the log, level+1 for runs
+*/
+unsigned SourceCount(leaderboard* lb, unsigned source) {
+    return source > 0 ? lb->runs[source-1].count : lb->logCount;
+}
+
+/**
+    \brief Counts all scores which rank higher than the key
+    \param lb Pointer to the board
+    \param key Pointer to the key
+*/
+unsigned CountBetter(leaderboard* lb, const leaderboard_key* key) {
+    unsigned ret = LogCountBetter(lb, key);
+    for (unsigned i=0; i < LEADERBOARD_LEVELS; i++) ret += RunCountBetter(&lb->runs[i], key);
+    return ret;
+}
+
+/**
+    \brief Reads manifest and opens the runs listed in it
+    \param lb Pointer to the board
+    \return 0 on success, -2 if there is no manifest, -3 if the board is invalid
+*/
+int ReadManifest(leaderboard* lb) {
+    FILE* fp = fopen(lb->path, "rb");
+    if (!fp) return -2;
+
+    unsigned words[MANIFEST_LEN];
+    size_t len = fread(words, sizeof(unsigned), MANIFEST_LEN, fp);
+    fclose(fp);
+    if (len != MANIFEST_LEN || DecodeBigendian(words[MANIFEST_LEN-1]) != CalcCRC32((char*)words, sizeof(unsigned)*(MANIFEST_LEN-1))) return -3;
+    if (DecodeBigendian(words[0]) != MANIFEST_SIG || DecodeBigendian(words[1]) != LEADERBOARD_VER ||
+        DecodeBigendian(words[5]) != LEADERBOARD_LEVELS) return -3;
+
+    lb->nextSeq = DecodeBigendian(words[2]);
+    lb->nextGen = DecodeBigendian(words[3]);
+    lb->logGen = DecodeBigendian(words[4]);
+    for (unsigned i=0; i < LEADERBOARD_LEVELS; i++) {
+        unsigned gen = DecodeBigendian(words[6+2*i]);
+        unsigned count = DecodeBigendian(words[7+2*i]);
+        if (gen == 0) continue;
+
+        char* path = FileName(lb, gen, "run");
+        int err = path ? RunOpen(&lb->runs[i], path, gen, count) : -2;
+        free(path);
+        if (err != 0) return -3;
+    }
+    return 0;
+}
+
+/**
+    \brief Replaces the manifest atomically with the current files of the board
+    \param lb Pointer to the board
+    \return 0 on success, -2 on errors
+*/
+int WriteManifest(leaderboard* lb) {
+    unsigned words[MANIFEST_LEN];
+    words[0] = EncodeBigendian(MANIFEST_SIG);
+    words[1] = EncodeBigendian(LEADERBOARD_VER);
+    words[2] = EncodeBigendian(lb->nextSeq);
+    words[3] = EncodeBigendian(lb->nextGen);
+    words[4] = EncodeBigendian(lb->logGen);
+    words[5] = EncodeBigendian(LEADERBOARD_LEVELS);
+    for (unsigned i=0; i < LEADERBOARD_LEVELS; i++) {
+        words[6+2*i] = EncodeBigendian(lb->runs[i].gen);
+        words[7+2*i] = EncodeBigendian(lb->runs[i].count);
+    }
+    words[MANIFEST_LEN-1] = EncodeBigendian(CalcCRC32((char*)words, sizeof(unsigned)*(MANIFEST_LEN-1)));
+
+    //  Write next to the old manifest and replace it, readers never see a partial file
+    size_t len = strlen(lb->path) + sizeof(".tmp");
+    char* tmp = (char*)malloc(len);
+    if (!tmp) return -2;
+    snprintf(tmp, len, "%s.tmp", lb->path);
+
+    int ret = -2;
+    FILE* fp = fopen(tmp, "wb");
+    if (fp) {
+        size_t written = fwrite(words, sizeof(words), 1, fp);
+        if (fclose(fp) == 0 && written == 1 && rename(tmp, lb->path) == 0) ret = 0;
+        else remove(tmp);
+    }
+    free(tmp);
+    return ret;
+}
+
+/**
+    \brief Merges the log and the runs of the lowest levels into one run
+
+    The run is written to the lowest level which has room for all of
+    them, and the board switches to it and a new log in the manifest.
+    \param lb Pointer to the board
+    \return 0 on success, -2 on errors
+*/
+int Merge(leaderboard* lb) {
+    unsigned long long total = lb->logCount, capacity = LEADERBOARD_LOG_MAX;
+    unsigned level = 0;
+    for (; level < LEADERBOARD_LEVELS-1; level++) {
+        total += lb->runs[level].count;
+        capacity *= LEADERBOARD_GROWTH;
+        if (total <= capacity) break;
+    }
+    if (level == LEADERBOARD_LEVELS-1) total += lb->runs[level].count;
+    if (total > UINT_MAX/RECORD_WORDS) return -2;
+
+    unsigned gen = lb->nextGen++;
+    unsigned logGen = lb->nextGen++;
+    char* path = FileName(lb, gen, "run");
+    FILE* fp = path ? fopen(path, "wb") : NULL;
+    if (!fp) {
+        free(path);
+        return -2;
+    }
+
+    //  K-way merge of the log and the runs, written in chunks of blocks
+    unsigned words[RECORD_WORDS*LEADERBOARD_BLOCK];
+    words[0] = EncodeBigendian(RUN_SIG);
+    words[1] = EncodeBigendian(LEADERBOARD_VER);
+    words[2] = EncodeBigendian((unsigned)total);
+    unsigned crc = CRC32Update(CRC32_INIT, words, sizeof(unsigned)*RUN_HEADER_LEN);
+    bool ok = fwrite(words, sizeof(unsigned), RUN_HEADER_LEN, fp) == RUN_HEADER_LEN;
+
+    unsigned pos[SOURCES] = {0};
+    unsigned used = 0;
+    for (unsigned long long n=0; n < total && ok; n++) {
+        int best = -1;
+        leaderboard_key bestKey;
+        for (unsigned s=0; s <= level+1; s++) {
+            leaderboard_key* key;
+            if (pos[s] >= SourceCount(lb, s)) continue;
+            if (SourceGet(lb, s, pos[s], NULL, &key) != 0) {
+                ok = false;
+                break;
+            }
+            if (best < 0 || CompareKeys(key, &bestKey) < 0) {
+                best = s;
+                bestKey = *key;
+            }
+        }
+        hiscore_list_entry* e;
+        if (!ok || best < 0 || SourceGet(lb, best, pos[best], &e, NULL) != 0) {
+            ok = false;
+            break;
+        }
+        EncodeRecord(words + used*RECORD_WORDS, e, bestKey.seq);
+        pos[best]++;
+
+        if (++used == LEADERBOARD_BLOCK || n+1 == total) {
+            crc = CRC32Update(crc, words, sizeof(unsigned)*RECORD_WORDS*used);
+            ok = fwrite(words, sizeof(unsigned)*RECORD_WORDS, used, fp) == used;
+            used = 0;
+        }
+    }
+    words[0] = EncodeBigendian(CRC32Final(crc));
+    ok = ok && fwrite(words, sizeof(unsigned), 1, fp) == 1;
+    ok = fclose(fp) == 0 && ok;
+
+    //  New run is read back like any other
+    leaderboard_run run = {.blockIndex = UINT_MAX};
+    FILE* logFp = NULL;
+    ok = ok && RunOpen(&run, path, gen, (unsigned)total) == 0;
+    ok = ok && (logFp = LogCreate(lb, logGen)) != NULL;
+
+    //  Manifest commits the merge
+    leaderboard_run old[LEADERBOARD_LEVELS];
+    memcpy(old, lb->runs, sizeof(old));
+    unsigned oldLogGen = lb->logGen;
+    if (ok) {
+        for (unsigned i=0; i < level; i++) {
+            memset(&lb->runs[i], 0, sizeof(leaderboard_run));
+            lb->runs[i].blockIndex = UINT_MAX;
+        }
+        lb->runs[level] = run;
+        lb->logGen = logGen;
+        if (WriteManifest(lb) != 0) {
+            memcpy(lb->runs, old, sizeof(old));
+            lb->logGen = oldLogGen;
+            ok = false;
+        }
+    }
+    if (!ok) {
+        RunClose(&run);
+        if (logFp) fclose(logFp);
+        remove(path);
+        free(path);
+        char* logPath = FileName(lb, logGen, "log");
+        if (logPath) remove(logPath);
+        free(logPath);
+        return -2;
+    }
+    free(path);
+
+    //  Old files aren't listed anymore
+    for (unsigned i=0; i <= level; i++) {
+        if (old[i].gen == 0) continue;
+        char* runPath = FileName(lb, old[i].gen, "run");
+        RunClose(&old[i]);
+        if (runPath) remove(runPath);
+        free(runPath);
+    }
+    char* logPath = FileName(lb, oldLogGen, "log");
+    if (logPath) remove(logPath);
+    free(logPath);
+
+    fclose(lb->logFp);
+    lb->logFp = logFp;
+    lb->logCount = 0;
+    return 0;
+}
@@ -0,0 +1,110 @@
+#ifndef _LEADERBOARD_H_
+#define _LEADERBOARD_H_
+
+#include <stdio.h> /* FILE */
+
+#include "hiscore.h"
+
+#define LEADERBOARD_LOG_MAX 1024 /* Scores in the log before they are merged to the runs */
+#define LEADERBOARD_GROWTH 8    /* Size ratio of runs on consecutive levels */
+#define LEADERBOARD_LEVELS 12   /* Levels of runs, enough for billions of scores */
+#define LEADERBOARD_BLOCK 64    /* Records read from a run at once */
+
+/**
+    \brief Sort key of a score, every posted score has a different one
+*/
+typedef struct {
+    unsigned score;
+    unsigned time;
+    unsigned date;
+    unsigned seq;   /**< Order of posting, decides ties */
+} leaderboard_key;
+
+/**
+    \brief Sorted file of scores on one level
+
+    Only the first key of every block is kept in memory, records are
+    read from the file when needed.
+*/
+typedef struct {
+    FILE* fp;
+    unsigned gen;       /**< Generation in the file name, 0 if the level is empty */
+    unsigned count;     /**< Count of records */
+    leaderboard_key* fences; /**< First key of every LEADERBOARD_BLOCK records */
+
+    hiscore_list_entry* block; /**< Records of the last read block */
+    leaderboard_key* blockKeys;
+    unsigned blockIndex; /**< Index of the cached block, UINT_MAX if none */
+} leaderboard_run;
+
+/**
+    \brief Persistent leaderboard which keeps every posted score
+
+    New scores are appended to a log and kept sorted in memory. When the
+    log is full it is merged with the runs of the lowest levels into one
+    sorted run, so a score is rewritten about LEADERBOARD_GROWTH times per
+    level. Ranks are found with a binary search of the log and every run.
+
+    A manifest lists the files of the board and is replaced atomically
+    after a merge, so a crash can only leave unused files behind. One
+    process may change a board at a time, callers share it by locking
+    "<path>.lock" with LockFile() around LeaderboardOpen() and LeaderboardClose().
+*/
+typedef struct {
+    char* path;         /**< Path of the manifest, other files are named after it */
+    unsigned nextSeq;   /**< Sequence number of the next score */
+    unsigned nextGen;   /**< Generation of the next written file */
+    unsigned total;     /**< Count of scores on the board */
+
+    FILE* logFp;
+    unsigned logGen;
+    hiscore_list_entry* log; /**< Scores of the log, best first */
+    leaderboard_key* logKeys;
+    unsigned logCount;
+
+    leaderboard_run runs[LEADERBOARD_LEVELS]; /**< Level i holds up to LEADERBOARD_LOG_MAX*LEADERBOARD_GROWTH^(i+1) scores */
+} leaderboard;
+
+/**
+    \brief Opens a board, an empty one is created if it doesn't exist
+    \param path Path of the manifest, every board has its own
+    \return Pointer to the board, NULL on error or if the board is invalid
+
+    \note Use LeaderboardClose() to free instance
+*/
+extern leaderboard* LeaderboardOpen(const char* path);
+
+/**
+    \brief Closes files of the board and frees it
+    \param lb Pointer to the board
+*/
+extern void LeaderboardClose(leaderboard* lb);
+
+/**
+    \brief Posts a score to the board
+    \param lb Pointer to the board
+    \param entry Score to add, date should be set
+    \param outRank Ranking of the score starting from 0, can be NULL
+    \return 0 on success, -2 if writing failed
+*/
+extern int LeaderboardAdd(leaderboard* lb, const hiscore_list_entry* entry, unsigned* outRank);
+
+/**
+    \brief Gets ranking the score would have if posted now
+    \param lb Pointer to the board
+    \param entry Pointer to the score
+    \return Ranking starting from 0, count of scores if last
+*/
+extern unsigned LeaderboardRank(leaderboard* lb, const hiscore_list_entry* entry);
+
+/**
+    \brief Reads scores in ranking order
+    \param lb Pointer to the board
+    \param offset Ranking of the first score, 0 for the top scores
+    \param out Array where the scores are copied
+    \param len Length of the array
+    \return Count of scores copied
+*/
+extern unsigned LeaderboardPage(leaderboard* lb, unsigned offset, hiscore_list_entry* out, unsigned len);
+
+#endif //_LEADERBOARD_H_
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+
+#include "playback.h"
+
+static _Thread_local unsigned playbackClock = 0; /* Time returned to the game instance, one per thread */
+
+static unsigned GetPlaybackTime();
+static demo_list* NextInstruction(demo_playback* ptr);
+
+demo_playback* PlaybackCreate(demo* record, unsigned width, unsigned height) {
+    if (!record) return NULL;
+
+    demo_playback* ret = (demo_playback*)malloc(sizeof(demo_playback));
+    if (!ret) return NULL;
+
+    ret->gme = NULL;
+    ret->record = record;
+    ret->width = width;
+    ret->height = height;
+
+    if (PlaybackRestart(ret) != 0) {
+        PlaybackFree(ret);
+        return NULL;
+    }
+    return ret;
+}
+
+void PlaybackFree(demo_playback* ptr) {
+    if (!ptr) return;
+
+    GameFree(ptr->gme);
+    free(ptr);
+}
+
+int PlaybackRestart(demo_playback* ptr) {
+    if (!ptr) return -1;
+
+    GameFree(ptr->gme);
+    playbackClock = 0;
+    ptr->gme = GameInitDemo(ptr->width, ptr->height, GetPlaybackTime, ptr->record);
+    if (!ptr->gme) return -2;
+
+    ptr->position = NULL;
+    ptr->instrsDone = 0;
+    ptr->time = 0;
+
+    //  Clips start from the middle of a game
+    if (ptr->record->flags & DEMO_FLAG_CLIP) {
+        if (!ptr->record->checkpointsFirst) return -3;
+        return PlaybackLoadCheckpoint(ptr, (demo_checkpoint*)ptr->record->checkpointsFirst->value);
+    }
+    return 0;
+}
+
+demo_instruction* PlaybackPeek(demo_playback* ptr) {
+    demo_list* next = NextInstruction(ptr);
+    if (!next) return NULL;
+    return (demo_instruction*)next->value;
+}
+
+demo_instruction* PlaybackStep(demo_playback* ptr) {
+    demo_instruction* inst = PlaybackPeek(ptr);
+    if (!inst) return NULL;
+
+    //  Game sees the time when the instruction was recorded
+    playbackClock = inst->time;
+    ptr->time = inst->time;
+
+    //  Send instruction to game instance
+    if (inst->instruction == INPUT_UPDATE) {
+        //  Old demos force every gravity step
+        if (ptr->gme->recordedGravity) ptr->gme->nextUpdate = 0;
+        GameUpdate(ptr->gme);
+    } else {
+        GameProcessInput(ptr->gme, (player_input)inst->instruction);
+    }
+
+    //  Proceed to next instruction
+    ptr->position = NextInstruction(ptr);
+    ptr->instrsDone++;
+    return inst;
+}
+
+unsigned PlaybackRunUntil(demo_playback* ptr, unsigned time) {
+    unsigned count = 0;
+    demo_instruction* inst = PlaybackPeek(ptr);
+    while (inst && inst->time < time) {
+        PlaybackStep(ptr);
+        count++;
+        inst = PlaybackPeek(ptr);
+    }
+    PlaybackAdvance(ptr, time);
+    return count;
+}
+
+void PlaybackAdvance(demo_playback* ptr, unsigned time) {
+    if (!ptr || ptr->gme->recordedGravity) return;
+
+    //  Never past the next instruction, it may still change what happens
+    demo_instruction* inst = PlaybackPeek(ptr);
+    if (!inst) return;
+    if (inst->time < time) time = inst->time;
+    if (time <= ptr->time) return;
+
+    playbackClock = time;
+    ptr->time = time;
+    GameUpdate(ptr->gme);
+}
+
+int PlaybackSeekPiece(demo_playback* ptr, unsigned piece) {
+    if (!ptr) return -1;
+
+    //  Already passed, start over
+    if (PlaybackPieces(ptr) > piece) {
+        if (PlaybackRestart(ptr) != 0) return -2;
+    }
+
+    while (PlaybackPieces(ptr) < piece) {
+        if (!PlaybackStep(ptr)) return 1; // end of demo
+    }
+    return 0;
+}
+
+int PlaybackLoadCheckpoint(demo_playback* ptr, demo_checkpoint* checkpoint) {
+    if (!ptr || !checkpoint) return -1;
+
+    playbackClock = checkpoint->time;
+    int ret = GameLoadState(ptr->gme, checkpoint->state, checkpoint->len);
+    if (ret != 0) return ret;
+
+    ptr->position = checkpoint->position;
+    ptr->instrsDone = checkpoint->instrsDone;
+    ptr->time = checkpoint->time;
+    return 0;
+}
+
+unsigned PlaybackSeekEnd(demo_playback* ptr) {
+    unsigned count = 0;
+    while (PlaybackStep(ptr)) count++;
+    return count;
+}
+
+unsigned PlaybackSeekGameOver(demo_playback* ptr) {
+    unsigned count = 0;
+    while (!(ptr->gme->info.status & GAME_STATUS_END) && PlaybackStep(ptr)) count++;
+    return count;
+}
+
+unsigned PlaybackPieces(demo_playback* ptr) {
+    if (!ptr) return 0;
+
+    unsigned total = 0;
+    for (unsigned i=0; i < SHAPE_MAX; i++) total += ptr->gme->info.countTetromino[i];
+    return total;
+}
+
+game* PlaybackGame(demo_playback* ptr) {
+    return ptr ? ptr->gme : NULL;
+}
+
+bool PlaybackEnded(demo_playback* ptr) {
+    return !NextInstruction(ptr);
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Time function given to the game instance
+*/
+unsigned GetPlaybackTime() {
+    return playbackClock;
+}
+
+/**
+    \brief Get list element of the next instruction
+
+    Found through the last processed one, so instructions appended after
+    the end of demo are found too.
+*/
+demo_list* NextInstruction(demo_playback* ptr) {
+    if (!ptr) return NULL;
+    if (!ptr->position) return ptr->record->instrsFirst;
+    return ptr->position->next;
+}
@@ -0,0 +1,141 @@
+#ifndef _PLAYBACK_H_
+#define _PLAYBACK_H_
+
+#include <stdbool.h>
+
+#include "game.h"
+
+/**
+    \brief A structure that drives a game instance with a recorded demo
+
+    Playback has its own clock, which is advanced to the time of every
+    instruction processed. Nothing is rendered, so instructions can be
+    processed as fast as the game logic allows. Instructions added to the
+    demo during playback are played too, so demos can be played while
+    they are being decoded.
+*/
+typedef struct {
+    game* gme;          /**< Game instance driven by the demo */
+    demo* record;       /**< Demo being played, not owned by the playback */
+    demo_list* position; /**< Last processed instruction, NULL before the first */
+    unsigned instrsDone; /**< Count of processed instructions */
+    unsigned time;      /**< Time of the last processed instruction or PlaybackAdvance() in milliseconds */
+
+    unsigned width;     /**< The width of the game area */
+    unsigned height;    /**< The height of the game area */
+} demo_playback;
+
+/**
+    \brief Creates a new playback for the given demo
+    \param record Pointer to the demo instance
+    \param width The width of the game area
+    \param height The height of the game area
+    \return Pointer to the new playback, NULL on error
+
+    \note Use PlaybackFree() to delete instance. Demo isn't freed with it.
+*/
+extern demo_playback* PlaybackCreate(demo* record, unsigned width, unsigned height);
+
+/**
+    \brief Frees playback and its game instance
+    \param ptr Pointer to the playback
+*/
+extern void PlaybackFree(demo_playback* ptr);
+
+/**
+    \brief Restarts playback from the beginning of the demo
+
+    Clips start from their first checkpoint.
+    \param ptr Pointer to the playback
+    \return 0 on success, -3 if a clip has no valid starting state
+*/
+extern int PlaybackRestart(demo_playback* ptr);
+
+/**
+    \brief Get the next instruction without processing it
+    \param ptr Pointer to the playback
+    \return Pointer to the next instruction, NULL at the end of demo
+*/
+extern demo_instruction* PlaybackPeek(demo_playback* ptr);
+
+/**
+    \brief Processes the next instruction of the demo
+    \param ptr Pointer to the playback
+    \return Pointer to the processed instruction, NULL at the end of demo
+*/
+extern demo_instruction* PlaybackStep(demo_playback* ptr);
+
+/**
+    \brief Processes all instructions given before the time
+    \param ptr Pointer to the playback
+    \param time Playback time in milliseconds
+    \return Count of processed instructions
+*/
+extern unsigned PlaybackRunUntil(demo_playback* ptr, unsigned time);
+
+/**
+    \brief Runs gravity until the time without processing instructions
+
+    Falling is shown smoothly between instructions. Time is limited to the
+    next instruction, and nothing happens at the end of demo or in old
+    demos which have gravity steps as instructions.
+    \param ptr Pointer to the playback
+    \param time Playback time in milliseconds
+*/
+extern void PlaybackAdvance(demo_playback* ptr, unsigned time);
+
+/**
+    \brief Seeks to the moment when the given piece becomes active
+
+    Restarts playback if the piece has already been passed.
+    \param ptr Pointer to the playback
+    \param piece Number of the piece, first piece is 1
+    \return 0 on success, 1 if demo ended before the piece
+*/
+extern int PlaybackSeekPiece(demo_playback* ptr, unsigned piece);
+
+/**
+    \brief Continues playback from a checkpoint of the demo
+    \param ptr Pointer to the playback
+    \param checkpoint Checkpoint of the played demo
+    \return 0 on success, -3 if the state doesn't fit the game
+*/
+extern int PlaybackLoadCheckpoint(demo_playback* ptr, demo_checkpoint* checkpoint);
+
+/**
+    \brief Processes all remaining instructions
+    \param ptr Pointer to the playback
+    \return Count of processed instructions
+*/
+extern unsigned PlaybackSeekEnd(demo_playback* ptr);
+
+/**
+    \brief Processes instructions until the game is over or demo ends
+    \param ptr Pointer to the playback
+    \return Count of processed instructions
+*/
+extern unsigned PlaybackSeekGameOver(demo_playback* ptr);
+
+/**
+    \brief Get the game instance driven by the playback
+
+    For tools which load the core as a library and can't rely on its struct layouts.
+    \param ptr Pointer to the playback
+    \return Pointer to the game instance, NULL if ptr is NULL
+*/
+extern game* PlaybackGame(demo_playback* ptr);
+
+/**
+    \brief Get count of pieces spawned so far, including the active one
+    \param ptr Pointer to the playback
+*/
+extern unsigned PlaybackPieces(demo_playback* ptr);
+
+/**
+    \brief Check if all instructions have been processed
+    \param ptr Pointer to the playback
+    \return True at the end of demo, can change if instructions are added
+*/
+extern bool PlaybackEnded(demo_playback* ptr);
+
+#endif //_PLAYBACK_H_
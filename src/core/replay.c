@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "replay.h"
+
+static bool SnapshotUsable(demo_replay* ptr, unsigned index); // Snapshot and instructions after it are still in the rings
+
+demo_replay* ReplayCreate(unsigned seconds, unsigned stateLen) {
+    if (seconds == 0 || stateLen == 0 || stateLen > DEMO_CHECKPOINT_MAX_LEN) return NULL;
+
+    demo_replay* ret = (demo_replay*)calloc(1, sizeof(demo_replay));
+    if (!ret) return NULL;
+
+    //  Every snapshot needs the instructions after it, so the window is covered by both rings
+    ret->instrsSize = seconds*REPLAY_INPUTS_PER_SECOND;
+    ret->snapshotsSize = seconds*REPLAY_SNAPSHOTS_PER_SECOND + 1;
+    ret->stateLen = stateLen;
+    ret->window = seconds*1000;
+
+    //  States are allocated in the same block after the snapshots
+    ret->instrs = (demo_instruction*)malloc(sizeof(demo_instruction)*ret->instrsSize);
+    ret->snapshots = (replay_snapshot*)malloc((sizeof(replay_snapshot) + sizeof(unsigned)*stateLen)*ret->snapshotsSize);
+    if (!ret->instrs || !ret->snapshots) {
+        ReplayFree(ret);
+        return NULL;
+    }
+    unsigned* states = (unsigned*)(ret->snapshots + ret->snapshotsSize);
+    for (unsigned i=0; i < ret->snapshotsSize; i++) ret->snapshots[i].state = states + i*stateLen;
+
+    return ret;
+}
+
+void ReplayFree(demo_replay* ptr) {
+    if (!ptr) return;
+
+    free(ptr->instrs);
+    free(ptr->snapshots);
+    free(ptr);
+}
+
+void ReplayReset(demo_replay* ptr, const demo* header) {
+    if (!ptr) return;
+
+    ptr->instrsTotal = 0;
+    ptr->snapshotsTotal = 0;
+    ptr->flags = header ? header->flags : 0;
+    ptr->randomiser = header ? header->randomiser : 0;
+    ptr->rngVersion = header ? header->rngVersion : 0;
+    ptr->seed = header ? header->seed : 0;
+}
+
+void ReplayAddInstruction(demo_replay* ptr, unsigned time, unsigned instruction) {
+    if (!ptr) return;
+
+    demo_instruction* ins = &ptr->instrs[ptr->instrsTotal % ptr->instrsSize];
+    ins->time = time;
+    ins->instruction = instruction;
+    ptr->instrsTotal++;
+}
+
+unsigned* ReplaySnapshot(demo_replay* ptr, unsigned time) {
+    if (!ptr) return NULL;
+
+    replay_snapshot* s = &ptr->snapshots[ptr->snapshotsTotal % ptr->snapshotsSize];
+    s->instrsDone = ptr->instrsTotal;
+    s->time = time;
+    ptr->snapshotsTotal++;
+    return s->state;
+}
+
+demo* ReplayClip(demo_replay* ptr, unsigned time) {
+    if (!ptr || ptr->snapshotsTotal == 0) return NULL;
+
+    //  Clips start from a state, pieces can't be stored for the middle of a game
+    if (!(ptr->flags & DEMO_FLAG_SEEDED)) return NULL;
+
+    //  Oldest usable snapshot within the window, otherwise the latest usable one
+    unsigned oldest = ptr->snapshotsTotal > ptr->snapshotsSize ? ptr->snapshotsTotal - ptr->snapshotsSize : 0;
+    unsigned start = ptr->snapshotsTotal;
+    for (unsigned i = oldest; i < ptr->snapshotsTotal; i++) {
+        if (!SnapshotUsable(ptr, i)) continue;
+        start = i;
+        if (ptr->snapshots[i % ptr->snapshotsSize].time + ptr->window >= time) break;
+    }
+    if (start == ptr->snapshotsTotal) return NULL;
+
+    demo* ret = DemoCreateInstance();
+    if (!ret) return NULL;
+    ret->flags = ptr->flags | DEMO_FLAG_CLIP;
+    ret->randomiser = ptr->randomiser;
+    ret->rngVersion = ptr->rngVersion;
+    ret->seed = ptr->seed;
+
+    //  Instructions after the first snapshot
+    replay_snapshot* first = &ptr->snapshots[start % ptr->snapshotsSize];
+    int err = 0;
+    for (unsigned i = first->instrsDone; i < ptr->instrsTotal && err == 0; i++) {
+        demo_instruction* ins = &ptr->instrs[i % ptr->instrsSize];
+        err = DemoAddInstruction(ret, ins->time, ins->instruction);
+    }
+
+    //  Playback starts from the first checkpoint, the rest can verify the clip
+    for (unsigned i = start; i < ptr->snapshotsTotal && err == 0; i++) {
+        replay_snapshot* s = &ptr->snapshots[i % ptr->snapshotsSize];
+        err = DemoAddCheckpoint(ret, s->instrsDone - first->instrsDone, s->time, s->state, ptr->stateLen);
+    }
+
+    if (err != 0) {
+        DemoFree(ret);
+        return NULL;
+    }
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Check if a clip can start from the snapshot
+    \param ptr Pointer to the ring
+    \param index Number of the snapshot since reset
+    \return True if the snapshot and every instruction after it are in the rings
+*/
+bool SnapshotUsable(demo_replay* ptr, unsigned index) {
+    if (index >= ptr->snapshotsTotal || ptr->snapshotsTotal - index > ptr->snapshotsSize) return false;
+    return ptr->instrsTotal - ptr->snapshots[index % ptr->snapshotsSize].instrsDone <= ptr->instrsSize;
+}
@@ -0,0 +1,93 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include "demo.h"
+
+#define REPLAY_INPUTS_PER_SECOND 32 /* Instructions kept per second of the window */
+#define REPLAY_SNAPSHOTS_PER_SECOND 4 /* Snapshots kept per second of the window */
+
+/**
+    \brief Game state taken while recording to the ring
+*/
+typedef struct {
+    unsigned instrsDone;    /**< Count of instructions added before the snapshot */
+    unsigned time;          /**< Time of the snapshot from the start of the game */
+    unsigned* state;        /**< Words written by GameSaveState(), preallocated */
+} replay_snapshot;
+
+/**
+    \brief The latest moments of a game in fixed size rings
+
+    Game keeps the last instructions and snapshots of its state in
+    preallocated memory, so recording costs no allocations. A clip in the
+    demo format can be made from the ring at any moment.
+*/
+typedef struct {
+    demo_instruction* instrs;   /**< Ring of instructions */
+    unsigned instrsSize;        /**< Capacity of the instruction ring */
+    unsigned instrsTotal;       /**< Instructions added since reset, the next goes to instrsTotal % instrsSize */
+
+    replay_snapshot* snapshots; /**< Ring of snapshots */
+    unsigned snapshotsSize;     /**< Capacity of the snapshot ring */
+    unsigned snapshotsTotal;    /**< Snapshots taken since reset */
+    unsigned stateLen;          /**< Words of every snapshot state */
+
+    unsigned window;            /**< Length of clips in milliseconds */
+    unsigned flags, randomiser, rngVersion, seed; /**< Header of the game's demo */
+} demo_replay;
+
+/**
+    \brief Allocates rings for the given window
+    \param seconds Length of clips in seconds
+    \param stateLen Words of a game state, from GameSaveState()
+    \return Pointer to the ring, NULL on error
+
+    \note Use ReplayFree() to delete instance
+*/
+extern demo_replay* ReplayCreate(unsigned seconds, unsigned stateLen);
+
+/**
+    \brief Frees the rings
+    \param ptr Pointer to the ring
+*/
+extern void ReplayFree(demo_replay* ptr);
+
+/**
+    \brief Empties the rings for a new game
+    \param ptr Pointer to the ring
+    \param header Demo of the game, its flags, randomiser and seed are copied to clips
+*/
+extern void ReplayReset(demo_replay* ptr, const demo* header);
+
+/**
+    \brief Adds an instruction, the oldest one is overwritten when full
+    \param ptr Pointer to the ring
+    \param time Time from the start of the game in milliseconds
+    \param instruction The instruction
+*/
+extern void ReplayAddInstruction(demo_replay* ptr, unsigned time, unsigned instruction);
+
+/**
+    \brief Claims the next snapshot, the oldest one is overwritten when full
+    \param ptr Pointer to the ring
+    \param time Time of the state from the start of the game
+    \return Buffer of stateLen words where the state must be written
+*/
+extern unsigned* ReplaySnapshot(demo_replay* ptr, unsigned time);
+
+/**
+    \brief Makes a clip of the latest moments
+
+    Clip starts from the oldest snapshot within the window whose
+    instructions are all still in the ring, and ends to the last
+    instruction. Snapshots become checkpoints of the clip, playback
+    starts from the first one.
+    \param ptr Pointer to the ring
+    \param time Current time from the start of the game, the window ends to it
+    \return New demo with DEMO_FLAG_CLIP, NULL on error or if nothing is recorded
+
+    \note Use DemoFree() to delete the clip
+*/
+extern demo* ReplayClip(demo_replay* ptr, unsigned time);
+
+#endif //_REPLAY_H_
@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h> /* isalnum() */
+
+#include "scores.h"
+#include "game_randomisers.h"
+
+#define ENTRY_BYTES 36 /* score, rows, lvl, time, date, name[16] */
+#define RESPONSE_HEADER 12
+#define LOCK_SUFFIX ".lock"
+
+/**
+    MESSAGES:
+    Request
+        0               Operation           (byte)
+        1               Kind                (byte)
+        2               Length of the name  (byte)
+        3               Reserved, 0         (byte)
+        4-x             Name without '\0'
+        x+1 - x+4       Offset              (unsigned)
+        x+5 - x+8       Count               (unsigned)
+        x+9 - y         Scores of rank and insert, ENTRY_BYTES each
+
+    Response
+        0               Status              (byte)
+        1-3             Reserved, 0
+        4-7             Total               (unsigned)
+        8-11            Count               (unsigned)
+        12-x            Rankings (unsigned) of rank and insert, scores of top
+
+    Words are big-endian. A score is score, rows, level, time and date
+    followed by the 16 bytes of the name, like in the hiscore file.
+*/
+
+static scores_file* FileGet(scores_store* store, const char* name, unsigned char kind);
+static void FileClose(scores_store* store, scores_file* f);
+static bool ValidName(const char* name);
+
+static unsigned char* PutWord(unsigned char* p, unsigned value);
+static unsigned GetWord(const unsigned char* p);
+static unsigned char* PutEntry(unsigned char* p, const hiscore_list_entry* e);
+static const unsigned char* GetEntry(const unsigned char* p, hiscore_list_entry* e);
+
+scores_store* ScoresOpen(const char* dir, int (*lock)(const char*), void (*unlock)(int)) {
+    if (!dir) return NULL;
+
+    scores_store* store = (scores_store*)calloc(1, sizeof(scores_store));
+    if (!store) return NULL;
+    store->dir = (char*)malloc(strlen(dir)+1);
+    if (!store->dir) {
+        free(store);
+        return NULL;
+    }
+    strcpy(store->dir, dir);
+    store->lock = lock;
+    store->unlock = unlock;
+    return store;
+}
+
+void ScoresClose(scores_store* store) {
+    if (!store) return;
+
+    for (unsigned i=0; i < store->count; i++) FileClose(store, store->files[i]);
+    free(store->files);
+    free(store->dir);
+    free(store);
+}
+
+void ScoresExecute(scores_store* store, const scores_request* req, scores_response* resp) {
+    resp->status = scores_ok;
+    resp->total = 0;
+    resp->count = 0;
+    if (!store || !req || req->count > SCORES_BATCH_MAX || !ScoresServedName(req->name, req->kind) ||
+        req->op < scores_op_rank || req->op > scores_op_top
+    ) {
+        resp->status = scores_err_request;
+        return;
+    }
+
+    scores_file* f = FileGet(store, req->name, req->kind);
+    if (!f) {
+        resp->status = scores_err_open;
+        return;
+    }
+
+    bool changed = false;
+    for (unsigned i=0; req->op != scores_op_top && i < req->count; i++) {
+        hiscore_list_entry e = req->entries[i];
+        e.name[sizeof(e.name)-1] = '\0';
+        if (req->op == scores_op_rank) {
+            resp->ranks[i] = f->lb ? LeaderboardRank(f->lb, &e) : GetRanking(f->table, SCORES_TABLE_LENGTH, &e);
+        } else if (f->lb) {
+            if (LeaderboardAdd(f->lb, &e, &resp->ranks[i]) != 0) {
+                resp->status = scores_err_write;
+                break;
+            }
+        } else {
+            resp->ranks[i] = (unsigned)AddScoreToList(f->table, SCORES_TABLE_LENGTH, &e);
+            if (resp->ranks[i] < SCORES_TABLE_LENGTH) changed = true;
+        }
+        resp->count = i+1;
+    }
+
+    if (req->op == scores_op_top) {
+        if (f->lb) {
+            resp->count = LeaderboardPage(f->lb, req->offset, resp->entries, req->count);
+        } else {
+            for (unsigned i=req->offset; i < SCORES_TABLE_LENGTH && resp->count < req->count; i++) {
+                resp->entries[resp->count++] = f->table[i];
+            }
+        }
+    }
+
+    //  Table is rewritten once for the whole batch
+    if (changed && SaveHiScores(f->path, f->table, SCORES_TABLE_LENGTH) < 0) resp->status = scores_err_write;
+    resp->total = f->lb ? f->lb->total : SCORES_TABLE_LENGTH;
+}
+
+bool ScoresServedName(const char* name, unsigned char kind) {
+    if (!name || !ValidName(name)) return false;
+    if (kind == scores_table) return !strcmp(name, SCORES_TABLE_FILE);
+    if (kind != scores_board) return false;
+    if (!strcmp(name, SCORES_BENCH_BOARD)) return true;
+
+    size_t prefix = strlen(SCORES_BOARD_PREFIX);
+    if (strncmp(name, SCORES_BOARD_PREFIX, prefix)) return false;
+    for (unsigned i=0; i < RANDOMISER_MAX; i++) {
+        const randomiser_desc* desc = RandomiserGet((randomiser_type)i);
+        if (desc && !strcmp(name+prefix, desc->name)) return true;
+    }
+    return false;
+}
+
+unsigned ScoresServe(scores_store* store, const unsigned char* msg, unsigned len, unsigned char* out) {
+    //  Requests are large, one of each is enough
+    static scores_request req;
+    static scores_response resp;
+    if (ScoresUnpackRequest(msg, len, &req) != 0) {
+        resp.status = scores_err_request;
+        resp.total = resp.count = 0;
+        return ScoresPackResponse(&resp, 0, out);
+    }
+
+    ScoresExecute(store, &req, &resp);
+    return ScoresPackResponse(&resp, req.op, out);
+}
+
+unsigned ScoresPackRequest(const scores_request* req, unsigned char* out) {
+    if (!req || !out || req->count > SCORES_BATCH_MAX || !ValidName(req->name)) return 0;
+
+    size_t nameLen = strlen(req->name);
+    unsigned char* p = out;
+    *p++ = req->op;
+    *p++ = req->kind;
+    *p++ = (unsigned char)nameLen;
+    *p++ = 0;
+    memcpy(p, req->name, nameLen);
+    p += nameLen;
+    p = PutWord(p, req->offset);
+    p = PutWord(p, req->count);
+    if (req->op != scores_op_top) {
+        for (unsigned i=0; i < req->count; i++) p = PutEntry(p, &req->entries[i]);
+    }
+    return (unsigned)(p - out);
+}
+
+int ScoresUnpackRequest(const unsigned char* msg, unsigned len, scores_request* req) {
+    if (!msg || !req || len < 4) return -1;
+
+    unsigned nameLen = msg[2];
+    if (nameLen >= SCORES_NAME_MAX || len < 12 + nameLen) return -1;
+    req->op = msg[0];
+    req->kind = msg[1];
+    memcpy(req->name, msg+4, nameLen);
+    req->name[nameLen] = '\0';
+
+    const unsigned char* p = msg + 4 + nameLen;
+    req->offset = GetWord(p);
+    req->count = GetWord(p+4);
+    p += 8;
+    if (req->count > SCORES_BATCH_MAX) return -1;
+    if (req->op == scores_op_top) return p == msg+len ? 0 : -1;
+
+    if (len != 12 + nameLen + req->count*ENTRY_BYTES) return -1;
+    for (unsigned i=0; i < req->count; i++) p = GetEntry(p, &req->entries[i]);
+    return 0;
+}
+
+unsigned ScoresPackResponse(const scores_response* resp, unsigned char op, unsigned char* out) {
+    unsigned char* p = out;
+    *p++ = resp->status;
+    *p++ = 0;
+    *p++ = 0;
+    *p++ = 0;
+    p = PutWord(p, resp->total);
+    p = PutWord(p, resp->count);
+    for (unsigned i=0; i < resp->count && i < SCORES_BATCH_MAX; i++) {
+        p = op == scores_op_top ? PutEntry(p, &resp->entries[i]) : PutWord(p, resp->ranks[i]);
+    }
+    return (unsigned)(p - out);
+}
+
+int ScoresUnpackResponse(const unsigned char* msg, unsigned len, unsigned char op, scores_response* resp) {
+    if (!msg || !resp || len < RESPONSE_HEADER) return -1;
+
+    resp->status = msg[0];
+    resp->total = GetWord(msg+4);
+    resp->count = GetWord(msg+8);
+    unsigned size = op == scores_op_top ? ENTRY_BYTES : 4;
+    if (resp->count > SCORES_BATCH_MAX || len != RESPONSE_HEADER + resp->count*size) return -1;
+
+    const unsigned char* p = msg + RESPONSE_HEADER;
+    for (unsigned i=0; i < resp->count; i++) {
+        if (op == scores_op_top) {
+            p = GetEntry(p, &resp->entries[i]);
+        } else {
+            resp->ranks[i] = GetWord(p);
+            p += 4;
+        }
+    }
+    return 0;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Get an open file of the store, opens it on the first request
+    \param store Pointer to the store
+    \param name Name of the file
+    \param kind scores_kind of the file
+    \return Pointer to the file, NULL on error or if the file was opened as another kind
+*/
+scores_file* FileGet(scores_store* store, const char* name, unsigned char kind) {
+    for (unsigned i=0; i < store->count; i++) {
+        if (!strcmp(store->files[i]->name, name)) return store->files[i]->kind == kind ? store->files[i] : NULL;
+    }
+
+    scores_file** files = (scores_file**)realloc(store->files, sizeof(scores_file*)*(store->count+1));
+    if (!files) return NULL;
+    store->files = files;
+
+    scores_file* f = (scores_file*)calloc(1, sizeof(scores_file));
+    if (!f) return NULL;
+    strcpy(f->name, name);
+    f->kind = kind;
+    f->lock = -1;
+
+    size_t dirLen = strlen(store->dir);
+    bool slash = dirLen > 0 && store->dir[dirLen-1] != '/';
+    size_t len = dirLen + slash + strlen(name) + sizeof(LOCK_SUFFIX);
+    f->path = (char*)malloc(len);
+    if (!f->path) {
+        free(f);
+        return NULL;
+    }
+
+    //  Lock file first, then the file is read as the last writer left it
+    snprintf(f->path, len, "%s%s%s%s", store->dir, slash ? "/" : "", name, LOCK_SUFFIX);
+    if (store->lock && (f->lock = store->lock(f->path)) < 0) {
+        free(f->path);
+        free(f);
+        return NULL;
+    }
+    f->path[len-sizeof(LOCK_SUFFIX)] = '\0';
+
+    if (kind == scores_board) {
+        f->lb = LeaderboardOpen(f->path);
+        if (!f->lb) {
+            FileClose(store, f);
+            return NULL;
+        }
+    } else {
+        //  Missing or broken table starts empty, like in the game
+        ReadHiScores(f->path, f->table, SCORES_TABLE_LENGTH);
+    }
+
+    store->files[store->count++] = f;
+    return f;
+}
+
+/**
+    \brief Closes and frees a file of the store
+    \param store Pointer to the store
+    \param f Pointer to the file
+*/
+void FileClose(scores_store* store, scores_file* f) {
+    LeaderboardClose(f->lb);
+    if (f->lock >= 0 && store->unlock) store->unlock(f->lock);
+    free(f->path);
+    free(f);
+}
+
+/**
+    \brief Checks that name is a plain file name
+    \param name The name
+    \return True if valid
+*/
+bool ValidName(const char* name) {
+    size_t len = strnlen(name, SCORES_NAME_MAX);
+    if (len == 0 || len >= SCORES_NAME_MAX || name[0] == '.') return false;
+    for (size_t i=0; i < len; i++) {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '-' && name[i] != '_' && name[i] != '.') return false;
+    }
+    return true;
+}
+
+/**
+    \brief Writes big-endian word
+    \param p Where the word is written
+    \param value The word
+    \return Pointer after the word
+*/
+unsigned char* PutWord(unsigned char* p, unsigned value) {
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+    return p+4;
+}
+
+/**
+    \brief Reads big-endian word
+    \param p Pointer to the word
+    \return The word
+*/
+unsigned GetWord(const unsigned char* p) {
+    return (unsigned)p[0] << 24 | (unsigned)p[1] << 16 | (unsigned)p[2] << 8 | p[3];
+}
+
+/**
+    \brief Writes score of ENTRY_BYTES bytes
+    \param p Where the score is written
+    \param e Pointer to the score
+    \return Pointer after the score
+*/
+unsigned char* PutEntry(unsigned char* p, const hiscore_list_entry* e) {
+    p = PutWord(p, e->score);
+    p = PutWord(p, e->rows);
+    p = PutWord(p, e->lvl);
+    p = PutWord(p, e->time);
+    p = PutWord(p, e->date);
+
+    //  Padding after the name is zero
+    size_t len = strnlen(e->name, sizeof(e->name)-1);
+    memset(p, 0, sizeof(e->name));
+    memcpy(p, e->name, len);
+    return p + sizeof(e->name);
+}
+
+/**
+    \brief Reads score written by PutEntry()
+    \param p Pointer to the score
+    \param e Where the score is written
+    \return Pointer after the score
+*/
+const unsigned char* GetEntry(const unsigned char* p, hiscore_list_entry* e) {
+    e->score = GetWord(p);
+    e->rows = GetWord(p+4);
+    e->lvl = GetWord(p+8);
+    e->time = GetWord(p+12);
+    e->date = GetWord(p+16);
+    memcpy(e->name, p+20, sizeof(e->name));
+    e->name[sizeof(e->name)-1] = '\0';
+    return p + ENTRY_BYTES;
+}
@@ -0,0 +1,167 @@
+#ifndef _SCORES_H_
+#define _SCORES_H_
+
+#include "hiscore.h"
+#include "leaderboard.h"
+
+#define SCORES_TABLE_LENGTH 10  /* Scores kept in a table */
+#define SCORES_NAME_MAX 64      /* Longest name of a table or board, with '\0' */
+#define SCORES_BATCH_MAX 256    /* Scores in one request */
+#define SCORES_MSG_MAX 16384    /* Longest message of the protocol */
+#define SCORES_SOCKET "scored.sock" /* Socket of the daemon in its directory */
+#define SCORES_TABLE_FILE "hiscores"    /* The hiscore table */
+#define SCORES_BOARD_PREFIX "scores-"   /* Boards are named scores-<randomiser> */
+#define SCORES_BENCH_BOARD SCORES_BOARD_PREFIX "bench" /* Board of tetr-scored bench */
+
+typedef enum {
+    scores_op_rank = 1, /**< Rankings the scores would get */
+    scores_op_insert,   /**< Posts the scores */
+    scores_op_top       /**< Scores in ranking order */
+} scores_op;
+
+typedef enum {
+    scores_table = 0,   /**< Top SCORES_TABLE_LENGTH scores in a hiscore file */
+    scores_board        /**< Leaderboard which keeps every score */
+} scores_kind;
+
+typedef enum {
+    scores_ok = 0,
+    scores_err_request, /**< Invalid request */
+    scores_err_open,    /**< Table or board could not be opened */
+    scores_err_write    /**< A score could not be saved */
+} scores_status;
+
+/**
+    \brief Request to a store of scores
+*/
+typedef struct {
+    unsigned char op;   /**< scores_op */
+    unsigned char kind; /**< scores_kind */
+    char name[SCORES_NAME_MAX]; /**< File name of the table or board in the directory of the store */
+    unsigned offset;    /**< Ranking of the first score of top */
+    unsigned count;     /**< Count of scores wanted by top, or given to rank and insert */
+    hiscore_list_entry entries[SCORES_BATCH_MAX]; /**< Scores of rank and insert */
+} scores_request;
+
+/**
+    \brief Response of a store of scores
+*/
+typedef struct {
+    unsigned char status; /**< scores_status */
+    unsigned total;     /**< Count of scores in the table or board */
+    unsigned count;     /**< Count of rankings or entries */
+    unsigned ranks[SCORES_BATCH_MAX]; /**< Rankings of rank and insert starting from 0 */
+    hiscore_list_entry entries[SCORES_BATCH_MAX]; /**< Scores returned by top */
+} scores_response;
+
+/**
+    \brief Table or board opened by a store
+*/
+typedef struct {
+    char name[SCORES_NAME_MAX];
+    unsigned char kind;
+    int lock;           /**< Lock held while the store is open, -1 if none */
+    leaderboard* lb;    /**< Board, NULL for tables */
+    char* path;         /**< Path of the table */
+    hiscore_list_entry table[SCORES_TABLE_LENGTH];
+} scores_file;
+
+/**
+    \brief Tables and boards of one directory
+
+    Files are opened on their first request and kept open until the store
+    is closed. Each is locked for that time with "<name>.lock", so stores
+    of different processes take turns. Only the names accepted by
+    ScoresServedName() are opened, so a client can't make the store create
+    or hold any other files.
+*/
+typedef struct {
+    char* dir;
+    int (*lock)(const char*);   /**< Takes the lock of a path, NULL if not locked */
+    void (*unlock)(int);
+    scores_file** files;
+    unsigned count;
+} scores_store;
+
+/**
+    \brief Opens a store of scores
+    \param dir Directory of the files, "" for the working directory
+    \param lock Function which locks a lock file until unlock is called, can be NULL
+    \param unlock Function which releases the lock
+    \return Pointer to the store, NULL on error
+
+    \note Use ScoresClose() to free instance
+*/
+extern scores_store* ScoresOpen(const char* dir, int (*lock)(const char*), void (*unlock)(int));
+
+/**
+    \brief Closes files of the store and frees it
+    \param store Pointer to the store
+*/
+extern void ScoresClose(scores_store* store);
+
+/**
+    \brief Checks if a store serves the file
+    \param name Name of the table or board
+    \param kind scores_kind of the file
+    \return True for SCORES_TABLE_FILE, the boards of the randomisers and SCORES_BENCH_BOARD
+*/
+extern bool ScoresServedName(const char* name, unsigned char kind);
+
+/**
+    \brief Executes a request
+    \param store Pointer to the store
+    \param req The request
+    \param resp Result of the request, status tells if it failed
+*/
+extern void ScoresExecute(scores_store* store, const scores_request* req, scores_response* resp);
+
+/**
+    \brief Executes a request message and writes the response message
+    \param store Pointer to the store
+    \param msg Request packed with ScoresPackRequest()
+    \param len Length of the message
+    \param out Buffer of SCORES_MSG_MAX bytes for the response
+    \return Length of the response
+
+    \note Not reentrant, the request is unpacked to a static buffer
+*/
+extern unsigned ScoresServe(scores_store* store, const unsigned char* msg, unsigned len, unsigned char* out);
+
+/**
+    \brief Packs request to a message
+    \param req The request
+    \param out Buffer of SCORES_MSG_MAX bytes
+    \return Length of the message, 0 if the request is invalid
+*/
+extern unsigned ScoresPackRequest(const scores_request* req, unsigned char* out);
+
+/**
+    \brief Unpacks message to a request
+    \param msg The message
+    \param len Length of the message
+    \param req Where the request is unpacked
+    \return 0 on success, -1 if the message is invalid
+*/
+extern int ScoresUnpackRequest(const unsigned char* msg, unsigned len, scores_request* req);
+
+/**
+    \brief Packs response to a message
+    \param resp The response
+    \param op Operation of the request, decides which results are packed
+    \param out Buffer of SCORES_MSG_MAX bytes
+    \return Length of the message
+*/
+extern unsigned ScoresPackResponse(const scores_response* resp, unsigned char op, unsigned char* out);
+
+/**
+    \brief Unpacks message to a response
+    \param msg The message
+    \param len Length of the message
+    \param op Operation of the request
+    \param resp Where the response is unpacked
+    \return 0 on success, -1 if the message is invalid
+*/
+extern int ScoresUnpackResponse(const unsigned char* msg, unsigned len, unsigned char op, scores_response* resp);
+
+#endif //_SCORES_H_
@@ -0,0 +1,538 @@
+//  Plays a demo through the UI backends headless and measures rendering
+#define _XOPEN_SOURCE 600 /* posix_openpt() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h> /* clock_gettime() */
+#include <fcntl.h> /* posix_openpt(), O_NONBLOCK */
+#include <unistd.h> /* dup(), dup2(), read() */
+#include <poll.h> /* poll() */
+#include <pthread.h>
+#include <sys/ioctl.h> /* TIOCSWINSZ */
+
+#include "../ui/ui.h"
+#include "../ui/states/states.h"
+#include "../ui/curses/init.h"
+#include "../ui/video/init.h"
+#include "../ui/video/raster.h"
+#include "../ui/os/os.h"
+#ifndef _NO_SDL
+#include "SDL.h"
+#include "../ui/sdl/init.h"
+#endif //_NO_SDL
+
+#define LINE_LEN 512
+#define ARGS_MAX 8
+#define BENCH_FPS 60 /* Rate of the virtual clock */
+#define TERM_COLS 100
+#define TERM_ROWS 30
+#define TERM_CHUNK 4096 /* Bytes read from the terminal at once */
+#define MEASURE_ROUNDS 5
+
+static const char* helpStr =
+"Usage: tetr-benchrender [options] --demo <file>\n\
+Options:\n \
+  --help, -h\t\t\tDisplay this information\n \
+  --demo <file>\t\t\tDemo played through the backends\n \
+  --UI <UI>\t\t\tMeasure only one backend, curses, SDL or video\n \
+  --frames <n>\t\t\tStop after given count of frames. default=whole demo\n \
+  --rounds <n>\t\t\tTimes the demo is played through each backend. default=5\n \
+  --baseline <file>\t\tEarlier report to compare against, ignored if missing\n \
+  --out <file>\t\t\tWrite JSON report to file. default=stdout\n \
+  --threshold <percent>\t\tAllowed growth of frame time, draw calls and bytes. default=10\n\n\
+The demo is played with the demo state and a virtual clock of 60 frames\n\
+per second, so every backend renders the same frames as fast as it can.\n\
+Backends take turns in rounds and the round with the fastest median frame\n\
+is kept for each. Curses renders to a pseudo-terminal, SDL to an offscreen window with the\n\
+software renderer and video to /dev/null. Exit status is 0 on success, 1\n\
+if a backend regressed, 2 on errors.\n";
+
+/**
+    \brief UI backend and how it is run headless
+*/
+typedef struct {
+    const char* name;
+    int (*init)(UI_Functions*, int, char**);
+    char* args[ARGS_MAX];   /**< Command line given to init, NULL terminated */
+    bool draws;             /**< Draw calls are counted */
+    bool terminal;          /**< Renders to a pseudo-terminal */
+} render_backend;
+
+/**
+    \brief Result of one backend
+*/
+typedef struct {
+    const render_backend* backend;
+    bool valid;             /**< Backend was initialized and the demo played */
+    unsigned long frames;
+    double p50;             /**< Frame times in milliseconds */
+    double p90;
+    double p99;
+    double max;
+    double draws;           /**< Draw calls per frame */
+    unsigned long maxDraws;
+    unsigned long long bytes; /**< Written to the terminal */
+} render_result;
+
+static const render_backend backends[] = {
+    {"curses", CursesInit, {"tetr-benchrender", NULL}, false, true},
+#ifndef _NO_SDL
+    {"SDL", UI_SDLInit, {"tetr-benchrender", "--fps", "0", NULL}, true, false},
+#endif //_NO_SDL
+    {"video", UI_VideoInit, {"tetr-benchrender", "--fps", "60", "--out", "/dev/null", NULL}, true, false},
+};
+#define BACKEND_COUNT (sizeof(backends)/sizeof(backends[0]))
+
+//  Draw calls and sleeping of the backends are intercepted with the linker
+static unsigned long drawCalls = 0;
+void __wrap_SleepMs(unsigned ms) { (void)ms; }
+extern void __real_VideoFill(video_image* dst, video_rect* rect, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+extern void __real_VideoDrawRect(video_image* dst, video_rect* rect, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+extern void __real_VideoBlit(video_image* dst, video_image* src, video_rect* clip, video_rect* target, const unsigned char* mod, unsigned char a);
+void __wrap_VideoFill(video_image* dst, video_rect* rect, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+    drawCalls++; __real_VideoFill(dst, rect, r, g, b, a);
+}
+void __wrap_VideoDrawRect(video_image* dst, video_rect* rect, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+    drawCalls++; __real_VideoDrawRect(dst, rect, r, g, b, a);
+}
+void __wrap_VideoBlit(video_image* dst, video_image* src, video_rect* clip, video_rect* target, const unsigned char* mod, unsigned char a) {
+    drawCalls++; __real_VideoBlit(dst, src, clip, target, mod, a);
+}
+#ifndef _NO_SDL
+extern int __real_SDL_RenderClear(SDL_Renderer* ren);
+extern int __real_SDL_RenderCopy(SDL_Renderer* ren, SDL_Texture* tex, const SDL_Rect* src, const SDL_Rect* dst);
+extern int __real_SDL_RenderFillRect(SDL_Renderer* ren, const SDL_Rect* rect);
+extern int __real_SDL_RenderDrawRect(SDL_Renderer* ren, const SDL_Rect* rect);
+extern int __real_SDL_RenderCopyF(SDL_Renderer* ren, SDL_Texture* tex, const SDL_Rect* src, const SDL_FRect* dst);
+extern int __real_SDL_RenderFillRectF(SDL_Renderer* ren, const SDL_FRect* rect);
+extern int __real_SDL_RenderGeometry(SDL_Renderer* ren, SDL_Texture* tex, const SDL_Vertex* verts, int nverts, const int* indices, int nindices);
+int __wrap_SDL_RenderClear(SDL_Renderer* ren) { drawCalls++; return __real_SDL_RenderClear(ren); }
+int __wrap_SDL_RenderCopy(SDL_Renderer* ren, SDL_Texture* tex, const SDL_Rect* src, const SDL_Rect* dst) {
+    drawCalls++; return __real_SDL_RenderCopy(ren, tex, src, dst);
+}
+int __wrap_SDL_RenderFillRect(SDL_Renderer* ren, const SDL_Rect* rect) { drawCalls++; return __real_SDL_RenderFillRect(ren, rect); }
+int __wrap_SDL_RenderDrawRect(SDL_Renderer* ren, const SDL_Rect* rect) { drawCalls++; return __real_SDL_RenderDrawRect(ren, rect); }
+int __wrap_SDL_RenderCopyF(SDL_Renderer* ren, SDL_Texture* tex, const SDL_Rect* src, const SDL_FRect* dst) {
+    drawCalls++; return __real_SDL_RenderCopyF(ren, tex, src, dst);
+}
+int __wrap_SDL_RenderFillRectF(SDL_Renderer* ren, const SDL_FRect* rect) { drawCalls++; return __real_SDL_RenderFillRectF(ren, rect); }
+int __wrap_SDL_RenderGeometry(SDL_Renderer* ren, SDL_Texture* tex, const SDL_Vertex* verts, int nverts, const int* indices, int nindices) {
+    drawCalls++; return __real_SDL_RenderGeometry(ren, tex, verts, nverts, indices, nindices);
+}
+#endif //_NO_SDL
+
+//  Virtual clock and frame limit of the played demo
+static unsigned long clockFrames = 0;
+static unsigned long maxFrames = 0;
+static int (*backendInput)(UI_Functions*) = NULL;
+
+//  Pseudo-terminal which replaces stdin and stdout of curses
+static int termMaster = -1;
+static int savedIn = -1;
+static int savedOut = -1;
+static pthread_t termReader;
+static atomic_bool termClosing = false;
+static unsigned long long termBytes = 0;
+
+static double NowMs();
+static unsigned BenchMillis();
+static int BenchInput(UI_Functions* funs);
+static bool RunBackend(const render_backend* backend, const char* path, render_result* out);
+static int CompareMs(const void* a, const void* b);
+static int OpenTerminal();
+static void CloseTerminal();
+static void* ReadTerminal(void* data);
+static double BaselineValue(const char* path, const char* name, const char* field);
+static void WriteReport(FILE* fp, const char* path, render_result* results, unsigned count);
+
+int main(int argc, char** argv) {
+    const char* path = NULL;
+    const char* only = NULL;
+    const char* baseline = NULL;
+    const char* output = NULL;
+    double threshold = 10;
+    unsigned rounds = MEASURE_ROUNDS;
+
+    //  Process command line arguments
+    for (int i=1; i<argc; i++) {
+        bool invalidArgs = false;
+        if (!strcmp(argv[i], "--demo")) {
+            if (argc <= ++i) invalidArgs = true;
+            else path = argv[i];
+        } else if (!strcmp(argv[i], "--UI")) {
+            if (argc <= ++i) invalidArgs = true;
+            else only = argv[i];
+        } else if (!strcmp(argv[i], "--frames")) {
+            if (argc <= ++i) invalidArgs = true;
+            else maxFrames = strtoul(argv[i], NULL, 10);
+        } else if (!strcmp(argv[i], "--rounds")) {
+            char* end;
+            if (argc <= ++i) invalidArgs = true;
+            else if (argv[i][0] == '-' || (rounds = strtoul(argv[i], &end, 10)) < 1 || *end) invalidArgs = true;
+        } else if (!strcmp(argv[i], "--baseline")) {
+            if (argc <= ++i) invalidArgs = true;
+            else baseline = argv[i];
+        } else if (!strcmp(argv[i], "--out")) {
+            if (argc <= ++i) invalidArgs = true;
+            else output = argv[i];
+        } else if (!strcmp(argv[i], "--threshold")) {
+            if (argc <= ++i) invalidArgs = true;
+            else threshold = atof(argv[i]);
+        } else {
+            invalidArgs = true;
+        }
+
+        if (invalidArgs) {
+            printf("%s", helpStr);
+            return 2;
+        }
+    }
+    if (!path) {
+        printf("%s", helpStr);
+        return 2;
+    }
+
+    //  Headless defaults, can be overridden from the environment
+    setenv("TERM", "xterm", 0);
+#ifndef _NO_SDL
+    setenv("SDL_VIDEODRIVER", "offscreen", 0);
+    setenv("SDL_RENDER_DRIVER", "software", 0);
+    setenv("SDL_AUDIODRIVER", "dummy", 0);
+#endif //_NO_SDL
+
+    static render_result results[BACKEND_COUNT];
+    unsigned count = 0;
+    int ret = 0;
+    for (unsigned i=0; i < BACKEND_COUNT; i++) {
+        if (only && strcmp(only, backends[i].name)) continue;
+        results[count].backend = &backends[i];
+        results[count++].valid = true;
+    }
+    if (!count) {
+        fprintf(stderr, "Unknown UI %s\n", only);
+        return 2;
+    }
+
+    /*
+        Backends take turns and the round with the fastest median frame is
+        kept for each, so a burst of load on the machine doesn't hit all rounds
+    */
+    for (unsigned round = 0; round < rounds; round++) {
+        for (unsigned i=0; i < count; i++) {
+            render_result* r = &results[i];
+            if (!r->valid) continue;
+
+            render_result current = {.backend = r->backend};
+            if (!RunBackend(r->backend, path, &current)) {
+                fprintf(stderr, "%s: could not play %s\n", r->backend->name, path);
+                r->valid = false;
+                ret = 2;
+            } else if (round == 0 || current.p50 < r->p50) {
+                current.valid = true;
+                *r = current;
+            }
+        }
+    }
+
+    FILE* fp = output ? fopen(output, "w") : stdout;
+    if (!fp) {
+        fprintf(stderr, "Could not open %s\n", output);
+        return 2;
+    }
+    WriteReport(fp, path, results, count);
+    if (fp != stdout) fclose(fp);
+
+    //  Summary and comparison with the baseline
+    for (unsigned i=0; i < count; i++) {
+        render_result* r = &results[i];
+        if (!r->valid) continue;
+        const char* name = r->backend->name;
+        fprintf(stderr, "%s: %lu frames, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms in the best of %u rounds", name,
+            r->frames, r->p50, r->p90, r->p99, r->max, rounds);
+        if (r->backend->draws) fprintf(stderr, ", %.1f draw calls per frame", r->draws);
+        if (r->backend->terminal) fprintf(stderr, ", %.0f bytes per frame", r->frames ? (double)r->bytes/r->frames : 0.0);
+        fprintf(stderr, "\n");
+
+        double base = baseline ? BaselineValue(baseline, name, "p50") : 0;
+        if (base <= 0) {
+            if (baseline) fprintf(stderr, "No baseline of %s in %s, save one with 'make bench-render-baseline'\n", name, baseline);
+            continue;
+        }
+
+        //  Frame time is noisy, counts of draw calls and bytes change only with the code
+        const char* fields[] = {"p50", "draws", "bytesPerFrame"};
+        double values[] = {r->p50, r->draws, r->frames ? (double)r->bytes/r->frames : 0.0};
+        for (unsigned f=0; f < 3; f++) {
+            double old = BaselineValue(baseline, name, fields[f]);
+            if (old <= 0) continue;
+            double change = (values[f] - old)*100/old;
+            fprintf(stderr, "  %s baseline %.3f, change %+.1f%%\n", fields[f], old, change);
+            if (change > threshold) {
+                fprintf(stderr, "  %s of %s grew more than %.1f%%\n", fields[f], name, threshold);
+                if (ret < 1) ret = 1;
+            }
+        }
+    }
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+double NowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000.0 + ts.tv_nsec/1000000.0;
+}
+
+/**
+    \brief Time of the virtual clock, advanced by one frame per main loop
+*/
+unsigned BenchMillis() {
+    return (unsigned long long)clockFrames*1000/BENCH_FPS;
+}
+
+/**
+    \brief Reads input of the backend and quits when the frame limit is reached
+    \param funs Pointer to UI functions struct
+    \return Count of inputs
+*/
+int BenchInput(UI_Functions* funs) {
+    int count = backendInput(funs);
+    if (maxFrames > 0 && clockFrames >= maxFrames && count < INPUT_ARRAY_LEN) {
+        funs->inputs[count] = 'q';
+        funs->inputTimes[count++] = 0;
+    }
+    return count;
+}
+
+/**
+    \brief Plays the demo through the backend with the main loop of the game
+    \param backend The backend
+    \param path Path to the demo
+    \param out Where results are written
+    \return False on error
+*/
+bool RunBackend(const render_backend* backend, const char* path, render_result* out) {
+    //  Settings of the demo state, freed by the state
+    void** data = (void**)malloc(sizeof(void*));
+    state_demo_data* settings = (state_demo_data*)calloc(1, sizeof(state_demo_data));
+    char* str = (char*)malloc(strlen(path)+1);
+    if (!data || !settings || !str) {
+        free(data);
+        free(settings);
+        free(str);
+        return false;
+    }
+    strcpy(str, path);
+    settings->path = str;
+    settings->showKeys = true;
+    settings->exitAtEnd = true;
+    settings->stream = OpenStream(path);
+    *data = settings;
+    if (settings->stream < 0) {
+        free(str);
+        free(settings);
+        free(data);
+        return false;
+    }
+
+    if (backend->terminal && OpenTerminal() != 0) {
+        CloseStream(settings->stream);
+        free(str);
+        free(settings);
+        free(data);
+        return false;
+    }
+
+    int argc = 0;
+    while (backend->args[argc]) argc++;
+    UI_Functions ui = {NULL};
+    void* (*CurrentState)(UI_Functions*, void**) = NULL;
+    if (backend->init(&ui, argc, (char**)backend->args) == 0) {
+        CurrentState = StatePlayDemo;
+        backendInput = ui.UIGetInput;
+        ui.UIGetInput = BenchInput;
+        ui.UIGetMillis = BenchMillis;
+    } else {
+        CloseStream(settings->stream);
+        free(str);
+        free(settings);
+        *data = NULL;
+    }
+
+    //  Main loop of MainProgram, timed from the state to the end of the frame
+    double* times = NULL;
+    unsigned long* draws = NULL;
+    unsigned long frames = 0, size = 0;
+    clockFrames = 0;
+    while (CurrentState != NULL) {
+        if (frames == size) {
+            size = size ? 2*size : 1024;
+            double* newTimes = (double*)realloc(times, size*sizeof(double));
+            if (newTimes) times = newTimes;
+            unsigned long* newDraws = (unsigned long*)realloc(draws, size*sizeof(unsigned long));
+            if (newDraws) draws = newDraws;
+            if (!newTimes || !newDraws) {
+                fprintf(stderr, "Out of memory\n");
+                exit(2);
+            }
+        }
+
+        drawCalls = 0;
+        double start = NowMs();
+        CurrentState = CurrentState(&ui, data);
+        ui.UIMainLoopEnd(&ui);
+        times[frames] = NowMs() - start;
+        draws[frames++] = drawCalls;
+        clockFrames++;
+    }
+
+    if (*data != NULL) free(*data);
+    free(data);
+    if (ui.UICleanup) ui.UICleanup(&ui);
+    if (backend->terminal) CloseTerminal();
+
+    out->frames = frames;
+    out->bytes = backend->terminal ? termBytes : 0;
+    out->draws = 0;
+    out->maxDraws = 0;
+    for (unsigned long i=0; i < frames; i++) {
+        out->draws += draws[i];
+        if (draws[i] > out->maxDraws) out->maxDraws = draws[i];
+    }
+    if (frames) {
+        out->draws /= frames;
+        qsort(times, frames, sizeof(double), CompareMs);
+        out->p50 = times[frames*50/100];
+        out->p90 = times[frames*90/100];
+        out->p99 = times[frames*99/100];
+        out->max = times[frames-1];
+    }
+    free(times);
+    free(draws);
+    return frames > 1;
+}
+
+int CompareMs(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+    \brief Replaces stdin and stdout with a pseudo-terminal and starts reading it
+    \return 0 on success
+*/
+int OpenTerminal() {
+    termMaster = posix_openpt(O_RDWR | O_NOCTTY);
+    if (termMaster < 0) return -1;
+    int slave = -1;
+    if (grantpt(termMaster) == 0 && unlockpt(termMaster) == 0) slave = open(ptsname(termMaster), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        close(termMaster);
+        termMaster = -1;
+        return -2;
+    }
+    struct winsize ws = {.ws_row = TERM_ROWS, .ws_col = TERM_COLS};
+    ioctl(slave, TIOCSWINSZ, &ws);
+    fcntl(termMaster, F_SETFL, fcntl(termMaster, F_GETFL) | O_NONBLOCK);
+
+    //  Output is read while it is written, a full terminal would block curses
+    termBytes = 0;
+    atomic_store(&termClosing, false);
+    if (pthread_create(&termReader, NULL, ReadTerminal, NULL) != 0) {
+        close(slave);
+        close(termMaster);
+        termMaster = -1;
+        return -3;
+    }
+
+    fflush(stdout);
+    savedIn = dup(STDIN_FILENO);
+    savedOut = dup(STDOUT_FILENO);
+    dup2(slave, STDIN_FILENO);
+    dup2(slave, STDOUT_FILENO);
+    close(slave);
+    return 0;
+}
+
+/**
+    \brief Gives stdin and stdout back and waits for the rest of the output
+*/
+void CloseTerminal() {
+    fflush(stdout);
+    dup2(savedIn, STDIN_FILENO);
+    dup2(savedOut, STDOUT_FILENO);
+    close(savedIn);
+    close(savedOut);
+
+    atomic_store(&termClosing, true);
+    pthread_join(termReader, NULL);
+    close(termMaster);
+    termMaster = -1;
+}
+
+/**
+    \brief Thread function, counts bytes written to the terminal until it is closed
+    \param data Unused
+*/
+void* ReadTerminal(void* data) {
+    (void)data;
+
+    char buf[TERM_CHUNK];
+    struct pollfd pfd = {.fd = termMaster, .events = POLLIN};
+    while (true) {
+        //  Closing is checked only when the terminal is empty, so the output is read to the end
+        bool closing = atomic_load(&termClosing);
+        int ready = poll(&pfd, 1, 10);
+        ssize_t len = ready > 0 ? read(termMaster, buf, TERM_CHUNK) : 0;
+        if (len > 0) termBytes += len;
+        else if (closing) break;
+    }
+    return NULL;
+}
+
+/**
+    \brief Finds a value of a backend in a report
+    \param path Path to the report
+    \param name Name of the backend
+    \param field Name of the value
+    \return The value, 0 if not found
+*/
+double BaselineValue(const char* path, const char* name, const char* field) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return 0;
+
+    //  Reports have one backend per line
+    double ret = 0;
+    char line[LINE_LEN], key[LINE_LEN];
+    snprintf(key, LINE_LEN, "\"name\": \"%s\"", name);
+    char value[LINE_LEN];
+    snprintf(value, LINE_LEN, "\"%s\": ", field);
+    while (fgets(line, LINE_LEN, fp)) {
+        char* pos = strstr(line, value);
+        if (strstr(line, key) && pos) {
+            ret = atof(pos + strlen(value));
+            break;
+        }
+    }
+    fclose(fp);
+    return ret;
+}
+
+void WriteReport(FILE* fp, const char* path, render_result* results, unsigned count) {
+    fprintf(fp, "{\n  \"demo\": \"%s\",\n  \"fps\": %u,\n  \"backends\": [\n", path, BENCH_FPS);
+    for (unsigned i=0; i < count; i++) {
+        render_result* r = &results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"ok\": %s, \"frames\": %lu, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f",
+            r->backend->name, r->valid ? "true" : "false", r->frames, r->p50, r->p90, r->p99, r->max);
+        if (r->backend->draws) fprintf(fp, ", \"draws\": %.2f, \"maxDraws\": %lu", r->draws, r->maxDraws);
+        if (r->backend->terminal) fprintf(fp, ", \"bytes\": %llu, \"bytesPerFrame\": %.1f",
+            r->bytes, r->frames ? (double)r->bytes/r->frames : 0.0);
+        fprintf(fp, "}%s\n", i+1 < count ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
@@ -0,0 +1,300 @@
+//  Replays a golden demo corpus, checks final states and measures throughput
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h> /* clock_gettime() */
+
+#include "../ui/ui.h" /* MAP_WIDTH, MAP_HEIGHT */
+#include "../core/playback.h"
+
+#define LINE_LEN 512
+#define MAX_DEMOS 256
+#define MEASURE_ROUNDS 5
+
+static const char* helpStr =
+"Usage: tetr-benchreplay [options] --golden <file>\n\
+Options:\n \
+  --help, -h\t\t\tDisplay this information\n \
+  --golden <file>\t\tList of '<hash> <demo>' lines, demos relative to the list\n \
+  --baseline <file>\t\tEarlier report to compare against, ignored if missing\n \
+  --out <file>\t\t\tWrite JSON report to file. default=stdout\n \
+  --threshold <percent>\t\tAllowed throughput regression. default=10\n \
+  --min-time <ms>\t\tMinimum time each demo is replayed. default=200\n \
+  --update\t\t\tRewrite hashes of the golden list with the current core\n\n\
+Each demo is read and played headless until it ends. The final state hash\n\
+must match the golden hash. Exit status is 0 on success, 1 if a hash\n\
+differs or throughput regressed, 2 on errors.\n";
+
+/**
+    \brief Result of one demo
+*/
+typedef struct {
+    char name[LINE_LEN];    /**< Path relative to the golden list */
+    unsigned golden;        /**< Expected hash */
+    unsigned hash;          /**< Hash after replay */
+    bool valid;             /**< Demo was read and played */
+    unsigned pieces;        /**< Pieces spawned in one replay */
+    unsigned runs;          /**< Times replayed */
+    double ms;              /**< Time of one replay in the fastest round */
+    unsigned long allocs;   /**< Allocations made by one replay */
+} replay_result;
+
+//  Allocations are counted by wrapping malloc() with the linker
+static unsigned long allocCount = 0;
+extern void* __real_malloc(size_t size);
+extern void* __real_calloc(size_t n, size_t size);
+extern void* __real_realloc(void* ptr, size_t size);
+void* __wrap_malloc(size_t size) { allocCount++; return __real_malloc(size); }
+void* __wrap_calloc(size_t n, size_t size) { allocCount++; return __real_calloc(n, size); }
+void* __wrap_realloc(void* ptr, size_t size) { allocCount++; return __real_realloc(ptr, size); }
+
+static double NowMs();
+static bool ReplayOnce(const char* path, unsigned* outHash, unsigned* outPieces);
+static void MeasureRound(const char* path, double time, replay_result* out);
+static double BaselinePps(const char* path, const char* name);
+static void WriteReport(FILE* fp, replay_result* results, unsigned count, double totalPps);
+
+int main(int argc, char** argv) {
+    const char* golden = NULL;
+    const char* baseline = NULL;
+    const char* output = NULL;
+    double threshold = 10;
+    unsigned minTime = 200;
+    bool update = false;
+
+    //  Process command line arguments
+    for (int i=1; i<argc; i++) {
+        bool invalidArgs = false;
+        if (!strcmp(argv[i], "--golden")) {
+            if (argc <= ++i) invalidArgs = true;
+            else golden = argv[i];
+        } else if (!strcmp(argv[i], "--baseline")) {
+            if (argc <= ++i) invalidArgs = true;
+            else baseline = argv[i];
+        } else if (!strcmp(argv[i], "--out")) {
+            if (argc <= ++i) invalidArgs = true;
+            else output = argv[i];
+        } else if (!strcmp(argv[i], "--threshold")) {
+            if (argc <= ++i) invalidArgs = true;
+            else threshold = atof(argv[i]);
+        } else if (!strcmp(argv[i], "--min-time")) {
+            if (argc <= ++i) invalidArgs = true;
+            else minTime = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "--update")) {
+            update = true;
+        } else {
+            invalidArgs = true;
+        }
+
+        if (invalidArgs) {
+            printf("%s", helpStr);
+            return 2;
+        }
+    }
+    if (!golden) {
+        printf("%s", helpStr);
+        return 2;
+    }
+
+    //  Demos are relative to the directory of the golden list
+    char dir[LINE_LEN] = "";
+    const char* slash = strrchr(golden, '/');
+    if (slash && slash-golden+1 < LINE_LEN) {
+        memcpy(dir, golden, slash-golden+1);
+        dir[slash-golden+1] = '\0';
+    }
+
+    FILE* fp = fopen(golden, "r");
+    if (!fp) {
+        fprintf(stderr, "Could not read %s\n", golden);
+        return 2;
+    }
+    static replay_result results[MAX_DEMOS];
+    static char paths[MAX_DEMOS][2*LINE_LEN];
+    unsigned count = 0;
+    char line[LINE_LEN];
+    while (fgets(line, LINE_LEN, fp) && count < MAX_DEMOS) {
+        replay_result* r = &results[count];
+        if (line[0] == '#' || sscanf(line, "%x %511s", &r->golden, r->name) != 2) continue;
+        count++;
+    }
+    fclose(fp);
+
+    //  Replay every demo once to check the hash and count allocations
+    int ret = 0;
+    for (unsigned i=0; i < count; i++) {
+        replay_result* r = &results[i];
+        snprintf(paths[i], 2*LINE_LEN, "%s%s", dir, r->name);
+
+        unsigned long allocsBefore = allocCount;
+        r->valid = ReplayOnce(paths[i], &r->hash, &r->pieces);
+        r->allocs = allocCount - allocsBefore;
+        if (!r->valid) {
+            fprintf(stderr, "%s: could not be played\n", r->name);
+            ret = 2;
+        } else if (!update && r->hash != r->golden) {
+            fprintf(stderr, "%s: final hash %08x, expected %08x\n", r->name, r->hash, r->golden);
+            if (ret < 1) ret = 1;
+        }
+    }
+
+    /*
+        Measure in rounds over the whole corpus and keep the fastest round of
+        each demo, so a burst of load on the machine doesn't hit all rounds
+    */
+    unsigned pieces = 0;
+    double ms = 0;
+    for (unsigned round = 0; round < MEASURE_ROUNDS && !update; round++) {
+        for (unsigned i=0; i < count; i++) {
+            if (results[i].valid) MeasureRound(paths[i], (double)minTime/MEASURE_ROUNDS, &results[i]);
+        }
+    }
+    for (unsigned i=0; i < count; i++) {
+        pieces += results[i].pieces;
+        ms += results[i].ms;
+    }
+
+    //  Rewrite golden list with current hashes
+    if (update) {
+        fp = fopen(golden, "w");
+        if (!fp) {
+            fprintf(stderr, "Could not write %s\n", golden);
+            return 2;
+        }
+        fprintf(fp, "# Final state hashes of bench-replay demos, update with 'tetr-benchreplay --update'\n");
+        for (unsigned i=0; i < count; i++) {
+            if (results[i].valid) fprintf(fp, "%08x %s\n", results[i].hash, results[i].name);
+        }
+        fclose(fp);
+        fprintf(stderr, "Updated %u hashes in %s\n", count, golden);
+        return ret;
+    }
+
+    double totalPps = ms > 0 ? pieces*1000.0/ms : 0;
+    fp = output ? fopen(output, "w") : stdout;
+    if (!fp) {
+        fprintf(stderr, "Could not open %s\n", output);
+        return 2;
+    }
+    WriteReport(fp, results, count, totalPps);
+    if (fp != stdout) fclose(fp);
+
+    //  Throughput of the whole corpus against the baseline
+    fprintf(stderr, "%u demos, %u pieces, %.0f pieces/s\n", count, pieces, totalPps);
+    double base = baseline ? BaselinePps(baseline, "TOTAL") : 0;
+    if (base > 0) {
+        double change = (totalPps - base)*100/base;
+        fprintf(stderr, "Baseline %.0f pieces/s, change %+.1f%%\n", base, change);
+        if (change < -threshold) {
+            fprintf(stderr, "Throughput regressed more than %.1f%%\n", threshold);
+            if (ret < 1) ret = 1;
+        }
+    } else if (baseline) {
+        fprintf(stderr, "No baseline in %s, save one with 'make bench-baseline'\n", baseline);
+    }
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+double NowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000.0 + ts.tv_nsec/1000000.0;
+}
+
+/**
+    \brief Reads and plays demo until it ends
+    \param path Path to the demo
+    \param outHash Final state hash
+    \param outPieces Count of pieces spawned
+    \return False on error
+*/
+bool ReplayOnce(const char* path, unsigned* outHash, unsigned* outPieces) {
+    demo* record = DemoRead(path);
+    if (!record) return false;
+
+    demo_playback* playback = PlaybackCreate(record, MAP_WIDTH, MAP_HEIGHT+2);
+    if (!playback) {
+        DemoFree(record);
+        return false;
+    }
+
+    while (PlaybackStep(playback));
+    *outHash = GameHashState(playback->gme);
+    *outPieces = PlaybackPieces(playback);
+
+    PlaybackFree(playback);
+    DemoFree(record);
+    return true;
+}
+
+/**
+    \brief Replays demo repeatedly for one round of measurements
+    \param path Path to the demo
+    \param time Minimum time of the round in milliseconds
+    \param out Where results are written, the fastest round is kept
+*/
+void MeasureRound(const char* path, double time, replay_result* out) {
+    unsigned runs = 0;
+    double start = NowMs(), end = start;
+    while (end - start < time || runs == 0) {
+        unsigned hash, pieces;
+        ReplayOnce(path, &hash, &pieces);
+        runs++;
+        end = NowMs();
+    }
+
+    double ms = (end - start)/runs;
+    if (out->runs == 0 || ms < out->ms) out->ms = ms;
+    out->runs += runs;
+}
+
+/**
+    \brief Finds pieces per second of a demo in a report
+    \param path Path to the report
+    \param name Name of the demo, or TOTAL
+    \return Pieces per second, 0 if not found
+*/
+double BaselinePps(const char* path, const char* name) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return 0;
+
+    //  Reports have one entry per line
+    double ret = 0;
+    char line[LINE_LEN], key[LINE_LEN+16];
+    snprintf(key, LINE_LEN+16, "\"name\": \"%s\"", name);
+    while (fgets(line, LINE_LEN, fp)) {
+        char* pps = strstr(line, "\"pps\": ");
+        if (strstr(line, key) && pps) {
+            ret = atof(pps + 7);
+            break;
+        }
+    }
+    fclose(fp);
+    return ret;
+}
+
+void WriteReport(FILE* fp, replay_result* results, unsigned count, double totalPps) {
+    unsigned long allocs = 0;
+    unsigned pieces = 0;
+    double ms = 0;
+
+    fprintf(fp, "{\n  \"demos\": [\n");
+    for (unsigned i=0; i < count; i++) {
+        replay_result* r = &results[i];
+        double pps = r->ms > 0 ? r->pieces*1000.0/r->ms : 0;
+        fprintf(fp, "    {\"name\": \"%s\", \"hash\": \"%08x\", \"ok\": %s, \"pieces\": %u, \"runs\": %u, \"ms\": %.4f, \"pps\": %.1f, \"allocs\": %lu}%s\n",
+            r->name, r->hash, (r->valid && r->hash == r->golden) ? "true" : "false",
+            r->pieces, r->runs, r->ms, pps, r->allocs, i+1 < count ? "," : "");
+        allocs += r->allocs;
+        pieces += r->pieces;
+        ms += r->ms;
+    }
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"total\": {\"name\": \"TOTAL\", \"pieces\": %u, \"ms\": %.4f, \"pps\": %.1f, \"allocs\": %lu}\n}\n",
+        pieces, ms, totalPps, allocs);
+}
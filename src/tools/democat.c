@@ -0,0 +1,489 @@
+//  Keeps an index of demo metadata, lists, sorts and filters demos without reading them
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h> /* strftime(), mktime() */
+#include <unistd.h> /* sysconf() */
+#include <sys/stat.h> /* stat() */
+
+#include "../ui/ui.h" /* MAP_WIDTH, MAP_HEIGHT */
+#include "../ui/os/os.h"
+#include "../core/catalogue.h"
+#include "../core/game_randomisers.h" /* RandomiserGet() */
+
+#define MAX_THREADS 64
+#define MAX_FILTERS 16
+#define PATH_LEN 4096
+
+static const char* helpStr =
+"Usage: tetr-democat [options] <update|list|dupes> <dir>\n\
+Commands:\n \
+  update\t\t\tIndex new and changed demos of the directory\n \
+  list\t\t\t\tList indexed demos\n \
+  dupes\t\t\t\tList demos with identical content\n\
+Options:\n \
+  --help, -h\t\t\tDisplay this information\n \
+  --jobs, -j <count>\t\tCount of threads indexing demos. default=count of CPUs\n \
+  --sort, -s <field>\t\tSort list by field. default=name\n \
+  --reverse, -r\t\t\tReverse the order of the list\n \
+  --filter, -f <field><op><value>\tOnly list matching demos, can be repeated\n \
+  --limit, -n <count>\t\tList at most count demos\n\n\
+Fields are name, date, score, lines, level, time, pieces, size, randomiser and\n\
+ending. Operators are =, !=, <, <=, > and >=. Dates are given as YYYY-MM-DD,\n\
+times in seconds, randomisers as 7bag, tgm, random or stored and endings as\n\
+topout, ended or invalid. The index is kept in " CATALOGUE_FILE " of the directory.\n";
+
+/**
+    \brief Fields of an entry used for sorting and filtering
+*/
+typedef enum {
+    FIELD_NAME,
+    FIELD_DATE,
+    FIELD_SCORE,
+    FIELD_LINES,
+    FIELD_LEVEL,
+    FIELD_TIME,
+    FIELD_PIECES,
+    FIELD_SIZE,
+    FIELD_RANDOMISER,
+    FIELD_ENDING,
+    FIELD_MAX
+} catalogue_field;
+
+static const char* fieldNames[FIELD_MAX] = {
+    "name", "date", "score", "lines", "level", "time", "pieces", "size", "randomiser", "ending"
+};
+
+static const char* endingNames[] = {"invalid", "ended", "topout"};
+
+typedef enum {
+    OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE
+} filter_op;
+
+/**
+    \brief Condition given with --filter
+*/
+typedef struct {
+    catalogue_field field;
+    filter_op op;
+    unsigned value;     /**< Value compared to, unused for names */
+    const char* str;    /**< Substring of the name */
+} catalogue_filter;
+
+/**
+    \brief Demos to be scanned, shared by all worker threads
+*/
+typedef struct {
+    char** paths;
+    catalogue_entry** entries;
+    unsigned count;
+    atomic_uint next; /**< Index of the next demo to scan */
+} scan_work;
+
+static int Update(const char* dir, const char* indexPath, unsigned jobs);
+static int List(demo_catalogue* cat, catalogue_filter* filters, unsigned filterCount, catalogue_field sort, bool reverse, unsigned limit);
+static int Dupes(demo_catalogue* cat);
+static void* Worker(void* data);
+static unsigned FieldValue(catalogue_entry* e, catalogue_field field);
+static int CompareEntries(const void* a, const void* b);
+static int CompareHashes(const void* a, const void* b);
+static bool ParseFilter(const char* str, catalogue_filter* out);
+static bool Matches(catalogue_entry* e, catalogue_filter* filter);
+static const char* RandomiserName(unsigned randomiser);
+
+static catalogue_field sortField = FIELD_NAME; // Used by CompareEntries()
+
+int main(int argc, char** argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned jobs = cpus > 0 ? (unsigned)cpus : 1;
+    const char* command = NULL;
+    const char* dir = NULL;
+    catalogue_field sort = FIELD_NAME;
+    bool reverse = false;
+    unsigned limit = 0;
+    catalogue_filter filters[MAX_FILTERS];
+    unsigned filterCount = 0;
+
+    //  Process command line arguments
+    for (int i=1; i<argc; i++) {
+        bool invalidArgs = false;
+        if (!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "-j")) {
+            if (argc <= ++i || atoi(argv[i]) <= 0) invalidArgs = true;
+            else jobs = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "--sort") || !strcmp(argv[i], "-s")) {
+            invalidArgs = true;
+            if (argc > ++i) {
+                for (unsigned f=0; f < FIELD_MAX; f++) {
+                    if (!strcmp(argv[i], fieldNames[f])) {
+                        sort = (catalogue_field)f;
+                        invalidArgs = false;
+                    }
+                }
+            }
+        } else if (!strcmp(argv[i], "--reverse") || !strcmp(argv[i], "-r")) {
+            reverse = true;
+        } else if (!strcmp(argv[i], "--filter") || !strcmp(argv[i], "-f")) {
+            if (argc <= ++i || filterCount == MAX_FILTERS || !ParseFilter(argv[i], &filters[filterCount])) invalidArgs = true;
+            else filterCount++;
+        } else if (!strcmp(argv[i], "--limit") || !strcmp(argv[i], "-n")) {
+            if (argc <= ++i || atoi(argv[i]) <= 0) invalidArgs = true;
+            else limit = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
+            invalidArgs = true;
+        } else if (!command) {
+            command = argv[i];
+        } else if (!dir) {
+            dir = argv[i];
+        } else {
+            invalidArgs = true;
+        }
+
+        if (invalidArgs) {
+            printf("%s", helpStr);
+            return 1;
+        }
+    }
+    if (!command || !dir) {
+        printf("%s", helpStr);
+        return 1;
+    }
+    if (jobs > MAX_THREADS) jobs = MAX_THREADS;
+
+    char indexPath[PATH_LEN];
+    snprintf(indexPath, PATH_LEN, "%s/%s", dir, CATALOGUE_FILE);
+
+    if (!strcmp(command, "update")) return Update(dir, indexPath, jobs);
+    if (strcmp(command, "list") && strcmp(command, "dupes")) {
+        printf("%s", helpStr);
+        return 1;
+    }
+
+    demo_catalogue* cat = CatalogueRead(indexPath);
+    if (!cat) {
+        fprintf(stderr, "No valid index in %s, create it with 'tetr-democat update %s'\n", dir, dir);
+        return 2;
+    }
+    int ret = !strcmp(command, "list") ? List(cat, filters, filterCount, sort, reverse, limit) : Dupes(cat);
+    CatalogueFree(cat);
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Indexes new and changed demos, entries of unchanged demos are kept
+    \return Exit status
+*/
+int Update(const char* dir, const char* indexPath, unsigned jobs) {
+    unsigned count = 0;
+    char** paths = ListDirectory(dir, ".demo", &count);
+    if (!paths) {
+        fprintf(stderr, "Could not read %s\n", dir);
+        return 2;
+    }
+
+    demo_catalogue* old = CatalogueRead(indexPath);
+    demo_catalogue* cat = CatalogueCreate();
+    scan_work work = {.paths = (char**)malloc(sizeof(char*)*(count+1)), .count = 0};
+    unsigned* pending = (unsigned*)malloc(sizeof(unsigned)*(count+1)); // Entries to scan
+    if (!cat || !work.paths || !pending) {
+        FreeDirectoryList(paths, count);
+        CatalogueFree(old);
+        CatalogueFree(cat);
+        free(work.paths);
+        free(pending);
+        return 2;
+    }
+
+    //  Paths are sorted, so entries are added in the order of names
+    unsigned added = 0, changed = 0, kept = 0;
+    size_t dirLen = strlen(dir) + 1;
+    for (unsigned i=0; i < count; i++) {
+        struct stat st;
+        if (stat(paths[i], &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        const char* name = paths[i] + dirLen;
+        catalogue_entry* known = CatalogueFind(old, name);
+        catalogue_entry e = {.mtime = (unsigned)st.st_mtime, .size = (unsigned)st.st_size};
+        bool scan = !known || known->mtime != e.mtime || known->size != e.size;
+        if (!scan) e = *known;
+        e.name = (char*)malloc(strlen(name)+1);
+        if (!e.name) continue;
+        strcpy(e.name, name);
+        if (CatalogueAdd(cat, &e) != 0) {
+            free(e.name);
+            continue;
+        }
+
+        if (!scan) {
+            kept++;
+        } else {
+            pending[work.count] = cat->count-1;
+            work.paths[work.count++] = paths[i];
+            if (known) changed++;
+            else added++;
+        }
+    }
+    unsigned removed = old ? old->count - kept - changed : 0;
+
+    //  Entries don't move anymore, scan new and changed demos in parallel
+    work.entries = (catalogue_entry**)malloc(sizeof(catalogue_entry*)*(work.count+1));
+    int ret = 0;
+    if (!work.entries) {
+        ret = 2;
+    } else {
+        for (unsigned i=0; i < work.count; i++) work.entries[i] = &cat->entries[pending[i]];
+        atomic_init(&work.next, 0);
+
+        if (jobs > work.count) jobs = work.count;
+        pthread_t threads[MAX_THREADS];
+        unsigned started = 0;
+        for (; started+1 < jobs; started++) {
+            if (pthread_create(&threads[started], NULL, Worker, &work) != 0) break;
+        }
+        Worker(&work);
+        for (unsigned i=0; i < started; i++) pthread_join(threads[i], NULL);
+
+        if (CatalogueSave(cat, indexPath) == 0) {
+            fprintf(stderr, "Could not write %s\n", indexPath);
+            ret = 2;
+        }
+    }
+
+    unsigned invalid = 0;
+    for (unsigned i=0; i < cat->count; i++) {
+        if (cat->entries[i].ending == CATALOGUE_INVALID) invalid++;
+    }
+    fprintf(stderr, "%u demos: %u new, %u changed, %u removed, %u unchanged, %u invalid\n",
+        cat->count, added, changed, removed, kept, invalid);
+
+    free(work.entries);
+    free(work.paths);
+    free(pending);
+    FreeDirectoryList(paths, count);
+    CatalogueFree(old);
+    CatalogueFree(cat);
+    return ret;
+}
+
+/**
+    \brief Prints matching entries of the catalogue
+    \return Exit status
+*/
+int List(demo_catalogue* cat, catalogue_filter* filters, unsigned filterCount, catalogue_field sort, bool reverse, unsigned limit) {
+    catalogue_entry** list = (catalogue_entry**)malloc(sizeof(catalogue_entry*)*(cat->count+1));
+    if (!list) return 2;
+
+    unsigned count = 0;
+    for (unsigned i=0; i < cat->count; i++) {
+        bool match = true;
+        for (unsigned f=0; f < filterCount && match; f++) match = Matches(&cat->entries[i], &filters[f]);
+        if (match) list[count++] = &cat->entries[i];
+    }
+
+    //  Catalogue is already sorted by name
+    if (sort != FIELD_NAME) {
+        sortField = sort;
+        qsort(list, count, sizeof(catalogue_entry*), CompareEntries);
+    }
+    if (limit == 0 || limit > count) limit = count;
+
+    //  Buffered output, listing is bound by the terminal otherwise
+    static char outBuf[1 << 16];
+    setvbuf(stdout, outBuf, _IOFBF, sizeof(outBuf));
+    printf("%-16s %8s %6s %5s %7s %6s %-10s %-7s %s\n",
+        "date", "score", "lines", "level", "time", "pieces", "randomiser", "ending", "name");
+    for (unsigned i=0; i < limit; i++) {
+        catalogue_entry* e = list[reverse ? count-1-i : i];
+        char date[32];
+        time_t t = e->mtime;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&t));
+        unsigned seconds = e->duration/1000;
+
+        printf("%-16s %8u %6u %5u %4u:%02u %6u %-10s %-7s %s\n",
+            date, e->score, e->rows, e->level, seconds/60, seconds%60, e->pieces,
+            RandomiserName(e->randomiser), endingNames[e->ending < CATALOGUE_TOPOUT ? e->ending : CATALOGUE_TOPOUT],
+            e->name);
+    }
+    fflush(stdout);
+    fprintf(stderr, "%u of %u demos\n", limit, cat->count);
+
+    free(list);
+    return 0;
+}
+
+/**
+    \brief Prints groups of entries with the same content hash
+    \return Exit status
+*/
+int Dupes(demo_catalogue* cat) {
+    catalogue_entry** list = (catalogue_entry**)malloc(sizeof(catalogue_entry*)*(cat->count+1));
+    if (!list) return 2;
+
+    for (unsigned i=0; i < cat->count; i++) list[i] = &cat->entries[i];
+    qsort(list, cat->count, sizeof(catalogue_entry*), CompareHashes);
+
+    unsigned groups = 0, extra = 0;
+    for (unsigned i=0; i < cat->count;) {
+        unsigned j = i+1;
+        while (j < cat->count && !CompareHashes(&list[i], &list[j])) j++;
+        if (j - i > 1) {
+            if (groups++) printf("\n");
+            for (unsigned k=i; k < j; k++) printf("%08x%08x %s\n", list[k]->hash[0], list[k]->hash[1], list[k]->name);
+            extra += j-i-1;
+        }
+        i = j;
+    }
+    fprintf(stderr, "%u groups, %u duplicate demos\n", groups, extra);
+
+    free(list);
+    return 0;
+}
+
+/**
+    \brief Thread function, scans demos until all are done
+    \param data Pointer to scan_work
+*/
+void* Worker(void* data) {
+    scan_work* work = (scan_work*)data;
+
+    unsigned i;
+    while ((i = atomic_fetch_add(&work->next, 1)) < work->count) {
+        CatalogueScanDemo(work->paths[i], MAP_WIDTH, MAP_HEIGHT+2, work->entries[i]);
+    }
+    return NULL;
+}
+
+unsigned FieldValue(catalogue_entry* e, catalogue_field field) {
+    switch (field) {
+        case FIELD_DATE:        return e->mtime;
+        case FIELD_SCORE:       return e->score;
+        case FIELD_LINES:       return e->rows;
+        case FIELD_LEVEL:       return e->level;
+        case FIELD_TIME:        return e->duration;
+        case FIELD_PIECES:      return e->pieces;
+        case FIELD_SIZE:        return e->size;
+        case FIELD_RANDOMISER:  return e->randomiser;
+        case FIELD_ENDING:      return e->ending;
+        default:                return 0;
+    }
+}
+
+//  Orders by sortField, equal entries stay ordered by name
+int CompareEntries(const void* a, const void* b) {
+    catalogue_entry* ea = *(catalogue_entry* const*)a;
+    catalogue_entry* eb = *(catalogue_entry* const*)b;
+    unsigned va = FieldValue(ea, sortField), vb = FieldValue(eb, sortField);
+    if (va != vb) return va < vb ? -1 : 1;
+    return strcmp(ea->name, eb->name);
+}
+
+int CompareHashes(const void* a, const void* b) {
+    catalogue_entry* ea = *(catalogue_entry* const*)a;
+    catalogue_entry* eb = *(catalogue_entry* const*)b;
+    if (ea->hash[0] != eb->hash[0]) return ea->hash[0] < eb->hash[0] ? -1 : 1;
+    if (ea->hash[1] != eb->hash[1]) return ea->hash[1] < eb->hash[1] ? -1 : 1;
+    return 0;
+}
+
+/**
+    \brief Parses <field><op><value>
+    \return False if invalid
+*/
+bool ParseFilter(const char* str, catalogue_filter* out) {
+    static const char* ops[] = {"!=", "<=", ">=", "=", "<", ">"};
+    static const filter_op opTypes[] = {OP_NE, OP_LE, OP_GE, OP_EQ, OP_LT, OP_GT};
+
+    //  Field name ends to the first operator character
+    size_t fieldLen = strcspn(str, "!=<>");
+    if (str[fieldLen] == '\0') return false;
+
+    bool found = false;
+    for (unsigned f=0; f < FIELD_MAX; f++) {
+        if (strlen(fieldNames[f]) == fieldLen && !strncmp(str, fieldNames[f], fieldLen)) {
+            out->field = (catalogue_field)f;
+            found = true;
+        }
+    }
+    if (!found) return false;
+
+    const char* value = NULL;
+    for (unsigned i=0; i < sizeof(ops)/sizeof(ops[0]) && !value; i++) {
+        if (!strncmp(str+fieldLen, ops[i], strlen(ops[i]))) {
+            out->op = opTypes[i];
+            value = str+fieldLen+strlen(ops[i]);
+        }
+    }
+    if (!value) return false;
+
+    out->str = value;
+    out->value = 0;
+    switch (out->field) {
+        case FIELD_NAME:
+            //  Names are matched as substrings
+            return out->op == OP_EQ || out->op == OP_NE;
+        case FIELD_DATE: {
+            struct tm tm = {0};
+            if (sscanf(value, "%d-%d-%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday) != 3) return false;
+            tm.tm_year -= 1900;
+            tm.tm_mon -= 1;
+            tm.tm_isdst = -1;
+            out->value = (unsigned)mktime(&tm);
+            return true;
+        }
+        case FIELD_TIME:
+            out->value = (unsigned)(atof(value)*1000);
+            return true;
+        case FIELD_RANDOMISER:
+            if (!strcmp(value, "stored")) {
+                out->value = CATALOGUE_STORED;
+                return true;
+            }
+            for (unsigned r=0; r < RANDOMISER_MAX; r++) {
+                if (!strcmp(value, RandomiserName(r))) {
+                    out->value = r;
+                    return true;
+                }
+            }
+            return false;
+        case FIELD_ENDING:
+            for (unsigned e=0; e < sizeof(endingNames)/sizeof(endingNames[0]); e++) {
+                if (!strcmp(value, endingNames[e])) {
+                    out->value = e;
+                    return true;
+                }
+            }
+            return false;
+        default:
+            out->value = strtoul(value, NULL, 10);
+            return true;
+    }
+}
+
+bool Matches(catalogue_entry* e, catalogue_filter* filter) {
+    if (filter->field == FIELD_NAME) {
+        bool found = strstr(e->name, filter->str) != NULL;
+        return filter->op == OP_EQ ? found : !found;
+    }
+
+    unsigned v = FieldValue(e, filter->field);
+    switch (filter->op) {
+        case OP_EQ: return v == filter->value;
+        case OP_NE: return v != filter->value;
+        case OP_LT: return v < filter->value;
+        case OP_LE: return v <= filter->value;
+        case OP_GT: return v > filter->value;
+        case OP_GE: return v >= filter->value;
+    }
+    return false;
+}
+
+const char* RandomiserName(unsigned randomiser) {
+    if (randomiser >= RANDOMISER_MAX) return "stored";
+    return RandomiserGet((randomiser_type)randomiser)->name;
+}
@@ -0,0 +1,240 @@
+//  Compresses demos with the predictive codec, and checks that they decode back unchanged
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h> /* clock_gettime() */
+#include <sys/stat.h> /* stat() */
+
+#include "../ui/ui.h" /* MAP_WIDTH, MAP_HEIGHT */
+#include "../ui/os/os.h"
+#include "../core/codec.h"
+
+static const char* helpStr =
+"Usage: tetr-democodec <command> <args>\n\
+Commands:\n \
+  encode <demo> <out>\t\tCompress a demo\n \
+  decode <in> <demo>\t\tDecompress to a demo file\n \
+  test <dir|file>...\t\tCompress demos in memory and check they decode unchanged\n\n\
+Inputs are predicted by replaying the game, so decoding is about as fast\n\
+as playing the demo. Checkpoints are not kept, except for the start of\n\
+clips. Exit status is 0 on success, 1 if a demo decodes differently, 2 on\n\
+errors.\n";
+
+static int Encode(const char* in, const char* out);
+static int Decode(const char* in, const char* out);
+static int TestDemo(const char* path, size_t* rawTotal, size_t* codedTotal);
+static bool SameDemo(demo* a, demo* b);
+static unsigned char* ReadFile(const char* path, size_t* outLen);
+static double NowMs();
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("%s", helpStr);
+        return 2;
+    }
+
+    if (!strcmp(argv[1], "encode") && argc == 4) return Encode(argv[2], argv[3]);
+    if (!strcmp(argv[1], "decode") && argc == 4) return Decode(argv[2], argv[3]);
+    if (strcmp(argv[1], "test")) {
+        printf("%s", helpStr);
+        return 2;
+    }
+
+    int ret = 0;
+    unsigned checked = 0, failed = 0;
+    size_t rawTotal = 0, codedTotal = 0;
+    for (int i=2; i<argc; i++) {
+        struct stat st;
+        if (stat(argv[i], &st) != 0) {
+            fprintf(stderr, "Could not read %s\n", argv[i]);
+            ret = 2;
+            continue;
+        }
+
+        //  Directories are searched for demos
+        unsigned count = 1;
+        char** paths = NULL;
+        if (S_ISDIR(st.st_mode)) {
+            paths = ListDirectory(argv[i], ".demo", &count);
+            if (!paths) {
+                fprintf(stderr, "Could not list %s\n", argv[i]);
+                ret = 2;
+                continue;
+            }
+        }
+
+        for (unsigned j=0; j < count; j++) {
+            int res = TestDemo(paths ? paths[j] : argv[i], &rawTotal, &codedTotal);
+            checked++;
+            if (res > ret) ret = res;
+            if (res != 0) failed++;
+        }
+        FreeDirectoryList(paths, count);
+    }
+
+    printf("%u demos checked, %u failed, %zu bytes coded to %zu (%.1f%%)\n", checked, failed,
+        rawTotal, codedTotal, rawTotal ? 100.0*codedTotal/rawTotal : 0.0);
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Compresses a demo file
+    \param in Path to the demo
+    \param out Path to the compressed file
+    \return Exit status
+*/
+int Encode(const char* in, const char* out) {
+    demo* record = DemoRead(in);
+    if (!record) {
+        fprintf(stderr, "Could not read %s\n", in);
+        return 2;
+    }
+
+    size_t len;
+    unsigned char* data = CodecEncode(record, MAP_WIDTH, MAP_HEIGHT+2, &len);
+    DemoFree(record);
+    if (!data) {
+        fprintf(stderr, "Could not encode %s\n", in);
+        return 2;
+    }
+
+    FILE* fp = fopen(out, "w");
+    size_t written = fp ? fwrite(data, 1, len, fp) : 0;
+    if (fp) fclose(fp);
+    free(data);
+    if (written != len) {
+        fprintf(stderr, "Could not write %s\n", out);
+        return 2;
+    }
+    return 0;
+}
+
+/**
+    \brief Decompresses to a demo file
+    \param in Path to the compressed file
+    \param out Path to the demo
+    \return Exit status
+*/
+int Decode(const char* in, const char* out) {
+    size_t len;
+    unsigned char* data = ReadFile(in, &len);
+    demo* record = data ? CodecDecode(data, len) : NULL;
+    free(data);
+    if (!record) {
+        fprintf(stderr, "Could not decode %s\n", in);
+        return 2;
+    }
+
+    unsigned written = DemoSave(record, out);
+    DemoFree(record);
+    if (written == 0) {
+        fprintf(stderr, "Could not write %s\n", out);
+        return 2;
+    }
+    return 0;
+}
+
+/**
+    \brief Compresses and decompresses one demo and prints the result
+    \param path Path to the demo
+    \param rawTotal Size of the demo file is added to it
+    \param codedTotal Size of the compressed demo is added to it
+    \return Exit status of the demo
+*/
+int TestDemo(const char* path, size_t* rawTotal, size_t* codedTotal) {
+    struct stat st;
+    demo* record = stat(path, &st) == 0 ? DemoRead(path) : NULL;
+    if (!record) {
+        printf("%s: could not be read\n", path);
+        return 2;
+    }
+
+    double start = NowMs();
+    size_t len;
+    unsigned char* data = CodecEncode(record, MAP_WIDTH, MAP_HEIGHT+2, &len);
+    if (!data) {
+        printf("%s: could not be encoded\n", path);
+        DemoFree(record);
+        return 2;
+    }
+    double encoded = NowMs();
+    demo* decoded = CodecDecode(data, len);
+    double done = NowMs();
+    free(data);
+
+    int ret = 0;
+    if (!decoded || !SameDemo(record, decoded)) {
+        printf("%s: decoded demo differs\n", path);
+        ret = 1;
+    } else {
+        printf("%s: ok, %u instructions, %zu bytes to %zu (%.1f%%, %.2f bits per instruction), encode %.1f ms, decode %.1f ms\n",
+            path, record->instrsCount, (size_t)st.st_size, len, 100.0*len/st.st_size,
+            record->instrsCount ? 8.0*len/record->instrsCount : 0.0, encoded-start, done-encoded);
+        *rawTotal += st.st_size;
+        *codedTotal += len;
+    }
+    DemoFree(decoded);
+    DemoFree(record);
+    return ret;
+}
+
+/**
+    \brief Compares everything the codec keeps
+    \param a Original demo
+    \param b Decoded demo
+    \return True if instructions, pieces and header are the same
+*/
+bool SameDemo(demo* a, demo* b) {
+    if (a->flags != b->flags || a->instrsCount != b->instrsCount || a->piecesCount != b->piecesCount) return false;
+    if ((a->flags & DEMO_FLAG_SEEDED) && (a->randomiser != b->randomiser || a->seed != b->seed)) return false;
+
+    demo_list* x = a->instrsFirst;
+    demo_list* y = b->instrsFirst;
+    for (; x && y; x = x->next, y = y->next) {
+        if (memcmp(x->value, y->value, sizeof(demo_instruction))) return false;
+    }
+    if (x || y) return false;
+
+    x = a->piecesFirst;
+    y = b->piecesFirst;
+    for (; x && y; x = x->next, y = y->next) {
+        if (*(unsigned*)x->value != *(unsigned*)y->value) return false;
+    }
+    return !x && !y;
+}
+
+/**
+    \brief Reads whole file to memory
+    \param path Path to the file
+    \param outLen Count of bytes read
+    \return Contents of the file, free with free(). NULL on error
+*/
+unsigned char* ReadFile(const char* path, size_t* outLen) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return NULL;
+
+    struct stat st;
+    unsigned char* ret = NULL;
+    if (fstat(fileno(fp), &st) == 0 && st.st_size > 0) ret = (unsigned char*)malloc(st.st_size);
+    if (ret && fread(ret, 1, st.st_size, fp) != (size_t)st.st_size) {
+        free(ret);
+        ret = NULL;
+    }
+    fclose(fp);
+    *outLen = ret ? (size_t)st.st_size : 0;
+    return ret;
+}
+
+/**
+    \brief Get monotonic time in milliseconds
+*/
+double NowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000.0 + ts.tv_nsec/1e6;
+}
@@ -0,0 +1,285 @@
+//  Plays demos with two builds of the core and reports where they diverge
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <dlfcn.h> /* dlopen(), dlsym() */
+#include <sys/stat.h> /* stat() */
+
+#include "../ui/ui.h" /* MAP_WIDTH, MAP_HEIGHT */
+#include "../ui/os/os.h"
+#include "../core/playback.h"
+
+#define DUMP_LEN 1024
+
+static const char* helpStr =
+"Usage: tetr-demodiff [options] <dir|file>...\n\
+Options:\n \
+  --help, -h\t\t\tDisplay this information\n \
+  --a <lib>\t\t\tCore library used as engine A. default=built-in core\n \
+  --b <lib>\t\t\tCore library used as engine B. default=built-in core\n\n\
+Every demo is played with both engines in lockstep. State hashes are\n\
+compared after each instruction and the first difference is reported\n\
+with both maps. Core libraries are built with 'make tools' to\n\
+build/libtetrcore.so, copy one aside before changing the core.\n\
+Exit status is 0 if all demos match, 1 on divergence, 2 on errors.\n";
+
+/**
+    \brief Functions of one build of the core
+
+    Structs of a loaded core can differ from the ones compiled in, so they
+    are read only through its own functions.
+*/
+typedef struct {
+    const char* name;
+    void* handle; /**< dlopen() handle, NULL for the built-in core */
+    demo* (*fnDemoRead)(const char*);
+    void (*fnDemoFree)(demo*);
+    demo_playback* (*fnPlaybackCreate)(demo*, unsigned, unsigned);
+    demo_instruction* (*fnPlaybackStep)(demo_playback*);
+    void (*fnPlaybackFree)(demo_playback*);
+    game* (*fnPlaybackGame)(demo_playback*);
+    void (*fnInstructionInfo)(demo_instruction*, unsigned*, unsigned*);
+    void (*fnSummary)(game*, unsigned*, unsigned*, unsigned*);
+    unsigned (*fnHashState)(game*);
+    unsigned (*fnDumpMap)(game*, char*, unsigned);
+} core_engine;
+
+/**
+    \brief Playback of a demo with one engine
+*/
+typedef struct {
+    core_engine* engine;
+    demo* record;
+    demo_playback* playback;
+} engine_run;
+
+static bool LoadEngine(core_engine* out, const char* path);
+static bool StartRun(engine_run* run, core_engine* engine, const char* path);
+static void StopRun(engine_run* run);
+static int CompareDemo(core_engine* a, core_engine* b, const char* path);
+static void DumpState(engine_run* run, unsigned hash);
+
+int main(int argc, char** argv) {
+    const char* libA = NULL;
+    const char* libB = NULL;
+    int first = argc;
+
+    //  Process command line arguments
+    for (int i=1; i<argc; i++) {
+        bool invalidArgs = false;
+        if (!strcmp(argv[i], "--a")) {
+            if (argc <= ++i) invalidArgs = true;
+            else libA = argv[i];
+        } else if (!strcmp(argv[i], "--b")) {
+            if (argc <= ++i) invalidArgs = true;
+            else libB = argv[i];
+        } else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
+            invalidArgs = true;
+        } else {
+            first = i;
+            break;
+        }
+
+        if (invalidArgs) {
+            printf("%s", helpStr);
+            return 2;
+        }
+    }
+    if (first == argc) {
+        printf("%s", helpStr);
+        return 2;
+    }
+
+    core_engine a, b;
+    if (!LoadEngine(&a, libA) || !LoadEngine(&b, libB)) return 2;
+
+    int ret = 0;
+    unsigned checked = 0, diverged = 0;
+    for (int i=first; i<argc; i++) {
+        struct stat st;
+        if (stat(argv[i], &st) != 0) {
+            fprintf(stderr, "Could not read %s\n", argv[i]);
+            ret = 2;
+            continue;
+        }
+
+        //  Directories are searched for demos
+        unsigned count = 1;
+        char** paths = NULL;
+        if (S_ISDIR(st.st_mode)) {
+            paths = ListDirectory(argv[i], ".demo", &count);
+            if (!paths) {
+                fprintf(stderr, "Could not list %s\n", argv[i]);
+                ret = 2;
+                continue;
+            }
+        }
+
+        for (unsigned j=0; j < count; j++) {
+            int res = CompareDemo(&a, &b, paths ? paths[j] : argv[i]);
+            checked++;
+            if (res > ret) ret = res;
+            if (res == 1) diverged++;
+        }
+        FreeDirectoryList(paths, count);
+    }
+
+    printf("%u demos checked, %u diverged\n", checked, diverged);
+
+    if (a.handle) dlclose(a.handle);
+    if (b.handle) dlclose(b.handle);
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Loads functions of a core build
+    \param out Where functions are stored
+    \param path Path to the core library, NULL for the built-in core
+    \return True on success
+*/
+bool LoadEngine(core_engine* out, const char* path) {
+    memset(out, 0, sizeof(core_engine));
+
+    if (!path) {
+        out->name = "built-in";
+        out->fnDemoRead = DemoRead;
+        out->fnDemoFree = DemoFree;
+        out->fnPlaybackCreate = PlaybackCreate;
+        out->fnPlaybackStep = PlaybackStep;
+        out->fnPlaybackFree = PlaybackFree;
+        out->fnPlaybackGame = PlaybackGame;
+        out->fnInstructionInfo = DemoInstructionInfo;
+        out->fnSummary = GameSummary;
+        out->fnHashState = GameHashState;
+        out->fnDumpMap = GameDumpMap;
+        return true;
+    }
+
+    //  Local symbols, both libraries keep their own state
+    out->name = path;
+    out->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!out->handle) {
+        fprintf(stderr, "Could not load %s: %s\n", path, dlerror());
+        return false;
+    }
+
+    *(void**)&out->fnDemoRead = dlsym(out->handle, "DemoRead");
+    *(void**)&out->fnDemoFree = dlsym(out->handle, "DemoFree");
+    *(void**)&out->fnPlaybackCreate = dlsym(out->handle, "PlaybackCreate");
+    *(void**)&out->fnPlaybackStep = dlsym(out->handle, "PlaybackStep");
+    *(void**)&out->fnPlaybackFree = dlsym(out->handle, "PlaybackFree");
+    *(void**)&out->fnPlaybackGame = dlsym(out->handle, "PlaybackGame");
+    *(void**)&out->fnInstructionInfo = dlsym(out->handle, "DemoInstructionInfo");
+    *(void**)&out->fnSummary = dlsym(out->handle, "GameSummary");
+    *(void**)&out->fnHashState = dlsym(out->handle, "GameHashState");
+    *(void**)&out->fnDumpMap = dlsym(out->handle, "GameDumpMap");
+
+    if (!out->fnDemoRead || !out->fnDemoFree || !out->fnPlaybackCreate || !out->fnPlaybackStep ||
+        !out->fnPlaybackFree || !out->fnPlaybackGame || !out->fnInstructionInfo || !out->fnSummary ||
+        !out->fnHashState || !out->fnDumpMap) {
+        fprintf(stderr, "%s is missing core functions\n", path);
+        dlclose(out->handle);
+        return false;
+    }
+    return true;
+}
+
+/**
+    \brief Reads demo and starts playback with given engine
+    \return True on success
+*/
+bool StartRun(engine_run* run, core_engine* engine, const char* path) {
+    run->engine = engine;
+    run->playback = NULL;
+    run->record = engine->fnDemoRead(path);
+    if (!run->record) return false;
+
+    run->playback = engine->fnPlaybackCreate(run->record, MAP_WIDTH, MAP_HEIGHT+2);
+    return run->playback != NULL;
+}
+
+void StopRun(engine_run* run) {
+    if (run->playback) run->engine->fnPlaybackFree(run->playback);
+    if (run->record) run->engine->fnDemoFree(run->record);
+    run->playback = NULL;
+    run->record = NULL;
+}
+
+/**
+    \brief Plays demo with both engines in lockstep
+    \return 0 if equal, 1 on divergence, 2 on error
+*/
+int CompareDemo(core_engine* a, core_engine* b, const char* path) {
+    engine_run runA, runB;
+    bool okA = StartRun(&runA, a, path);
+    bool okB = StartRun(&runB, b, path);
+    if (!okA || !okB) {
+        fprintf(stderr, "%s: could not be played with %s\n", path, !okA ? a->name : b->name);
+        StopRun(&runA);
+        StopRun(&runB);
+        return 2;
+    }
+
+    int ret = 0;
+    unsigned step = 0;
+    unsigned hashA = a->fnHashState(a->fnPlaybackGame(runA.playback));
+    unsigned hashB = b->fnHashState(b->fnPlaybackGame(runB.playback));
+    demo_instruction* inst = NULL;
+    while (true) {
+        if (hashA != hashB) {
+            printf("%s: diverged at instruction %u", path, step);
+            if (inst) {
+                unsigned time, input;
+                a->fnInstructionInfo(inst, &time, &input);
+                printf(" (time %u ms, input %u)", time, input);
+            }
+            printf("\n");
+            ret = 1;
+            break;
+        }
+
+        inst = a->fnPlaybackStep(runA.playback);
+        demo_instruction* instB = b->fnPlaybackStep(runB.playback);
+        if (!inst || !instB) {
+            if (inst || instB) {
+                printf("%s: demo ended at instruction %u with %s only\n", path, step, inst ? b->name : a->name);
+                ret = 1;
+            }
+            break;
+        }
+
+        step++;
+        hashA = a->fnHashState(a->fnPlaybackGame(runA.playback));
+        hashB = b->fnHashState(b->fnPlaybackGame(runB.playback));
+    }
+    if (ret != 0) {
+        DumpState(&runA, hashA);
+        DumpState(&runB, hashB);
+    }
+    if (ret == 0) printf("%s: %u instructions match, final hash %08x\n", path, step, hashA);
+
+    StopRun(&runA);
+    StopRun(&runB);
+    return ret;
+}
+
+/**
+    \brief Prints map and hash of a playback
+*/
+void DumpState(engine_run* run, unsigned hash) {
+    char map[DUMP_LEN];
+    core_engine* engine = run->engine;
+    game* gme = engine->fnPlaybackGame(run->playback);
+    unsigned score, rows;
+    engine->fnSummary(gme, &score, &rows, NULL);
+    engine->fnDumpMap(gme, map, DUMP_LEN);
+    printf("  %s, hash %08x, score %u, lines %u:\n", engine->name, hash, score, rows);
+
+    //  Indent every row
+    for (char* row = strtok(map, "\n"); row; row = strtok(NULL, "\n")) printf("    %s\n", row);
+}
@@ -0,0 +1,326 @@
+//  Computes gameplay statistics for a collection of demo records
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h> /* sysconf() */
+#include <sys/stat.h> /* stat() */
+
+#include "../ui/ui.h" /* MAP_WIDTH, MAP_HEIGHT */
+#include "../ui/os/os.h"
+#include "../core/playback.h"
+
+#define MAX_THREADS 64
+
+static const char* helpStr =
+"Usage: tetr-demostats [options] <dir|file>...\n\
+Options:\n \
+  --help, -h\t\t\tDisplay this information\n \
+  --jobs, -j <count>\t\tCount of worker threads. default=count of CPUs\n \
+  --output, -o <path>\t\tWrite CSV to file instead of stdout\n\n\
+Directories are searched for *.demo files. Statistics written per demo:\n \
+  pps\t\t\t\tPieces placed per second\n \
+  kpp\t\t\t\tPlayer inputs per piece\n \
+  apm\t\t\t\tPlayer inputs (actions) per minute\n \
+  single..tetris\t\tCount of each line clear type\n \
+  avg_height\t\t\tAverage stack height after a piece is placed\n \
+  cause\t\t\t\tblockout (next piece couldn't spawn), lockout (stack\n \
+  \t\t\t\treached above the visible field), ended (demo ended\n \
+  \t\t\t\tbefore game over) or invalid\n";
+
+/**
+    \brief Statistics gathered from one demo
+*/
+typedef struct {
+    bool valid;         /**< Demo was read and played */
+    bool toppedOut;     /**< Game ended to a top out */
+    bool lockedOut;     /**< Stack was above the visible field when it topped out */
+    unsigned duration;  /**< Time of the last instruction in milliseconds */
+    unsigned placed;    /**< Count of pieces placed */
+    unsigned inputs;    /**< Count of player inputs */
+    unsigned clears[4]; /**< Single, double, triple and tetris clears */
+    unsigned score;
+    unsigned rows;
+    unsigned level;
+    double heightSum;       /**< Sum of sampled stack heights */
+    unsigned heightSamples; /**< Count of sampled stack heights */
+} demo_stats;
+
+/**
+    \brief Work shared by all worker threads
+*/
+typedef struct {
+    char** paths;
+    unsigned count;
+    demo_stats* results;
+    atomic_uint next; /**< Index of the next demo to analyse */
+} stats_work;
+
+static void* Worker(void* data);
+static void AnalyseDemo(const char* path, demo_stats* out);
+static unsigned StackHeight(game* gme);
+static void WriteRow(FILE* fp, const char* name, demo_stats* s, const char* cause);
+static void WriteField(FILE* fp, const char* str);
+static bool AddPaths(const char* path, char*** list, unsigned* count, unsigned* size);
+
+int main(int argc, char** argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned jobs = cpus > 0 ? (unsigned)cpus : 1;
+    const char* output = NULL;
+
+    unsigned count = 0, size = 0;
+    char** paths = NULL;
+
+    //  Process command line arguments
+    for (int i=1; i<argc; i++) {
+        bool invalidArgs = false;
+        if (!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "-j")) {
+            if (argc <= ++i || atoi(argv[i]) <= 0) invalidArgs = true;
+            else jobs = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "--output") || !strcmp(argv[i], "-o")) {
+            if (argc <= ++i) invalidArgs = true;
+            else output = argv[i];
+        } else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
+            printf("%s", helpStr);
+            FreeDirectoryList(paths, count);
+            return 0;
+        } else if (!AddPaths(argv[i], &paths, &count, &size)) {
+            fprintf(stderr, "Could not read %s\n", argv[i]);
+            invalidArgs = true;
+        }
+
+        if (invalidArgs) {
+            printf("%s", helpStr);
+            FreeDirectoryList(paths, count);
+            return 1;
+        }
+    }
+    if (count == 0) {
+        printf("%s", helpStr);
+        return 1;
+    }
+    if (jobs > MAX_THREADS) jobs = MAX_THREADS;
+    if (jobs > count) jobs = count;
+
+    stats_work work = {.paths = paths, .count = count};
+    atomic_init(&work.next, 0);
+    work.results = (demo_stats*)calloc(count, sizeof(demo_stats));
+    if (!work.results) {
+        FreeDirectoryList(paths, count);
+        return 2;
+    }
+
+    //  Analyse demos, main thread works too
+    pthread_t threads[MAX_THREADS];
+    unsigned started = 0;
+    for (; started+1 < jobs; started++) {
+        if (pthread_create(&threads[started], NULL, Worker, &work) != 0) break;
+    }
+    Worker(&work);
+    for (unsigned i=0; i < started; i++) pthread_join(threads[i], NULL);
+
+    //  Write results in the order of paths
+    FILE* fp = output ? fopen(output, "w") : stdout;
+    if (!fp) {
+        fprintf(stderr, "Could not open %s\n", output);
+        free(work.results);
+        FreeDirectoryList(paths, count);
+        return 2;
+    }
+    fprintf(fp, "file,duration_ms,placed,inputs,pps,kpp,apm,single,double,triple,tetris,avg_height,score,lines,level,cause\n");
+
+    demo_stats total = {.valid = true};
+    unsigned blockouts = 0, lockouts = 0, ended = 0, invalid = 0;
+    for (unsigned i=0; i < count; i++) {
+        demo_stats* s = &work.results[i];
+        const char* cause = "ended";
+        if (!s->valid) cause = "invalid";
+        else if (s->toppedOut) cause = s->lockedOut ? "lockout" : "blockout";
+        WriteRow(fp, paths[i], s, cause);
+        if (!s->valid) {
+            invalid++;
+            continue;
+        }
+        if (s->toppedOut && s->lockedOut) lockouts++;
+        else if (s->toppedOut) blockouts++;
+        else ended++;
+
+        total.duration += s->duration;
+        total.placed += s->placed;
+        total.inputs += s->inputs;
+        for (unsigned j=0; j < 4; j++) total.clears[j] += s->clears[j];
+        total.score += s->score;
+        total.rows += s->rows;
+        if (s->level > total.level) total.level = s->level;
+        total.heightSum += s->heightSum;
+        total.heightSamples += s->heightSamples;
+    }
+
+    char cause[64];
+    snprintf(cause, 64, "blockout:%u lockout:%u ended:%u invalid:%u", blockouts, lockouts, ended, invalid);
+    WriteRow(fp, "TOTAL", &total, cause);
+
+    if (fp != stdout) fclose(fp);
+    free(work.results);
+    FreeDirectoryList(paths, count);
+    return 0;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Thread function, analyses demos until all are done
+    \param data Pointer to stats_work
+*/
+void* Worker(void* data) {
+    stats_work* work = (stats_work*)data;
+
+    unsigned i;
+    while ((i = atomic_fetch_add(&work->next, 1)) < work->count) {
+        AnalyseDemo(work->paths[i], &work->results[i]);
+    }
+    return NULL;
+}
+
+/**
+    \brief Plays demo and collects statistics
+    \param path Path to the demo
+    \param out Where statistics are written
+*/
+void AnalyseDemo(const char* path, demo_stats* out) {
+    memset(out, 0, sizeof(demo_stats));
+
+    demo* record = DemoRead(path);
+    if (!record) return;
+
+    demo_playback* playback = PlaybackCreate(record, MAP_WIDTH, MAP_HEIGHT+2);
+    if (!playback) {
+        DemoFree(record);
+        return;
+    }
+
+    //  Sample stack height each time a new piece spawns
+    unsigned pieces = PlaybackPieces(playback);
+    demo_instruction* inst;
+    while ((inst = PlaybackStep(playback)) != NULL) {
+        if (inst->instruction != INPUT_UPDATE) out->inputs++;
+
+        unsigned now = PlaybackPieces(playback);
+        if (now != pieces) {
+            pieces = now;
+            out->heightSum += StackHeight(playback->gme);
+            out->heightSamples++;
+        }
+    }
+
+    game_info* info = &playback->gme->info;
+    out->valid = true;
+    out->toppedOut = (info->status & GAME_STATUS_END) != 0;
+    //  Game ends only when the next piece collides, blocks in the hidden rows mean the stack got there first
+    out->lockedOut = out->toppedOut && StackHeight(playback->gme) > MAP_HEIGHT;
+    out->duration = playback->time;
+    out->placed = pieces > 0 ? pieces-1 : 0; // active piece is never placed
+    for (unsigned j=0; j < 4; j++) out->clears[j] = info->countClears[j];
+    out->score = info->score;
+    out->rows = info->rows;
+    out->level = info->level;
+
+    PlaybackFree(playback);
+    DemoFree(record);
+}
+
+/**
+    \brief Calculates height of the stack
+    \param gme Pointer to the game instance
+    \return Count of rows from the bottom to the highest block
+*/
+unsigned StackHeight(game* gme) {
+    game_map* map = &gme->map;
+    for (unsigned row=0; row < map->height; row++) {
+        for (unsigned x=0; x < map->width; x++) {
+            if (map->blockMask[row*map->width+x]) return map->height-row;
+        }
+    }
+    return 0;
+}
+
+/**
+    \brief Writes one CSV row
+*/
+void WriteRow(FILE* fp, const char* name, demo_stats* s, const char* cause) {
+    double seconds = s->duration/1000.0;
+    double pps = seconds > 0 ? s->placed/seconds : 0;
+    double kpp = s->placed > 0 ? (double)s->inputs/s->placed : 0;
+    double apm = seconds > 0 ? s->inputs*60.0/seconds : 0;
+    double height = s->heightSamples > 0 ? s->heightSum/s->heightSamples : 0;
+
+    WriteField(fp, name);
+    fprintf(fp, ",%u,%u,%u,%.3f,%.3f,%.1f,%u,%u,%u,%u,%.2f,%u,%u,%u,%s\n",
+        s->duration, s->placed, s->inputs, pps, kpp, apm,
+        s->clears[0], s->clears[1], s->clears[2], s->clears[3],
+        height, s->score, s->rows, s->level, cause);
+}
+
+/**
+    \brief Writes a CSV field, quoted if it contains separators or quotes
+*/
+void WriteField(FILE* fp, const char* str) {
+    if (!strpbrk(str, ",\"\r\n")) {
+        fputs(str, fp);
+        return;
+    }
+
+    fputc('"', fp);
+    for (; *str; str++) {
+        if (*str == '"') fputc('"', fp); // Quotes are doubled
+        fputc(*str, fp);
+    }
+    fputc('"', fp);
+}
+
+/**
+    \brief Adds a file, or demos of a directory, to the list
+    \return False if path couldn't be read
+*/
+bool AddPaths(const char* path, char*** list, unsigned* count, unsigned* size) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+
+    char** found = NULL;
+    unsigned foundCount = 0;
+    if (S_ISDIR(st.st_mode)) {
+        found = ListDirectory(path, ".demo", &foundCount);
+        if (!found) return false;
+    }
+
+    //  Make room for new paths
+    unsigned needed = *count + (found ? foundCount : 1);
+    if (needed > *size) {
+        unsigned newSize = *size ? *size : 64;
+        while (newSize < needed) newSize *= 2;
+        char** grown = (char**)realloc(*list, sizeof(char*)*newSize);
+        if (!grown) {
+            FreeDirectoryList(found, foundCount);
+            return false;
+        }
+        *list = grown;
+        *size = newSize;
+    }
+
+    if (found) {
+        //  Take ownership of the listed paths
+        memcpy(*list + *count, found, sizeof(char*)*foundCount);
+        *count += foundCount;
+        free(found);
+    } else {
+        char* str = (char*)malloc(strlen(path)+1);
+        if (!str) return false;
+        strcpy(str, path);
+        (*list)[(*count)++] = str;
+    }
+    return true;
+}
@@ -0,0 +1,250 @@
+//  Verifies demos by replaying the segments between checkpoints in parallel
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h> /* clock_gettime() */
+#include <unistd.h> /* sysconf() */
+#include <sys/stat.h> /* stat() */
+
+#include "../ui/ui.h" /* MAP_WIDTH, MAP_HEIGHT */
+#include "../ui/os/os.h"
+#include "../core/playback.h"
+
+#define MAX_THREADS 64
+
+static const char* helpStr =
+"Usage: tetr-demoverify [options] <dir|file>...\n\
+Options:\n \
+  --help, -h\t\t\tDisplay this information\n \
+  --jobs, -j <count>\t\tCount of worker threads. default=count of CPUs\n\n\
+Demos are split at the checkpoints written by the recorder. Every segment\n\
+is replayed on its own thread from the checkpoint before it, and the state\n\
+at its end must match the next checkpoint. Demos without checkpoints are\n\
+replayed as one segment. Exit status is 0 if all demos are verified, 1 if\n\
+a segment differs, 2 on errors.\n";
+
+/**
+    \brief Result of one segment
+*/
+typedef enum {
+    SEGMENT_OK,
+    SEGMENT_DIFFERS,    /**< State at the end doesn't match the checkpoint */
+    SEGMENT_ERROR       /**< Playback couldn't start from the checkpoint */
+} segment_result;
+
+/**
+    \brief Segments of one demo, shared by all worker threads
+*/
+typedef struct {
+    demo* record;
+    demo_checkpoint** checkpoints; /**< Segment i ends to checkpoint i */
+    unsigned segments;      /**< Count of checkpoints + 1 */
+    segment_result* results;
+    unsigned finalHash;     /**< State hash at the end of the last segment */
+    unsigned pieces;        /**< Pieces spawned in the whole demo */
+    atomic_uint next;       /**< Index of the next segment to verify */
+} verify_work;
+
+static int VerifyDemo(const char* path, unsigned jobs);
+static void* Worker(void* data);
+static segment_result VerifySegment(verify_work* work, unsigned segment);
+static double NowMs();
+
+int main(int argc, char** argv) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned jobs = cpus > 0 ? (unsigned)cpus : 1;
+    int first = argc;
+
+    //  Process command line arguments
+    for (int i=1; i<argc; i++) {
+        bool invalidArgs = false;
+        if (!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "-j")) {
+            if (argc <= ++i || atoi(argv[i]) <= 0) invalidArgs = true;
+            else jobs = atoi(argv[i]);
+        } else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
+            invalidArgs = true;
+        } else {
+            first = i;
+            break;
+        }
+
+        if (invalidArgs) {
+            printf("%s", helpStr);
+            return 2;
+        }
+    }
+    if (first == argc) {
+        printf("%s", helpStr);
+        return 2;
+    }
+    if (jobs > MAX_THREADS) jobs = MAX_THREADS;
+
+    int ret = 0;
+    unsigned checked = 0, failed = 0;
+    for (int i=first; i<argc; i++) {
+        struct stat st;
+        if (stat(argv[i], &st) != 0) {
+            fprintf(stderr, "Could not read %s\n", argv[i]);
+            ret = 2;
+            continue;
+        }
+
+        //  Directories are searched for demos
+        unsigned count = 1;
+        char** paths = NULL;
+        if (S_ISDIR(st.st_mode)) {
+            paths = ListDirectory(argv[i], ".demo", &count);
+            if (!paths) {
+                fprintf(stderr, "Could not list %s\n", argv[i]);
+                ret = 2;
+                continue;
+            }
+        }
+
+        for (unsigned j=0; j < count; j++) {
+            int res = VerifyDemo(paths ? paths[j] : argv[i], jobs);
+            checked++;
+            if (res > ret) ret = res;
+            if (res != 0) failed++;
+        }
+        FreeDirectoryList(paths, count);
+    }
+
+    printf("%u demos checked, %u failed\n", checked, failed);
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Verifies segments of one demo in parallel and prints the result
+    \param path Path to the demo
+    \param jobs Count of threads
+    \return Exit status of the demo
+*/
+int VerifyDemo(const char* path, unsigned jobs) {
+    double start = NowMs();
+    demo* record = DemoRead(path);
+    if (!record) {
+        printf("%s: could not be read\n", path);
+        return 2;
+    }
+
+    verify_work work = {.record = record, .segments = record->checkpointsCount+1};
+    atomic_init(&work.next, 0);
+    work.checkpoints = (demo_checkpoint**)malloc(sizeof(demo_checkpoint*)*work.segments);
+    work.results = (segment_result*)calloc(work.segments, sizeof(segment_result));
+    if (!work.checkpoints || !work.results) {
+        free(work.checkpoints);
+        free(work.results);
+        DemoFree(record);
+        return 2;
+    }
+    unsigned n = 0;
+    for (demo_list* list = record->checkpointsFirst; list != NULL; list = list->next) {
+        work.checkpoints[n++] = (demo_checkpoint*)list->value;
+    }
+
+    //  Verify segments, main thread works too
+    if (jobs > work.segments) jobs = work.segments;
+    pthread_t threads[MAX_THREADS];
+    unsigned started = 0;
+    for (; started+1 < jobs; started++) {
+        if (pthread_create(&threads[started], NULL, Worker, &work) != 0) break;
+    }
+    Worker(&work);
+    for (unsigned i=0; i < started; i++) pthread_join(threads[i], NULL);
+
+    //  Report the first failed segment
+    int ret = 0;
+    for (unsigned i=0; i < work.segments && ret == 0; i++) {
+        if (work.results[i] == SEGMENT_OK) continue;
+
+        unsigned from = i > 0 ? work.checkpoints[i-1]->instrsDone : 0;
+        unsigned to = i < n ? work.checkpoints[i]->instrsDone : record->instrsCount;
+        printf("%s: segment %u, instructions %u-%u, %s\n", path, i+1, from, to,
+            work.results[i] == SEGMENT_DIFFERS ? "state differs from checkpoint" : "could not start from checkpoint");
+        ret = work.results[i] == SEGMENT_DIFFERS ? 1 : 2;
+    }
+    if (ret == 0) {
+        printf("%s: ok, %u segments, %u pieces, final hash %08x, %.1f ms\n",
+            path, work.segments, work.pieces, work.finalHash, NowMs()-start);
+    }
+
+    free(work.checkpoints);
+    free(work.results);
+    DemoFree(record);
+    return ret;
+}
+
+/**
+    \brief Thread function, verifies segments until all are done
+    \param data Pointer to verify_work
+*/
+void* Worker(void* data) {
+    verify_work* work = (verify_work*)data;
+
+    unsigned i;
+    while ((i = atomic_fetch_add(&work->next, 1)) < work->segments) {
+        work->results[i] = VerifySegment(work, i);
+    }
+    return NULL;
+}
+
+/**
+    \brief Replays segment from the checkpoint before it to the next one
+    \param work Segments of the demo
+    \param segment Index of the segment
+    \return Result of the segment
+*/
+segment_result VerifySegment(verify_work* work, unsigned segment) {
+    demo_playback* playback = PlaybackCreate(work->record, MAP_WIDTH, MAP_HEIGHT+2);
+    if (!playback) return SEGMENT_ERROR;
+
+    if (segment > 0 && PlaybackLoadCheckpoint(playback, work->checkpoints[segment-1]) != 0) {
+        PlaybackFree(playback);
+        return SEGMENT_ERROR;
+    }
+
+    //  Last segment runs to the end of demo
+    segment_result ret = SEGMENT_OK;
+    if (segment+1 == work->segments) {
+        while (PlaybackStep(playback));
+        work->finalHash = GameHashState(playback->gme);
+        work->pieces = PlaybackPieces(playback);
+        PlaybackFree(playback);
+        return ret;
+    }
+
+    demo_checkpoint* end = work->checkpoints[segment];
+    while (playback->instrsDone < end->instrsDone && PlaybackStep(playback));
+    PlaybackAdvance(playback, end->time); // Steps after the last instruction
+
+    unsigned len = GameSaveState(playback->gme, NULL, 0);
+    unsigned* state = (unsigned*)malloc(sizeof(unsigned)*len);
+    if (!state) {
+        ret = SEGMENT_ERROR;
+    } else {
+        GameSaveState(playback->gme, state, len);
+        if (playback->instrsDone != end->instrsDone || len != end->len ||
+            memcmp(state, end->state, sizeof(unsigned)*len) != 0
+        ) {
+            ret = SEGMENT_DIFFERS;
+        }
+    }
+
+    free(state);
+    PlaybackFree(playback);
+    return ret;
+}
+
+double NowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000.0 + ts.tv_nsec/1000000.0;
+}
@@ -0,0 +1,279 @@
+//  Queries and posts scores of a persistent leaderboard
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h> /* time(), clock_gettime() */
+
+#include "../core/leaderboard.h"
+#include "../core/scores.h"
+#include "../ui/os/os.h" /* LockFile(), ConnectSocket() */
+
+#define PAGE_DEFAULT 10
+#define PAGE_MAX 1000
+
+static const char* helpStr =
+"Usage: tetr-leaderboard <board> <command> [args]\n\
+Commands:\n \
+  top [count]\t\t\tList the best scores. default count=10\n \
+  page <rank> [count]\t\tList scores starting from the ranking\n \
+  rank <score> <time>\t\tRanking a score would get, time in milliseconds\n \
+  add <name> <score> <lines> <level> <time>\tPost a score\n \
+  fill <count> [seed]\t\tPost random scores and measure the board\n\n\
+Board is the path of its manifest, other files of the board are written\n\
+next to it. Rankings start from 1. The board is locked while the command\n\
+runs, so it can be used while the game is posting scores. If tetr-scored\n\
+serves the directory, it holds the lock and commands are sent to it\n\
+instead, except fill which needs the board to itself.\n";
+
+static void PrintScores(hiscore_list_entry* list, unsigned count, unsigned first);
+static int ConnectDaemon(const char* board, char* name);
+static int RunRemote(int sock, const char* name, int argc, char** argv);
+static int Request(int sock, const scores_request* req, scores_response* resp);
+static int Fill(leaderboard* lb, unsigned count, unsigned seed);
+static double NowMs();
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printf("%s", helpStr);
+        return 2;
+    }
+
+    //  Daemon keeps the board locked until it exits, so it runs the command
+    char name[SCORES_NAME_MAX];
+    int sock = ConnectDaemon(argv[1], name);
+    if (sock >= 0) {
+        int ret = RunRemote(sock, name, argc, argv);
+        CloseSocket(sock);
+        return ret;
+    }
+
+    //  Same lock file as the game uses
+    char lockPath[512];
+    snprintf(lockPath, sizeof(lockPath), "%s.lock", argv[1]);
+    int lock = LockFile(lockPath);
+    leaderboard* lb = lock >= 0 ? LeaderboardOpen(argv[1]) : NULL;
+    if (!lb) {
+        fprintf(stderr, "Could not open board %s\n", argv[1]);
+        UnlockFile(lock);
+        return 2;
+    }
+
+    int ret = 0;
+    const char* cmd = argv[2];
+    if ((!strcmp(cmd, "top") && argc <= 4) || (!strcmp(cmd, "page") && (argc == 4 || argc == 5))) {
+        bool top = !strcmp(cmd, "top");
+        unsigned offset = top ? 0 : (unsigned)strtoul(argv[3], NULL, 10);
+        if (offset > 0) offset--;
+        unsigned count = PAGE_DEFAULT;
+        if (argc > (top ? 3 : 4)) count = (unsigned)strtoul(argv[top ? 3 : 4], NULL, 10);
+        if (count > PAGE_MAX) count = PAGE_MAX;
+
+        hiscore_list_entry list[PAGE_MAX];
+        double start = NowMs();
+        unsigned n = LeaderboardPage(lb, offset, list, count);
+        double done = NowMs();
+        PrintScores(list, n, offset);
+        printf("%u of %u scores, %.3f ms\n", n, lb->total, done-start);
+    } else if (!strcmp(cmd, "rank") && argc == 5) {
+        hiscore_list_entry e = {.score = (unsigned)strtoul(argv[3], NULL, 10), .time = (unsigned)strtoul(argv[4], NULL, 10),
+            .date = (unsigned)time(NULL)};
+        double start = NowMs();
+        unsigned rank = LeaderboardRank(lb, &e);
+        printf("Ranking %u of %u, %.3f ms\n", rank+1, lb->total+1, NowMs()-start);
+    } else if (!strcmp(cmd, "add") && argc == 8) {
+        hiscore_list_entry e = {.score = (unsigned)strtoul(argv[4], NULL, 10), .rows = (unsigned)strtoul(argv[5], NULL, 10),
+            .lvl = (unsigned)strtoul(argv[6], NULL, 10), .time = (unsigned)strtoul(argv[7], NULL, 10), .date = (unsigned)time(NULL)};
+        strncpy(e.name, argv[3], sizeof(e.name)-1);
+        unsigned rank;
+        if (LeaderboardAdd(lb, &e, &rank) == 0) {
+            printf("Ranking %u of %u\n", rank+1, lb->total);
+        } else {
+            fprintf(stderr, "Could not post score\n");
+            ret = 2;
+        }
+    } else if (!strcmp(cmd, "fill") && (argc == 4 || argc == 5)) {
+        ret = Fill(lb, (unsigned)strtoul(argv[3], NULL, 10), argc == 5 ? (unsigned)strtoul(argv[4], NULL, 10) : 1);
+    } else {
+        printf("%s", helpStr);
+        ret = 2;
+    }
+
+    LeaderboardClose(lb);
+    UnlockFile(lock);
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Prints scores as a table
+    \param list Array of scores
+    \param count Count of scores
+    \param first Ranking of the first score starting from 0
+*/
+void PrintScores(hiscore_list_entry* list, unsigned count, unsigned first) {
+    for (unsigned i=0; i < count; i++) {
+        hiscore_list_entry* e = &list[i];
+        time_t date = (time_t)e->date;
+        char str[32] = "";
+        strftime(str, sizeof(str), "%Y-%m-%d %H:%M", localtime(&date));
+        printf("%10u  %-15s %10u %6u %4u %6u:%02u.%u  %s\n", first+i+1, e->name, e->score, e->rows, e->lvl,
+            e->time/60000, e->time/1000%60, e->time/100%10, str);
+    }
+}
+
+/**
+    \brief Connects to the daemon serving the directory of the board
+    \param board Path of the board
+    \param name Where the file name of the board is written, SCORES_NAME_MAX bytes
+    \return Connected socket, negative if no daemon serves the board
+*/
+int ConnectDaemon(const char* board, char* name) {
+    const char* slash = strrchr(board, '/');
+    const char* file = slash ? slash+1 : board;
+    if (strlen(file) >= SCORES_NAME_MAX || !ScoresServedName(file, scores_board)) return -1;
+    strcpy(name, file);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%.*s%s", slash ? (int)(slash-board+1) : 0, board, SCORES_SOCKET);
+    return ConnectSocket(path);
+}
+
+/**
+    \brief Runs the command with the daemon
+    \param sock Connection to the daemon
+    \param name File name of the board
+    \param argc Argument count
+    \param argv Program arguments
+    \return Exit status
+*/
+int RunRemote(int sock, const char* name, int argc, char** argv) {
+    static scores_request req;
+    static scores_response resp;
+    memset(&req, 0, sizeof(req));
+    req.kind = scores_board;
+    strcpy(req.name, name);
+
+    const char* cmd = argv[2];
+    if ((!strcmp(cmd, "top") && argc <= 4) || (!strcmp(cmd, "page") && (argc == 4 || argc == 5))) {
+        bool top = !strcmp(cmd, "top");
+        unsigned offset = top ? 0 : (unsigned)strtoul(argv[3], NULL, 10);
+        if (offset > 0) offset--;
+        unsigned count = PAGE_DEFAULT;
+        if (argc > (top ? 3 : 4)) count = (unsigned)strtoul(argv[top ? 3 : 4], NULL, 10);
+        if (count > PAGE_MAX) count = PAGE_MAX;
+
+        //  Pages larger than a response are fetched in parts
+        unsigned n = 0;
+        double start = NowMs();
+        req.op = scores_op_top;
+        do {
+            req.offset = offset + n;
+            req.count = count-n < SCORES_BATCH_MAX ? count-n : SCORES_BATCH_MAX;
+            if (Request(sock, &req, &resp) != 0) return 2;
+            PrintScores(resp.entries, resp.count, req.offset);
+            n += resp.count;
+        } while (n < count && resp.count == req.count);
+        printf("%u of %u scores, %.3f ms, served by tetr-scored\n", n, resp.total, NowMs()-start);
+    } else if (!strcmp(cmd, "rank") && argc == 5) {
+        req.op = scores_op_rank;
+        req.count = 1;
+        req.entries[0] = (hiscore_list_entry){.score = (unsigned)strtoul(argv[3], NULL, 10),
+            .time = (unsigned)strtoul(argv[4], NULL, 10), .date = (unsigned)time(NULL)};
+        double start = NowMs();
+        if (Request(sock, &req, &resp) != 0) return 2;
+        printf("Ranking %u of %u, %.3f ms, served by tetr-scored\n", resp.ranks[0]+1, resp.total+1, NowMs()-start);
+    } else if (!strcmp(cmd, "add") && argc == 8) {
+        req.op = scores_op_insert;
+        req.count = 1;
+        hiscore_list_entry* e = &req.entries[0];
+        *e = (hiscore_list_entry){.score = (unsigned)strtoul(argv[4], NULL, 10), .rows = (unsigned)strtoul(argv[5], NULL, 10),
+            .lvl = (unsigned)strtoul(argv[6], NULL, 10), .time = (unsigned)strtoul(argv[7], NULL, 10), .date = (unsigned)time(NULL)};
+        strncpy(e->name, argv[3], sizeof(e->name)-1);
+        if (Request(sock, &req, &resp) != 0) return 2;
+        printf("Ranking %u of %u\n", resp.ranks[0]+1, resp.total);
+    } else if (!strcmp(cmd, "fill") && (argc == 4 || argc == 5)) {
+        fprintf(stderr, "tetr-scored serves %s, stop it to fill the board\n", argv[1]);
+        return 2;
+    } else {
+        printf("%s", helpStr);
+        return 2;
+    }
+    return 0;
+}
+
+/**
+    \brief Sends request and waits for the response
+    \param sock Connection to the daemon
+    \param req The request
+    \param resp Where the response is written
+    \return 0 on success, prints errors
+*/
+int Request(int sock, const scores_request* req, scores_response* resp) {
+    static unsigned char msg[SCORES_MSG_MAX];
+    unsigned len = ScoresPackRequest(req, msg);
+    int n = len && SendFrame(sock, msg, len) == 0 ? ReceiveFrame(sock, msg, SCORES_MSG_MAX) : -1;
+    if (n < 0 || ScoresUnpackResponse(msg, (unsigned)n, req->op, resp) != 0) {
+        fprintf(stderr, "Daemon didn't answer\n");
+        return -1;
+    }
+    if (resp->status != scores_ok) {
+        fprintf(stderr, "Request failed with status %u\n", resp->status);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+    \brief Posts random scores and prints how fast the board is
+    \param lb Pointer to the board
+    \param count Count of scores posted
+    \param seed Seed of the scores
+    \return Exit status
+*/
+int Fill(leaderboard* lb, unsigned count, unsigned seed) {
+    srand(seed);
+    double start = NowMs(), slowest = 0;
+    for (unsigned i=0; i < count; i++) {
+        hiscore_list_entry e = {.score = (unsigned)rand() % 1000000, .rows = (unsigned)rand() % 300,
+            .lvl = (unsigned)rand() % 30, .time = (unsigned)rand() % 1800000, .date = (unsigned)time(NULL)};
+        snprintf(e.name, sizeof(e.name), "fill%u", (unsigned)rand() % 100000);
+
+        double t = NowMs();
+        if (LeaderboardAdd(lb, &e, NULL) != 0) {
+            fprintf(stderr, "Could not post score %u\n", i);
+            return 2;
+        }
+        t = NowMs() - t;
+        if (t > slowest) slowest = t;
+    }
+    double added = NowMs();
+
+    //  Lookups of random scores and pages
+    unsigned lookups = 1000;
+    for (unsigned i=0; i < lookups; i++) {
+        hiscore_list_entry e = {.score = (unsigned)rand() % 1000000, .time = (unsigned)rand() % 1800000};
+        LeaderboardRank(lb, &e);
+    }
+    double ranked = NowMs();
+    hiscore_list_entry page[PAGE_DEFAULT];
+    for (unsigned i=0; i < lookups && lb->total; i++) LeaderboardPage(lb, (unsigned)rand() % lb->total, page, PAGE_DEFAULT);
+    double paged = NowMs();
+
+    printf("%u scores posted, %.2f us per score, slowest %.1f ms\n", count, count ? 1000*(added-start)/count : 0.0, slowest);
+    printf("%u scores on the board, rank %.2f us, page of %u %.2f us\n", lb->total,
+        1000*(ranked-added)/lookups, PAGE_DEFAULT, 1000*(paged-ranked)/lookups);
+    return 0;
+}
+
+/**
+    \brief Get monotonic time in milliseconds
+*/
+double NowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000.0 + ts.tv_nsec/1e6;
+}
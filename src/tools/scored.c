@@ -0,0 +1,255 @@
+//  Serves the hiscore table and leaderboards of a directory over a Unix domain socket
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h> /* sigaction() */
+#include <poll.h> /* poll() */
+#include <unistd.h> /* unlink() */
+#include <time.h> /* time(), clock_gettime() */
+
+#include "../ui/os/os.h"
+#include "../core/scores.h"
+
+#define CLIENTS_MAX 64
+#define BENCH_BOARD SCORES_BENCH_BOARD
+
+static const char* helpStr =
+"Usage: tetr-scored <dir> [command]\n\
+       tetr-scored --help\n\
+Commands:\n \
+  serve\t\t\t\tServe the scores of the directory, default\n \
+  bench <count> [batch]\t\tPost random scores to the running daemon and measure it\n\n\
+The daemon listens on <dir>/" SCORES_SOCKET " and keeps the hiscore table and\n\
+the leaderboards of the randomisers open and locked until it exits, other\n\
+files are refused. Games and tetr-leaderboard using the directory send\n\
+their requests to it, or change the files themselves when it isn't\n\
+running. Bench posts to the board " BENCH_BOARD ".\n";
+
+static volatile sig_atomic_t stopping = 0;
+
+static int Serve(const char* dir);
+static int Bench(const char* dir, unsigned count, unsigned batch);
+static int Request(int sock, const scores_request* req, scores_response* resp);
+static void OnSignal(int sig);
+static double NowMs();
+
+int main(int argc, char** argv) {
+    if (argc >= 2 && (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-h"))) {
+        printf("%s", helpStr);
+        return 0;
+    }
+    //  Options aren't directories
+    if (argc < 2 || argc > 5 || argv[1][0] == '-') {
+        printf("%s", helpStr);
+        return 2;
+    }
+
+    if (argc == 2 || (!strcmp(argv[2], "serve") && argc == 3)) return Serve(argv[1]);
+    if (!strcmp(argv[2], "bench") && argc >= 4) {
+        unsigned batch = argc == 5 ? (unsigned)strtoul(argv[4], NULL, 10) : 1;
+        if (batch < 1) batch = 1;
+        if (batch > SCORES_BATCH_MAX) batch = SCORES_BATCH_MAX;
+        return Bench(argv[1], (unsigned)strtoul(argv[3], NULL, 10), batch);
+    }
+    printf("%s", helpStr);
+    return 2;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Serves requests until interrupted
+    \param dir Directory of the scores
+    \return Exit status
+*/
+int Serve(const char* dir) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, SCORES_SOCKET);
+    int listener = ListenSocket(path);
+    if (listener < 0) {
+        fprintf(stderr, "Could not listen on %s, is the daemon already running?\n", path);
+        return 2;
+    }
+
+    scores_store* store = ScoresOpen(dir, LockFile, UnlockFile);
+    if (!store) {
+        CloseSocket(listener);
+        unlink(path);
+        return 2;
+    }
+
+    //  Interrupted poll() returns, so the loop sees the flag
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = OnSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    printf("Serving %s on %s\n", dir, path);
+    fflush(stdout);
+
+    //  First slot is the listener, clients keep their connection for many requests
+    struct pollfd fds[CLIENTS_MAX+1];
+    unsigned count = 1;
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+    static unsigned char msg[SCORES_MSG_MAX];
+    static unsigned char out[SCORES_MSG_MAX];
+    unsigned long requests = 0;
+
+    while (!stopping) {
+        if (poll(fds, count, -1) < 0) continue;
+
+        for (unsigned i=1; i < count; i++) {
+            if (!fds[i].revents) continue;
+            int len = (fds[i].revents & POLLIN) ? ReceiveFrame(fds[i].fd, msg, SCORES_MSG_MAX) : -1;
+            if (len >= 0) {
+                unsigned outLen = ScoresServe(store, msg, (unsigned)len, out);
+                if (SendFrame(fds[i].fd, out, outLen) == 0) {
+                    requests++;
+                    continue;
+                }
+            }
+
+            //  Closed or broken connection, last slot is moved here
+            CloseSocket(fds[i].fd);
+            fds[i--] = fds[--count];
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int sock = AcceptSocket(listener);
+            if (sock >= 0 && count <= CLIENTS_MAX) {
+                fds[count].fd = sock;
+                fds[count].events = POLLIN;
+                fds[count++].revents = 0;
+            } else {
+                CloseSocket(sock);
+            }
+        }
+    }
+
+    for (unsigned i=0; i < count; i++) CloseSocket(fds[i].fd);
+    unlink(path);
+    ScoresClose(store);
+    printf("%lu requests served\n", requests);
+    return 0;
+}
+
+/**
+    \brief Posts random scores and prints latencies of the requests
+    \param dir Directory of the running daemon
+    \param count Count of scores posted
+    \param batch Scores in one request
+    \return Exit status
+*/
+int Bench(const char* dir, unsigned count, unsigned batch) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, SCORES_SOCKET);
+    int sock = ConnectSocket(path);
+    if (sock < 0) {
+        fprintf(stderr, "No daemon listening on %s\n", path);
+        return 2;
+    }
+
+    static scores_request req;
+    static scores_response resp;
+    memset(&req, 0, sizeof(req));
+    req.kind = scores_board;
+    strcpy(req.name, BENCH_BOARD);
+
+    srand((unsigned)time(NULL) ^ (unsigned)getpid());
+    unsigned requests = 0;
+    double start = NowMs(), slowest = 0;
+    for (unsigned posted=0; posted < count; posted += req.count) {
+        req.op = scores_op_insert;
+        req.count = count-posted < batch ? count-posted : batch;
+        for (unsigned i=0; i < req.count; i++) {
+            hiscore_list_entry e = {.score = (unsigned)rand() % 1000000, .rows = (unsigned)rand() % 300,
+                .lvl = (unsigned)rand() % 30, .time = (unsigned)rand() % 1800000, .date = (unsigned)time(NULL)};
+            snprintf(e.name, sizeof(e.name), "bench%u", (unsigned)rand() % 100000);
+            req.entries[i] = e;
+        }
+
+        double t = NowMs();
+        if (Request(sock, &req, &resp) != 0) {
+            CloseSocket(sock);
+            return 2;
+        }
+        t = NowMs() - t;
+        if (t > slowest) slowest = t;
+        requests++;
+    }
+    double posted = NowMs();
+
+    //  Rank and top of random scores, one per request
+    unsigned lookups = 1000;
+    req.op = scores_op_rank;
+    req.count = 1;
+    for (unsigned i=0; i < lookups; i++) {
+        req.entries[0].score = (unsigned)rand() % 1000000;
+        req.entries[0].time = (unsigned)rand() % 1800000;
+        if (Request(sock, &req, &resp) != 0) {
+            CloseSocket(sock);
+            return 2;
+        }
+    }
+    double ranked = NowMs();
+    req.op = scores_op_top;
+    req.count = 10;
+    for (unsigned i=0; i < lookups; i++) {
+        req.offset = resp.total ? (unsigned)rand() % resp.total : 0;
+        if (Request(sock, &req, &resp) != 0) {
+            CloseSocket(sock);
+            return 2;
+        }
+    }
+    double paged = NowMs();
+    CloseSocket(sock);
+
+    printf("%u scores posted in %u requests, %.2f us per request, %.2f us per score, slowest %.2f ms\n",
+        count, requests, requests ? 1000*(posted-start)/requests : 0.0, count ? 1000*(posted-start)/count : 0.0, slowest);
+    printf("%u scores on the board, rank %.2f us, top 10 %.2f us per request\n", resp.total,
+        1000*(ranked-posted)/lookups, 1000*(paged-ranked)/lookups);
+    return 0;
+}
+
+/**
+    \brief Sends request and waits for the response
+    \param sock Connection to the daemon
+    \param req The request
+    \param resp Where the response is written
+    \return 0 on success, prints errors
+*/
+int Request(int sock, const scores_request* req, scores_response* resp) {
+    static unsigned char msg[SCORES_MSG_MAX];
+    unsigned len = ScoresPackRequest(req, msg);
+    int n = len && SendFrame(sock, msg, len) == 0 ? ReceiveFrame(sock, msg, SCORES_MSG_MAX) : -1;
+    if (n < 0 || ScoresUnpackResponse(msg, (unsigned)n, req->op, resp) != 0) {
+        fprintf(stderr, "Daemon didn't answer\n");
+        return -1;
+    }
+    if (resp->status != scores_ok) {
+        fprintf(stderr, "Request failed with status %u\n", resp->status);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+    \brief Stops serving on SIGINT and SIGTERM
+*/
+void OnSignal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+/**
+    \brief Get monotonic time in milliseconds
+*/
+double NowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000.0 + ts.tv_nsec/1e6;
+}
@@ -1,9 +1,27 @@
 #include <unistd.h> /* readlink() */
 #include <sys/time.h> /* gettimeofday() */
 #include <time.h> /*nanosleep()*/
+#include <dirent.h> /* opendir(), readdir() */
+#include <stdlib.h> /* malloc(), realloc(), qsort() */
+#include <string.h> /* strlen(), strcmp() */
+#include <stdio.h> /* snprintf() */
+#include <fcntl.h> /* open(), fcntl() */
+#include <errno.h>
+#include <limits.h> /* INT_MAX */
+#include <sys/stat.h> /* fstat() */
+#include <sys/file.h> /* flock() */
+#include <sys/socket.h> /* socket(), send(), recv() */
+#include <sys/un.h> /* sockaddr_un */
 
 #include "os.h"
 
+#define SOCKET_TIMEOUT_MS 1000
+
+static int ComparePaths(const void* a, const void* b); // qsort() comparator for ListDirectory()
+static int SocketAddress(const char* path, struct sockaddr_un* addr);
+static int SetTimeouts(int sock);
+static int TransferAll(int sock, void* data, unsigned len, int sending);
+
 int GetExecutablePath(char* buf, unsigned len) {
     int ret = (int)readlink("/proc/self/exe", buf, len);
     //  On error return straight
@@ -26,3 +44,232 @@ void SleepMs(unsigned ms) {
     struct timespec ts = {.tv_sec = 0, .tv_nsec = ms*1000000};
     nanosleep(&ts, NULL);
 }
+
+char** ListDirectory(const char* path, const char* suffix, unsigned* outCount) {
+    DIR* dir = opendir(path);
+    if (!dir) return NULL;
+
+    unsigned count = 0, size = 64;
+    char** ret = (char**)malloc(sizeof(char*)*size);
+    size_t pathLen = strlen(path);
+    size_t suffixLen = suffix ? strlen(suffix) : 0;
+
+    struct dirent* ent;
+    while (ret && (ent = readdir(dir)) != NULL) {
+        size_t nameLen = strlen(ent->d_name);
+        if (ent->d_name[0] == '.') continue; // hidden, current and parent
+        if (nameLen < suffixLen || strcmp(ent->d_name+nameLen-suffixLen, suffix ? suffix : "")) continue;
+
+        //  Grow array when full
+        if (count == size) {
+            size *= 2;
+            char** grown = (char**)realloc(ret, sizeof(char*)*size);
+            if (!grown) break;
+            ret = grown;
+        }
+
+        size_t len = pathLen + nameLen + 2;
+        char* str = (char*)malloc(len);
+        if (!str) break;
+        snprintf(str, len, "%s/%s", path, ent->d_name);
+        ret[count++] = str;
+    }
+    closedir(dir);
+
+    if (ret) qsort(ret, count, sizeof(char*), ComparePaths);
+    if (outCount) *outCount = count;
+    return ret;
+}
+
+void FreeDirectoryList(char** list, unsigned count) {
+    if (!list) return;
+    for (unsigned i=0; i < count; i++) free(list[i]);
+    free(list);
+}
+
+int OpenStream(const char* path) {
+    int fd = -1;
+    if (strcmp(path, "-") == 0) {
+        //  Keyboard input of the UI is read from the terminal instead of the pipe
+        fd = dup(STDIN_FILENO);
+        int tty = isatty(STDIN_FILENO) ? -1 : open("/dev/tty", O_RDONLY);
+        if (tty >= 0) {
+            dup2(tty, STDIN_FILENO);
+            close(tty);
+        }
+    } else {
+        fd = open(path, O_RDONLY);
+    }
+    if (fd < 0) return -1;
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int ReadStream(int stream, void* buf, unsigned len) {
+    ssize_t ret = read(stream, buf, len);
+    if (ret > 0) return (int)ret;
+    if (ret < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+
+    //  End of file, regular files may still grow
+    struct stat st;
+    if (fstat(stream, &st) == 0 && S_ISREG(st.st_mode)) return 0;
+    return -1;
+}
+
+void CloseStream(int stream) {
+    if (stream >= 0) close(stream);
+}
+
+int LockFile(const char* path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+
+    //  Lock is released if the process dies
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+void UnlockFile(int lock) {
+    if (lock < 0) return;
+    flock(lock, LOCK_UN);
+    close(lock);
+}
+
+unsigned long long FileStamp(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+
+    //  Replacing with rename() changes the inode, writing in place changes the time and size
+    unsigned long long ret = 14695981039346656037ULL;
+    unsigned long long parts[] = {st.st_ino, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+    for (unsigned i=0; i < 4; i++) ret = (ret ^ parts[i]) * 1099511628211ULL;
+    return ret ? ret : 1;
+}
+
+int ListenSocket(const char* path) {
+    struct sockaddr_un addr;
+    if (SocketAddress(path, &addr) != 0) return -1;
+
+    //  A socket nobody answers is left by a dead process
+    int other = ConnectSocket(path);
+    if (other >= 0) {
+        close(other);
+        return -1;
+    }
+    unlink(path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(sock, 64) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int AcceptSocket(int listener) {
+    int sock;
+    do {
+        sock = accept(listener, NULL, NULL);
+    } while (sock < 0 && errno == EINTR);
+    if (sock >= 0 && SetTimeouts(sock) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int ConnectSocket(const char* path) {
+    struct sockaddr_un addr;
+    if (SocketAddress(path, &addr) != 0) return -1;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 || SetTimeouts(sock) != 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int SendFrame(int sock, const void* data, unsigned len) {
+    unsigned char header[4] = {len >> 24, len >> 16, len >> 8, len};
+    if (TransferAll(sock, header, 4, 1) != 0) return -1;
+    return TransferAll(sock, (void*)data, len, 1);
+}
+
+int ReceiveFrame(int sock, void* buf, unsigned len) {
+    unsigned char header[4];
+    if (TransferAll(sock, header, 4, 0) != 0) return -1;
+    unsigned msgLen = (unsigned)header[0] << 24 | header[1] << 16 | header[2] << 8 | header[3];
+    if (msgLen > len || msgLen > INT_MAX) return -1;
+    return TransferAll(sock, buf, msgLen, 0) == 0 ? (int)msgLen : -1;
+}
+
+void CloseSocket(int sock) {
+    if (sock >= 0) close(sock);
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Fills address of a socket path
+    \param path Path to the socket
+    \param addr The address
+    \return 0 on success, -1 if the path is too long
+*/
+int SocketAddress(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) return -1;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+/**
+    \brief Limits how long sending and receiving may block
+    \param sock Socket handle
+    \return 0 on success
+*/
+int SetTimeouts(int sock) {
+    struct timeval tv = {SOCKET_TIMEOUT_MS/1000, SOCKET_TIMEOUT_MS%1000*1000};
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0) return -1;
+    return setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/**
+    \brief Sends or receives all of the bytes
+    \param sock Socket handle
+    \param data The bytes
+    \param len Count of bytes
+    \param sending Non-zero to send, 0 to receive
+    \return 0 on success, -1 on error, timeout or closed connection
+*/
+int TransferAll(int sock, void* data, unsigned len, int sending) {
+    unsigned char* p = (unsigned char*)data;
+    while (len > 0) {
+        //  A closed peer returns an error instead of raising SIGPIPE
+        ssize_t n = sending ? send(sock, p, len, MSG_NOSIGNAL) : recv(sock, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (unsigned)n;
+    }
+    return 0;
+}
+
+int ComparePaths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
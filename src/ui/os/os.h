@@ -20,3 +20,119 @@ extern unsigned GetTime();
     \param ms Time in milliseconds
 */
 extern void SleepMs(unsigned ms);
+
+/**
+    \brief List files in a directory
+    \param path Path to the directory
+    \param suffix Only names ending with the suffix are listed, NULL lists all
+    \param outCount Count of listed files
+    \return Sorted array of paths, NULL on error
+
+    \note Use FreeDirectoryList() to free returned array
+*/
+extern char** ListDirectory(const char* path, const char* suffix, unsigned* outCount);
+
+/**
+    \brief Frees array returned by ListDirectory()
+    \param list Array of paths
+    \param count Count of paths
+*/
+extern void FreeDirectoryList(char** list, unsigned count);
+
+/**
+    \brief Opens file or pipe for reading without blocking
+    \param path Path to the file, "-" for standard input
+    \return Stream handle, -1 on error
+
+    Standard input is moved to a new handle and replaced with the terminal,
+    so UIs can still read the keyboard.
+
+    \note Use CloseStream() to close the stream
+*/
+extern int OpenStream(const char* path);
+
+/**
+    \brief Reads data available in the stream without waiting
+    \param stream Handle returned by OpenStream()
+    \param buf Where data is read
+    \param len Size of the buffer
+    \return Count of bytes read, 0 if nothing available yet, -1 if closed or on error
+
+    \note End of a regular file returns 0, the file may still grow
+*/
+extern int ReadStream(int stream, void* buf, unsigned len);
+
+/**
+    \brief Closes stream opened with OpenStream()
+    \param stream Stream handle
+*/
+extern void CloseStream(int stream);
+
+/**
+    \brief Takes an advisory lock shared by all processes
+    \param path Path to the lock file, created if missing
+    \return Lock handle, -1 on error
+
+    \note Blocks until other processes release the lock. Use UnlockFile() to release it
+*/
+extern int LockFile(const char* path);
+
+/**
+    \brief Releases lock taken with LockFile()
+    \param lock Lock handle
+*/
+extern void UnlockFile(int lock);
+
+/**
+    \brief Get a stamp which changes when the file is modified or replaced
+    \param path Path to the file
+    \return The stamp, 0 if the file doesn't exist
+*/
+extern unsigned long long FileStamp(const char* path);
+
+/**
+    \brief Listens for connections on a Unix domain socket
+    \param path Path to the socket, a stale socket left by a dead process is replaced
+    \return Socket handle, -1 on error or if another process is listening
+*/
+extern int ListenSocket(const char* path);
+
+/**
+    \brief Accepts a connection to a listening socket
+    \param listener Handle returned by ListenSocket()
+    \return Socket handle, -1 on error
+*/
+extern int AcceptSocket(int listener);
+
+/**
+    \brief Connects to a Unix domain socket
+    \param path Path to the socket
+    \return Socket handle, -1 if nothing is listening
+*/
+extern int ConnectSocket(const char* path);
+
+/**
+    \brief Sends a message prefixed by its length
+    \param sock Socket handle
+    \param data The message
+    \param len Length of the message
+    \return 0 on success, -1 on error
+*/
+extern int SendFrame(int sock, const void* data, unsigned len);
+
+/**
+    \brief Receives a message sent with SendFrame()
+    \param sock Socket handle
+    \param buf Where the message is read
+    \param len Size of the buffer
+    \return Length of the message, -1 on error, timeout or if it doesn't fit
+
+    \note Sockets time out after a second, so a stuck peer can't hang the caller
+*/
+extern int ReceiveFrame(int sock, void* buf, unsigned len);
+
+/**
+    \brief Closes socket opened with ListenSocket(), AcceptSocket() or ConnectSocket()
+    \param sock Socket handle
+*/
+extern void CloseSocket(int sock);
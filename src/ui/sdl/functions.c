@@ -2,6 +2,10 @@
 #include "string.h" /* strlen() */
 #include "functions.h"
 
+#if !SDL_VERSION_ATLEAST(2, 0, 18)
+#error "SDL 2.0.18 or newer is needed for SDL_RenderGeometry()"
+#endif
+
 typedef struct {
     unsigned char r, g, b;
 } Color;
@@ -29,11 +33,55 @@ static int sym_colors[] = {
 };
 
 static unsigned movementKeys = 0; /** Bitmask to save movement key states for eliminating repeat delay */
+static unsigned cellGeneration = 0; /** Changed by AdjustCell() when the cell size changes */
+static unsigned repeatNext = 0; /** SDL_GetTicks() time of the next autorepeat of movement keys */
+static bool noGeometry = false; /** Set when the renderer fails SDL_RenderGeometry(), quads are drawn one by one */
 
 //  Static function declarations -------------
-static void DrawTetromino(SDL_Renderer* ren, SDL_Rect* cel, SpriteSheet* texture, tetromino* tetr, int offset_x, int offset_y, bool ignorearea);
+static void DrawTetromino(QuadBatch* batch, SpriteSheet* sheet, SDL_Rect* cell, tetromino* tetr, int offset_x, int offset_y, Uint8 alpha, bool ignorearea);
 static int HandleEvents(UI_Functions* funs, SDL_Event* ev);
 
+/**
+    \brief Returns the movement key bit of a key, "wasd" or arrows
+    \param key Scancode of the key
+    \return 0 if not a movement key
+*/
+static unsigned MovementBit(SDL_Scancode key);
+
+/**
+    \brief Returns the input of a key which isn't a movement key
+    \param key Scancode of the key
+    \return Letter, number or space, 0 for other keys
+*/
+static int KeyInput(SDL_Scancode key);
+
+/**
+    \brief Appends an input if there's room
+    \param funs    Pointer to UI functions
+    \param count   Count of inputs, incremented
+    \param input   The input
+    \param time    SDL_GetTicks() time of the input, 0 if now
+*/
+static void AddInput(UI_Functions* funs, unsigned* count, int input, Uint32 time);
+
+/**
+    \brief Appends the movement keys being held
+    \param funs    Pointer to UI functions
+    \param count   Count of inputs, incremented
+    \param time    SDL_GetTicks() time of the movement
+*/
+static void AddMovement(UI_Functions* funs, unsigned* count, Uint32 time);
+
+/**
+    \brief Appends autorepeats of the held movement keys due until given time
+    \param funs    Pointer to UI functions
+    \param count   Count of inputs, incremented
+    \param until   SDL_GetTicks() time, repeats after it are left for later
+
+    Repeats which don't fit the input array are skipped.
+*/
+static void RepeatMovement(UI_Functions* funs, unsigned* count, Uint32 until);
+
 /**
     \brief Render game area
     \param sdldata Pointer to SDL UI data
@@ -61,6 +109,110 @@ static void RenderBox(SDL_Renderer* ren, SDL_Rect* cell, SpriteSheet* style, SDL
 */
 static void RenderSprite(SDL_Renderer* ren, SpriteSheet* sheet, unsigned clip, SDL_Rect* pos_target);
 
+/**
+    \brief Queues a block, sprite of its symbol or a rectangle of its color
+    \param batch   Batch of the blocks
+    \param sheet   Block sprite sheet, NULL if not loaded
+    \param symbol  Symbol of the block
+    \param target  Area of the block
+    \param alpha   Opacity of the block
+*/
+static void AddBlock(QuadBatch* batch, SpriteSheet* sheet, unsigned symbol, SDL_Rect* target, Uint8 alpha);
+
+/**
+    \brief Writes vertices of a quad
+    \param batch   Batch whose texture the clip is from
+    \param v       4 vertices: top-left, top-right, bottom-left, bottom-right
+    \param target  Area of the quad in pixels
+    \param clip    Area of the texture, NULL if untextured
+    \param color   Color of the quad, modulates the texture
+*/
+static void SetQuad(const QuadBatch* batch, SDL_Vertex* v, const SDL_FRect* target, const SDL_Rect* clip, SDL_Color color);
+
+/**
+    \brief Makes room for quads at the end of the batch
+    \param batch   Pointer to the batch
+    \param count   Count of quads added
+    \return First vertex of the added quads, NULL on allocation error
+*/
+static SDL_Vertex* ReserveQuads(QuadBatch* batch, unsigned count);
+
+/**
+    \brief Draws the queued quads with one call and empties the batch
+    \param ren     SDL Renderer used
+    \param batch   Pointer to the batch
+*/
+static void DrawQuads(SDL_Renderer* ren, QuadBatch* batch);
+
+/**
+    \brief Draws the queued quads one by one, for renderers without geometry support
+    \param ren     SDL Renderer used
+    \param batch   Pointer to the batch
+*/
+static void DrawQuadsSlow(SDL_Renderer* ren, QuadBatch* batch);
+
+/**
+    \brief Queues the locked blocks of the game area
+    \param batch   Batch of the blocks
+    \param sheet   Block sprite sheet, NULL if not loaded
+    \param gme     Pointer to the game instance
+    \param cell    Area of the top-left visible cell
+*/
+static void QueueStack(QuadBatch* batch, SpriteSheet* sheet, game* gme, SDL_Rect cell);
+
+/**
+    \brief Compares the game area to the blocks in the stack layer and saves it
+    \param data    Pointer to SDL UI data
+    \param gme     Pointer to the game instance
+    \return True if a block was locked, cleared or moved since the last call
+*/
+static bool StackChanged(ui_sdl_data* data, game* gme);
+
+/**
+    \brief Makes sure the layer has a texture of the area
+    \param ren     SDL Renderer used
+    \param layer   Pointer to the layer
+    \param area    Position and size on the screen, a new size invalidates the layer
+    \return False if the texture could not be created
+*/
+static bool PrepareLayer(SDL_Renderer* ren, Layer* layer, SDL_Rect* area);
+
+/**
+    \brief Redirects rendering to the cleared, transparent layer
+    \param ren     SDL Renderer used
+    \param layer   Pointer to the layer
+
+    Coordinates are relative to the area of the layer until EndLayer() is called.
+*/
+static void BeginLayer(SDL_Renderer* ren, Layer* layer);
+static void EndLayer(SDL_Renderer* ren, Layer* layer);
+
+/**
+    \brief Returns cached glyph quads of the text, lays them out on a miss
+    \param data    Pointer to SDL UI data
+    \param text    The text
+    \param color   Color of the text
+    \return NULL on allocation error
+*/
+static TextCacheEntry* LayoutText(ui_sdl_data* data, const char* text, text_color color);
+
+/**
+    \brief Adds quads of the text to the batch of the frame
+    \param batch   Pointer to the text batch
+    \param entry   Laid out text
+    \param x       Position of the text in pixels
+    \param y
+    \return 0 on success, -1 on allocation error
+*/
+static int QueueText(TextBatch* batch, const TextCacheEntry* entry, float x, float y);
+
+/**
+    \brief Draws the queued text with one call and empties the batch
+    \param data Pointer to SDL UI data
+*/
+static void FlushText(ui_sdl_data* data);
+static void ClearTextCache(TextBatch* batch);
+
 int UI_SDLGameInit(UI_Functions* funs) {
     // ui_sdl_data* data = (ui_sdl_data*)funs->data;
 
@@ -138,16 +290,27 @@ void UI_SDLDemoShowPressed(UI_Functions* funs, unsigned topx, unsigned topy, dem
 void UI_SDLHiscoreRenderBegin(UI_Functions* funs) {
     ui_sdl_data* data = (ui_sdl_data*)funs->data;
 
-    //  Make sure screen is clear
+    //  Make sure screen is clear, quads queued before would be drawn over the new screen
     SDL_SetRenderDrawColor(data->renderer, 64, 64, 64, 255);
     SDL_RenderClear(data->renderer);
+    data->board.count = 0;
+    data->text->quads.count = 0;
 }
 
 int UI_SDLHiscoreGetName(UI_Functions* funs, hiscore_list_entry* entry, unsigned maxlen, unsigned rank) {
+    ui_sdl_data* data = (ui_sdl_data*)funs->data;
+
     //  Generate message
     char msg[128] = {0};
     snprintf(msg, 128, "NEW HISCORE, %d. PLACE.", rank);
 
+    //  Keys are read from the event queue here, the game must not see them later.
+    //  Releases are drained too, so no key is left held or repeating.
+    TimedKey key;
+    while (PopKey(&data->keys, &key));
+    movementKeys = 0;
+    funs->inputTimes[0] = 0;
+
     SDL_StartTextInput();
     SDL_Event ev;
 
@@ -189,7 +352,6 @@ int UI_SDLHiscoreGetName(UI_Functions* funs, hiscore_list_entry* entry, unsigned
     UI_SDLTextRender(funs, 35, 16, color_red, entry->name);
 
     if (drawCaret) {
-        ui_sdl_data* data = (ui_sdl_data*)funs->data;
         SDL_Rect caret = *(data->cell);
         caret.x = (strlen(entry->name)+35) * caret.w;
         caret.y = caret.h * 16;
@@ -205,84 +367,55 @@ int UI_SDLHiscoreGetName(UI_Functions* funs, hiscore_list_entry* entry, unsigned
 void UI_SDLTextRender(UI_Functions* funs, unsigned x, unsigned y, text_color color, char* text) {
     ui_sdl_data* data = (ui_sdl_data*)funs->data;
 
-    int winW, winH;
-    SDL_GetWindowSize(data->window, &winW, &winH);
-    int rowSz = data->cell->h;
-    int colSz = data->cell->w;
-
-    unsigned len = strlen(text);
-
-    //  Set text color
-    SDL_SetTextureColorMod(data->font->texture, sdl_colors[color].r, sdl_colors[color].g, sdl_colors[color].b);
-    SDL_SetTextureAlphaMod(data->font->texture, 255);
-
-    //  Text rendering
-    SDL_Rect target = {.x = x*colSz, .y = y*rowSz, .w = colSz, .h = rowSz};
-    for (unsigned i = 0; i < len; i++, target.x += colSz) {
-        int ch = toupper(text[i]);
-
-        if (ch <= data->fontlast) {
-            int pos = ch - data->font1st;
-            if (pos >= 0) {
-                RenderSprite(data->renderer, data->font, pos, &target);
-            }
-        }
-    }
+    //  Text is drawn on top of the frame when it ends
+    TextCacheEntry* entry = LayoutText(data, text, color);
+    if (entry) QueueText(data->text, entry, x*data->cell->w, y*data->cell->h);
 }
 
 void UI_SDLTetrominoRender(UI_Functions* funs, unsigned topx, unsigned topy, tetromino* tetr) {
     ui_sdl_data* data = (ui_sdl_data*)funs->data;
 
-    unsigned c = tetr->blocks[0]->symbol;
-    c = sym_colors[c];
-    SDL_SetRenderDrawColor(data->renderer, sdl_colors[c].r, sdl_colors[c].g, sdl_colors[c].b, 255);
-
     SDL_Rect cell = *data->cell;
     cell.w = cell.h;
-    DrawTetromino(data->renderer, &cell, data->blocks, tetr, data->cell->w*topx, (data->cell->h)*(topy), true);
+    DrawTetromino(&data->board, data->blocks, &cell, tetr, data->cell->w*topx, (data->cell->h)*(topy), 255, true);
 }
 
 int UI_SDLGetInput(UI_Functions* funs) {
     if (!funs) return 0;
-    unsigned old_movementKeys = movementKeys;
+    ui_sdl_data* data = (ui_sdl_data*)funs->data;
 
+    //  Other events are handled now, keys come from the ring with their times
     SDL_Event ev;
     unsigned count = 0;
-    //  Process events if any and array not full
-    while (SDL_PollEvent(&ev) && count < INPUT_ARRAY_LEN) {
+    while (count < INPUT_ARRAY_LEN && SDL_PollEvent(&ev)) {
+        if (ev.type == SDL_KEYDOWN || ev.type == SDL_KEYUP) continue;
+
         int input = HandleEvents(funs, &ev);
         if (input == 0) continue; // nothing interesting
-
-        funs->inputs[count] = input;
-        count++;
+        AddInput(funs, &count, input, 0);
     }
 
-    static unsigned next;
-    //  If movement keys are down add them, "wasd"-keys
-    if (movementKeys) {
-        bool getInput = false;
-
-        ui_sdl_data* data = funs->data;
-        if (old_movementKeys < movementKeys) {
-            // More keys down than last time, next repeat is t+DAS
-            next = SDL_GetTicks() + data->das;
-            getInput = true;
-        } else if (next < SDL_GetTicks()) {
-            // Next repeat is t+ARR
-            next = SDL_GetTicks() + data->arr;
-            getInput = true;
-        }
-
-        if (getInput) {
-            for(unsigned pos = 0; pos < movementKeys && count < INPUT_ARRAY_LEN; pos++) {
-                char keytocmd[] = "adsw";
-                if (movementKeys & (1 << pos)) {
-                    funs->inputs[count] = keytocmd[pos];
-                    count++;
-                }
-            }
+    //  Autorepeat runs up to each key, so a released key doesn't repeat after it
+    TimedKey key;
+    while (count < INPUT_ARRAY_LEN && PopKey(&data->keys, &key)) {
+        RepeatMovement(funs, &count, key.time);
+
+        unsigned bit = MovementBit(key.scancode);
+        if (!key.down) {
+            movementKeys &= ~bit;
+        } else if (bit) {
+            if (movementKeys & bit) continue; // Repeated by the system
+            movementKeys |= bit;
+
+            //  More keys down than before, held keys move now and repeat after DAS
+            AddMovement(funs, &count, key.time);
+            repeatNext = key.time + data->das;
+        } else {
+            int input = KeyInput(key.scancode);
+            if (input) AddInput(funs, &count, input, key.time);
         }
     }
+    RepeatMovement(funs, &count, SDL_GetTicks());
 
     return count;
 }
@@ -306,17 +439,24 @@ unsigned UI_SDLMillis() {
 void UI_SDLMainLoopEnd(UI_Functions* funs) {
     ui_sdl_data* data = (ui_sdl_data*)funs->data;
 
+    //  Blocks are under the text
+    DrawQuads(data->renderer, &data->board);
+    FlushText(data);
     SDL_RenderPresent(data->renderer);
+    MarkFramePresented(&data->pacer);
     SDL_SetRenderDrawColor(data->renderer, 64, 64, 64, 255);
     if (data->clearScreen) {
         SDL_RenderClear(data->renderer);
         data->clearScreen = false;
     }
 
-    SDL_Delay(2); // Sleep 2 ms to reduce CPU usage
+    //  Sleep until the next frame, wake up for input and autorepeat
+    WaitNextFrame(&data->pacer, movementKeys ? repeatNext : 0);
 }
 
 void AdjustCell(SDL_Rect* cell, unsigned winW, unsigned winH) {
+    SDL_Rect old = *cell;
+
     // 80x24 cells in a window
     cell->x = 0;
     cell->y = 0;
@@ -326,6 +466,15 @@ void AdjustCell(SDL_Rect* cell, unsigned winW, unsigned winH) {
     //  Make sure cell can't be 0
     if (cell->w == 0) cell->w = 1;
     if (cell->h == 0) cell->h = 1;
+
+    //  Laid out text doesn't fit the new cells
+    if (cell->w != old.w || cell->h != old.h) cellGeneration++;
+}
+
+void FreeLayer(Layer* layer) {
+    if (layer->texture) SDL_DestroyTexture(layer->texture);
+    layer->texture = NULL;
+    layer->valid = false;
 }
 
 void FreeSpriteSheet(SpriteSheet* sheet) {
@@ -339,6 +488,49 @@ void FreeSpriteSheet(SpriteSheet* sheet) {
     free(sheet);
 }
 
+int InitQuadBatch(QuadBatch* batch, SDL_Texture* texture) {
+    int texW = 1, texH = 1;
+    if (texture && SDL_QueryTexture(texture, NULL, NULL, &texW, &texH) != 0) return -1;
+
+    batch->texture = texture;
+    batch->texW = texW;
+    batch->texH = texH;
+    batch->verts = NULL;
+    batch->indices = NULL;
+    batch->count = 0;
+    batch->size = 0;
+    return 0;
+}
+
+void FreeQuadBatch(QuadBatch* batch) {
+    free(batch->verts);
+    free(batch->indices);
+    batch->verts = NULL;
+    batch->indices = NULL;
+    batch->count = batch->size = 0;
+}
+
+TextBatch* CreateTextBatch(SpriteSheet* font) {
+    if (!font) return NULL;
+
+    TextBatch* batch = (TextBatch*)calloc(1, sizeof(TextBatch));
+    if (!batch) return NULL;
+    if (InitQuadBatch(&batch->quads, font->texture) != 0) {
+        free(batch);
+        return NULL;
+    }
+    batch->generation = cellGeneration;
+    return batch;
+}
+
+void FreeTextBatch(TextBatch* batch) {
+    if (!batch) return; // nothing to free
+
+    ClearTextCache(batch);
+    FreeQuadBatch(&batch->quads);
+    free(batch);
+}
+
 /***********************
 Static functions
 ***********************/
@@ -354,9 +546,26 @@ void DrawMap(UI_Functions* funs, game* gme) {
     target.y = target.h;
     target.w *= MAP_WIDTH;
     target.h *= MAP_HEIGHT;
-    RenderBox(ren, &cell, sdldata->borders, &target); // Draw bg and borders
     sdldata->gameAreaWidth = target.w+target.x; //  Set gameAreaWidth in pixels
 
+    //  Layers cover the game area and its borders, each is redrawn only when it has changed
+    SDL_Rect area = {.x = target.x - cell.w, .y = target.y - cell.h, .w = target.w + 2*cell.w, .h = target.h + 2*cell.h};
+    bool layered = sdldata->layered && PrepareLayer(ren, &sdldata->chrome, &area) && PrepareLayer(ren, &sdldata->stack, &area);
+    if (layered) {
+        if (!sdldata->chrome.valid) {
+            SDL_Rect inner = target;
+            inner.x -= area.x;
+            inner.y -= area.y;
+            BeginLayer(ren, &sdldata->chrome);
+            SDL_SetRenderDrawColor(ren, 255, 255, 255, 255); // Outline if no sprite sheet
+            RenderBox(ren, &cell, sdldata->borders, &inner);
+            EndLayer(ren, &sdldata->chrome);
+        }
+        SDL_RenderCopy(ren, sdldata->chrome.texture, NULL, &area);
+    } else {
+        RenderBox(ren, &cell, sdldata->borders, &target); // Draw bg and borders
+    }
+
     //  Don't render blocks if paused
     if (gme->info.status & GAME_STATUS_PAUSE) {
         SDL_Rect cell = *sdldata->cell;
@@ -368,59 +577,36 @@ void DrawMap(UI_Functions* funs, game* gme) {
     }
 
     //  Game area blocks
-    block** mask = gme->map.blockMask;
-    unsigned len =  gme->map.width*gme->map.height;
-    int rightBorder = target.x+target.w;
     cell.x = target.x;
     cell.y = target.y;
-
-    SDL_SetRenderDrawColor(ren, 255, 0, 0, 255);
-    //  Render the whole game area, except the 2 top rows which are hidden
-    for (unsigned pos = gme->map.width*2; pos < len; pos++) {
-        //  If block exists
-        if (mask[pos]) {
-            //  Change color and render
-            unsigned sym = mask[pos]->symbol;
-
-            // if texture loaded, use it
-            if (sdldata->blocks) {
-                RenderSprite(ren, sdldata->blocks, sym, &cell);
-            } else {
-                sym = sym_colors[sym];
-                SDL_SetRenderDrawColor(ren, sdl_colors[sym].r, sdl_colors[sym].g, sdl_colors[sym].b, 255);
-                SDL_RenderFillRect(ren, &cell);
-            }
-        }
-
-        cell.x += cell.w;
-        if (cell.x >= rightBorder) { // If row processed move to the next row
-            cell.x = target.x;
-            cell.y += cell.h;
+    if (layered) {
+        bool changed = StackChanged(sdldata, gme);
+        if (changed || !sdldata->stack.valid) {
+            SDL_Rect inner = cell;
+            inner.x -= area.x;
+            inner.y -= area.y;
+            BeginLayer(ren, &sdldata->stack);
+            QueueStack(&sdldata->stackQuads, sdldata->blocks, gme, inner);
+            DrawQuads(ren, &sdldata->stackQuads);
+            EndLayer(ren, &sdldata->stack);
         }
+        SDL_RenderCopy(ren, sdldata->stack.texture, NULL, &area);
+    } else {
+        QueueStack(&sdldata->board, sdldata->blocks, gme, cell);
     }
 
-    //  Render active tetromino
-    unsigned c = gme->active->blocks[0]->symbol;
-    c = sym_colors[c];
-    SDL_SetRenderDrawColor(ren, sdl_colors[c].r, sdl_colors[c].g, sdl_colors[c].b, 255);
-    DrawTetromino(ren, &cell, sdldata->blocks, gme->active, target.x, target.y, false);
-    unsigned tmp = gme->active->y;
+    if (!gme->active) return;
 
-    //  Render ghost
+    //  Render active tetromino and its ghost
+    DrawTetromino(&sdldata->board, sdldata->blocks, &cell, gme->active, target.x, target.y, 255, false);
+    unsigned tmp = gme->active->y;
     gme->active->y = gme->info.ghostY;
-    if (sdldata->blocks) {
-        SDL_SetTextureAlphaMod(sdldata->blocks->texture, 64);
-        DrawTetromino(ren, &cell, sdldata->blocks, gme->active, target.x, target.y, false);
-        SDL_SetTextureAlphaMod(sdldata->blocks->texture, 255);
-    } else {
-        SDL_SetRenderDrawColor(ren, sdl_colors[c].r, sdl_colors[c].g, sdl_colors[c].b, 64);
-        DrawTetromino(ren, &cell, sdldata->blocks, gme->active, target.x, target.y, false);
-    }
+    DrawTetromino(&sdldata->board, sdldata->blocks, &cell, gme->active, target.x, target.y, 64, false);
     gme->active->y = tmp;
 }
 
-void DrawTetromino(SDL_Renderer* ren, SDL_Rect* cell, SpriteSheet* texture, tetromino* tetr, int offset_x, int offset_y, bool ignorearea) {
-    if (!tetr || !ren || !cell) return;
+void DrawTetromino(QuadBatch* batch, SpriteSheet* sheet, SDL_Rect* cell, tetromino* tetr, int offset_x, int offset_y, Uint8 alpha, bool ignorearea) {
+    if (!tetr || !batch || !cell) return;
 
     unsigned origoX = tetr->x;
     unsigned origoY = tetr->y -2; // 2 hidden rows
@@ -433,8 +619,7 @@ void DrawTetromino(SDL_Renderer* ren, SDL_Rect* cell, SpriteSheet* texture, tetr
 
         //  Determine if block is in game area
         if (ignorearea || temp.y >= offset_y) {
-            if (texture) RenderSprite(ren, texture, tetr->blocks[0]->symbol, &temp);
-            else SDL_RenderFillRect(ren, &temp);
+            AddBlock(batch, sheet, tetr->blocks[0]->symbol, &temp, alpha);
         }
     }
 }
@@ -445,42 +630,20 @@ int HandleEvents(UI_Functions* funs, SDL_Event* ev) {
     switch (ev->type) {
         case SDL_QUIT: return 'q';
         case SDL_KEYDOWN: {
-            switch (ev->key.keysym.scancode) {
-                case SDL_SCANCODE_SPACE: return ' '; break;
-
-                //  Movement
-                case SDL_SCANCODE_UP:
-                case SDL_SCANCODE_W: movementKeys |= 1 << INPUT_ROTATE; return 0;
-                case SDL_SCANCODE_LEFT:
-                case SDL_SCANCODE_A: movementKeys |= 1 << INPUT_LEFT; return 0;
-                case SDL_SCANCODE_DOWN:
-                case SDL_SCANCODE_S: movementKeys |= 1 << INPUT_DOWN; return 0;
-                case SDL_SCANCODE_RIGHT:
-                case SDL_SCANCODE_D: movementKeys |= 1 << INPUT_RIGHT; return 0;
-
-                default: {
-                    const char* key = SDL_GetKeyName(SDL_GetKeyFromScancode(ev->key.keysym.scancode));
-                    //   All letters and numbers (excluding numpad-nums)
-                    if (strlen(key) == 1) {
-                        // printf("Button down: %c\n", key[0]);
-                        return key[0];
-                    }
-                } break;
-            }
+            //  Held keys are tracked only from the key ring
+            if (MovementBit(ev->key.keysym.scancode)) return 0;
+            return KeyInput(ev->key.keysym.scancode);
         } break;
-        case SDL_KEYUP: {
-            switch (ev->key.keysym.scancode) {
-                //  Movement
-                case SDL_SCANCODE_UP:
-                case SDL_SCANCODE_W: movementKeys &= ~(1 << INPUT_ROTATE); break;
-                case SDL_SCANCODE_LEFT:
-                case SDL_SCANCODE_A: movementKeys &= ~(1 << INPUT_LEFT); break;
-                case SDL_SCANCODE_DOWN:
-                case SDL_SCANCODE_S: movementKeys &= ~(1 << INPUT_DOWN); break;
-                case SDL_SCANCODE_RIGHT:
-                case SDL_SCANCODE_D: movementKeys &= ~(1 << INPUT_RIGHT); break;
-                default: break;
-            }
+        case SDL_RENDER_TARGETS_RESET: {
+            //  Contents of the layers are lost
+            data->chrome.valid = false;
+            data->stack.valid = false;
+            return event_req_refresh;
+        } break;
+        case SDL_RENDER_DEVICE_RESET: {
+            //  All textures are lost
+            if (ReloadTextures(data) != 0) fprintf(stderr, "Could not reload textures. %s\n", SDL_GetError());
+            return event_req_refresh;
         } break;
         case SDL_WINDOWEVENT: {
             if (ev->window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
@@ -494,6 +657,57 @@ int HandleEvents(UI_Functions* funs, SDL_Event* ev) {
     return 0;
 }
 
+unsigned MovementBit(SDL_Scancode key) {
+    switch (key) {
+        case SDL_SCANCODE_UP:
+        case SDL_SCANCODE_W: return 1 << INPUT_ROTATE;
+        case SDL_SCANCODE_LEFT:
+        case SDL_SCANCODE_A: return 1 << INPUT_LEFT;
+        case SDL_SCANCODE_DOWN:
+        case SDL_SCANCODE_S: return 1 << INPUT_DOWN;
+        case SDL_SCANCODE_RIGHT:
+        case SDL_SCANCODE_D: return 1 << INPUT_RIGHT;
+        default: return 0;
+    }
+}
+
+int KeyInput(SDL_Scancode key) {
+    if (key == SDL_SCANCODE_SPACE) return ' ';
+
+    //   All letters and numbers (excluding numpad-nums)
+    const char* name = SDL_GetKeyName(SDL_GetKeyFromScancode(key));
+    return strlen(name) == 1 ? name[0] : 0;
+}
+
+void AddInput(UI_Functions* funs, unsigned* count, int input, Uint32 time) {
+    if (*count >= INPUT_ARRAY_LEN) return;
+
+    funs->inputs[*count] = input;
+    funs->inputTimes[*count] = time;
+    (*count)++;
+}
+
+void AddMovement(UI_Functions* funs, unsigned* count, Uint32 time) {
+    const char keytocmd[] = "adsw";
+    for (unsigned pos = 0; pos < sizeof(keytocmd)-1; pos++) {
+        if (movementKeys & (1 << pos)) AddInput(funs, count, keytocmd[pos], time);
+    }
+}
+
+void RepeatMovement(UI_Functions* funs, unsigned* count, Uint32 until) {
+    if (!movementKeys) return;
+
+    ui_sdl_data* data = (ui_sdl_data*)funs->data;
+    unsigned step = data->arr ? data->arr : 1;
+    while ((Sint32)(until - repeatNext) >= 0 && *count < INPUT_ARRAY_LEN) {
+        AddMovement(funs, count, repeatNext);
+        repeatNext += step;
+    }
+
+    //  Array is full, don't fall behind
+    if ((Sint32)(until - repeatNext) >= 0) repeatNext = until + step;
+}
+
 void RenderBox(SDL_Renderer* ren, SDL_Rect* cell, SpriteSheet* style, SDL_Rect* target) {
     SDL_Rect pos = *target;
     pos.w = cell->w;
@@ -544,3 +758,243 @@ void RenderBox(SDL_Renderer* ren, SDL_Rect* cell, SpriteSheet* style, SDL_Rect*
 void RenderSprite(SDL_Renderer* ren, SpriteSheet* sheet, unsigned clip, SDL_Rect* pos_target) {
     SDL_RenderCopy(ren, sheet->texture, &sheet->clips[clip], pos_target);
 }
+
+void AddBlock(QuadBatch* batch, SpriteSheet* sheet, unsigned symbol, SDL_Rect* target, Uint8 alpha) {
+    SDL_Vertex* v = ReserveQuads(batch, 1);
+    if (!v) return;
+
+    SDL_FRect area = {.x = target->x, .y = target->y, .w = target->w, .h = target->h};
+    if (sheet) {
+        SDL_Color white = {.r = 255, .g = 255, .b = 255, .a = alpha};
+        SetQuad(batch, v, &area, &sheet->clips[symbol], white);
+    } else {
+        unsigned c = sym_colors[symbol];
+        SDL_Color color = {.r = sdl_colors[c].r, .g = sdl_colors[c].g, .b = sdl_colors[c].b, .a = alpha};
+        SetQuad(batch, v, &area, NULL, color);
+    }
+}
+
+void SetQuad(const QuadBatch* batch, SDL_Vertex* v, const SDL_FRect* target, const SDL_Rect* clip, SDL_Color color) {
+    float u0 = 0, u1 = 0, v0 = 0, v1 = 0;
+    if (clip) {
+        u0 = clip->x / batch->texW;
+        u1 = (clip->x + clip->w) / batch->texW;
+        v0 = clip->y / batch->texH;
+        v1 = (clip->y + clip->h) / batch->texH;
+    }
+    float x0 = target->x, x1 = target->x + target->w;
+    float y0 = target->y, y1 = target->y + target->h;
+
+    v[0] = (SDL_Vertex){.position = {x0, y0}, .color = color, .tex_coord = {u0, v0}};
+    v[1] = (SDL_Vertex){.position = {x1, y0}, .color = color, .tex_coord = {u1, v0}};
+    v[2] = (SDL_Vertex){.position = {x0, y1}, .color = color, .tex_coord = {u0, v1}};
+    v[3] = (SDL_Vertex){.position = {x1, y1}, .color = color, .tex_coord = {u1, v1}};
+}
+
+SDL_Vertex* ReserveQuads(QuadBatch* batch, unsigned count) {
+    count += batch->count;
+    if (count > batch->size) {
+        unsigned size = batch->size ? batch->size : 256;
+        while (size < count) size *= 2;
+
+        SDL_Vertex* verts = (SDL_Vertex*)realloc(batch->verts, sizeof(SDL_Vertex)*4*size);
+        if (!verts) return NULL;
+        batch->verts = verts;
+        int* indices = (int*)realloc(batch->indices, sizeof(int)*6*size);
+        if (!indices) return NULL;
+        batch->indices = indices;
+
+        //  Quads are always in the same order, indices are written once
+        for (unsigned i = batch->size; i < size; i++) {
+            int* idx = &indices[6*i];
+            idx[0] = 4*i;   idx[1] = 4*i+1; idx[2] = 4*i+2;
+            idx[3] = 4*i+2; idx[4] = 4*i+1; idx[5] = 4*i+3;
+        }
+        batch->size = size;
+    }
+
+    SDL_Vertex* v = &batch->verts[4*batch->count];
+    batch->count = count;
+    return v;
+}
+
+void DrawQuads(SDL_Renderer* ren, QuadBatch* batch) {
+    if (batch->count && (noGeometry ||
+        SDL_RenderGeometry(ren, batch->texture, batch->verts, 4*batch->count, batch->indices, 6*batch->count) != 0)
+    ) {
+        noGeometry = true;
+        DrawQuadsSlow(ren, batch);
+    }
+    batch->count = 0;
+}
+
+void DrawQuadsSlow(SDL_Renderer* ren, QuadBatch* batch) {
+    for (unsigned i = 0; i < batch->count; i++) {
+        const SDL_Vertex* v = &batch->verts[4*i];
+        SDL_FRect dst = {v[0].position.x, v[0].position.y, v[3].position.x - v[0].position.x, v[3].position.y - v[0].position.y};
+        SDL_Color c = v[0].color;
+        if (batch->texture && v[3].tex_coord.x > v[0].tex_coord.x) {
+            SDL_Rect src = {
+                (int)(v[0].tex_coord.x*batch->texW + 0.5f), (int)(v[0].tex_coord.y*batch->texH + 0.5f),
+                (int)((v[3].tex_coord.x - v[0].tex_coord.x)*batch->texW + 0.5f), (int)((v[3].tex_coord.y - v[0].tex_coord.y)*batch->texH + 0.5f)
+            };
+            SDL_SetTextureColorMod(batch->texture, c.r, c.g, c.b);
+            SDL_SetTextureAlphaMod(batch->texture, c.a);
+            SDL_RenderCopyF(ren, batch->texture, &src, &dst);
+        } else {
+            SDL_SetRenderDrawColor(ren, c.r, c.g, c.b, c.a);
+            SDL_RenderFillRectF(ren, &dst);
+        }
+    }
+    if (batch->texture) {
+        SDL_SetTextureColorMod(batch->texture, 255, 255, 255);
+        SDL_SetTextureAlphaMod(batch->texture, 255);
+    }
+}
+
+void QueueStack(QuadBatch* batch, SpriteSheet* sheet, game* gme, SDL_Rect cell) {
+    block** mask = gme->map.blockMask;
+    unsigned len = gme->map.width*gme->map.height;
+    int left = cell.x;
+    int rightBorder = cell.x + cell.w*gme->map.width;
+
+    //  Render the whole game area, except the 2 top rows which are hidden
+    for (unsigned pos = gme->map.width*2; pos < len; pos++) {
+        //  If block exists
+        if (mask[pos]) AddBlock(batch, sheet, mask[pos]->symbol, &cell, 255);
+
+        cell.x += cell.w;
+        if (cell.x >= rightBorder) { // If row processed move to the next row
+            cell.x = left;
+            cell.y += cell.h;
+        }
+    }
+}
+
+bool StackChanged(ui_sdl_data* data, game* gme) {
+    bool changed = false;
+    unsigned len = gme->map.width*gme->map.height;
+    if (len != data->stackLen) {
+        unsigned char* cells = (unsigned char*)realloc(data->stackCells, len);
+        if (!cells) return true; // Redrawn every frame instead
+        data->stackCells = cells;
+        data->stackLen = len;
+        changed = true;
+    }
+
+    //  Cheaper than drawing, the map is a couple of hundred cells
+    block** mask = gme->map.blockMask;
+    for (unsigned pos = 0; pos < len; pos++) {
+        unsigned char c = mask[pos] ? mask[pos]->symbol+1 : 0;
+        if (data->stackCells[pos] != c) {
+            data->stackCells[pos] = c;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool PrepareLayer(SDL_Renderer* ren, Layer* layer, SDL_Rect* area) {
+    if (layer->texture && layer->area.w == area->w && layer->area.h == area->h) {
+        layer->area = *area;
+        return true;
+    }
+
+    FreeLayer(layer);
+    layer->texture = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, area->w, area->h);
+    if (!layer->texture) return false;
+    SDL_SetTextureBlendMode(layer->texture, SDL_BLENDMODE_BLEND);
+    layer->area = *area;
+    return true;
+}
+
+void BeginLayer(SDL_Renderer* ren, Layer* layer) {
+    SDL_SetRenderTarget(ren, layer->texture);
+    SDL_SetRenderDrawColor(ren, 0, 0, 0, 0);
+    SDL_RenderClear(ren);
+}
+
+void EndLayer(SDL_Renderer* ren, Layer* layer) {
+    SDL_SetRenderTarget(ren, NULL);
+    SDL_SetRenderDrawColor(ren, 64, 64, 64, 255);
+    layer->valid = true;
+}
+
+TextCacheEntry* LayoutText(ui_sdl_data* data, const char* text, text_color color) {
+    TextBatch* batch = data->text;
+    if (batch->generation != cellGeneration) {
+        ClearTextCache(batch);
+        batch->generation = cellGeneration;
+    }
+
+    //  FNV-1a, compared before the strings
+    unsigned hash = 2166136261u;
+    for (const char* c = text; *c; c++) hash = (hash ^ (unsigned char)*c) * 16777619u;
+
+    TextCacheEntry* slot = NULL;
+    for (unsigned i = 0; i < TEXT_CACHE_LEN; i++) {
+        TextCacheEntry* entry = &batch->cache[i];
+        if (entry->text && entry->hash == hash && entry->color == color && strcmp(entry->text, text) == 0) {
+            entry->used = batch->frame;
+            return entry;
+        }
+        //  Free entry, or the least recently used one if all are taken
+        if (!slot || (slot->text && (!entry->text || entry->used < slot->used))) slot = entry;
+    }
+
+    unsigned len = strlen(text);
+    char* copy = (char*)malloc(len+1);
+    SDL_Vertex* verts = (SDL_Vertex*)malloc(sizeof(SDL_Vertex)*4*(len ? len : 1));
+    if (!copy || !verts) {
+        free(copy);
+        free(verts);
+        return NULL;
+    }
+    memcpy(copy, text, len+1);
+
+    SDL_Color vcolor = {.r = sdl_colors[color].r, .g = sdl_colors[color].g, .b = sdl_colors[color].b, .a = 255};
+    SDL_FRect target = {.x = 0, .y = 0, .w = data->cell->w, .h = data->cell->h};
+    unsigned glyphs = 0;
+    for (unsigned i = 0; i < len; i++, target.x += target.w) {
+        int ch = toupper((unsigned char)text[i]);
+        if (ch > data->fontlast || ch < data->font1st) continue; // space or unknown
+
+        SetQuad(&batch->quads, &verts[4*glyphs++], &target, &data->font->clips[ch - data->font1st], vcolor);
+    }
+
+    free(slot->text);
+    free(slot->verts);
+    slot->text = copy;
+    slot->hash = hash;
+    slot->color = color;
+    slot->verts = verts;
+    slot->glyphs = glyphs;
+    slot->used = batch->frame;
+    return slot;
+}
+
+int QueueText(TextBatch* batch, const TextCacheEntry* entry, float x, float y) {
+    SDL_Vertex* v = ReserveQuads(&batch->quads, entry->glyphs);
+    if (!v) return -1;
+
+    for (unsigned i = 0; i < 4*entry->glyphs; i++) {
+        v[i] = entry->verts[i];
+        v[i].position.x += x;
+        v[i].position.y += y;
+    }
+    return 0;
+}
+
+void FlushText(ui_sdl_data* data) {
+    DrawQuads(data->renderer, &data->text->quads);
+    data->text->frame++;
+}
+
+void ClearTextCache(TextBatch* batch) {
+    for (unsigned i = 0; i < TEXT_CACHE_LEN; i++) {
+        free(batch->cache[i].text);
+        free(batch->cache[i].verts);
+        batch->cache[i].text = NULL;
+        batch->cache[i].verts = NULL;
+    }
+}
@@ -2,6 +2,8 @@
 
 #include "SDL.h"
 #include "../ui.h"
+#include "pacing.h"
+#include "input.h"
 
 typedef struct {
     SDL_Texture* texture;
@@ -9,6 +11,54 @@ typedef struct {
     unsigned len;
 } SpriteSheet;
 
+#define TEXT_CACHE_LEN 128 /* Distinct strings kept laid out */
+
+/**
+    \brief Quads drawn from one texture with one SDL_RenderGeometry() call
+*/
+typedef struct {
+    SDL_Texture* texture; /**< NULL for colored quads */
+    float texW, texH;   /**< Size of the texture */
+    SDL_Vertex* verts;  /**< 4 per quad */
+    int* indices;       /**< 6 per quad, two triangles */
+    unsigned count;     /**< Quads queued */
+    unsigned size;      /**< Quads allocated */
+} QuadBatch;
+
+/**
+    \brief Part of the screen rendered to a texture, redrawn only when it changes
+*/
+typedef struct {
+    SDL_Texture* texture; /**< Render target, NULL until first drawn */
+    SDL_Rect area;      /**< Position and size on the screen */
+    bool valid;         /**< False when the content must be redrawn */
+} Layer;
+
+/**
+    \brief Glyph quads of a string, laid out once and reused while it's drawn
+*/
+typedef struct {
+    char* text;         /**< Copy of the string, NULL if the entry is free */
+    unsigned hash;
+    text_color color;
+    SDL_Vertex* verts;  /**< 4 per glyph, relative to the position of the text */
+    unsigned glyphs;
+    unsigned used;      /**< Frame of the last use, the least recent is replaced */
+} TextCacheEntry;
+
+/**
+    \brief Text of a frame, drawn with one SDL_RenderGeometry() call
+
+    Strings are keyed by text and color. Cache is emptied when AdjustCell()
+    changes the cell size, so the layouts always match the current cells.
+*/
+typedef struct {
+    TextCacheEntry cache[TEXT_CACHE_LEN];
+    unsigned generation; /**< Cell size generation of the cached layouts */
+    QuadBatch quads;    /**< Glyphs queued for this frame */
+    unsigned frame;
+} TextBatch;
+
 /**
     \brief Struct for all SDL related stuff needed in UI
 */
@@ -23,15 +73,30 @@ typedef struct {
     //  DAS and ARR
     unsigned das; /**< Autorepeat start delay */
     unsigned arr; /**< Autorepeat rate */
+    KeyRing  keys; /**< Key events with their times */
 
     //  Game sprites
     SpriteSheet* borders;
     SpriteSheet* blocks;
+    QuadBatch   board; /**< Blocks of the frame, drawn from blocks or colored if not loaded */
+
+    //  Layers of the game area, drawn directly if render targets aren't supported
+    bool        layered;
+    Layer       chrome; /**< Background and borders */
+    Layer       stack;  /**< Locked blocks */
+    QuadBatch   stackQuads; /**< Blocks drawn to the stack layer */
+    unsigned char* stackCells; /**< Symbol+1 of each cell when the stack was drawn, 0 if empty */
+    unsigned    stackLen;
 
     //  Font data
     SpriteSheet* font;
     char        font1st;
     char        fontlast;
+    TextBatch*  text;
+
+    //  Frame pacing
+    FramePacer  pacer;
+    bool        frameStats; /**< Print frame statistics at exit */
 
     bool clearScreen;
     void* additional;
@@ -57,3 +122,32 @@ extern void UI_SDLMainLoopEnd(UI_Functions* funs);
 
 extern void AdjustCell(SDL_Rect* cell, unsigned winW, unsigned winH);
 extern void FreeSpriteSheet(SpriteSheet* sheet);
+extern void FreeLayer(Layer* layer);
+
+/**
+    \brief Loads the textures again after the renderer has lost them
+    \param data Pointer to SDL data
+    \return 0 on success, negative if an image could not be loaded
+*/
+extern int ReloadTextures(ui_sdl_data* data);
+
+/**
+    \brief Prepares empty batch for quads of the texture
+    \param batch   Pointer to the batch
+    \param texture Texture of the quads, NULL for colored quads
+    \return 0 on success, -1 if the texture can't be queried
+
+    \see FreeQuadBatch(QuadBatch* batch)
+*/
+extern int InitQuadBatch(QuadBatch* batch, SDL_Texture* texture);
+extern void FreeQuadBatch(QuadBatch* batch);
+
+/**
+    \brief Allocates batch for the text drawn with the font
+    \param font Font sprite sheet
+    \return NULL on error
+
+    \see FreeTextBatch(TextBatch* batch)
+*/
+extern TextBatch* CreateTextBatch(SpriteSheet* font);
+extern void FreeTextBatch(TextBatch* batch);
@@ -12,6 +12,10 @@
 #define WIN_DEF_W 1024
 #define WIN_DEF_H 768
 
+#define FONT_FILE "font.bmp"
+#define BORDERS_FILE "borders-hires.bmp"
+#define BLOCKS_FILE "blocks.bmp"
+
 /**
     \brief Load given image to SDL_Texture
     \param ren  SDL Rendering context
@@ -55,15 +59,29 @@ static SDL_Rect* ClipRectByCount(SDL_Rect* canvas, unsigned x, unsigned y);
 */
 static SpriteSheet* GenerateSheet(SDL_Texture* texture, SDL_Rect* clips, unsigned len);
 
+/**
+    \brief Loads the texture of a sprite sheet again
+    \param ren   SDL Rendering context
+    \param sheet Sprite sheet, nothing is done if NULL
+    \param path  Path to the image file
+    \return 0 on success, negative if the image could not be loaded
+*/
+static int ReloadSheet(SDL_Renderer* ren, SpriteSheet* sheet, const char* path);
+
 static const char* CmdLineHelpStr =
 " SDL\n\
    --no-textures\t\tDisables texture loading, except for font\n\
    --width <w>, --height <h>\tSet window size\n\
    --das <delay-ms>\t\tAuto repeat start delay. default=100\n\
-   --arr <delay-ms>\t\tAuto repeat rate delay. default=50\n";
+   --arr <delay-ms>\t\tAuto repeat rate delay. default=50\n\
+   --vsync\t\t\tWait for the display refresh when presenting\n\
+   --fps <n>\t\t\tTarget frame rate, 0 for unlimited. default=display refresh rate\n\
+   --frame-stats\t\tPrint frame rate and frame time jitter at exit\n";
 
 int UI_SDLInit(UI_Functions* ret, int argc, char** argv) {
     bool ena_textures = true;
+    bool vsync = false;
+    int fps = -1; // display refresh rate
     int winWidth = WIN_DEF_W, winHeight = WIN_DEF_H;
 
     //  Set data pointer
@@ -78,6 +96,8 @@ int UI_SDLInit(UI_Functions* ret, int argc, char** argv) {
     //  Default settings
     sdldata->das = 100;
     sdldata->arr = 50;
+    sdldata->frameStats = false;
+    bool frameStats = false;
 
     //  Process command line arguments
     for (int pos = 1; pos < argc; pos++) {
@@ -106,6 +126,25 @@ int UI_SDLInit(UI_Functions* ret, int argc, char** argv) {
             if (temp < 0) temp = 0;
             sdldata->arr = temp;
         }
+        else if (strcmp(argv[pos], "--vsync") == 0) {
+            vsync = true;
+        }
+        else if (strcmp(argv[pos], "--fps") == 0) {
+            if (++pos >= argc) continue; // ignore if no value
+            fps = atoi(argv[pos]);
+            if (fps < 0) fps = 0;
+        }
+        else if (strcmp(argv[pos], "--frame-stats") == 0) {
+            frameStats = true;
+        }
+    }
+
+    //  Headers may be newer than the library loaded at run time
+    SDL_version linked;
+    SDL_GetVersion(&linked);
+    if (SDL_VERSIONNUM(linked.major, linked.minor, linked.patch) < SDL_VERSIONNUM(2, 0, 18)) {
+        fprintf(stderr, "SDL 2.0.18 or newer is needed, found %u.%u.%u\n", linked.major, linked.minor, linked.patch);
+        return -1;
     }
 
     //  Init SDL
@@ -114,6 +153,7 @@ int UI_SDLInit(UI_Functions* ret, int argc, char** argv) {
         fprintf(stderr, "Could not initialize SDL:  %s\n", SDL_GetError());
         return -1;
     }
+    StartKeyRing(&sdldata->keys);
 
     //  Init window
     SDL_Window* win;
@@ -132,7 +172,7 @@ int UI_SDLInit(UI_Functions* ret, int argc, char** argv) {
 
     //  Init renderer
     SDL_Renderer* ren;
-    ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED);
+    ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
     if (!ren) {
         fprintf(stderr, "Could not create renderer: %s\n", SDL_GetError());
         SDL_DestroyWindow(win);
@@ -141,13 +181,26 @@ int UI_SDLInit(UI_Functions* ret, int argc, char** argv) {
     }
     SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
 
+    //  Frames are paced by sleeping if vsync isn't available
+    SDL_RendererInfo info;
+    if (vsync && (SDL_GetRendererInfo(ren, &info) != 0 || !(info.flags & SDL_RENDERER_PRESENTVSYNC))) {
+        fprintf(stderr, "Vsync is not supported, sleeping between frames instead.\n");
+        vsync = false;
+    }
+    if (fps < 0) {
+        SDL_DisplayMode mode;
+        fps = SDL_GetWindowDisplayMode(win, &mode) == 0 && mode.refresh_rate > 0 ? mode.refresh_rate : 60;
+    }
+    InitFramePacer(&sdldata->pacer, fps, vsync);
+    sdldata->frameStats = frameStats;
+
     /*  Load all used resources, fonts, images, audio etc.*/
     //  Load font
     //  Generate path
     char path[512] = {0};
     strcpy(path, SDL_GetBasePath());
     unsigned pathbaseLen = strlen(path);
-    strncpy(path+pathbaseLen, "font.bmp", 512-pathbaseLen);
+    strncpy(path+pathbaseLen, FONT_FILE, 512-pathbaseLen);
 
     //  Load image
     SDL_Rect canvas = {.x = 0, .y = 0 };
@@ -166,12 +219,17 @@ int UI_SDLInit(UI_Functions* ret, int argc, char** argv) {
 
     sdldata->font1st = '!';
     sdldata->fontlast = '`';
+    sdldata->text = CreateTextBatch(sdldata->font);
+    if (!sdldata->text) {
+        fprintf(stderr, "Could not create text batch. %s\n", SDL_GetError());
+        return -3;
+    }
 
     sdldata->borders = NULL;
     sdldata->blocks = NULL;
     if (ena_textures) {
         //  Load game area background and borders
-        strncpy(path+pathbaseLen, "borders-hires.bmp", 512-pathbaseLen);
+        strncpy(path+pathbaseLen, BORDERS_FILE, 512-pathbaseLen);
         SDL_Texture* borders = LoadImage(ren, path, &canvas.w, &canvas.h);
         SDL_Rect* border_clips = ClipRectByCount(&canvas, 3, 3);
         if (!borders || !border_clips) {
@@ -181,7 +239,7 @@ int UI_SDLInit(UI_Functions* ret, int argc, char** argv) {
         sdldata->borders = GenerateSheet(borders, border_clips, 0);
 
         //  Load block textures
-        strncpy(path+pathbaseLen, "blocks.bmp", 512-pathbaseLen);
+        strncpy(path+pathbaseLen, BLOCKS_FILE, 512-pathbaseLen);
         SDL_Texture* blocks = LoadImage(ren, path, &canvas.w, &canvas.h);
         SDL_Rect* block_clips = ClipRectByCount(&canvas, 7, 1);
         if (!blocks || !block_clips) {
@@ -192,6 +250,20 @@ int UI_SDLInit(UI_Functions* ret, int argc, char** argv) {
         sdldata->blocks = GenerateSheet(blocks, block_clips, 0);
     } // ena_textures
 
+    //  Blocks are colored rectangles without textures
+    if (InitQuadBatch(&sdldata->board, sdldata->blocks ? sdldata->blocks->texture : NULL) != 0) {
+        fprintf(stderr, "Could not create block batch. %s\n", SDL_GetError());
+        return -4;
+    }
+
+    //  Game area layers are created when first drawn
+    sdldata->layered = SDL_RenderTargetSupported(ren);
+    sdldata->chrome = (Layer){0};
+    sdldata->stack = (Layer){0};
+    sdldata->stackCells = NULL;
+    sdldata->stackLen = 0;
+    InitQuadBatch(&sdldata->stackQuads, sdldata->board.texture);
+
     //  Render cell rect
     sdldata->cell = (SDL_Rect*)calloc(1, sizeof(SDL_Rect));
     AdjustCell(sdldata->cell, winWidth, winHeight);
@@ -227,11 +299,19 @@ int UI_SDLInit(UI_Functions* ret, int argc, char** argv) {
 void UI_SDLCleanUp(UI_Functions* ptr) {
     if (ptr && ptr->data) {
         ui_sdl_data* sdldata = (ui_sdl_data*)ptr->data;
+        if (sdldata->frameStats) PrintFrameStats(&sdldata->pacer, stdout);
+        StopKeyRing(&sdldata->keys);
         SDL_free(sdldata->basePath);
 
+        FreeQuadBatch(&sdldata->board);
+        FreeQuadBatch(&sdldata->stackQuads);
+        FreeLayer(&sdldata->chrome);
+        FreeLayer(&sdldata->stack);
+        free(sdldata->stackCells);
         FreeSpriteSheet(sdldata->blocks);
         FreeSpriteSheet(sdldata->borders);
         //  Destroy font
+        FreeTextBatch(sdldata->text);
         FreeSpriteSheet(sdldata->font);
         free(sdldata->cell);
 
@@ -243,6 +323,27 @@ void UI_SDLCleanUp(UI_Functions* ptr) {
     SDL_Quit();
 }
 
+int ReloadTextures(ui_sdl_data* data) {
+    //  Layers are created again when drawn
+    FreeLayer(&data->chrome);
+    FreeLayer(&data->stack);
+
+    char path[512];
+    int ret = 0;
+    snprintf(path, sizeof(path), "%s%s", data->basePath, FONT_FILE);
+    if (ReloadSheet(data->renderer, data->font, path) != 0) ret = -1;
+    snprintf(path, sizeof(path), "%s%s", data->basePath, BORDERS_FILE);
+    if (ReloadSheet(data->renderer, data->borders, path) != 0) ret = -1;
+    snprintf(path, sizeof(path), "%s%s", data->basePath, BLOCKS_FILE);
+    if (ReloadSheet(data->renderer, data->blocks, path) != 0) ret = -1;
+
+    //  Batches draw from the new textures
+    data->text->quads.texture = data->font->texture;
+    data->board.texture = data->blocks ? data->blocks->texture : NULL;
+    data->stackQuads.texture = data->board.texture;
+    return ret;
+}
+
 const char* UI_SDLGetHelp() {
     return CmdLineHelpStr;
 }
@@ -326,6 +427,13 @@ SDL_Rect* ClipRectByCount(SDL_Rect* canvas, unsigned x, unsigned y) {
 }
 
 
+int ReloadSheet(SDL_Renderer* ren, SpriteSheet* sheet, const char* path) {
+    if (!sheet) return 0;
+    if (sheet->texture) SDL_DestroyTexture(sheet->texture);
+    sheet->texture = LoadImage(ren, path, NULL, NULL);
+    return sheet->texture ? 0 : -1;
+}
+
 static SpriteSheet* GenerateSheet(SDL_Texture* texture, SDL_Rect* clips, unsigned len) {
     SpriteSheet* sheet = (SpriteSheet*)malloc(sizeof(SpriteSheet));
     if (sheet) {
@@ -0,0 +1,58 @@
+#include "input.h"
+
+static int WatchKeys(void* data, SDL_Event* ev);
+
+void StartKeyRing(KeyRing* ring) {
+    SDL_AtomicSet(&ring->head, 0);
+    SDL_AtomicSet(&ring->tail, 0);
+    SDL_AtomicSet(&ring->dropped, 0);
+    SDL_AddEventWatch(WatchKeys, ring);
+}
+
+void StopKeyRing(KeyRing* ring) {
+    SDL_DelEventWatch(WatchKeys, ring);
+}
+
+bool PopKey(KeyRing* ring, TimedKey* out) {
+    int tail = SDL_AtomicGet(&ring->tail);
+    if (SDL_AtomicGet(&ring->head) == tail) return false;
+
+    //  Key is read after seeing the head, and before the slot is given back
+    SDL_MemoryBarrierAcquire();
+    *out = ring->keys[tail & (KEY_RING_LEN-1)];
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&ring->tail, tail+1);
+    return true;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Event watch, copies key events to the ring when they are queued
+    \param data Pointer to the ring
+    \param ev   The event
+    \return Ignored by SDL
+*/
+int WatchKeys(void* data, SDL_Event* ev) {
+    if (ev->type != SDL_KEYDOWN && ev->type != SDL_KEYUP) return 1;
+
+    KeyRing* ring = (KeyRing*)data;
+    int head = SDL_AtomicGet(&ring->head);
+    if ((unsigned)(head - SDL_AtomicGet(&ring->tail)) >= KEY_RING_LEN) {
+        SDL_AtomicAdd(&ring->dropped, 1);
+        return 1;
+    }
+
+    TimedKey* key = &ring->keys[head & (KEY_RING_LEN-1)];
+    key->time = ev->key.timestamp;
+    key->scancode = ev->key.keysym.scancode;
+    key->down = ev->type == SDL_KEYDOWN;
+    key->repeat = ev->key.repeat != 0;
+
+    //  Key is written before the reader can see it
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&ring->head, head+1);
+    return 1;
+}
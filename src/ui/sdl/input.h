@@ -0,0 +1,52 @@
+/*
+    Timestamped keyboard input of the SDL UI. Key events are copied to a
+    ring when SDL queues them, so their times aren't rounded to frames.
+*/
+#include <stdbool.h>
+
+#include "SDL.h"
+
+#define KEY_RING_LEN 256 /* Power of two */
+
+/**
+    \brief Key press or release with the time it happened
+*/
+typedef struct {
+    Uint32 time;            /**< SDL_GetTicks() time of the event */
+    SDL_Scancode scancode;
+    bool down;              /**< Pressed, false if released */
+    bool repeat;            /**< Repeated by the system */
+} TimedKey;
+
+/**
+    \brief Lock-free ring of key events, one writer and one reader
+
+    The writer is an event watch, which runs in the thread queuing the
+    events. Keys are lost if the ring is full.
+*/
+typedef struct {
+    TimedKey keys[KEY_RING_LEN];
+    SDL_atomic_t head;      /**< Count of keys written, changed only by the writer */
+    SDL_atomic_t tail;      /**< Count of keys read, changed only by the reader */
+    SDL_atomic_t dropped;   /**< Keys lost because the ring was full */
+} KeyRing;
+
+/**
+    \brief Empties the ring and starts copying key events to it
+    \param ring Pointer to the ring
+*/
+extern void StartKeyRing(KeyRing* ring);
+
+/**
+    \brief Stops copying key events to the ring
+    \param ring Pointer to the ring
+*/
+extern void StopKeyRing(KeyRing* ring);
+
+/**
+    \brief Takes the oldest key from the ring
+    \param ring Pointer to the ring
+    \param out  Where the key is written
+    \return False if the ring is empty
+*/
+extern bool PopKey(KeyRing* ring, TimedKey* out);
@@ -0,0 +1,86 @@
+#include "pacing.h"
+
+static double TicksToMs(FramePacer* pacer, Uint64 ticks);
+
+void InitFramePacer(FramePacer* pacer, unsigned fps, bool vsync) {
+    pacer->vsync = vsync;
+    pacer->fps = fps;
+    pacer->freq = SDL_GetPerformanceFrequency();
+    pacer->period = fps ? pacer->freq / fps : 0;
+    pacer->deadline = 0;
+    pacer->last = 0;
+    pacer->early = false;
+
+    pacer->frames = 0;
+    pacer->extra = 0;
+    pacer->late = 0;
+    pacer->sum = 0;
+    pacer->sumSq = 0;
+    pacer->worst = 0;
+}
+
+void MarkFramePresented(FramePacer* pacer) {
+    //  Frames drawn for input would make the frame times look shorter
+    if (pacer->early) {
+        pacer->early = false;
+        pacer->extra++;
+        return;
+    }
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (pacer->last) {
+        double ms = TicksToMs(pacer, now - pacer->last);
+        pacer->frames++;
+        pacer->sum += ms;
+        pacer->sumSq += ms*ms;
+        if (ms > pacer->worst) pacer->worst = ms;
+        if (pacer->period && ms > 1.5*TicksToMs(pacer, pacer->period)) pacer->late++;
+    }
+    pacer->last = now;
+}
+
+void WaitNextFrame(FramePacer* pacer, Uint32 wake) {
+    //  Presenting has already waited for the display
+    if (pacer->vsync || !pacer->period) return;
+
+    //  Deadline moves only when reached, frames drawn early for input don't push it
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now >= pacer->deadline) {
+        pacer->deadline += pacer->period;
+        if (pacer->deadline <= now) pacer->deadline = now + pacer->period;
+    }
+
+    Uint64 until = pacer->deadline;
+    if (wake) {
+        Sint32 left = (Sint32)(wake - SDL_GetTicks());
+        Uint64 at = now + (left > 0 ? (Uint64)left * pacer->freq / 1000 : 0);
+        if (at < until) until = at;
+    }
+    pacer->early = until < pacer->deadline;
+    if (until <= now) return;
+
+    //  Rounded up, waking up early would draw the frame twice
+    Uint32 ms = (Uint32)(((until - now) * 1000 + pacer->freq - 1) / pacer->freq);
+    if (SDL_WaitEventTimeout(NULL, ms)) pacer->early = true;
+}
+
+void PrintFrameStats(FramePacer* pacer, FILE* out) {
+    if (!pacer->frames) return;
+
+    double mean = pacer->sum / pacer->frames;
+    double variance = pacer->sumSq / pacer->frames - mean*mean;
+    double jitter = variance > 0 ? SDL_sqrt(variance) : 0;
+    fprintf(out, "%lu frames, %.1f fps, frame time %.2f ms, jitter %.2f ms, worst %.2f ms, %lu late, %lu extra for input\n",
+        pacer->frames, mean > 0 ? 1000/mean : 0, mean, jitter, pacer->worst, pacer->late, pacer->extra);
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Converts performance counter ticks to milliseconds
+*/
+double TicksToMs(FramePacer* pacer, Uint64 ticks) {
+    return ticks * 1000.0 / pacer->freq;
+}
@@ -0,0 +1,59 @@
+/*
+    Frame pacing of the SDL UI. Frames are presented at a target rate and
+    the main loop sleeps between them, waking up early for input.
+*/
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "SDL.h"
+
+/**
+    \brief Frame scheduler and frame time statistics
+*/
+typedef struct {
+    bool vsync;         /**< Presenting waits for the display, no sleeping */
+    unsigned fps;       /**< Target frame rate, 0 for unlimited */
+    Uint64 freq;        /**< Performance counter ticks in a second */
+    Uint64 period;      /**< Ticks in a frame */
+    Uint64 deadline;    /**< Time of the next frame */
+    Uint64 last;        /**< Time of the last paced present, 0 before the first */
+    bool early;         /**< Woken up before the deadline, the next frame is drawn for input */
+
+    //  Frame times in milliseconds, between presents at the deadlines
+    unsigned long frames;
+    unsigned long extra; /**< Frames drawn early for input, not in the frame times */
+    unsigned long late; /**< Frames longer than 1.5 periods */
+    double sum;
+    double sumSq;
+    double worst;
+} FramePacer;
+
+/**
+    \brief Initializes the scheduler
+    \param pacer    Pointer to the pacer
+    \param fps      Target frame rate, 0 for unlimited
+    \param vsync    True if the renderer waits for the display when presenting
+*/
+extern void InitFramePacer(FramePacer* pacer, unsigned fps, bool vsync);
+
+/**
+    \brief Records time of the frame, called right after presenting
+    \param pacer    Pointer to the pacer
+*/
+extern void MarkFramePresented(FramePacer* pacer);
+
+/**
+    \brief Sleeps until the next frame is due or input arrives
+    \param pacer    Pointer to the pacer
+    \param wake     SDL_GetTicks() time when the input must be read again, 0 if not needed
+
+    Missed deadlines aren't caught up, the next frame is a period from now.
+*/
+extern void WaitNextFrame(FramePacer* pacer, Uint32 wake);
+
+/**
+    \brief Prints frame rate, frame time and its jitter of the paced frames
+    \param pacer    Pointer to the pacer
+    \param out      Where to print
+*/
+extern void PrintFrameStats(FramePacer* pacer, FILE* out);
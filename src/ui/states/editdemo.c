@@ -0,0 +1,232 @@
+#include <ctype.h> /* tolower() */
+#include <string.h> /* strlen(), strcpy() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "states.h"
+#include "common.h"
+#include "../../core/editor.h"
+
+#define INFO_LEN 64
+#define RETIME_STEP 16 /* Milliseconds moved with '+' and '-', about one frame */
+#define JUMP_INSTRS 10 /* Instructions moved with up and down */
+
+//  Static fsm functions
+static int StateInit(UI_Functions* funs, void** data);
+static void StateCleanUp(UI_Functions* funs);
+
+static void ShowHelp(UI_Functions* funs, unsigned x, unsigned y);
+/**
+    \brief Moves the cursor and measures the re-simulation
+    \param funs Pointer to UI functions struct
+    \param instrsDone Count of instructions before the cursor
+*/
+static void Seek(UI_Functions* funs, unsigned instrsDone);
+/**
+    \brief Re-simulates the end of demo after an edit
+    \param funs Pointer to UI functions struct
+*/
+static void Resimulate(UI_Functions* funs);
+/**
+    \brief Saves edited demo next to the original
+*/
+static void SaveEdited();
+
+//  Static vars used by this state
+static bool is_running = false;
+static demo* record = NULL;
+static demo_editor* editor = NULL;
+static char* demoPath = NULL; /* Path of the demo */
+
+static unsigned insertInput = INPUT_LEFT; /* Input added with 'n' */
+static unsigned seekInstr = 0; /* Instruction number typed by user */
+
+static char infoName[INFO_LEN];
+static char infoInstr[INFO_LEN];
+static char infoNext[INFO_LEN];
+static char infoInsert[INFO_LEN];
+static char infoResult[INFO_LEN];
+static char infoResim[INFO_LEN];
+static char infoMsg[INFO_LEN];
+
+static const char* inputNames[] = {"LEFT", "RIGHT", "DOWN", "ROTATE", "SET", "UPDATE"};
+
+void* StateEditDemo(UI_Functions* funs, void** data) {
+    //  State init
+    if (!is_running) {
+        if (StateInit(funs, data) != 0) {
+            free(demoPath);
+            demoPath = NULL;
+            return NULL;
+        }
+        is_running = true;
+    }
+
+    //  Process input
+    unsigned done = editor->cursor->instrsDone;
+    unsigned icount = funs->UIGetInput(funs); // Fill input array
+    for (unsigned iii = 0; iii < icount; iii++) { // Process all inputs
+        int in = tolower(funs->inputs[iii]);
+        switch (in) {
+            case 'q': is_running = false; break;
+            case 'a': if (done > 0) Seek(funs, done-1); break;
+            case 'd': Seek(funs, done+1); break;
+            case 'w': Seek(funs, done > JUMP_INSTRS ? done-JUMP_INSTRS : 0); break;
+            case 's': Seek(funs, done+JUMP_INSTRS); break;
+            case 'g': {
+                Seek(funs, seekInstr);
+                seekInstr = 0;
+            } break;
+            case 'i': insertInput = (insertInput+1) % INPUT_UPDATE; break;
+            case 'n': {
+                if (EditorInsert(editor, editor->cursor->time, insertInput) == 0) Resimulate(funs);
+            } break;
+            case 'x': if (EditorDelete(editor) == 0) Resimulate(funs); break;
+            case '+':
+            case '=': if (EditorRetime(editor, RETIME_STEP) == 0) Resimulate(funs); break;
+            case '-': if (EditorRetime(editor, -RETIME_STEP) == 0) Resimulate(funs); break;
+            case '.': if (EditorRetime(editor, 1) == 0) Resimulate(funs); break;
+            case ',': if (EditorRetime(editor, -1) == 0) Resimulate(funs); break;
+            case 'v': SaveEdited(); break;
+            default: {
+                //  Digits select the instruction for 'g'
+                if (in >= '0' && in <= '9' && seekInstr < 100000000) {
+                    seekInstr = seekInstr*10 + (in-'0');
+                }
+            } break;
+        }
+        done = editor->cursor->instrsDone;
+    }
+
+    //  Generate info texts
+    snprintf(infoInstr, INFO_LEN, "Instruction: %u of %u", editor->cursor->instrsDone, record->instrsCount);
+    if (seekInstr > 0) snprintf(infoInstr, INFO_LEN, "Go to instruction: %u", seekInstr);
+    demo_instruction* next = EditorNext(editor);
+    if (next) {
+        snprintf(infoNext, INFO_LEN, "Next: %s at %u ms (+%u)", next->instruction <= INPUT_UPDATE ? inputNames[next->instruction] : "?",
+            next->time, next->time - editor->cursor->time);
+    } else {
+        snprintf(infoNext, INFO_LEN, "Next: end of demo");
+    }
+    snprintf(infoInsert, INFO_LEN, "Insert: %s", inputNames[insertInput]);
+
+    // Renderings
+    unsigned infox, infoy;
+    game* gme = editor->cursor->gme;
+    ShowGameInfo(funs, gme, true, &infox, &infoy);
+
+    funs->UIDemoShowPressed(funs, infox+20, infoy+15, NULL);
+    if (next && next->instruction != INPUT_UPDATE) funs->UIDemoShowPressed(funs, infox+20, infoy+15, next);
+
+    ShowHelp(funs, infox+18, infoy+1);
+
+    funs->UITextRender(funs, infox, infoy+17, color_red, infoName);
+    funs->UITextRender(funs, infox, infoy+18, color_red, infoInstr);
+    funs->UITextRender(funs, infox, infoy+19, color_red, infoNext);
+    funs->UITextRender(funs, infox, infoy+20, color_red, infoInsert);
+    funs->UITextRender(funs, infox, infoy+21, color_red, infoResult);
+    funs->UITextRender(funs, infox, infoy+22, color_red, infoResim);
+    funs->UITextRender(funs, infox, infoy+23, color_red, infoMsg);
+    funs->UIGameRender(funs, gme);
+
+    //  If quit requested
+    if (!is_running) {
+        StateCleanUp(funs);
+        return NULL;
+    }
+    return StateEditDemo;
+}
+
+int StateInit(UI_Functions* funs, void** data) {
+    if (!data) return -1;
+
+    //  Get demo path
+    state_demo_data* settings = *data;
+    demoPath = settings->path;
+    free(*data);
+    *data = NULL;
+    if (!demoPath) return -2;
+
+    record = DemoRead(demoPath);
+    editor = EditorCreate(record, MAP_WIDTH, MAP_HEIGHT+2);
+    if (!editor) {
+        fprintf(stderr, "Failed to load demo %s\n", demoPath);
+        DemoFree(record);
+        record = NULL;
+        return -3;
+    }
+
+    if (funs->UIGameInit(funs)) {
+        EditorFree(editor);
+        editor = NULL;
+        DemoFree(record);
+        record = NULL;
+        return -2;
+    }
+
+    insertInput = INPUT_LEFT;
+    seekInstr = 0;
+    infoMsg[0] = '\0';
+    snprintf(infoName, INFO_LEN, "EDIT: %s", demoPath);
+    Resimulate(funs);
+    return 0;
+}
+
+void StateCleanUp(UI_Functions* funs) {
+    EditorFree(editor);
+    editor = NULL;
+    DemoFree(record);
+    record = NULL;
+    free(demoPath);
+    demoPath = NULL;
+
+    //  Free sub windows
+    funs->UIGameCleanup(funs);
+}
+
+void Seek(UI_Functions* funs, unsigned instrsDone) {
+    unsigned start = funs->UIGetMillis();
+    EditorSeek(editor, instrsDone);
+    snprintf(infoResim, INFO_LEN, "Seek: %u instructions, %u ms", editor->resimulated, funs->UIGetMillis() - start);
+}
+
+void Resimulate(UI_Functions* funs) {
+    unsigned start = funs->UIGetMillis();
+    demo_playback* result = EditorResult(editor);
+    if (!result) {
+        snprintf(infoResult, INFO_LEN, "Result: could not be simulated");
+        return;
+    }
+
+    game_info* s = &result->gme->info;
+    snprintf(infoResult, INFO_LEN, "Result: score %u, lines %u, %s", s->score, s->rows,
+        (s->status & GAME_STATUS_END) ? "top out" : "ended");
+    snprintf(infoResim, INFO_LEN, "Re-simulated: %u instructions, %u ms", editor->resimulated, funs->UIGetMillis() - start);
+}
+
+void SaveEdited() {
+    //  Never overwrites the original, name.demo is saved as name-edit.demo
+    size_t len = strlen(demoPath);
+    if (len >= 5 && !strcmp(demoPath+len-5, ".demo")) len -= 5;
+    char* path = (char*)malloc(len + sizeof("-edit.demo"));
+    if (!path) return;
+    memcpy(path, demoPath, len);
+    strcpy(path+len, "-edit.demo");
+
+    if (DemoSave(record, path) > 0) snprintf(infoMsg, INFO_LEN, "Saved: %s", path);
+    else snprintf(infoMsg, INFO_LEN, "Could not save %s", path);
+    free(path);
+}
+
+void ShowHelp(UI_Functions* funs, unsigned x, unsigned y) {
+    funs->UITextRender(funs, x, y++, color_white, "Controls:");
+    funs->UITextRender(funs, x, y++, color_green, "LEFT, RIGHT - Previous, next instruction");
+    funs->UITextRender(funs, x, y++, color_green, "UP, DOWN    - Back, forward 10 instructions");
+    funs->UITextRender(funs, x, y++, color_green, "0-9, G      - Jump to instruction N");
+    funs->UITextRender(funs, x, y++, color_green, "I, N        - Select input, insert it");
+    funs->UITextRender(funs, x, y++, color_green, "X           - Delete next instruction");
+    funs->UITextRender(funs, x, y++, color_green, "+ -, . ,    - Retime next by 16 ms, 1 ms");
+    funs->UITextRender(funs, x, y++, color_green, "V           - Save as name-edit.demo");
+    funs->UITextRender(funs, x, y, color_green, "Q           - QUIT");
+}
@@ -7,21 +7,47 @@
 
 #include "states.h"
 #include "common.h"
+#include "ioworker.h"
+
+/**
+    \brief Demo written by the I/O worker
+*/
+typedef struct {
+    demo* record;
+    char* name;
+    bool clip;          /**< Instant replay instead of the whole game */
+    unsigned written;   /**< Bytes written, 0 on error */
+} save_job;
 
 //  Static fsm functions
 static int StateInit(UI_Functions* funs, void** data);
 static void StateCleanUp(UI_Functions* funs);
 
-static char* GenerateDemoName(UI_Functions* funs);
-static void ShowHelp(UI_Functions* funs, unsigned x, unsigned y, bool showSave);
+static char* GenerateDemoName(UI_Functions* funs, const char* suffix);
+/**
+    \brief Hands demo to the I/O worker, the latest save is shown
+    \param record Demo, freed by the job
+    \param name Path of the demo, freed by the job
+    \param clip True for instant replays
+*/
+static void StartSave(demo* record, char* name, bool clip);
+/**
+    \brief Shows the result of the latest save if it has finished
+*/
+static void FinishSave();
+static void RunSave(void* data);
+static void ReleaseSave(void* data);
+static void ShowHelp(UI_Functions* funs, unsigned x, unsigned y, bool showSave, bool showClip);
 
 //  Static vars used by this state
 static bool is_running = false;
 static game* gme = NULL;
 static bool alreadySaved = false;
+static bool endSeen = false; // Table is prefetched once the game has ended
+static io_job* saving = NULL; // Latest save, NULL if shown
 static state_game_data settings = {0}; /* Game settings, stays same until changed */
 
-static char textDemo[128] = {0}; //  Demo saved text
+static char textDemo[128] = {0}; //  Demo or clip saved text
 
 //  State code
 void* StateGame(UI_Functions* funs, void** data) {
@@ -35,47 +61,65 @@ void* StateGame(UI_Functions* funs, void** data) {
     //  Read and process user input
     unsigned icount = funs->UIGetInput(funs); // Fill input array
     for (unsigned iii = 0; iii < icount; iii++) { // Process all inputs
+        //  Moves are applied and recorded at the time they happened
+        unsigned time = funs->inputTimes[iii] ? funs->inputTimes[iii] : funs->UIGetMillis();
         switch (tolower(funs->inputs[iii])) {
-            case 'w': GameProcessInput(gme, INPUT_ROTATE); break;
-            case 'a': GameProcessInput(gme, INPUT_LEFT); break;
-            case 's': GameProcessInput(gme, INPUT_DOWN); break;
-            case 'd': GameProcessInput(gme, INPUT_RIGHT); break;
-            case ' ': GameProcessInput(gme, INPUT_SET); break;
+            case 'w': GameProcessInputAt(gme, INPUT_ROTATE, time); break;
+            case 'a': GameProcessInputAt(gme, INPUT_LEFT, time); break;
+            case 's': GameProcessInputAt(gme, INPUT_DOWN, time); break;
+            case 'd': GameProcessInputAt(gme, INPUT_RIGHT, time); break;
+            case ' ': GameProcessInputAt(gme, INPUT_SET, time); break;
             case 'q': is_running = false; break;
             case 'p': GameTogglePause(gme); break;
             case 'r': if ((gme->info.status & GAME_STATUS_END) && !alreadySaved) {
                 alreadySaved = true;
 
-                char* name = GenerateDemoName(funs);
+                //  Game has ended, the recording is written by the worker
+                char* name = GenerateDemoName(funs, ".demo");
                 if (!name) break;
-
-                snprintf(textDemo, 128, "Demo saved: %s", name);
-
-                DemoSave(gme->demorecord, name);
-                free(name);
+                StartSave(GameDetachDemo(gme), name, false);
+            } break;
+            case 'c': {
+                //  Instant replay of the last seconds, also during the game
+                demo* clip = GameReplayClip(gme);
+                char* name = clip ? GenerateDemoName(funs, "-clip.demo") : NULL;
+                if (name) {
+                    StartSave(clip, name, true);
+                } else {
+                    snprintf(textDemo, 128, "Clip could not be saved");
+                    DemoFree(clip);
+                }
             } break;
             default: break;
         }
     }
 
     //  Print msg if is demo saved
-    if (alreadySaved) funs->UITextRender(funs, 0, 0, color_red, textDemo);
+    FinishSave();
+    if (textDemo[0]) funs->UITextRender(funs, 0, 0, color_red, textDemo);
 
     GameUpdate(gme);
+    if ((gme->info.status & GAME_STATUS_END) && !endSeen) {
+        //  Table may have changed during the game
+        endSeen = true;
+        HiscoresPrefetch(funs);
+    }
 
     unsigned x, y;
     ShowGameInfo(funs, gme, true, &x, &y);
 
-    ShowHelp(funs, x+18, y+7, gme->info.status & GAME_STATUS_END);
+    ShowHelp(funs, x+18, y+7, gme->info.status & GAME_STATUS_END, gme->replay != NULL);
     funs->UIGameRender(funs, gme);
 
     //  If quit requested
     if (!is_running) {
-        *data = malloc(sizeof(hiscore_list_entry));
-        if (!*data) return NULL;
+        state_hiscore_data* result = (state_hiscore_data*)calloc(1, sizeof(state_hiscore_data));
+        if (!result) return NULL;
+        *data = result;
 
         //  Fill entry struct
-        hiscore_list_entry* e = (hiscore_list_entry*)*data;
+        result->randomiser = gme->info.randomiser;
+        hiscore_list_entry* e = &result->entry;
         e->score = gme->info.score;
         e->rows = gme->info.rows;
         e->lvl = gme->info.level;
@@ -109,7 +153,15 @@ int StateInit(UI_Functions* funs, void** data) {
         return -3;
     }
 
+    //  Instant replays are optional, the game works without them
+    if (GameEnableReplay(gme, settings.replaySeconds) != 0) {
+        fprintf(stderr, "CORE: Couldn't allocate instant replay\n");
+    }
+
     alreadySaved = false;
+    endSeen = false;
+    textDemo[0] = '\0';
+    HiscoresPrefetch(funs);
     return 0;
 }
 
@@ -120,11 +172,15 @@ void StateCleanUp(UI_Functions* funs) {
     GameFree(gme);
     gme = NULL;
 
+    //  Unfinished save is completed by the worker
+    IoRelease(saving);
+    saving = NULL;
+
     //  Free sub windows
     funs->UIGameCleanup(funs);
 }
 
-char* GenerateDemoName(UI_Functions* funs) {
+char* GenerateDemoName(UI_Functions* funs, const char* suffix) {
     static const unsigned strLen = 64;
     char* ret = (char*)calloc(strLen, sizeof(char));
     if (ret) {
@@ -141,18 +197,74 @@ char* GenerateDemoName(UI_Functions* funs) {
         }
         time_t t = time(NULL);
         struct tm* tmp = localtime(&t);
-        strftime(ret+len, strLen+30, "%Y%m%d-%H%M%S.demo", tmp);
+        len += strftime(ret+len, strLen+30, "%Y%m%d-%H%M%S", tmp);
+        strcpy(ret+len, suffix);
     }
     return ret;
 }
 
-void ShowHelp(UI_Functions* funs, unsigned x, unsigned y, bool showSave) {
+void StartSave(demo* record, char* name, bool clip) {
+    save_job* s = (save_job*)calloc(1, sizeof(save_job));
+    io_job* job = NULL;
+    if (s) {
+        s->record = record;
+        s->name = name;
+        s->clip = clip;
+        job = IoSubmit(RunSave, ReleaseSave, s);
+        if (!job) ReleaseSave(s);
+    } else {
+        DemoFree(record);
+        free(name);
+    }
+    if (!job) {
+        snprintf(textDemo, 128, "%s could not be saved", clip ? "Clip" : "Demo");
+        return;
+    }
+
+    snprintf(textDemo, 128, "Saving %s: %s", clip ? "clip" : "demo", name);
+    IoRelease(saving);
+    saving = job;
+}
+
+void FinishSave() {
+    if (!saving || !IoDone(saving)) return;
+
+    save_job* s = (save_job*)saving->data;
+    if (s->written > 0) snprintf(textDemo, 128, "%s saved: %s", s->clip ? "Clip" : "Demo", s->name);
+    else snprintf(textDemo, 128, "%s could not be saved", s->clip ? "Clip" : "Demo");
+    IoRelease(saving);
+    saving = NULL;
+}
+
+/**
+    \brief Writes the demo, runs in the I/O worker
+    \param data Pointer to save_job
+*/
+void RunSave(void* data) {
+    save_job* s = (save_job*)data;
+    s->written = DemoSave(s->record, s->name);
+}
+
+/**
+    \brief Frees save_job with its demo
+    \param data Pointer to save_job
+*/
+void ReleaseSave(void* data) {
+    save_job* s = (save_job*)data;
+    DemoFree(s->record);
+    free(s->name);
+    free(s);
+}
+
+void ShowHelp(UI_Functions* funs, unsigned x, unsigned y, bool showSave, bool showClip) {
     funs->UITextRender(funs, x, y++, color_white, "Controls:");
     funs->UITextRender(funs, x, y++, color_green, "LEFT, RIGHT, DOWN - Move tetromino");
     funs->UITextRender(funs, x, y++, color_green, "UP                - Rotate");
     funs->UITextRender(funs, x, y++, color_green, "SPACE             - Set tetromino");
     funs->UITextRender(funs, x, y++, color_green, "P                 - Pause");
     funs->UITextRender(funs, x, y++, color_green, "Q                 - QUIT");
+    if (showClip)
+        funs->UITextRender(funs, x, y++, color_green, "C                 - Save instant replay");
 
     if (showSave)
         funs->UITextRender(funs, x, y, color_red, "R                 - Save demo");
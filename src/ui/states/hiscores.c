@@ -6,18 +6,77 @@
 #include <stdbool.h>
 
 #include "states.h"
+#include "ioworker.h"
+#include "../../core/scores.h"
+#include "../os/os.h"
+
+#define REFRESH_MS 500 /* How often the table is checked for changes by other instances */
+
+/**
+    \brief Reading and writing of scores done by the I/O worker
+*/
+typedef struct {
+    char dir[256];              /**< Directory of the executable */
+    state_hiscore_data* result; /**< Finished game posted to its leaderboard, NULL if none */
+    bool merge;                 /**< Result is added to the table too */
+    bool force;                 /**< Table is read even if the file hasn't changed */
+    unsigned long long stamp;   /**< Stamp of the table the state has, then of the read table */
+    bool loaded;                /**< Table was read */
+    hiscore_list_entry table[HISCORE_LENGTH];
+    char textBoard[128];        /**< Result of posting, empty if nothing was posted */
+    scores_request req;
+    scores_response resp;
+} score_job;
 
 static int StateInit(UI_Functions* funs, void** data);
 static void CleanUp();
 
 static void DrawHiscores(UI_Functions* funs, hiscore_list_entry* list, unsigned len);
 static void ShowHelp(UI_Functions* funs, unsigned x, unsigned y);
+/**
+    \brief Ranks the entry waiting for a name, games off the table are only posted
+*/
+static void UpdateRank();
+/**
+    \brief Starts a score job if none is running, finished game is handed to it
+    \param funs Pointer to UI functions struct
+    \param force Read the table even if it hasn't changed
+    \return 0 on success, -1 if a job is running or on error
+*/
+static int StartJob(UI_Functions* funs, bool force);
+/**
+    \brief Takes the results of the score job if it has finished
+    \return True if a job finished
+*/
+static bool FinishJob();
+/**
+    \brief Merges and posts the result and reads the table, runs in the I/O worker
+    \param data Pointer to score_job
+*/
+static void RunJob(void* data);
+/**
+    \brief Frees score_job
+    \param data Pointer to score_job
+*/
+static void ReleaseJob(void* data);
+/**
+    \brief Sends request to the score daemon, or executes it in this process if none is running
+    \param j Pointer to the job, its req is sent and resp received
+    \return 0 if the response was received
+*/
+static int Exchange(score_job* j);
 
 static bool is_running = false;
 static hiscore_list_entry scoreTable[HISCORE_LENGTH] = {0};
-static hiscore_list_entry* entry = NULL;
+static bool tableReady = false; // Table has been read at least once
+static state_hiscore_data* result = NULL; // Finished game not handed to a job yet
+static hiscore_list_entry* entry = NULL; // Entry of the result waiting for a name
+static bool merge = false; // Result is added to the table
 static unsigned rank = HISCORE_LENGTH;
-static char path_hiscore[256] = {0};
+static char textBoard[128] = {0};
+static io_job* job = NULL; // Score job in the worker, NULL if none
+static unsigned long long stamp = 0; // Stamp of the file when it was read
+static unsigned lastCheck = 0;
 
 void* StateHiscores(UI_Functions* funs, void** data) {
     if (!is_running) {
@@ -28,15 +87,22 @@ void* StateHiscores(UI_Functions* funs, void** data) {
     void* (*nextState)(UI_Functions*, void**);
     nextState = StateHiscores;
 
+    //  Results of the worker, the next job starts when it's idle
+    if (FinishJob()) {
+        UpdateRank();
+        DrawHiscores(funs, scoreTable, HISCORE_LENGTH);
+    }
+    if (!job && ((result && !entry) || funs->UIGetMillis() - lastCheck >= REFRESH_MS)) StartJob(funs, false);
+
     unsigned icount = 0;
-    if (entry != NULL) {
+    if (entry != NULL && tableReady) {
         DrawHiscores(funs, scoreTable, HISCORE_LENGTH);
         icount = funs->UIHiscoreGetName(funs, entry, 15, rank+1);
         if (icount > 0 && funs->inputs[0] == event_ready) {
-            AddScoreToList(scoreTable, HISCORE_LENGTH, entry);
-            SaveHiScores(path_hiscore, scoreTable, HISCORE_LENGTH);
-            free(entry);
+            //  Table is shown with the entry when the job has written it
             entry = NULL;
+            merge = true;
+            StartJob(funs, false);
             DrawHiscores(funs, scoreTable, HISCORE_LENGTH);
         }
     } else {
@@ -59,40 +125,60 @@ void* StateHiscores(UI_Functions* funs, void** data) {
         }
     }
 
-    if (!is_running) CleanUp();
+    if (!is_running) {
+        //  Score is posted without a name if the name wasn't given, the worker finishes it
+        if (result) {
+            if (entry) merge = false;
+            entry = NULL;
+            IoRelease(job);
+            job = NULL;
+            StartJob(funs, false);
+        }
+        CleanUp();
+    }
     return nextState;
 }
 
+void HiscoresPrefetch(UI_Functions* funs) {
+    FinishJob();
+    if (!job) StartJob(funs, !tableReady);
+}
+
 int StateInit(UI_Functions* funs, void** data) {
     if (!data || !funs) return -1;
 
-    //  Read high scores
-    int len = funs->UIGetExePath(funs, path_hiscore, 256);
-    if (len < 0) return -2;
-    strncpy(path_hiscore+len, HISCORE_FILE, 256-len);
-    ReadHiScores(path_hiscore, scoreTable, HISCORE_LENGTH);
-
-    entry = (hiscore_list_entry*)*data;
+    result = (state_hiscore_data*)*data;
+    *data = NULL;
+    entry = NULL;
+    merge = false;
     rank = HISCORE_LENGTH;
-    if (entry != NULL) {
-        if(entry->score > 0) {
-            rank = GetRanking(scoreTable, HISCORE_LENGTH, entry);
-        }
-        if (rank < HISCORE_LENGTH) {
-            // Set date for entry
-            entry->date = (unsigned)time(NULL);
-        } else {
-            free(entry);
+    textBoard[0] = '\0';
+    if (result != NULL) {
+        // Set date for entry
+        entry = &result->entry;
+        entry->date = (unsigned)time(NULL);
+        if (entry->score == 0) {
+            //  Empty games aren't posted
+            free(result);
+            result = NULL;
             entry = NULL;
         }
-        *data = NULL;
     }
+
+    //  Table was prefetched during the game, it's checked again
+    FinishJob();
+    UpdateRank();
+    if (!job) StartJob(funs, !tableReady);
     DrawHiscores(funs, scoreTable, HISCORE_LENGTH);
     return 0;
 }
 
 void CleanUp() {
     is_running = false;
+    IoRelease(job);
+    job = NULL;
+    free(result);
+    result = NULL;
 }
 
 void DrawHiscores(UI_Functions* funs, hiscore_list_entry* list, unsigned len) {
@@ -135,6 +221,141 @@ void DrawHiscores(UI_Functions* funs, hiscore_list_entry* list, unsigned len) {
         funs->UITextRender(funs, topx+41, topy, color_magenta, temp);
         funs->UITextRender(funs, topx+50, topy, color_yellow, ctime(&date));
     }
+
+    if (textBoard[0]) funs->UITextRender(funs, topx, topy+1, color_default, textBoard);
+}
+
+void UpdateRank() {
+    if (!entry || !tableReady) return;
+
+    rank = GetRanking(scoreTable, HISCORE_LENGTH, entry);
+    if (rank >= HISCORE_LENGTH) {
+        entry = NULL;
+        merge = false;
+    }
+}
+
+int StartJob(UI_Functions* funs, bool force) {
+    if (job) return -1;
+
+    score_job* j = (score_job*)calloc(1, sizeof(score_job));
+    if (!j) return -1;
+    if (funs->UIGetExePath(funs, j->dir, 256) < 0) {
+        free(j);
+        return -1;
+    }
+    j->force = force;
+    j->stamp = stamp;
+    if (result && !entry) {
+        j->result = result;
+        j->merge = merge;
+    }
+
+    job = IoSubmit(RunJob, ReleaseJob, j);
+    if (!job) {
+        free(j);
+        return -1;
+    }
+    if (j->result) result = NULL;
+    lastCheck = funs->UIGetMillis();
+    return 0;
+}
+
+bool FinishJob() {
+    if (!job || !IoDone(job)) return false;
+
+    score_job* j = (score_job*)job->data;
+    if (j->loaded) {
+        memcpy(scoreTable, j->table, sizeof(scoreTable));
+        tableReady = true;
+        stamp = j->stamp;
+    }
+    if (j->textBoard[0]) strcpy(textBoard, j->textBoard);
+    IoRelease(job);
+    job = NULL;
+    return true;
+}
+
+void RunJob(void* data) {
+    score_job* j = (score_job*)data;
+    scores_request* req = &j->req;
+    scores_response* resp = &j->resp;
+
+    if (j->result && j->merge) {
+        //  Store inserts to the latest table, others can't write it meanwhile
+        memset(req, 0, sizeof(*req));
+        req->op = scores_op_insert;
+        req->kind = scores_table;
+        strcpy(req->name, HISCORE_FILE);
+        req->count = 1;
+        req->entries[0] = j->result->entry;
+        Exchange(j);
+    }
+
+    if (j->result) {
+        const randomiser_desc* desc = RandomiserGet(j->result->randomiser);
+        memset(req, 0, sizeof(*req));
+        req->op = scores_op_insert;
+        req->kind = scores_board;
+        if (desc) snprintf(req->name, SCORES_NAME_MAX, "%s%s", LEADERBOARD_FILE, desc->name);
+        req->count = 1;
+        req->entries[0] = j->result->entry;
+
+        if (desc && Exchange(j) == 0 && resp->status == scores_ok && resp->count == 1) {
+            snprintf(j->textBoard, 128, "Leaderboard %s: ranking %u of %u", desc->name, resp->ranks[0]+1, resp->total);
+        } else {
+            snprintf(j->textBoard, 128, "Score could not be posted to the leaderboard");
+        }
+    }
+
+    //  File is replaced atomically by whoever saves it
+    char path[256+sizeof(HISCORE_FILE)];
+    snprintf(path, sizeof(path), "%s%s", j->dir, HISCORE_FILE);
+    unsigned long long current = FileStamp(path);
+    if (!j->force && !j->merge && current == j->stamp) return;
+
+    memset(req, 0, sizeof(*req));
+    req->op = scores_op_top;
+    req->kind = scores_table;
+    strcpy(req->name, HISCORE_FILE);
+    req->count = HISCORE_LENGTH;
+    if (Exchange(j) == 0 && resp->status == scores_ok) {
+        for (unsigned i=0; i < resp->count && i < HISCORE_LENGTH; i++) j->table[i] = resp->entries[i];
+    } else if (!j->force) {
+        return;
+    }
+    //  Unreadable table is shown empty, like a missing file
+    j->loaded = true;
+    j->stamp = current;
+}
+
+void ReleaseJob(void* data) {
+    score_job* j = (score_job*)data;
+    free(j->result);
+    free(j);
+}
+
+int Exchange(score_job* j) {
+    unsigned char msg[SCORES_MSG_MAX];
+    unsigned len = ScoresPackRequest(&j->req, msg);
+    if (len == 0) return -1;
+
+    char path[256+sizeof(SCORES_SOCKET)];
+    snprintf(path, sizeof(path), "%s%s", j->dir, SCORES_SOCKET);
+    int sock = ConnectSocket(path);
+    if (sock >= 0) {
+        //  Request may have been executed, so it isn't retried locally
+        int n = SendFrame(sock, msg, len) == 0 ? ReceiveFrame(sock, msg, SCORES_MSG_MAX) : -1;
+        CloseSocket(sock);
+        return n >= 0 ? ScoresUnpackResponse(msg, (unsigned)n, j->req.op, &j->resp) : -1;
+    }
+
+    //  No daemon, files are locked and changed by this process
+    scores_store* store = ScoresOpen(j->dir, LockFile, UnlockFile);
+    if (!store) return -1;
+    ScoresExecute(store, &j->req, &j->resp);
+    ScoresClose(store);
+    return 0;
 }
 
 void ShowHelp(UI_Functions* funs, unsigned x, unsigned y) {
@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "ioworker.h"
+
+static void* Worker(void* data);
+static void FreeJob(io_job* job);
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER; // Signaled when a job is queued or the worker should stop
+static pthread_t thread;
+static bool started = false;
+static bool quit = false;
+static io_job* first = NULL; // Queue of jobs not run yet
+static io_job* last = NULL;
+
+io_job* IoSubmit(void (*run)(void*), void (*release)(void*), void* data) {
+    if (!run) return NULL;
+
+    io_job* job = (io_job*)calloc(1, sizeof(io_job));
+    if (!job) return NULL;
+    job->run = run;
+    job->release = release;
+    job->data = data;
+
+    pthread_mutex_lock(&lock);
+    if (!started && !quit) started = pthread_create(&thread, NULL, Worker, NULL) == 0;
+    if (!started) {
+        //  No worker, the caller waits instead
+        pthread_mutex_unlock(&lock);
+        run(data);
+        job->done = true;
+        return job;
+    }
+
+    if (last) last->next = job;
+    else first = job;
+    last = job;
+    pthread_cond_signal(&cond);
+    pthread_mutex_unlock(&lock);
+    return job;
+}
+
+bool IoDone(io_job* job) {
+    if (!job) return true;
+
+    pthread_mutex_lock(&lock);
+    bool ret = job->done;
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+void IoRelease(io_job* job) {
+    if (!job) return;
+
+    pthread_mutex_lock(&lock);
+    bool done = job->done;
+    job->detached = !done;
+    pthread_mutex_unlock(&lock);
+    if (done) FreeJob(job);
+}
+
+void IoShutdown(void) {
+    pthread_mutex_lock(&lock);
+    quit = true;
+    pthread_cond_signal(&cond);
+    bool wasStarted = started;
+    started = false;
+    pthread_mutex_unlock(&lock);
+    if (wasStarted) pthread_join(thread, NULL);
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Thread function, runs queued jobs until the queue is empty and quit is set
+    \param data Unused
+*/
+void* Worker(void* data) {
+    (void)data;
+
+    pthread_mutex_lock(&lock);
+    while (first || !quit) {
+        if (!first) {
+            pthread_cond_wait(&cond, &lock);
+            continue;
+        }
+
+        io_job* job = first;
+        first = job->next;
+        if (!first) last = NULL;
+
+        //  Run without the lock, states can poll meanwhile
+        pthread_mutex_unlock(&lock);
+        job->run(job->data);
+        pthread_mutex_lock(&lock);
+
+        job->done = true;
+        if (job->detached) {
+            pthread_mutex_unlock(&lock);
+            FreeJob(job);
+            pthread_mutex_lock(&lock);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/**
+    \brief Frees the job and its data
+    \param job Handle of the job
+*/
+void FreeJob(io_job* job) {
+    if (job->release) job->release(job->data);
+    free(job);
+}
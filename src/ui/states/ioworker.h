@@ -0,0 +1,57 @@
+#ifndef _IOWORKER_H_
+#define _IOWORKER_H_
+
+#include <stdbool.h>
+
+/**
+    \brief File operation run by the background I/O worker
+
+    States submit jobs and poll them once per frame, so reading and
+    writing files never stalls rendering. Jobs run one at a time in the
+    order they were submitted.
+*/
+typedef struct io_job {
+    void (*run)(void* data);     /**< Runs in the worker thread */
+    void (*release)(void* data); /**< Frees data, NULL if nothing to free */
+    void* data;
+    bool done;          /**< Set when run has returned */
+    bool detached;      /**< Freed by the worker when done */
+    struct io_job* next;
+} io_job;
+
+/**
+    \brief Queues a job, the worker is started by the first one
+    \param run Function which does the work, data can't be touched by the caller until it's done
+    \param release Function which frees data, NULL if not needed
+    \param data Data of the job
+    \return Handle of the job, NULL on allocation error
+
+    If the worker can't be started the job is run before returning.
+    \note Use IoRelease() to free the handle
+*/
+extern io_job* IoSubmit(void (*run)(void*), void (*release)(void*), void* data);
+
+/**
+    \brief Checks if the job has finished without waiting
+    \param job Handle of the job
+    \return True if done, its data can be read
+*/
+extern bool IoDone(io_job* job);
+
+/**
+    \brief Frees the job and its data
+
+    Unfinished job is still run, it's freed by the worker afterwards.
+    \param job Handle of the job, can be NULL
+*/
+extern void IoRelease(io_job* job);
+
+/**
+    \brief Runs the queued jobs to the end and stops the worker
+
+    Called before exit, so scores and demos are written even if the state
+    which submitted them has ended.
+*/
+extern void IoShutdown(void);
+
+#endif //_IOWORKER_H_
@@ -6,8 +6,16 @@
 
 #include "states.h"
 #include "common.h"
+#include "../../core/playback.h"
+#include "../os/os.h"
+#include "playlist.h"
 
 #define INFO_LEN 64
+#define TURBO_FRAME_MS 15 /* Time used to simulate per frame in turbo mode */
+#define TURBO_BATCH 256 /* Instructions processed between clock checks */
+#define STREAM_CHUNK 4096 /* Bytes read from the demo at once */
+#define STREAM_FRAME_MAX 64 /* Chunks read per frame at most */
+#define ATTRACT_HOLD_MS 3000 /* Time the end of a demo is shown in attract mode */
 
 //  Static fsm functions
 static int StateInit(UI_Functions* funs, void** data);
@@ -15,27 +23,56 @@ static void StateCleanUp(UI_Functions* funs);
 
 static void ShowHelp(UI_Functions* funs, unsigned x, unsigned y);
 /**
-    \brief Wrapper function to return demo time
+    \brief Simulates as many instructions as fit in one frame
+    \param funs Pointer to UI functions struct
 */
-static unsigned GetDemoTime();
+static void RunTurbo(UI_Functions* funs);
+/**
+    \brief Synchronizes playback clock after a seek
+    \param funs Pointer to UI functions struct
+*/
+static void SeekDone(UI_Functions* funs);
+/**
+    \brief Decodes demo data available in the stream
+    \param funs Pointer to UI functions struct
+    \return 0 on success, negative if playback couldn't be started
+*/
+static int PollStream(UI_Functions* funs);
+/**
+    \brief Check if more instructions can still arrive
+*/
+static bool StreamOpen();
+/**
+    \brief Switches to the demo loaded by the playlist
+    \param funs Pointer to UI functions struct
+    \return 0 on success, negative if none of the demos can be played
+*/
+static int PlayNext(UI_Functions* funs);
 
 //  Static vars used by this state
 static bool is_running = false;
-static game* gme = NULL;
-static demo* record = NULL;
-static unsigned start = 0; /* Time of the demo playback start, in ms */
+static demo_playback* playback = NULL; /* NULL until the header is decoded */
+static demo* record = NULL; /* Owned by the stream, or by this state in attract mode */
+static demo_stream* stream = NULL; /* NULL in attract mode */
+static demo_playlist* playlist = NULL; /* Demos looped in attract mode */
+static bool ended = false; /* Current demo of the playlist has ended */
+static unsigned timeEnded = 0; /* When it ended */
+static int streamHandle = -1;
+static bool streamClosed = false; /* Stream closed before the demo was complete */
 static char* demoPath = NULL; /* Path of the demo */
-static unsigned countInstruction = 0; /* Instruction count shown */
-static demo_list* demoPosition = NULL; /* Pointer to the current demo instruction */
 
 static unsigned timeLast = 0;
 static float timeDemo = 0;
 static float timeScale = 1; /* Used in fast forwarding */
+static bool turbo = false; /* Simulate as fast as possible, render once per frame */
+static unsigned seekPiece = 0; /* Piece number typed by user */
 
 static bool showKeys = true;
+static bool exitAtEnd = false;
 static char infoName[INFO_LEN];
 static char infoInstr[INFO_LEN];
 static char infoTScal[INFO_LEN]; // time scale
+static char infoSeek[INFO_LEN];
 
 void* StatePlayDemo(UI_Functions* funs, void** data) {
     //  State init
@@ -50,7 +87,8 @@ void* StatePlayDemo(UI_Functions* funs, void** data) {
     //  Process input
     unsigned icount = funs->UIGetInput(funs); // Fill input array
     for (unsigned iii = 0; iii < icount; iii++) { // Process all inputs
-        switch (tolower(funs->inputs[iii])) {
+        int in = tolower(funs->inputs[iii]);
+        switch (in) {
             case 'q': is_running = false; break;
             case 'a': {
                 timeScale -= 0.1f;
@@ -64,63 +102,117 @@ void* StatePlayDemo(UI_Functions* funs, void** data) {
                 timeScale = 0;
                 snprintf(infoTScal, INFO_LEN, "Time scale: PAUSED");
             } break;
-            default: break;
+            case 't': {
+                turbo = !turbo;
+                if (turbo) snprintf(infoTScal, INFO_LEN, "Time scale: TURBO");
+                else snprintf(infoTScal, INFO_LEN, "Time scale: %.2f", timeScale);
+            } break;
+            case 'e': {
+                if (!playback) break;
+                PlaybackSeekEnd(playback);
+                SeekDone(funs);
+            } break;
+            case 'o': {
+                if (!playback) break;
+                PlaybackSeekGameOver(playback);
+                SeekDone(funs);
+            } break;
+            case 'g': {
+                if (!playback) break;
+                PlaybackSeekPiece(playback, seekPiece > 0 ? seekPiece : 1);
+                seekPiece = 0;
+                SeekDone(funs);
+            } break;
+            default: {
+                //  Digits select the piece for 'g'
+                if (in >= '0' && in <= '9' && seekPiece < 100000000) {
+                    seekPiece = seekPiece*10 + (in-'0');
+                }
+            } break;
         }
     }
     if (timeScale < 0) {
         timeScale = 0;
         snprintf(infoTScal, INFO_LEN, "Time scale: PAUSED");
     }
+    if (seekPiece > 0) snprintf(infoSeek, INFO_LEN, "Go to piece: %u", seekPiece);
+    else infoSeek[0] = '\0';
 
     static unsigned infox = 0, infoy = 0;
 
-    demo_instruction* inst = NULL;
+    //  Decode data which has arrived, playback starts after the header
+    if (PollStream(funs) != 0) is_running = false;
+    if (!playback) {
+        funs->UITextRender(funs, 1, 1, color_red, infoName);
+        snprintf(infoInstr, INFO_LEN, "%s", stream->status == DEMO_STREAM_ERROR ? stream->error : "Waiting for demo data...");
+        funs->UITextRender(funs, 1, 2, color_red, infoInstr);
+        if (!StreamOpen() && exitAtEnd) is_running = false;
+        if (!is_running) {
+            StateCleanUp(funs);
+            return NULL;
+        }
+        return StatePlayDemo;
+    }
+
     //  If demo hasn't ended
-    if (demoPosition) {
-        unsigned timeDelta = funs->UIGetMillis() - timeLast;  //  Calculate playback time
-        timeLast = funs->UIGetMillis();
-        timeDemo += timeScale*timeDelta;
-
-        inst = (demo_instruction*)demoPosition->value; // Get current instruction
-
-        //  Process instructions until we have to wait for the next one
-        while (inst->time < timeDemo) {
-            //  Send instruction to game instance
-            if (inst->instruction == INPUT_UPDATE) {
-                // Force game update
-                gme->nextUpdate = 0;
-                GameUpdate(gme);
-            } else {
-                if (showKeys) funs->UIDemoShowPressed(funs, infox+20, infoy+12, inst);
-                GameProcessInput(gme, (player_input)inst->instruction);
+    if (!PlaybackEnded(playback)) {
+        if (turbo) {
+            RunTurbo(funs);
+        } else {
+            unsigned timeDelta = funs->UIGetMillis() - timeLast;  //  Calculate playback time
+            timeLast = funs->UIGetMillis();
+            timeDemo += timeScale*timeDelta;
+
+            //  Process instructions until we have to wait for the next one
+            demo_instruction* inst = PlaybackPeek(playback);
+            while (inst && inst->time < timeDemo) {
+                PlaybackStep(playback);
+                if (showKeys && inst->instruction != INPUT_UPDATE) {
+                    funs->UIDemoShowPressed(funs, infox+20, infoy+13, inst);
+                }
+                inst = PlaybackPeek(playback);
             }
-
-            //  Proceed to next instruction
-            demoPosition = demoPosition->next;
-            countInstruction++;
-            if (!demoPosition) break; // end of demo
-
-            inst = (demo_instruction*)demoPosition->value;
+            PlaybackAdvance(playback, timeDemo); // Gravity between instructions
         }
+    }
 
-        //  Generate info texts
-        int len = snprintf(infoInstr, INFO_LEN, "Instruction: %u of %u", countInstruction, record->instrsCount);
-        if (countInstruction >= record->instrsCount && len < INFO_LEN) {
-            snprintf(infoInstr+len, INFO_LEN-len, " - DEMO ENDED");
-        }
+    //  Generate info texts
+    int len = snprintf(infoInstr, INFO_LEN, "Instruction: %u of %u", playback->instrsDone, record->instrsCount);
+    if (stream && stream->status == DEMO_STREAM_ERROR && len < INFO_LEN) {
+        snprintf(infoInstr+len, INFO_LEN-len, " - %s", stream->error);
+    } else if (streamClosed && len < INFO_LEN) {
+        snprintf(infoInstr+len, INFO_LEN-len, " - STREAM CLOSED");
+    } else if (PlaybackEnded(playback) && len < INFO_LEN) {
+        snprintf(infoInstr+len, INFO_LEN-len, StreamOpen() ? " - WAITING" : " - DEMO ENDED");
+    } else if (playlist && len < INFO_LEN) {
+        snprintf(infoInstr+len, INFO_LEN-len, " - ATTRACT MODE");
     }
 
     // Renderings
-    ShowGameInfo(funs, gme, true, &infox, &infoy);
+    ShowGameInfo(funs, playback->gme, true, &infox, &infoy);
 
-    if (showKeys) funs->UIDemoShowPressed(funs, infox+20, infoy+12, NULL); // Render empty grid if nothing happens
+    if (showKeys) funs->UIDemoShowPressed(funs, infox+20, infoy+13, NULL); // Render empty grid if nothing happens
 
     ShowHelp(funs, infox+18, infoy+7);
 
     funs->UITextRender(funs, infox, infoy+17, color_red, infoName);
     funs->UITextRender(funs, infox, infoy+18, color_red, infoInstr);
     funs->UITextRender(funs, infox, infoy+19, color_red, infoTScal);
-    funs->UIGameRender(funs, gme);
+    funs->UITextRender(funs, infox, infoy+20, color_red, infoSeek);
+    funs->UIGameRender(funs, playback->gme);
+
+    //  Final frame is rendered, quit if requested
+    if (playlist) {
+        //  Attract mode shows the end for a moment and continues with the next demo
+        if (!PlaybackEnded(playback)) {
+            ended = false;
+        } else if (!ended) {
+            ended = true;
+            timeEnded = funs->UIGetMillis();
+        } else if (funs->UIGetMillis() - timeEnded >= ATTRACT_HOLD_MS && PlayNext(funs) != 0) {
+            is_running = false;
+        }
+    } else if (exitAtEnd && PlaybackEnded(playback) && !StreamOpen()) is_running = false;
 
     //  If quit requested
     if (!is_running) {
@@ -139,36 +231,71 @@ int StateInit(UI_Functions* funs, void** data) {
     if (!demoPath) return -2;
 
     showKeys = settings->showKeys;
+    exitAtEnd = settings->exitAtEnd;
+    streamHandle = settings->stream; //  Opened by MainProgram
+    bool attract = settings->attract;
     free(*data);
     *data = NULL;
 
     if (funs->UIGameInit(funs)) {
+        CloseStream(streamHandle);
+        streamHandle = -1;
         return -2;
     }
 
-    //  Load demo file
-    record = DemoRead(demoPath);
-    if (!record) {
+    timeScale = 1;
+    turbo = false;
+    seekPiece = 0;
+    snprintf(infoTScal, INFO_LEN, "Time scale: %.2f", timeScale);
+
+    //  Attract mode loops demos of a playlist, the next one is loaded while playing
+    if (attract) {
+        stream = NULL;
+        playback = NULL;
+        record = NULL;
+        playlist = PlaylistOpen(demoPath);
+        if (!playlist || PlayNext(funs) != 0) {
+            fprintf(stderr, "No playable demos in %s\n", demoPath);
+            PlaylistFree(playlist);
+            playlist = NULL;
+            funs->UIGameCleanup(funs);
+            return -3;
+        }
+        return 0;
+    }
+
+    //  Demo is decoded while it is read
+    streamClosed = false;
+    stream = DemoStreamCreate();
+    if (streamHandle < 0 || !stream) {
         fprintf(stderr, "Failed to load demo %s\n", demoPath);
+        CloseStream(streamHandle);
+        streamHandle = -1;
+        DemoStreamFree(stream);
+        stream = NULL;
         return -3;
     }
+    record = stream->record;
+    playback = NULL;
 
-    //  Init demo game
-    gme = GameInitDemo(MAP_WIDTH, MAP_HEIGHT+2, GetDemoTime, record);
-
-    demoPosition = record->instrsFirst; //  Set demo position to begining
-    timeLast = start = funs->UIGetMillis(); //  Set starting time of playback
-    countInstruction = 0;
-    timeScale = 1;
+    timeLast = funs->UIGetMillis(); //  Set starting time of playback
+    timeDemo = 0;
     snprintf(infoName, INFO_LEN, "DEMO: %s", demoPath);
-    snprintf(infoTScal, INFO_LEN, "Time scale: %.2f", timeScale);
 
     return 0;
 }
 
 void StateCleanUp(UI_Functions* funs) {
-    GameFree(gme);
-    gme = NULL;
+    PlaybackFree(playback);
+    playback = NULL;
+    if (playlist) DemoFree(record);
+    PlaylistFree(playlist);
+    playlist = NULL;
+    DemoStreamFree(stream); // Frees the record
+    stream = NULL;
+    record = NULL;
+    CloseStream(streamHandle);
+    streamHandle = -1;
     free(demoPath);
     demoPath = NULL;
 
@@ -176,13 +303,85 @@ void StateCleanUp(UI_Functions* funs) {
     funs->UIGameCleanup(funs);
 }
 
-unsigned GetDemoTime() {
-    return timeDemo;
+void RunTurbo(UI_Functions* funs) {
+    unsigned frameEnd = funs->UIGetMillis() + TURBO_FRAME_MS;
+
+    //  Check the clock only between batches, it costs more than an instruction
+    do {
+        for (unsigned i=0; i < TURBO_BATCH; i++) {
+            if (!PlaybackStep(playback)) break;
+        }
+    } while (!PlaybackEnded(playback) && frameEnd - funs->UIGetMillis() <= TURBO_FRAME_MS);
+
+    timeDemo = playback->time;
+    timeLast = funs->UIGetMillis();
+}
+
+void SeekDone(UI_Functions* funs) {
+    //  Continue from the position of the last processed instruction
+    timeDemo = playback->time;
+    timeLast = funs->UIGetMillis();
 }
 
 void ShowHelp(UI_Functions* funs, unsigned x, unsigned y) {
     funs->UITextRender(funs, x, y++, color_white, "Controls:");
     funs->UITextRender(funs, x, y++, color_green, "LEFT, RIGHT - Change time scale");
-    funs->UITextRender(funs, x, y++, color_green, "P           - Set time scale to 0");
+    funs->UITextRender(funs, x, y++, color_green, "P, T        - Pause, toggle turbo");
+    funs->UITextRender(funs, x, y++, color_green, "E, O        - Jump to end, game over");
+    funs->UITextRender(funs, x, y++, color_green, "0-9, G      - Jump to piece N");
     funs->UITextRender(funs, x, y, color_green, "Q           - QUIT");
 }
+
+int PollStream(UI_Functions* funs) {
+    if (!stream) return 0; //  Attract mode has whole demos
+
+    unsigned char chunk[STREAM_CHUNK];
+
+    //  Read what is available, limited so that rendering isn't starved
+    for (unsigned i=0; i < STREAM_FRAME_MAX && StreamOpen(); i++) {
+        int len = ReadStream(streamHandle, chunk, STREAM_CHUNK);
+        if (len < 0) streamClosed = true;
+        if (len <= 0) break;
+        DemoStreamFeed(stream, chunk, len);
+    }
+
+    //  Start playback when the header and pieces are decoded, clips need their starting state
+    int ready = (stream->flags & DEMO_FLAG_CLIP) ? DEMO_STREAM_DONE : DEMO_STREAM_INSTRUCTIONS;
+    if (!playback && stream->status >= ready) {
+        playback = PlaybackCreate(record, MAP_WIDTH, MAP_HEIGHT+2);
+        if (!playback) {
+            fprintf(stderr, "Failed to start playback of %s\n", demoPath);
+            return -4;
+        }
+        SeekDone(funs); //  Set starting time of playback
+    }
+    return 0;
+}
+
+bool StreamOpen() {
+    return stream && !streamClosed && (stream->status == DEMO_STREAM_HEADER || stream->status == DEMO_STREAM_INSTRUCTIONS);
+}
+
+int PlayNext(UI_Functions* funs) {
+    PlaybackFree(playback);
+    playback = NULL;
+    DemoFree(record);
+    record = NULL;
+
+    //  Demo is ready unless the list is played faster than it loads
+    for (unsigned tries = 0; tries < playlist->count; tries++) {
+        const char* path = PlaylistNext(playlist, &record);
+        if (!path) return -3;
+
+        playback = PlaybackCreate(record, MAP_WIDTH, MAP_HEIGHT+2);
+        if (playback) {
+            snprintf(infoName, INFO_LEN, "DEMO: %s", path);
+            ended = false;
+            SeekDone(funs); //  Set starting time of playback
+            return 0;
+        }
+        DemoFree(record);
+        record = NULL;
+    }
+    return -4;
+}
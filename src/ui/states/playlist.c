@@ -0,0 +1,167 @@
+#include <stdio.h> /* fopen(), fgets() */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h> /* stat() */
+
+#include "playlist.h"
+#include "../os/os.h"
+
+#define LINE_LEN 4096 /* Longest path in a list file */
+
+static char** ReadListFile(const char* path, unsigned* outCount);
+static void* Loader(void* data);
+
+demo_playlist* PlaylistOpen(const char* path) {
+    if (!path) return NULL;
+
+    demo_playlist* ret = (demo_playlist*)calloc(1, sizeof(demo_playlist));
+    if (!ret) return NULL;
+
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) ret->paths = ListDirectory(path, ".demo", &ret->count);
+    else ret->paths = ReadListFile(path, &ret->count);
+
+    if (!ret->paths || ret->count == 0) {
+        FreeDirectoryList(ret->paths, ret->count);
+        free(ret);
+        return NULL;
+    }
+
+    pthread_mutex_init(&ret->lock, NULL);
+    pthread_cond_init(&ret->cond, NULL);
+    if (pthread_create(&ret->thread, NULL, Loader, ret) != 0) {
+        pthread_mutex_destroy(&ret->lock);
+        pthread_cond_destroy(&ret->cond);
+        FreeDirectoryList(ret->paths, ret->count);
+        free(ret);
+        return NULL;
+    }
+    return ret;
+}
+
+void PlaylistFree(demo_playlist* list) {
+    if (!list) return;
+
+    pthread_mutex_lock(&list->lock);
+    list->quit = true;
+    pthread_cond_broadcast(&list->cond);
+    pthread_mutex_unlock(&list->lock);
+    pthread_join(list->thread, NULL);
+
+    DemoFree(list->record);
+    pthread_mutex_destroy(&list->lock);
+    pthread_cond_destroy(&list->cond);
+    FreeDirectoryList(list->paths, list->count);
+    free(list);
+}
+
+const char* PlaylistNext(demo_playlist* list, demo** record) {
+    if (!list || !record) return NULL;
+
+    pthread_mutex_lock(&list->lock);
+    while (!list->record && !list->failed) pthread_cond_wait(&list->cond, &list->lock);
+
+    const char* ret = NULL;
+    *record = NULL;
+    if (list->record) {
+        //  Empty slot wakes the loader for the next demo
+        *record = list->record;
+        ret = list->paths[list->index];
+        list->record = NULL;
+        pthread_cond_broadcast(&list->cond);
+    }
+    pthread_mutex_unlock(&list->lock);
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Reads paths of a list file
+    \param path Path to the list
+    \param outCount Count of paths
+    \return Array of paths, free with FreeDirectoryList()
+*/
+char** ReadListFile(const char* path, unsigned* outCount) {
+    FILE* fp = fopen(path, "r");
+    if (!fp) return NULL;
+
+    //  Relative paths start from the directory of the list
+    const char* slash = strrchr(path, '/');
+    size_t dirLen = slash ? (size_t)(slash - path) + 1 : 0;
+
+    unsigned count = 0, size = 16;
+    char** ret = (char**)malloc(sizeof(char*)*size);
+    char line[LINE_LEN];
+    while (ret && fgets(line, LINE_LEN, fp)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (len == 0 || line[0] == '#') continue;
+
+        //  Grow array when full
+        if (count == size) {
+            size *= 2;
+            char** grown = (char**)realloc(ret, sizeof(char*)*size);
+            if (!grown) break;
+            ret = grown;
+        }
+
+        size_t prefix = line[0] == '/' ? 0 : dirLen;
+        char* str = (char*)malloc(prefix + len + 1);
+        if (!str) break;
+        memcpy(str, path, prefix);
+        memcpy(str+prefix, line, len+1);
+        ret[count++] = str;
+    }
+    fclose(fp);
+
+    *outCount = count;
+    return ret;
+}
+
+/**
+    \brief Thread function, keeps the slot filled with the next readable demo
+    \param data Pointer to demo_playlist
+*/
+void* Loader(void* data) {
+    demo_playlist* list = (demo_playlist*)data;
+    unsigned failures = 0; // Demos failed in a row
+
+    pthread_mutex_lock(&list->lock);
+    while (!list->quit) {
+        if (list->record) {
+            pthread_cond_wait(&list->cond, &list->lock);
+            continue;
+        }
+
+        //  Read without the lock, playing the current demo isn't blocked
+        unsigned index = list->next;
+        list->next = (index+1) % list->count;
+        pthread_mutex_unlock(&list->lock);
+        demo* record = DemoRead(list->paths[index]);
+        pthread_mutex_lock(&list->lock);
+
+        if (!record) {
+            //  Invalid demos are skipped
+            if (++failures < list->count) continue;
+
+            //  Whole list failed, wake up the waiting player
+            list->failed = true;
+            pthread_cond_broadcast(&list->cond);
+            break;
+        }
+        failures = 0;
+
+        if (list->quit) {
+            DemoFree(record);
+            break;
+        }
+        list->record = record;
+        list->index = index;
+        pthread_cond_broadcast(&list->cond);
+    }
+    pthread_mutex_unlock(&list->lock);
+    return NULL;
+}
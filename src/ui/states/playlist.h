@@ -0,0 +1,58 @@
+#ifndef _PLAYLIST_H_
+#define _PLAYLIST_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "../../core/demo.h"
+
+/**
+    \brief Demos of the attract mode, loaded ahead in a background thread
+
+    The next demo is read, decoded and its checksum validated while the
+    current one plays, so switching takes no time. The list loops forever,
+    demos which can't be read are skipped.
+*/
+typedef struct {
+    char** paths;       /**< Demos in the order of playing */
+    unsigned count;     /**< Count of paths */
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;    /**< Signaled when the slot is filled or emptied */
+    bool quit;              /**< Tells the thread to stop */
+    bool failed;            /**< None of the demos could be read */
+
+    unsigned next;          /**< Index of the next demo to load */
+    demo* record;           /**< Loaded demo in the slot, NULL if empty */
+    unsigned index;         /**< Index of the loaded demo */
+} demo_playlist;
+
+/**
+    \brief Opens a playlist and starts loading the first demo
+    \param path Directory of demos, or a text file with one path per line
+    \return Pointer to the playlist, NULL if it has no demos or on error
+
+    Relative paths of a list file are relative to its directory. Empty
+    lines and lines starting with '#' are ignored.
+    \note Use PlaylistFree() to delete instance
+*/
+extern demo_playlist* PlaylistOpen(const char* path);
+
+/**
+    \brief Stops the thread and frees the playlist
+    \param list Pointer to the playlist
+*/
+extern void PlaylistFree(demo_playlist* list);
+
+/**
+    \brief Takes the loaded demo and starts loading the one after it
+
+    Waits only if the demo hasn't been loaded yet.
+    \param list Pointer to the playlist
+    \param record Where the demo is returned, free with DemoFree()
+    \return Path of the demo, NULL if none of the demos can be read
+*/
+extern const char* PlaylistNext(demo_playlist* list, demo** record);
+
+#endif //_PLAYLIST_H_
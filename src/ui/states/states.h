@@ -1,8 +1,13 @@
 #include "../ui.h"
+#include "../../core/scores.h"
 
 //  How many records are kept in the hiscore table
-#define HISCORE_LENGTH 10
-#define HISCORE_FILE "hiscores"
+#define HISCORE_LENGTH SCORES_TABLE_LENGTH
+#define HISCORE_FILE SCORES_TABLE_FILE
+//  Every score is posted to the leaderboard of its randomiser, scores-<randomiser>
+#define LEADERBOARD_FILE SCORES_BOARD_PREFIX
+//  Default length of instant replays in seconds
+#define REPLAY_SECONDS 30
 
 /*
     !States must free the additional data passed!
@@ -10,11 +15,20 @@
 
 typedef struct {
     unsigned randomiser;
+    unsigned replaySeconds; /**< Length of instant replays, 0 disables */
 } state_game_data;
 
+typedef struct {
+    hiscore_list_entry entry;
+    unsigned randomiser; /**< Leaderboard the score is posted to */
+} state_hiscore_data;
+
 typedef struct {
     char* path;
     bool  showKeys;
+    bool  exitAtEnd; /**< Quit after the last instruction is shown */
+    int   stream;   /**< Demo opened with OpenStream(), closed by the state */
+    bool  attract;  /**< Path is a directory or list of demos which are looped */
 } state_demo_data;
 
 /**
@@ -31,12 +45,23 @@ extern void* StateGame(UI_Functions* funs, void** data);
     \brief State function which handles displaying the high scores
 
     Handles displaying the high scores and adding new high scores in to the table.
-    Can take in hiscore_list_entry* as additional data.
+    Can take in state_hiscore_data* as additional data. The score is
+    also posted to the leaderboard of its randomiser. Scores are read and
+    written through tetr-scored if it serves the directory of the
+    executable, otherwise by this process.
     \param funs Pointer to UI functions struct
     \param data Additional data used by state
     \return Function pointer to the next state
 */
 extern void* StateHiscores(UI_Functions* funs, void** data);
+/**
+    \brief Reads the high score table in the background
+
+    Called during the game, so StateHiscores can show the table and ask
+    for a name without waiting for the file.
+    \param funs Pointer to UI functions struct
+*/
+extern void HiscoresPrefetch(UI_Functions* funs);
 /**
     \brief State function which handles playing recorded demo
 
@@ -46,3 +71,14 @@ extern void* StateHiscores(UI_Functions* funs, void** data);
     \return Function pointer to the next state
 */
 extern void* StatePlayDemo(UI_Functions* funs, void** data);
+/**
+    \brief State function which edits instructions of a demo
+
+    Steps through the demo, inserts, deletes and retimes instructions and
+    shows the result of the edited demo immediately. Additional data is
+    state_demo_data, the demo is read whole.
+    \param funs Pointer to UI functions struct
+    \param data Additional data used by state
+    \return Function pointer to the next state
+*/
+extern void* StateEditDemo(UI_Functions* funs, void** data);
@@ -7,16 +7,23 @@
 #include "ui.h"
 #include "curses/init.h"
 #include "sdl/init.h"
+#include "video/init.h"
 #include "states/states.h"
+#include "states/ioworker.h"
+#include "os/os.h"
 
 static char* generalHelp =
 "Usage: tetr [options]\n\
 General Options:\n \
   --help, -h\t\t\tDisplay this information\n \
-  --demo, -d <path>\t\tPlay given demo record\n \
+  --demo, -d <path>\t\tPlay given demo record, - reads from stdin\n \
   --showkeys <0|1>\t\tShow pressed keys during demo playback\n \
+  --exit-at-end\t\t\tQuit when demo playback ends\n \
+  --attract <dir|list>\t\tLoop demos of a directory or a list file\n \
+  --edit <path>\t\t\tEdit instructions of a demo, saved as name-edit.demo\n \
   --randomiser, -r <name>\tSet randomiser used. Where name is 7bag, tgm or random\n \
   --srand <seed>\t\tSet seed used by randomiser\n \
+  --replay <seconds>\t\tLength of instant replays, 0 disables. default=30\n \
   --UI <UI>\t\t\tSet UI used, see below\n\n\
 UIs:\n ";
 
@@ -33,8 +40,8 @@ int MainProgram(int argc, char** argv) {
 
     CurrentState = StateGame; //  Set game state as default
     unsigned stateArgs = 0; // index of state arguments in argv
-    state_game_data gameSettings = {.randomiser = RANDOMISER_TGM};
-    state_demo_data demoSettings = {.path = NULL, .showKeys = true};
+    state_game_data gameSettings = {.randomiser = RANDOMISER_TGM, .replaySeconds = REPLAY_SECONDS};
+    state_demo_data demoSettings = {.path = NULL, .showKeys = true, .exitAtEnd = false, .attract = false};
 
     //  Initialize random seed
     srand((unsigned)time(NULL));
@@ -50,6 +57,23 @@ int MainProgram(int argc, char** argv) {
                 CurrentState = StatePlayDemo; // Set state to PlayDemo
             }
         }
+        else if (!strcmp(argv[i], "--attract")) {
+            if (argc <= ++i) {
+                invalidArgs = true;
+            } else {
+                stateArgs = i; //  Save the argument index of the playlist
+                CurrentState = StatePlayDemo;
+                demoSettings.attract = true;
+            }
+        }
+        else if (!strcmp(argv[i], "--edit")) {
+            if (argc <= ++i) {
+                invalidArgs = true;
+            } else {
+                stateArgs = i; //  Save the argument index of demo path
+                CurrentState = StateEditDemo;
+            }
+        }
         else if (!strcmp(argv[i], "--showkeys")) {
             if (argc <= ++i) {
                 invalidArgs = true;
@@ -58,6 +82,9 @@ int MainProgram(int argc, char** argv) {
                 else demoSettings.showKeys = false;
             }
         }
+        else if (!strcmp(argv[i], "--exit-at-end")) {
+            demoSettings.exitAtEnd = true;
+        }
         else if (!strcmp(argv[i], "--randomiser") || !strcmp(argv[i], "-r")) {
             if (argc <= ++i) {
                 invalidArgs = true;
@@ -81,6 +108,8 @@ int MainProgram(int argc, char** argv) {
 #endif //_NO_SDL
             } else if (!strcmp(argv[i], "curses")) {
                 UIInitFun = CursesInit;
+            } else if (!strcmp(argv[i], "video")) {
+                UIInitFun = UI_VideoInit;
             } else {
                 invalidArgs = true;
             }
@@ -90,6 +119,12 @@ int MainProgram(int argc, char** argv) {
             } else {
                 srand(atoi(argv[i]));
             }
+        } else if (!strcmp(argv[i], "--replay")) {
+            if (argc <= ++i || atoi(argv[i]) < 0) {
+                invalidArgs = true;
+            } else {
+                gameSettings.replaySeconds = atoi(argv[i]);
+            }
         } else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
             invalidArgs = true;
         }
@@ -101,11 +136,21 @@ int MainProgram(int argc, char** argv) {
 #ifndef _NO_SDL
             printf("%s", UI_SDLGetHelp());
 #endif //_NO_SDL
+            printf("%s", UI_VideoGetHelp());
             CurrentState = NULL;
             break;
         }
     }
 
+    //  Video UI has no player, it only records demos
+    if (UIInitFun == UI_VideoInit && CurrentState) {
+        if (CurrentState != StatePlayDemo || demoSettings.attract) {
+            fprintf(stderr, "Video UI requires --demo\n");
+            CurrentState = NULL;
+        }
+        demoSettings.exitAtEnd = true;
+    }
+
     //  Set state specific settings
     if (CurrentState == StateGame) {
         //  Copy game settings
@@ -123,6 +168,28 @@ int MainProgram(int argc, char** argv) {
         state_demo_data* set = (state_demo_data*)malloc(sizeof(state_demo_data));
         set->path = str;
         set->showKeys = demoSettings.showKeys;
+        set->exitAtEnd = demoSettings.exitAtEnd;
+        set->attract = demoSettings.attract;
+        *data = (void*)set;
+
+        //  Open before UI takes the terminal, stdin may be the demo. Playlists are read by the state
+        set->stream = set->attract ? -1 : OpenStream(str);
+        if (set->stream < 0 && !set->attract) {
+            fprintf(stderr, "Could not open demo %s\n", str);
+            free(str);
+            free(set);
+            *data = NULL;
+            CurrentState = NULL;
+        }
+    } else if (CurrentState == StateEditDemo) {
+        //  Editor reads the whole demo itself
+        size_t len = strlen(argv[stateArgs]);
+        char* str = (char*)malloc(sizeof(char)*len+1);
+        strcpy(str, argv[stateArgs]);
+
+        state_demo_data* set = (state_demo_data*)calloc(1, sizeof(state_demo_data));
+        set->path = str;
+        set->stream = -1;
         *data = (void*)set;
     }
 
@@ -140,6 +207,8 @@ int MainProgram(int argc, char** argv) {
 
         ui.UIMainLoopEnd(&ui);
     }
+    //  Scores and demos still being written
+    IoShutdown();
 
     //  Make sure state data is freed
     if (*data != NULL) free(*data);
@@ -5,7 +5,7 @@
 #define MAP_WIDTH  10
 #define MAP_HEIGHT 20
 
-#define INPUT_ARRAY_LEN 8
+#define INPUT_ARRAY_LEN 32
 
 #include "../core/game.h"
 #include "../core/hiscore.h"
@@ -59,6 +59,7 @@ typedef struct _uifun {
     void (*UICleanup)(struct _uifun*); /**< Frees memory and closes ui */
 
     int inputs[INPUT_ARRAY_LEN]; /** Input array filled by UIGetInput() */
+    unsigned inputTimes[INPUT_ARRAY_LEN]; /** UIGetMillis() time of each input, 0 if it happened now */
     void* data; /**< Pointer to data used by rendering functions */
 } UI_Functions;
 
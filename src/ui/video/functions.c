@@ -0,0 +1,359 @@
+#include <stdlib.h>
+#include <string.h> /* strlen() */
+#include <ctype.h> /* toupper() */
+
+#include "../os/os.h"
+#include "functions.h"
+
+typedef struct {
+    unsigned char r, g, b;
+} Color;
+
+//  Same colors as the SDL UI
+static Color video_colors[] = {
+    {.r = 0, .g = 0, .b = 0 },      // 0, black
+    {.r = 200, .g = 0, .b = 0 },    // 1, red
+    {.r = 0, .g = 200, .b = 0 },    // 2, green
+    {.r = 200, .g = 200, .b = 0 },  // 3, yellow
+    {.r = 0, .g = 0, .b = 255 },    // 4, blue
+    {.r = 255, .g = 0, .b = 255 },  // 5, magenta
+    {.r = 0, .g = 255, .b = 255 },  // 6, cyan
+    {.r = 255, .g = 255, .b = 255 },// 7, white
+    {.r = 255, .g = 255, .b = 255}, // 8, default, should be something different than background
+    //  Keep first 9 in this order, used in text rendering, same for all UIs
+
+    {.r = 255, .g = 96, .b = 0 },   // 9, orange
+};
+
+//  Tetromino colors used with video_colors array
+static int sym_colors[] = {
+    // O(yellow), I(cyan), T(purple), L(orange), J(blue), S(green), Z(red)
+    3, 6, 5, 9, 4, 2, 1
+};
+
+static unsigned clockFrames = 0; /* Frames written, the clock of the UI */
+static unsigned clockFps = 1;
+
+//  Static function declarations -------------
+/**
+    \brief Render game area
+    \param funs Pointer to UI functions struct
+    \param gme  Pointer to the game instance
+*/
+static void DrawMap(UI_Functions* funs, game* gme);
+
+/**
+    \brief Render tetromino with sprites or with given color
+    \param data     Pointer to video UI data
+    \param cell     Size of a block
+    \param tetr     Tetromino to draw
+    \param offset_x Left of the game area in pixels
+    \param offset_y Top of the game area in pixels
+    \param ignorearea If false blocks above the game area are not drawn
+    \param color    Color used without textures
+    \param alpha    Opacity
+*/
+static void DrawTetromino(ui_video_data* data, video_rect* cell, tetromino* tetr, int offset_x, int offset_y, bool ignorearea, Color* color, unsigned char alpha);
+
+/**
+    \brief Render a box with given sprite sheet
+    \param dst      Target image
+    \param cell     Dimensions of the sprite element
+    \param style    Pointer to the sprite sheet
+    \param target   Dimensions of the box contents in pixels
+*/
+static void RenderBox(video_image* dst, video_rect* cell, VideoSheet* style, video_rect* target);
+
+int UI_VideoGameInit(UI_Functions* funs) {
+    (void)funs;
+    return 0;
+}
+
+void UI_VideoGameCleanUp(UI_Functions* funs) {
+    (void)funs;
+}
+
+int UI_VideoGameRender(UI_Functions* funs, game* gme) {
+    ui_video_data* data = (ui_video_data*)funs->data;
+
+    data->clearScreen = true; // request clean frame after writing
+
+    DrawMap(funs, gme);
+    return 0;
+}
+
+void UI_VideoBeginGameInfo(UI_Functions* funs, unsigned* x, unsigned* y) {
+    ui_video_data* data = (ui_video_data*)funs->data;
+
+    if (data->gameAreaWidth == 0) *x = 1;
+    else *x = data->gameAreaWidth/data->cell.w + 2;
+    *y = 1;
+}
+
+void UI_VideoDemoShowPressed(UI_Functions* funs, unsigned topx, unsigned topy, demo_instruction* instruction) {
+    ui_video_data* data = (ui_video_data*)funs->data;
+
+    unsigned ticks = UI_VideoMillis();
+    static unsigned pressed[INPUT_SET+1] = {0}; // left, right, down, rotate, set
+    if (instruction) {
+        unsigned instr = instruction->instruction;
+        if (instr <= INPUT_SET) {
+            pressed[instr] = ticks;
+        }
+    }
+
+    //  Draw keys, same layout as the SDL UI
+    int cell = data->cell.h * 2;
+    video_rect target = {.x = topx*data->cell.w, .y = topy*data->cell.h, .w = cell, .h = cell};
+    for(unsigned i=0; i <= INPUT_SET; i++) {
+        switch (i) {
+            case INPUT_LEFT: target.y += cell; break;
+            case INPUT_RIGHT: target.x += cell*2; break;
+            case INPUT_DOWN: target.x -= cell; break;
+            case INPUT_ROTATE: target.y -= cell; break;
+            case INPUT_SET: {
+                target.x += cell*3;
+                target.y += cell;
+            } break;
+            default: break;
+        }
+
+        int delta = pressed[i] + 128 - ticks;
+        VideoDrawRect(data->frame, &target, 255, 255, 255, 255);
+        if (delta > 0 && pressed[i] > 0) {
+            VideoFill(data->frame, &target, 255, 255, 255, delta << 1);
+        }
+    }
+}
+
+void UI_VideoHiscoreRenderBegin(UI_Functions* funs) {
+    ui_video_data* data = (ui_video_data*)funs->data;
+    VideoFill(data->frame, NULL, 64, 64, 64, 255);
+}
+
+int UI_VideoHiscoreGetName(UI_Functions* funs, hiscore_list_entry* entry, unsigned maxlen, unsigned rank) {
+    (void)entry;
+    (void)maxlen;
+    (void)rank;
+    //  Nobody to ask, accept empty name
+    funs->inputs[0] = event_ready;
+    return 1;
+}
+
+void UI_VideoTextRender(UI_Functions* funs, unsigned x, unsigned y, text_color color, char* text) {
+    ui_video_data* data = (ui_video_data*)funs->data;
+    if (!data->font) return;
+
+    int rowSz = data->cell.h;
+    int colSz = data->cell.w;
+    const unsigned char mod[3] = {video_colors[color].r, video_colors[color].g, video_colors[color].b};
+
+    unsigned len = strlen(text);
+    video_rect target = {.x = x*colSz, .y = y*rowSz, .w = colSz, .h = rowSz};
+    for (unsigned i = 0; i < len; i++, target.x += colSz) {
+        int ch = toupper(text[i]);
+
+        if (ch <= data->fontlast) {
+            int pos = ch - data->font1st;
+            if (pos >= 0 && (unsigned)pos < data->font->len) {
+                VideoBlit(data->frame, data->font->image, &data->font->clips[pos], &target, mod, 255);
+            }
+        }
+    }
+}
+
+void UI_VideoTetrominoRender(UI_Functions* funs, unsigned topx, unsigned topy, tetromino* tetr) {
+    ui_video_data* data = (ui_video_data*)funs->data;
+    if (!tetr) return;
+
+    Color* c = &video_colors[sym_colors[tetr->blocks[0]->symbol]];
+    video_rect cell = data->cell;
+    cell.w = cell.h;
+    DrawTetromino(data, &cell, tetr, data->cell.w*topx, data->cell.h*topy, true, c, 255);
+}
+
+int UI_VideoGetInput(UI_Functions* funs) {
+    ui_video_data* data = (ui_video_data*)funs->data;
+
+    //  Quit when enough frames are written or output has failed
+    if ((data->maxFrames > 0 && data->frames >= data->maxFrames) || (data->out && ferror(data->out))) {
+        funs->inputs[0] = 'q';
+        return 1;
+    }
+    return 0;
+}
+
+int UI_VideoGetExePath(UI_Functions* funs, char* buf, unsigned len) {
+    (void)funs;
+    return GetExecutablePath(buf, len);
+}
+
+unsigned UI_VideoMillis() {
+    return (unsigned long long)clockFrames*1000/clockFps;
+}
+
+void UI_VideoMainLoopEnd(UI_Functions* funs) {
+    ui_video_data* data = (ui_video_data*)funs->data;
+    //  Frame limit reached, quit is pending
+    if (data->maxFrames > 0 && data->frames >= data->maxFrames) return;
+
+    if (data->out) {
+        VideoWriteY4MFrame(data->out, data->frame);
+    } else if (data->pngPattern) {
+        char path[512];
+        snprintf(path, 512, data->pngPattern, data->frames);
+        if (VideoWritePNG(path, data->frame) != 0) {
+            fprintf(stderr, "Could not write %s\n", path);
+            data->maxFrames = data->frames; // stop
+        }
+    }
+    data->frames++;
+
+    //  Advance the clock of the UI
+    clockFps = data->fps;
+    clockFrames = data->frames;
+
+    if (data->clearScreen) {
+        VideoFill(data->frame, NULL, 64, 64, 64, 255);
+        data->clearScreen = false;
+    }
+}
+
+void FreeVideoSheet(VideoSheet* sheet) {
+    if (!sheet) return;
+
+    free(sheet->clips);
+    VideoImageFree(sheet->image);
+    free(sheet);
+}
+
+/***********************
+Static functions
+***********************/
+void DrawMap(UI_Functions* funs, game* gme) {
+    ui_video_data* data = (ui_video_data*)funs->data;
+    video_rect cell = data->cell;
+    cell.w = cell.h;    //  Game area cells are squares
+
+    //  Calculate game area
+    video_rect target = cell;
+    target.x = target.w;
+    target.y = target.h;
+    target.w *= MAP_WIDTH;
+    target.h *= MAP_HEIGHT;
+    RenderBox(data->frame, &cell, data->borders, &target); // Draw bg and borders
+    data->gameAreaWidth = target.w+target.x; //  Set gameAreaWidth in pixels
+
+    //  Don't render blocks if paused
+    if (gme->info.status & GAME_STATUS_PAUSE) {
+        unsigned x = (target.x + target.w) / data->cell.w / 2 - 4;
+        unsigned y = (target.y + target.h) / data->cell.h / 2;
+        UI_VideoTextRender(funs, x, y, color_white, "Game paused!");
+        return;
+    }
+
+    //  Game area blocks, except the 2 top rows which are hidden
+    block** mask = gme->map.blockMask;
+    unsigned len = gme->map.width*gme->map.height;
+    int rightBorder = target.x+target.w;
+    cell.x = target.x;
+    cell.y = target.y;
+    for (unsigned pos = gme->map.width*2; pos < len; pos++) {
+        if (mask[pos]) {
+            unsigned sym = mask[pos]->symbol;
+            if (data->blocks) {
+                VideoBlit(data->frame, data->blocks->image, &data->blocks->clips[sym], &cell, NULL, 255);
+            } else {
+                Color* c = &video_colors[sym_colors[sym]];
+                VideoFill(data->frame, &cell, c->r, c->g, c->b, 255);
+            }
+        }
+
+        cell.x += cell.w;
+        if (cell.x >= rightBorder) { // If row processed move to the next row
+            cell.x = target.x;
+            cell.y += cell.h;
+        }
+    }
+
+    if (!gme->active) return;
+
+    //  Render active tetromino and its ghost
+    Color* c = &video_colors[sym_colors[gme->active->blocks[0]->symbol]];
+    DrawTetromino(data, &cell, gme->active, target.x, target.y, false, c, 255);
+
+    unsigned tmp = gme->active->y;
+    gme->active->y = gme->info.ghostY;
+    DrawTetromino(data, &cell, gme->active, target.x, target.y, false, c, 64);
+    gme->active->y = tmp;
+}
+
+void DrawTetromino(ui_video_data* data, video_rect* cell, tetromino* tetr, int offset_x, int offset_y, bool ignorearea, Color* color, unsigned char alpha) {
+    if (!tetr || !cell) return;
+
+    unsigned origoX = tetr->x;
+    unsigned origoY = tetr->y -2; // 2 hidden rows
+
+    video_rect temp = *cell;
+    block** blocks = tetr->blocks;
+    for (unsigned i = 0; i < 4; i++) {
+        temp.x = cell->w * (int)(blocks[i]->x +origoX) +offset_x;
+        temp.y = cell->h * (int)(blocks[i]->y +origoY) +offset_y;
+
+        //  Determine if block is in game area
+        if (ignorearea || temp.y >= offset_y) {
+            if (data->blocks) {
+                VideoBlit(data->frame, data->blocks->image, &data->blocks->clips[blocks[0]->symbol], &temp, NULL, alpha);
+            } else {
+                VideoFill(data->frame, &temp, color->r, color->g, color->b, alpha);
+            }
+        }
+    }
+}
+
+void RenderBox(video_image* dst, video_rect* cell, VideoSheet* style, video_rect* target) {
+    video_rect pos = *target;
+    pos.w = cell->w;
+    pos.h = cell->h;
+
+    //  If no sprite sheet provided
+    if (!style) {
+        VideoDrawRect(dst, target, 255, 255, 255, 255);
+        return;
+    }
+    //  background/filling
+    for (; pos.y <= target->h; pos.y += pos.h) {
+        for (pos.x = target->x; pos.x <= target->w; pos.x += pos.w) {
+            VideoBlit(dst, style->image, &style->clips[4], &pos, NULL, 255);
+        }
+    }
+
+    //  Vertical borders
+    for (pos.y = target->y; pos.y <= target->h; pos.y += pos.h) {
+        pos.x = target->x-cell->w;  //  left
+        VideoBlit(dst, style->image, &style->clips[3], &pos, NULL, 255);
+
+        pos.x = target->x+target->w; // right
+        VideoBlit(dst, style->image, &style->clips[5], &pos, NULL, 255);
+    }
+
+    //  Horizontal borders
+    for (pos.x = target->x; pos.x <= target->w; pos.x += pos.w) {
+        pos.y = target->y-cell->h;  //  top
+        VideoBlit(dst, style->image, &style->clips[1], &pos, NULL, 255);
+
+        pos.y = target->y+target->h; // bottom
+        VideoBlit(dst, style->image, &style->clips[7], &pos, NULL, 255);
+    }
+
+    //  Corner pieces
+    pos.x = target->x-cell->w;  // Left-Top
+    pos.y = target->y-cell->h;
+    VideoBlit(dst, style->image, &style->clips[0], &pos, NULL, 255);
+    pos.x = target->x+target->w; // Right-Top
+    VideoBlit(dst, style->image, &style->clips[2], &pos, NULL, 255);
+    pos.y = target->y+target->h; // Right-Bottom
+    VideoBlit(dst, style->image, &style->clips[8], &pos, NULL, 255);
+    pos.x = target->x-cell->w;  // Left-Bottom
+    VideoBlit(dst, style->image, &style->clips[6], &pos, NULL, 255);
+}
@@ -0,0 +1,67 @@
+#include <stdbool.h>
+
+#include "../ui.h"
+#include "raster.h"
+
+typedef struct {
+    video_image* image;
+    video_rect* clips;
+    unsigned len;
+} VideoSheet;
+
+/**
+    \brief Struct for all data needed by the video UI
+*/
+typedef struct {
+    video_image* frame; /**< Framebuffer rendered to */
+    char* basePath;     /**< Directory of the executable */
+
+    video_rect cell;    /**< Size of a rendered character */
+    unsigned gameAreaWidth; /**< Width of game area in pixels */
+
+    //  Game sprites
+    VideoSheet* borders;
+    VideoSheet* blocks;
+
+    //  Font data
+    VideoSheet* font;
+    char        font1st;
+    char        fontlast;
+
+    //  Output
+    unsigned fps;       /**< Frames per second */
+    unsigned frames;    /**< Count of frames written */
+    unsigned maxFrames; /**< Quit after this many frames, 0 for no limit */
+    FILE* out;          /**< Y4M stream, NULL when writing PNG files */
+    char* pngPattern;   /**< printf() pattern of PNG file names */
+
+    bool clearScreen;
+} ui_video_data;
+
+extern int  UI_VideoGameInit(UI_Functions* funs);
+extern void UI_VideoGameCleanUp(UI_Functions* funs);
+extern int  UI_VideoGameRender(UI_Functions* funs, game* gme);
+extern void UI_VideoBeginGameInfo(UI_Functions* funs, unsigned* x, unsigned* y);
+
+extern void UI_VideoDemoShowPressed(UI_Functions* funs, unsigned topx, unsigned topy, demo_instruction* instruction);
+
+extern void UI_VideoHiscoreRenderBegin(UI_Functions* funs);
+extern int  UI_VideoHiscoreGetName(UI_Functions* funs, hiscore_list_entry* entry, unsigned maxlen, unsigned rank);
+
+extern void UI_VideoTextRender(UI_Functions* funs, unsigned x, unsigned y, text_color color, char* text);
+extern void UI_VideoTetrominoRender(UI_Functions* funs, unsigned topx, unsigned topy, tetromino* tetr);
+extern int  UI_VideoGetInput(UI_Functions* funs);
+extern int  UI_VideoGetExePath(UI_Functions* funs, char* buf, unsigned len);
+
+/**
+    \brief Get time of the current frame
+    \return Milliseconds since the first frame, advances 1000/fps per frame
+*/
+extern unsigned UI_VideoMillis();
+
+/**
+    \brief Writes the rendered frame and advances the clock
+*/
+extern void UI_VideoMainLoopEnd(UI_Functions* funs);
+
+extern void FreeVideoSheet(VideoSheet* sheet);
@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h> // malloc(), atoi()
+#include <stdbool.h>
+#include <string.h> // strcmp(), strlen(), strncpy()
+
+#include "../os/os.h"
+#include "init.h"
+#include "functions.h"
+
+#define VIDEO_DEF_W 1024
+#define VIDEO_DEF_H 768
+#define VIDEO_DEF_FPS 30
+#define VIDEO_DEF_OUT "video.y4m"
+
+/**
+    \brief Load given image and clip it to a sprite sheet
+    \param path Path to image file
+    \param w    Sprite width, or 0 to split by count
+    \param h    Sprite height, or 0 to split by count
+    \param x    Count of sprite columns when splitting by count
+    \param y    Count of sprite rows when splitting by count
+    \return Pointer to the allocated VideoSheet. NULL on error
+
+    \note Clips rectangle row-by-row
+    \see FreeVideoSheet(VideoSheet* sheet)
+*/
+static VideoSheet* LoadSheet(const char* path, unsigned w, unsigned h, unsigned x, unsigned y);
+
+static const char* CmdLineHelpStr =
+" video (requires --demo)\n\
+   --out <path>\t\t\tY4M file or - for stdout, path ending in .png is a\n\
+   \t\t\t\tprintf pattern for numbered frames. default=video.y4m\n\
+   --fps <fps>\t\t\tFrame rate of the output. default=30\n\
+   --length <frames>\t\tStop after given count of frames. default=no limit\n\
+   --no-textures\t\tDisables texture loading, except for font\n\
+   --width <w>, --height <h>\tSet frame size\n";
+
+int UI_VideoInit(UI_Functions* ret, int argc, char** argv) {
+    bool ena_textures = true;
+    int width = VIDEO_DEF_W, height = VIDEO_DEF_H;
+    const char* outPath = VIDEO_DEF_OUT;
+
+    //  Set data pointer
+    ui_video_data* videodata = (ui_video_data*)calloc(1, sizeof(ui_video_data));
+    if (!videodata) {
+        fprintf(stderr, "Could not create data container.\n");
+        return -2;
+    }
+    ret->data = (void*)videodata;
+    ret->UICleanup = UI_VideoCleanUp; //  Make sure clean up function is set
+
+    //  Default settings
+    videodata->fps = VIDEO_DEF_FPS;
+
+    //  Process command line arguments
+    for (int pos = 1; pos < argc; pos++) {
+        if (strcmp(argv[pos], "--no-textures") == 0) {
+            ena_textures = false;
+        }
+        else if (strcmp(argv[pos], "--width") == 0) {
+            if (++pos >= argc) continue; // ignore if no value
+            width = atoi(argv[pos]);
+            if (width < 80) width = 80;
+        }
+        else if (strcmp(argv[pos], "--height") == 0) {
+            if (++pos >= argc) continue; // ignore if no value
+            height = atoi(argv[pos]);
+            if (height < 24) height = 24;
+        }
+        else if (strcmp(argv[pos], "--out") == 0) {
+            if (++pos >= argc) continue; // ignore if no value
+            outPath = argv[pos];
+        }
+        else if (strcmp(argv[pos], "--fps") == 0) {
+            if (++pos >= argc) continue; // ignore if no value
+            int temp = atoi(argv[pos]);
+            if (temp < 1) temp = 1;
+            if (temp > 1000) temp = 1000;
+            videodata->fps = temp;
+        }
+        else if (strcmp(argv[pos], "--length") == 0) {
+            if (++pos >= argc) continue; // ignore if no value
+            int temp = atoi(argv[pos]);
+            if (temp < 0) temp = 0;
+            videodata->maxFrames = temp;
+        }
+    }
+
+    //  Open output
+    unsigned outLen = strlen(outPath);
+    if (outLen > 4 && strcmp(outPath+outLen-4, ".png") == 0) {
+        videodata->pngPattern = (char*)malloc(outLen+1);
+        if (!videodata->pngPattern) return -2;
+        strcpy(videodata->pngPattern, outPath);
+    } else {
+        if (strcmp(outPath, "-") == 0) videodata->out = stdout;
+        else videodata->out = fopen(outPath, "wb");
+
+        if (!videodata->out || VideoWriteY4MHeader(videodata->out, width, height, videodata->fps) != 0) {
+            fprintf(stderr, "Could not open output %s\n", outPath);
+            return -1;
+        }
+    }
+
+    //  Framebuffer
+    videodata->frame = VideoImageCreate(width, height);
+    if (!videodata->frame) {
+        fprintf(stderr, "Could not create framebuffer.\n");
+        return -2;
+    }
+    VideoFill(videodata->frame, NULL, 64, 64, 64, 255);
+
+    /*  Load all used resources from the directory of the executable */
+    char path[512] = {0};
+    int pathbaseLen = GetExecutablePath(path, 512);
+    if (pathbaseLen < 0) {
+        fprintf(stderr, "Could not get path of the executable.\n");
+        return -3;
+    }
+    videodata->basePath = (char*)malloc(pathbaseLen+1);
+    if (videodata->basePath) strcpy(videodata->basePath, path);
+
+    //  Load font
+    strncpy(path+pathbaseLen, "font.bmp", 512-pathbaseLen);
+    videodata->font = LoadSheet(path, 16, 16, 0, 0);
+    if (!videodata->font) {
+        fprintf(stderr, "Could not initialize font %s\n", path);
+        return -3;
+    }
+    videodata->font1st = '!';
+    videodata->fontlast = '`';
+
+    if (ena_textures) {
+        //  Load game area background and borders
+        strncpy(path+pathbaseLen, "borders-hires.bmp", 512-pathbaseLen);
+        videodata->borders = LoadSheet(path, 0, 0, 3, 3);
+        if (!videodata->borders) {
+            fprintf(stderr, "Could not load borders %s\n", path);
+            return -4;
+        }
+
+        //  Load block textures
+        strncpy(path+pathbaseLen, "blocks.bmp", 512-pathbaseLen);
+        videodata->blocks = LoadSheet(path, 0, 0, 7, 1);
+        if (!videodata->blocks) {
+            fprintf(stderr, "Could not load block texture %s\n", path);
+            return -4;
+        }
+    } // ena_textures
+
+    //  Render cell rect, same 80x24 layout as the SDL UI
+    videodata->cell.w = width/80;
+    videodata->cell.h = height/24;
+
+    //  Assign all function pointers
+    ret->UIGameInit = UI_VideoGameInit;
+    ret->UIGameCleanup = UI_VideoGameCleanUp;
+    ret->UIGameRender = UI_VideoGameRender;
+    ret->UIBeginGameInfo = UI_VideoBeginGameInfo;
+
+    ret->UIDemoShowPressed = UI_VideoDemoShowPressed;
+
+    ret->UIHiscoreRenderBegin = UI_VideoHiscoreRenderBegin;
+    ret->UIHiscoreGetName = UI_VideoHiscoreGetName;
+
+    ret->UITextRender = UI_VideoTextRender;
+    ret->UITetrominoRender = UI_VideoTetrominoRender;
+    ret->UIGetInput = UI_VideoGetInput;
+    ret->UIGetMillis = UI_VideoMillis;
+    ret->UIGetExePath = UI_VideoGetExePath;
+    ret->UIMainLoopEnd = UI_VideoMainLoopEnd;
+
+    return 0;
+}
+
+void UI_VideoCleanUp(UI_Functions* ptr) {
+    if (ptr && ptr->data) {
+        ui_video_data* videodata = (ui_video_data*)ptr->data;
+
+        if (videodata->out) {
+            if (videodata->out == stdout) fflush(stdout);
+            else fclose(videodata->out);
+        }
+        free(videodata->pngPattern);
+        free(videodata->basePath);
+
+        FreeVideoSheet(videodata->blocks);
+        FreeVideoSheet(videodata->borders);
+        FreeVideoSheet(videodata->font);
+        VideoImageFree(videodata->frame);
+        free(videodata);
+        ptr->data = NULL;
+    }
+}
+
+const char* UI_VideoGetHelp() {
+    return CmdLineHelpStr;
+}
+
+/**
+    Static functions
+*/
+
+VideoSheet* LoadSheet(const char* path, unsigned w, unsigned h, unsigned x, unsigned y) {
+    video_image* img = VideoLoadBMP(path);
+    if (!img) return NULL;
+
+    //  Split by count if size not given
+    if (w == 0 || h == 0) {
+        w = img->w / (x ? x : 1);
+        h = img->h / (y ? y : 1);
+    } else {
+        x = img->w / w;
+        y = img->h / h;
+    }
+
+    VideoSheet* sheet = (VideoSheet*)malloc(sizeof(VideoSheet));
+    video_rect* clips = (video_rect*)malloc(sizeof(video_rect)*(x*y > 0 ? x*y : 1));
+    if (!sheet || !clips || w == 0 || h == 0) {
+        free(sheet);
+        free(clips);
+        VideoImageFree(img);
+        return NULL;
+    }
+
+    for (unsigned cur = 0; cur < x*y; cur++) {
+        clips[cur].x = (cur % x) * w;
+        clips[cur].y = (cur / x) * h;
+        clips[cur].w = w;
+        clips[cur].h = h;
+    }
+
+    sheet->image = img;
+    sheet->clips = clips;
+    sheet->len = x*y;
+    return sheet;
+}
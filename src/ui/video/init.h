@@ -0,0 +1,23 @@
+#include "../ui.h"
+
+/**
+    \brief Initialize video UI
+
+    Creates the framebuffer, opens the output and assigns correct functions to given struct
+    \param ret Pointer to struct used in returning function pointers
+    \param argc Argument count
+    \param argv Pointer to all program arguments
+    \return 0 on success
+*/
+extern int UI_VideoInit(UI_Functions* ret, int argc, char** argv);
+
+/**
+    \brief Closes the output and frees video UI data
+*/
+extern void UI_VideoCleanUp(UI_Functions* ptr);
+
+/**
+    \brief Get command line help for video UI
+    \param Return pointer to help string
+*/
+extern const char* UI_VideoGetHelp();
@@ -0,0 +1,311 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "raster.h"
+#include "../../core/crc32.h"
+
+#define PNG_BLOCK 65535 /* Maximum length of a stored deflate block */
+
+static unsigned ReadLE(const unsigned char* p, unsigned bytes);
+static void WriteBE(unsigned char* p, unsigned val);
+static void BlendPixel(unsigned char* px, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+static int ClipRect(video_image* img, video_rect* rect, video_rect* out);
+static int WritePNGChunk(FILE* fp, const char* type, const unsigned char* data, size_t len);
+
+video_image* VideoImageCreate(unsigned w, unsigned h) {
+    if (w == 0 || h == 0) return NULL;
+
+    video_image* ret = (video_image*)malloc(sizeof(video_image));
+    if (!ret) return NULL;
+
+    ret->pixels = (unsigned char*)calloc((size_t)w*h, 3);
+    if (!ret->pixels) {
+        free(ret);
+        return NULL;
+    }
+    ret->w = w;
+    ret->h = h;
+    return ret;
+}
+
+void VideoImageFree(video_image* img) {
+    if (!img) return;
+    free(img->pixels);
+    free(img);
+}
+
+video_image* VideoLoadBMP(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+
+    //  Read file header and the beginning of info header
+    unsigned char head[54];
+    if (fread(head, 1, 54, fp) != 54 || head[0] != 'B' || head[1] != 'M') {
+        fclose(fp);
+        return NULL;
+    }
+    unsigned offset = ReadLE(head+10, 4);
+    int w = (int)ReadLE(head+18, 4);
+    int h = (int)ReadLE(head+22, 4);
+    unsigned bpp = ReadLE(head+28, 2);
+    unsigned compression = ReadLE(head+30, 4);
+    if (bpp != 24 || compression != 0 || w <= 0 || h == 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    //  Negative height means rows are stored top to bottom
+    int topDown = h < 0;
+    if (h < 0) h = -h;
+
+    video_image* ret = VideoImageCreate(w, h);
+    size_t stride = ((size_t)w*3 + 3) & ~(size_t)3;
+    unsigned char* row = (unsigned char*)malloc(stride);
+    if (!ret || !row || fseek(fp, offset, SEEK_SET) != 0) {
+        VideoImageFree(ret);
+        free(row);
+        fclose(fp);
+        return NULL;
+    }
+
+    for (int y = 0; y < h; y++) {
+        if (fread(row, 1, stride, fp) != stride) {
+            VideoImageFree(ret);
+            ret = NULL;
+            break;
+        }
+        //  BGR to RGB
+        unsigned char* dst = ret->pixels + (size_t)(topDown ? y : h-1-y)*w*3;
+        for (int x = 0; x < w; x++) {
+            dst[x*3]   = row[x*3+2];
+            dst[x*3+1] = row[x*3+1];
+            dst[x*3+2] = row[x*3];
+        }
+    }
+
+    free(row);
+    fclose(fp);
+    return ret;
+}
+
+void VideoFill(video_image* dst, video_rect* rect, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+    video_rect area;
+    if (!ClipRect(dst, rect, &area)) return;
+
+    for (int y = area.y; y < area.y+area.h; y++) {
+        unsigned char* px = dst->pixels + ((size_t)y*dst->w + area.x)*3;
+        for (int x = 0; x < area.w; x++, px += 3) BlendPixel(px, r, g, b, a);
+    }
+}
+
+void VideoDrawRect(video_image* dst, video_rect* rect, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+    if (!rect || rect->w <= 0 || rect->h <= 0) return;
+
+    video_rect edge = {rect->x, rect->y, rect->w, 1};
+    VideoFill(dst, &edge, r, g, b, a); // top
+    edge.y = rect->y + rect->h - 1;
+    VideoFill(dst, &edge, r, g, b, a); // bottom
+    edge.y = rect->y + 1;
+    edge.w = 1;
+    edge.h = rect->h - 2;
+    VideoFill(dst, &edge, r, g, b, a); // left
+    edge.x = rect->x + rect->w - 1;
+    VideoFill(dst, &edge, r, g, b, a); // right
+}
+
+void VideoBlit(video_image* dst, video_image* src, video_rect* clip, video_rect* target, const unsigned char* mod, unsigned char a) {
+    if (!dst || !src || !clip || !target || clip->w <= 0 || clip->h <= 0) return;
+
+    video_rect area;
+    if (!ClipRect(dst, target, &area)) return;
+
+    for (int y = area.y; y < area.y+area.h; y++) {
+        //  Nearest source row
+        int sy = clip->y + (y - target->y)*clip->h/target->h;
+        if (sy < 0 || (unsigned)sy >= src->h) continue;
+
+        unsigned char* px = dst->pixels + ((size_t)y*dst->w + area.x)*3;
+        for (int x = area.x; x < area.x+area.w; x++, px += 3) {
+            int sx = clip->x + (x - target->x)*clip->w/target->w;
+            if (sx < 0 || (unsigned)sx >= src->w) continue;
+
+            const unsigned char* s = src->pixels + ((size_t)sy*src->w + sx)*3;
+            if (s[0] == 255 && s[1] == 0 && s[2] == 255) continue; // transparent
+
+            if (mod) BlendPixel(px, s[0]*mod[0]/255, s[1]*mod[1]/255, s[2]*mod[2]/255, a);
+            else BlendPixel(px, s[0], s[1], s[2], a);
+        }
+    }
+}
+
+int VideoWriteY4MHeader(FILE* fp, unsigned w, unsigned h, unsigned fps) {
+    if (!fp) return -1;
+    return fprintf(fp, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", w, h, fps) > 0 ? 0 : -2;
+}
+
+int VideoWriteY4MFrame(FILE* fp, video_image* img) {
+    if (!fp || !img) return -1;
+
+    size_t len = (size_t)img->w*img->h;
+    unsigned char* planes = (unsigned char*)malloc(len*3);
+    if (!planes) return -2;
+
+    //  RGB to BT.601 YCbCr, studio range
+    unsigned char* p = img->pixels;
+    for (size_t i = 0; i < len; i++, p += 3) {
+        int r = p[0], g = p[1], b = p[2];
+        planes[i]       = (( 66*r + 129*g +  25*b + 128) >> 8) + 16;
+        planes[len+i]   = ((-38*r -  74*g + 112*b + 128) >> 8) + 128;
+        planes[2*len+i] = ((112*r -  94*g -  18*b + 128) >> 8) + 128;
+    }
+
+    int ret = 0;
+    if (fputs("FRAME\n", fp) < 0 || fwrite(planes, 1, len*3, fp) != len*3) ret = -3;
+    free(planes);
+    return ret;
+}
+
+int VideoWritePNG(const char* path, video_image* img) {
+    if (!path || !img) return -1;
+
+    //  Raw data is a filter byte and RGB for each row
+    size_t rowLen = (size_t)img->w*3 + 1;
+    size_t rawLen = rowLen*img->h;
+    size_t blocks = (rawLen + PNG_BLOCK-1) / PNG_BLOCK;
+    size_t idatLen = 2 + blocks*5 + rawLen + 4; // zlib header, block headers, data, adler32
+
+    unsigned char* idat = (unsigned char*)malloc(idatLen);
+    if (!idat) return -2;
+
+    unsigned char* pos = idat;
+    *pos++ = 0x78; // deflate, 32K window
+    *pos++ = 0x01; // no compression level, header check
+
+    //  Stored deflate blocks, filled row by row
+    unsigned a = 1, b = 0; // adler32
+    size_t done = 0;
+    unsigned char* blockEnd = pos;
+    for (unsigned y = 0; y < img->h; y++) {
+        for (size_t x = 0; x < rowLen; x++) {
+            if (pos == blockEnd) {
+                size_t left = rawLen - done;
+                unsigned len = left > PNG_BLOCK ? PNG_BLOCK : left;
+                pos[0] = left <= PNG_BLOCK; // final block
+                pos[1] = len & 0xff;
+                pos[2] = len >> 8;
+                pos[3] = ~len & 0xff;
+                pos[4] = (~len >> 8) & 0xff;
+                pos += 5;
+                blockEnd = pos + len;
+            }
+
+            unsigned char c = x == 0 ? 0 : img->pixels[(size_t)y*img->w*3 + x-1];
+            *pos++ = c;
+            done++;
+            a = (a + c) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    WriteBE(pos, (b << 16) | a);
+
+    unsigned char ihdr[13] = {0};
+    WriteBE(ihdr, img->w);
+    WriteBE(ihdr+4, img->h);
+    ihdr[8] = 8; // bit depth
+    ihdr[9] = 2; // truecolor
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    FILE* fp = fopen(path, "wb");
+    int ret = -3;
+    if (fp) {
+        if (fwrite(signature, 1, 8, fp) == 8 &&
+            WritePNGChunk(fp, "IHDR", ihdr, 13) == 0 &&
+            WritePNGChunk(fp, "IDAT", idat, idatLen) == 0 &&
+            WritePNGChunk(fp, "IEND", NULL, 0) == 0) {
+            ret = 0;
+        }
+        fclose(fp);
+    }
+    free(idat);
+    return ret;
+}
+
+/*
+    Static functions
+*/
+
+/**
+    \brief Reads little endian integer
+*/
+unsigned ReadLE(const unsigned char* p, unsigned bytes) {
+    unsigned ret = 0;
+    for (unsigned i = bytes; i > 0; i--) ret = (ret << 8) | p[i-1];
+    return ret;
+}
+
+/**
+    \brief Writes 32-bit big endian integer
+*/
+void WriteBE(unsigned char* p, unsigned val) {
+    p[0] = val >> 24;
+    p[1] = val >> 16;
+    p[2] = val >> 8;
+    p[3] = val;
+}
+
+/**
+    \brief Blends color over a pixel
+*/
+void BlendPixel(unsigned char* px, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+    if (a == 255) {
+        px[0] = r;
+        px[1] = g;
+        px[2] = b;
+    } else {
+        px[0] = (r*a + px[0]*(255-a)) / 255;
+        px[1] = (g*a + px[1]*(255-a)) / 255;
+        px[2] = (b*a + px[2]*(255-a)) / 255;
+    }
+}
+
+/**
+    \brief Clips rectangle to the image
+    \param img Image
+    \param rect Rectangle, NULL for the whole image
+    \param out Clipped rectangle
+    \return 0 if nothing is left
+*/
+int ClipRect(video_image* img, video_rect* rect, video_rect* out) {
+    if (!img) return 0;
+
+    video_rect r = {0, 0, img->w, img->h};
+    if (rect) r = *rect;
+
+    if (r.x < 0) { r.w += r.x; r.x = 0; }
+    if (r.y < 0) { r.h += r.y; r.y = 0; }
+    if (r.x + r.w > (int)img->w) r.w = img->w - r.x;
+    if (r.y + r.h > (int)img->h) r.h = img->h - r.y;
+
+    *out = r;
+    return r.w > 0 && r.h > 0;
+}
+
+/**
+    \brief Writes PNG chunk with length and CRC
+    \return 0 on success
+*/
+int WritePNGChunk(FILE* fp, const char* type, const unsigned char* data, size_t len) {
+    unsigned char head[8];
+    WriteBE(head, len);
+    memcpy(head+4, type, 4);
+
+    unsigned crc = CRC32Reflected(CRC32_INIT, head+4, 4);
+    if (len) crc = CRC32Reflected(crc, data, len);
+    unsigned char tail[4];
+    WriteBE(tail, crc);
+
+    if (fwrite(head, 1, 8, fp) != 8) return -1;
+    if (len && fwrite(data, 1, len, fp) != len) return -1;
+    if (fwrite(tail, 1, 4, fp) != 4) return -1;
+    return 0;
+}
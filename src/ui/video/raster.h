@@ -0,0 +1,101 @@
+/*
+    Software rasteriser used by the video UI. Images are 24-bit RGB,
+    magenta (255, 0, 255) is transparent in sprites.
+*/
+#include <stdio.h>
+
+typedef struct {
+    int x, y;
+    int w, h;
+} video_rect;
+
+/**
+    \brief An RGB image, 3 bytes per pixel, rows top to bottom
+*/
+typedef struct {
+    unsigned w;
+    unsigned h;
+    unsigned char* pixels;
+} video_image;
+
+/**
+    \brief Allocates a new black image
+    \param w Width in pixels
+    \param h Height in pixels
+    \return Pointer to the image, NULL on error
+
+    \note Use VideoImageFree() to free image
+*/
+extern video_image* VideoImageCreate(unsigned w, unsigned h);
+
+/**
+    \brief Frees image
+    \param img Pointer to the image
+*/
+extern void VideoImageFree(video_image* img);
+
+/**
+    \brief Loads an uncompressed 24-bit BMP file
+    \param path Path to the file
+    \return Pointer to the image, NULL on error
+*/
+extern video_image* VideoLoadBMP(const char* path);
+
+/**
+    \brief Fills rectangle with blended color
+    \param dst Target image
+    \param rect Area to fill, NULL fills whole image
+    \param r,g,b Color
+    \param a Opacity, 255 is opaque
+*/
+extern void VideoFill(video_image* dst, video_rect* rect, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+
+/**
+    \brief Draws outline of rectangle
+    \param dst Target image
+    \param rect Rectangle to draw
+    \param r,g,b Color
+    \param a Opacity, 255 is opaque
+*/
+extern void VideoDrawRect(video_image* dst, video_rect* rect, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+
+/**
+    \brief Copies scaled part of an image
+
+    Nearest neighbour scaling. Transparent pixels are skipped and colors
+    are multiplied by the color modulation.
+    \param dst Target image
+    \param src Source image
+    \param clip Area of source image
+    \param target Area of target image
+    \param mod Color modulation, 3 bytes. NULL for none
+    \param a Opacity, 255 is opaque
+*/
+extern void VideoBlit(video_image* dst, video_image* src, video_rect* clip, video_rect* target, const unsigned char* mod, unsigned char a);
+
+/**
+    \brief Writes YUV4MPEG2 stream header
+    \param fp Output stream
+    \param w,h Frame size
+    \param fps Frame rate
+    \return 0 on success
+*/
+extern int VideoWriteY4MHeader(FILE* fp, unsigned w, unsigned h, unsigned fps);
+
+/**
+    \brief Writes image as a 4:4:4 YUV4MPEG2 frame
+    \param fp Output stream
+    \param img Image to write
+    \return 0 on success
+*/
+extern int VideoWriteY4MFrame(FILE* fp, video_image* img);
+
+/**
+    \brief Writes image as a PNG file
+
+    Image data is stored without compression.
+    \param path Path to the file
+    \param img Image to write
+    \return 0 on success
+*/
+extern int VideoWritePNG(const char* path, video_image* img);